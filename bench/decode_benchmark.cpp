@@ -0,0 +1,112 @@
+// Micro-benchmark of the register block decoder.
+//
+// Runs decode_be_words() on every backend available on this machine for a
+// few block sizes (one FC 3 response, a full rack, a large capture) and
+// prints the time per word and the speed-up over the scalar code. Results
+// of every backend are compared against the scalar ones first; a mismatch
+// ends the run with status 1.
+//
+// Usage: decode_benchmark [MIN_SECONDS_PER_CASE]
+
+#include "caparoc_commander/portable_print.hpp"
+#include "caparoc_commander/register_decode.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Buffers {
+    std::vector<uint8_t> bytes;
+    std::vector<uint16_t> words;
+};
+
+Buffers make_buffers(std::size_t words)
+{
+    std::mt19937 random(42);
+    Buffers buffers;
+    buffers.bytes.resize(2 * words);
+    for (auto &byte : buffers.bytes)
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+    buffers.words.resize(words);
+    cli::select_decode_backend(cli::DecodeBackend::SCALAR);
+    cli::decode_be_words(buffers.bytes, buffers.words);
+    return buffers;
+}
+
+// Nanoseconds per word, measured over at least min_seconds.
+double measure(const std::function<void()> &run, std::size_t words, double min_seconds)
+{
+    std::size_t iterations = 1;
+    for (;;)
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            run();
+        }
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        if (elapsed.count() >= min_seconds)
+        {
+            return elapsed.count() * 1e9 / static_cast<double>(iterations * words);
+        }
+        iterations *= 2;
+    }
+}
+
+bool verify(cli::DecodeBackend backend, std::size_t words)
+{
+    auto reference = make_buffers(words);
+    cli::select_decode_backend(backend);
+    std::vector<uint16_t> decoded(words);
+    cli::decode_be_words(reference.bytes, decoded);
+    return decoded == reference.words;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    double min_seconds = argc > 1 ? std::atof(argv[1]) : 0.2;
+    const std::size_t sizes[] = {125, 1024, 65536};
+    auto backends = cli::available_decode_backends();
+
+    for (auto backend : backends)
+    {
+        for (auto words : sizes)
+        {
+            // Odd sizes exercise the scalar tail as well.
+            if (!verify(backend, words) || !verify(backend, words + 7))
+            {
+                portable::println("MISMATCH: {} backend differs from scalar for {} words", cli::to_string(backend), words);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    portable::println("{:<14} {:>7} {:>8} {:>10} {:>8}", "function", "words", "backend", "ns/word", "speedup");
+    for (auto words : sizes)
+    {
+        auto buffers = make_buffers(words);
+        double scalar_ns = 0;
+        for (auto backend : backends)
+        {
+            cli::select_decode_backend(backend);
+            auto ns = measure([&] { cli::decode_be_words(buffers.bytes, buffers.words); }, words, min_seconds);
+            if (backend == cli::DecodeBackend::SCALAR)
+            {
+                scalar_ns = ns;
+            }
+            portable::println("{:<14} {:>7} {:>8} {:>10.3f} {:>7.1f}x", "decode_be", words, cli::to_string(backend), ns, scalar_ns / ns);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Start-up benchmark for caparoc_commander.
+
+Runs the CLI repeatedly against a throw-away Modbus TCP responder on the
+loopback interface and reports
+
+  * time to first request: from spawning the process until the first request
+    byte reaches the responder (process start, dynamic loading, static
+    initialization, option parsing, connect),
+  * total wall time of the invocation,
+  * peak resident set size up to the first request (VmHWM of the child,
+    sampled while it waits for the response; ru_maxrss cannot be used
+    because Linux carries the parent's peak over fork and exec).
+
+With --budget-ms / --budget-rss-kb the script exits with status 1 when the
+median time to first request or the peak RSS exceed the budget, so it can
+gate CI or a deployment on the gateways.
+
+Example:
+    bench/startup_benchmark.py build/bin/caparoc_commander --runs 200 \\
+        --budget-ms 5 --budget-rss-kb 6000 -- --read-uint16 0x2000
+"""
+
+import argparse
+import os
+import socket
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+
+def respond(connection):
+    """Answer every request until the client disconnects.
+
+    Reads return zero-filled registers, writes are acknowledged; enough for
+    the common single-shot invocations being benchmarked.
+    """
+    buffer = b""
+    while True:
+        data = connection.recv(4096)
+        if not data:
+            return
+        buffer += data
+        while len(buffer) >= 7:
+            tid, _, length, unit = struct.unpack(">HHHB", buffer[:7])
+            if len(buffer) < 6 + length:
+                break
+            pdu, buffer = buffer[7:6 + length], buffer[6 + length:]
+            function = pdu[0]
+            if function in (1, 3):
+                count = struct.unpack(">H", pdu[3:5])[0]
+                size = (count + 7) // 8 if function == 1 else count * 2
+                reply = bytes([function, size]) + bytes(size)
+            elif function in (5, 6, 15, 16):
+                reply = pdu[:5]
+            else:
+                reply = bytes([function | 0x80, 1])
+            connection.sendall(struct.pack(">HHHB", tid, 0, len(reply) + 1, unit) + reply)
+
+
+def read_peak_rss(pid):
+    """VmHWM of a running process in KiB."""
+    with open(f"/proc/{pid}/status") as status:
+        for line in status:
+            if line.startswith("VmHWM:"):
+                return int(line.split()[1])
+    return 0
+
+
+def run_once(binary, arguments):
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    port = listener.getsockname()[1]
+
+    command = [binary, "-i", f"127.0.0.1:{port}"] + arguments
+    start = time.perf_counter()
+    process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    first_request = None
+    peak_rss = 0
+    listener.settimeout(10)
+    try:
+        connection, _ = listener.accept()
+        with connection:
+            first = connection.recv(4096, socket.MSG_PEEK)
+            first_request = time.perf_counter()
+            peak_rss = read_peak_rss(process.pid)
+            if first:
+                respond(connection)
+    except socket.timeout:
+        pass
+    finally:
+        listener.close()
+
+    _, status = os.waitpid(process.pid, 0)
+    end = time.perf_counter()
+    if first_request is None:
+        raise RuntimeError(f"{' '.join(command)} did not send a request (status {status})")
+    return (first_request - start) * 1000.0, (end - start) * 1000.0, peak_rss
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary", help="path to caparoc_commander")
+    parser.add_argument("--runs", type=int, default=100, help="number of invocations (default: 100)")
+    parser.add_argument("--budget-ms", type=float, help="maximum median time to first request in ms")
+    parser.add_argument("--budget-rss-kb", type=int, help="maximum peak RSS in KiB")
+    parser.epilog = "Arguments after '--' are passed to the CLI (default: --read-uint16 0x2000)."
+    argv = sys.argv[1:]
+    split = argv.index("--") if "--" in argv else len(argv)
+    options = parser.parse_args(argv[:split])
+    options.arguments = argv[split + 1:] or ["--read-uint16", "0x2000"]
+
+    run_once(options.binary, options.arguments)  # warm the page cache
+    first, total, rss = [], [], []
+    for _ in range(options.runs):
+        t_first, t_total, max_rss = run_once(options.binary, options.arguments)
+        first.append(t_first)
+        total.append(t_total)
+        rss.append(max_rss)
+
+    print(f"runs: {options.runs}  arguments: {' '.join(options.arguments)}")
+    print(f"time to first request [ms]       min {min(first):7.3f}  median {statistics.median(first):7.3f}  p95 {percentile(first, 0.95):7.3f}")
+    print(f"total wall time [ms]             min {min(total):7.3f}  median {statistics.median(total):7.3f}  p95 {percentile(total, 0.95):7.3f}")
+    print(f"peak RSS at first request [KiB]  max {max(rss):7d}")
+
+    failed = False
+    if options.budget_ms is not None and statistics.median(first) > options.budget_ms:
+        print(f"FAIL: median time to first request exceeds budget of {options.budget_ms} ms")
+        failed = True
+    if options.budget_rss_kb is not None and max(rss) > options.budget_rss_kb:
+        print(f"FAIL: peak RSS exceeds budget of {options.budget_rss_kb} KiB")
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -13,6 +13,19 @@ if(NOT DEFINED CMAKE_SYSROOT AND EXISTS "/opt/bookworm-arm64-sysroot")
     set(CMAKE_SYSROOT /opt/bookworm-arm64-sysroot)
 endif()
 
+# Build-time helpers such as generate_register_table are aarch64 binaries;
+# run them through user-mode qemu with the target's libraries.
+if(NOT DEFINED CMAKE_CROSSCOMPILING_EMULATOR)
+    find_program(QEMU_AARCH64 NAMES qemu-aarch64-static qemu-aarch64)
+    if(QEMU_AARCH64)
+        if(DEFINED CMAKE_SYSROOT)
+            set(CMAKE_CROSSCOMPILING_EMULATOR ${QEMU_AARCH64} -L ${CMAKE_SYSROOT})
+        else()
+            set(CMAKE_CROSSCOMPILING_EMULATOR ${QEMU_AARCH64} -L /usr/aarch64-linux-gnu)
+        endif()
+    endif()
+endif()
+
 # Search paths: find libraries/headers for target only, programs on host
 set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
 set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
@@ -0,0 +1,26 @@
+#ifndef ACTION_EXECUTOR_HPP
+#define ACTION_EXECUTOR_HPP
+
+#include "caparoc_commander/cli_parser.hpp"
+
+namespace cli {
+
+/**
+ * @brief Execute all actions requested on the command line
+ *
+ * Actions that need a device run against every device given with --ip. On
+ * Linux they are driven by a single-threaded coroutine event loop: devices
+ * are served concurrently, every Modbus transaction has its own deadline
+ * (--timeout) and the whole invocation is bounded by --deadline. Raw register
+ * actions are fully asynchronous; actions implemented by libcaparoc block the
+ * loop for at most the remaining time budget. Actions that do not need a
+ * device run once, in command-line order, between the device actions.
+ *
+ * @param options Parsed command-line options
+ * @return int Process exit code
+ */
+int execute_actions(const CommandLineOptions& options);
+
+} // namespace cli
+
+#endif  // ACTION_EXECUTOR_HPP
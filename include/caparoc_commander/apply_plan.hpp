@@ -0,0 +1,109 @@
+#ifndef APPLY_PLAN_HPP
+#define APPLY_PLAN_HPP
+
+#include "libmodbus_cpp/modbus_connection.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Desired nominal current of one channel
+ */
+struct ChannelSetpoint {
+    uint8_t module = 0;
+    uint8_t channel = 0;
+    uint16_t nominal_current_a = 0;
+};
+
+/**
+ * @brief Desired state of one device
+ */
+struct DevicePlan {
+    std::string endpoint;  // HOST or HOST:PORT
+    std::vector<ChannelSetpoint> setpoints;
+};
+
+/**
+ * @brief Parse a desired-state plan
+ *
+ * The plan lists one section per device, followed by the nominal currents
+ * of its channels. '#' starts a comment.
+ *
+ *     [192.168.1.10]
+ *     1.1 = 4
+ *     1.2 = 6
+ *     [192.168.1.11:5020]
+ *     2.3 = 10
+ *
+ * @throws std::invalid_argument with the line number on syntax errors,
+ *         out-of-range channels and channels listed twice for a device
+ */
+std::vector<DevicePlan> parse_apply_plan(std::string_view text);
+
+/**
+ * @brief Read and parse a plan file
+ *
+ * @throws std::runtime_error if the file cannot be read
+ * @throws std::invalid_argument if the plan is malformed
+ */
+std::vector<DevicePlan> load_apply_plan(const std::string &path);
+
+enum class ApplyOutcome {
+    UNCHANGED,        // device already in the desired state
+    DRY_RUN,          // differences found, nothing written
+    APPLIED,          // all writes verified by readback
+    ROLLED_BACK,      // a write or readback failed, pre-state restored
+    ROLLBACK_FAILED,  // a write or readback failed and the pre-state could not be restored
+    READ_FAILED,      // current state could not be read, nothing written
+    CONNECT_FAILED,
+    SKIPPED           // not started before the deadline
+};
+
+struct ChannelChange {
+    ChannelSetpoint target;
+    uint16_t previous_a = 0;
+};
+
+struct DeviceApplyResult {
+    std::string endpoint;
+    ApplyOutcome outcome = ApplyOutcome::SKIPPED;
+    std::vector<ChannelChange> changes;  // minimal write set
+    std::size_t writes = 0;              // register writes issued, including rollback
+    std::string message;                 // first failure, or a warning
+    std::chrono::microseconds read_time{0};
+    std::chrono::microseconds write_time{0};
+    std::chrono::microseconds total_time{0};
+};
+
+/**
+ * @brief Bring one device into its planned state as a transaction
+ *
+ * Reads the current nominal current of every planned channel and only
+ * touches the channels that differ. Before writing, the global lock and the
+ * locks of those channels are captured. The channels are unlocked and
+ * written, then every written value is read back. If any step fails, the
+ * previous nominal currents are written back and the locks are restored.
+ * On success only the locks are restored, so the device differs from its
+ * pre-state in the planned nominal currents alone.
+ *
+ * @param dry_run Only compute the write set
+ */
+DeviceApplyResult apply_device_plan(libmodbus_cpp::ModbusConnection &conn, const DevicePlan &plan, bool dry_run);
+
+std::string_view to_string(ApplyOutcome outcome);
+
+/// true for outcomes that leave the device as planned or untouched on purpose
+bool is_successful(ApplyOutcome outcome);
+
+/// Multi-line report of one device
+std::string format_apply_result(const DeviceApplyResult &result);
+
+} // namespace cli
+
+#endif  // APPLY_PLAN_HPP
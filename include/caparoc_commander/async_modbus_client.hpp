@@ -0,0 +1,155 @@
+#ifndef ASYNC_MODBUS_CLIENT_HPP
+#define ASYNC_MODBUS_CLIENT_HPP
+
+#include "caparoc_commander/coil_bitset.hpp"
+#include "caparoc_commander/device_error.hpp"
+#include "caparoc_commander/event_loop.hpp"
+#include "caparoc_commander/rtt_estimator.hpp"
+#include "caparoc_commander/task.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief When a request left and its response arrived
+ *
+ * CLOCK_REALTIME nanoseconds since the Unix epoch. Kernel timestamps are
+ * taken by the network stack as the segment is handed to the device and as
+ * it arrives, so they do not include the event loop's scheduling delay.
+ */
+struct PacketTimes {
+    uint64_t sent_ns = 0;
+    uint64_t received_ns = 0;
+    bool kernel_sent = false;      // else taken just before send()
+    bool kernel_received = false;  // else taken right after recv()
+};
+
+/**
+ * @brief Non-blocking Modbus TCP client driven by an EventLoop
+ *
+ * Every request is an awaitable transaction with its own deadline. Several
+ * coroutines may share one client: requests are pipelined on the socket and
+ * responses are matched by MBAP transaction id, so a slow transaction does
+ * not hold up unrelated ones.
+ *
+ * Failures are returned as DeviceError values: a timeout or a refused
+ * connection costs no exception and no formatting.
+ *
+ * Only available on Linux.
+ */
+class AsyncModbusClient {
+public:
+    using TimePoint = EventLoop::TimePoint;
+
+    AsyncModbusClient(EventLoop &loop, std::string host, int port);
+    ~AsyncModbusClient();
+
+    AsyncModbusClient(const AsyncModbusClient &) = delete;
+    AsyncModbusClient &operator=(const AsyncModbusClient &) = delete;
+
+    /**
+     * @brief Establish the TCP connection
+     *
+     * @param deadline Point in time after which the attempt is abandoned
+     * @return Task<DeviceResult<void>> Nothing on success, otherwise why the attempt failed
+     */
+    Task<DeviceResult<void>> connect(TimePoint deadline);
+
+    bool is_connected() const;
+
+    /// Close the connection; transactions still in flight fail.
+    void close();
+
+    /**
+     * @brief Derive response timeouts from measured round-trip times
+     *
+     * With an estimator, each attempt of a transaction waits only
+     * estimator->timeout(); an unanswered request is sent again with a fresh
+     * transaction id (and a backed-off timeout) until the transaction's own
+     * deadline. The ids of earlier attempts stay valid, so whichever response
+     * arrives first completes the transaction, and PacketTimes reports the
+     * send time of the attempt it answers. Without one (the default), a
+     * request is sent once and waits for the full deadline.
+     *
+     * @param estimator Not owned, must outlive the client; nullptr disables it
+     */
+    void set_rtt_estimator(RttEstimator *estimator);
+
+    /// Requests sent again after an adaptive timeout
+    uint64_t retries() const;
+
+    /**
+     * @brief Shape requests to what the device handles well
+     *
+     * Register reads of more than @p max_block_words words are split into
+     * consecutive requests, and at most @p max_in_flight requests are
+     * outstanding at a time; further ones wait for a slot. 0 lifts a limit
+     * (the default).
+     */
+    void set_request_shape(uint16_t max_block_words, std::size_t max_in_flight);
+
+    /**
+     * @brief Ask the kernel for software timestamps of sent and received segments
+     *
+     * Uses SO_TIMESTAMPING; takes effect at the next connect(). Where the
+     * kernel does not provide them, PacketTimes falls back to user space.
+     */
+    void set_timestamping(bool enabled);
+
+    /**
+     * @brief Let receives busy-poll the device queue for up to @p budget before sleeping
+     *
+     * Uses SO_BUSY_POLL, which saves the interrupt and wake-up latency on
+     * drivers that support it at the cost of CPU time; takes effect at the
+     * next connect(). Raising it above net.core.busy_read needs
+     * CAP_NET_ADMIN; a refused setting is ignored. 0 (the default) is off.
+     */
+    void set_busy_poll(std::chrono::microseconds budget);
+
+    /**
+     * @brief Send a request ADU and await the matching response ADU
+     *
+     * The transaction id of @p request is replaced by a fresh one.
+     * All requests of this client are idempotent reads and writes, so
+     * sending one again after a timeout is harmless.
+     *
+     * @param times If not null, receives the send and receive times of the
+     *        answered attempt
+     * @return Task<DeviceResult<std::vector<uint8_t>>> Response ADU, or the
+     *         timeout, cancellation or connection loss
+     */
+    Task<DeviceResult<std::vector<uint8_t>>> transact(std::vector<uint8_t> request, TimePoint deadline, PacketTimes *times = nullptr);
+
+    // Exception responses fail with DeviceErrc::MODBUS_EXCEPTION and the exception code.
+    Task<DeviceResult<std::vector<uint16_t>>> read_holding_registers(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline);
+    Task<DeviceResult<void>> write_single_register(uint8_t unit_id, uint16_t address, uint16_t value, TimePoint deadline);
+    Task<DeviceResult<void>> write_multiple_registers(uint8_t unit_id, uint16_t address, std::vector<uint16_t> values, TimePoint deadline);
+    Task<DeviceResult<CoilBitset>> read_coils(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline);
+    Task<DeviceResult<void>> write_multiple_coils(uint8_t unit_id, uint16_t address, CoilBitset coils, TimePoint deadline);
+
+    const std::string &host() const { return host_; }
+    int port() const { return port_; }
+
+private:
+    struct State;
+
+    static Task<void> receive_loop(std::shared_ptr<State> state);
+    Task<DeviceResult<std::vector<uint16_t>>> read_block(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline);
+    Task<DeviceResult<void>> flush(TimePoint deadline);
+
+    EventLoop &loop_;
+    std::string host_;
+    int port_;
+    std::shared_ptr<State> state_;
+};
+
+} // namespace cli
+
+#endif  // ASYNC_MODBUS_CLIENT_HPP
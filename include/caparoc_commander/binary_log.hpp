@@ -0,0 +1,383 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include "caparoc_commander/portable_print.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace cli {
+
+/// Identifies a caparoc_commander binary log file ("CPLG")
+inline constexpr uint32_t BINARY_LOG_MAGIC = 0x43504C47;
+
+/// Incremented whenever the file or record layout changes
+inline constexpr uint16_t BINARY_LOG_FORMAT_VERSION = 1;
+
+/**
+ * @brief How one argument of a log record is stored
+ *
+ * Integers are widened to 64 bits and floats to double; strings are a u16
+ * length followed by at most LOG_MAX_STRING bytes.
+ */
+enum class LogArgType : uint8_t {
+    BOOL = 0,
+    CHAR = 1,
+    INT = 2,
+    UINT = 3,
+    DOUBLE = 4,
+    STRING = 5
+};
+
+/// Longer string arguments are cut
+inline constexpr std::size_t LOG_MAX_STRING = 256;
+
+template <typename T>
+consteval LogArgType log_arg_type()
+{
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        return LogArgType::BOOL;
+    }
+    else if constexpr (std::is_same_v<T, char>)
+    {
+        return LogArgType::CHAR;
+    }
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+        return LogArgType::INT;
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        return LogArgType::UINT;
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        return LogArgType::DOUBLE;
+    }
+    else
+    {
+        static_assert(std::is_convertible_v<const T &, std::string_view>, "binary log arguments are numbers, bools, chars or strings");
+        return LogArgType::STRING;
+    }
+}
+
+template <typename... Args>
+inline constexpr std::array<LogArgType, sizeof...(Args)> LOG_ARG_TYPES{log_arg_type<Args>()...};
+
+/**
+ * @brief One log statement in the source
+ *
+ * Defined as a function-local static by CAPAROC_LOG; the format string and
+ * argument types are written to the log once, records only carry the id.
+ */
+struct LogSite {
+    std::string_view format;
+    std::string_view file;
+    uint32_t line = 0;
+    std::span<const LogArgType> types{};
+    std::atomic<uint32_t> id{0};  // 0 until the first record
+};
+
+namespace detail {
+
+inline std::atomic<bool> binary_log_active{false};
+
+/**
+ * @brief Per-thread byte ring between the logging thread and the writer
+ *
+ * One producer (the owning thread) and one consumer (the writer thread);
+ * the same index protocol as SpscQueue, but records are variable-length
+ * byte strings:
+ *
+ *     size: u16, site: u32, time_ns: u64, arguments...
+ *
+ * in host byte order. The writer converts them to the file layout.
+ */
+class LogBuffer {
+public:
+    static constexpr std::size_t CAPACITY = 64 * 1024;
+    static constexpr std::size_t RECORD_HEADER_SIZE = 14;
+
+    explicit LogBuffer(uint16_t thread) : thread_(thread) {}
+
+    /// Producer: position to write @p size bytes at, or false (and a drop is counted) if they do not fit
+    bool reserve(std::size_t size, std::size_t &position)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (size > CAPACITY - (tail - head_.load(std::memory_order_acquire)))
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        position = tail;
+        return true;
+    }
+
+    void put(std::size_t &position, const void *data, std::size_t size)
+    {
+        auto offset = position & (CAPACITY - 1);
+        auto first = std::min(size, CAPACITY - offset);
+        std::memcpy(bytes_.data() + offset, data, first);
+        std::memcpy(bytes_.data(), static_cast<const uint8_t *>(data) + first, size - first);
+        position += size;
+    }
+
+    /// Producer: publish everything up to @p position
+    void commit(std::size_t position) { tail_.store(position, std::memory_order_release); }
+
+    /// Consumer: copy out all published bytes
+    void drain(std::vector<uint8_t> &out)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_acquire);
+        auto offset = head & (CAPACITY - 1);
+        auto first = std::min(tail - head, CAPACITY - offset);
+        out.insert(out.end(), bytes_.begin() + static_cast<std::ptrdiff_t>(offset), bytes_.begin() + static_cast<std::ptrdiff_t>(offset + first));
+        out.insert(out.end(), bytes_.begin(), bytes_.begin() + static_cast<std::ptrdiff_t>(tail - head - first));
+        head_.store(tail, std::memory_order_release);
+    }
+
+    uint16_t thread() const { return thread_; }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    std::atomic<bool> closed{false};  // the thread has exited
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{0};
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+    uint16_t thread_;
+    alignas(CACHE_LINE) std::array<uint8_t, CAPACITY> bytes_{};
+};
+
+/// Buffer of the calling thread, registered with the running logger on first use; nullptr without one
+LogBuffer *thread_log_buffer();
+
+/// Assigns the id of @p site
+uint32_t register_log_site(LogSite &site, std::span<const LogArgType> types);
+
+inline std::size_t encoded_size(std::string_view text)
+{
+    return 2 + std::min(text.size(), LOG_MAX_STRING);
+}
+
+template <typename T>
+std::size_t encoded_size(const T &value)
+{
+    if constexpr (log_arg_type<T>() == LogArgType::STRING)
+    {
+        return encoded_size(std::string_view(value));
+    }
+    else if constexpr (log_arg_type<T>() == LogArgType::BOOL || log_arg_type<T>() == LogArgType::CHAR)
+    {
+        return 1;
+    }
+    else
+    {
+        return 8;
+    }
+}
+
+template <typename T>
+void encode(LogBuffer &buffer, std::size_t &position, const T &value)
+{
+    constexpr auto type = log_arg_type<T>();
+    if constexpr (type == LogArgType::STRING)
+    {
+        std::string_view text(value);
+        auto length = static_cast<uint16_t>(std::min(text.size(), LOG_MAX_STRING));
+        buffer.put(position, &length, sizeof(length));
+        buffer.put(position, text.data(), length);
+    }
+    else if constexpr (type == LogArgType::BOOL || type == LogArgType::CHAR)
+    {
+        auto byte = static_cast<uint8_t>(value);
+        buffer.put(position, &byte, 1);
+    }
+    else
+    {
+        using Stored = std::conditional_t<type == LogArgType::INT, int64_t, std::conditional_t<type == LogArgType::UINT, uint64_t, double>>;
+        auto stored = static_cast<Stored>(value);
+        buffer.put(position, &stored, sizeof(stored));
+    }
+}
+
+} // namespace detail
+
+/// true while a BinaryLogger runs; one relaxed load
+inline bool binary_log_active()
+{
+    return detail::binary_log_active.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Append a record to the calling thread's log buffer
+ *
+ * Copies the site id, a steady-clock timestamp and the raw arguments; the
+ * text is only formatted when the log is read. Never blocks and never
+ * allocates after the thread's first record: when the buffer is full, the
+ * record is dropped and counted. Use CAPAROC_LOG rather than calling this
+ * directly.
+ */
+template <typename... Args>
+void write_log_record(LogSite &site, std::format_string<const Args &...> /* checked only */, const Args &...args)
+{
+    auto *buffer = detail::thread_log_buffer();
+    if (!buffer)
+    {
+        return;
+    }
+    auto id = site.id.load(std::memory_order_acquire);
+    if (id == 0)
+    {
+        id = detail::register_log_site(site, LOG_ARG_TYPES<Args...>);
+    }
+    auto size = detail::LogBuffer::RECORD_HEADER_SIZE + (std::size_t{0} + ... + detail::encoded_size(args));
+    std::size_t position;
+    if (!buffer->reserve(size, position))
+    {
+        return;
+    }
+    auto record_size = static_cast<uint16_t>(size);
+    auto time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    buffer->put(position, &record_size, sizeof(record_size));
+    buffer->put(position, &id, sizeof(id));
+    buffer->put(position, &time_ns, sizeof(time_ns));
+    (detail::encode(*buffer, position, args), ...);
+    buffer->commit(position);
+}
+
+/**
+ * @brief Record a message in the binary log, if one is running
+ *
+ * The format string is checked at compile time like std::format's.
+ * Costs one relaxed load when no log runs and a few tens of nanoseconds
+ * when one does.
+ */
+#define CAPAROC_LOG(format, ...)                                                               \
+    do                                                                                         \
+    {                                                                                          \
+        if (::cli::binary_log_active())                                                        \
+        {                                                                                      \
+            static ::cli::LogSite caparoc_log_site_{format, __FILE__, __LINE__};               \
+            ::cli::write_log_record(caparoc_log_site_, format __VA_OPT__(, ) __VA_ARGS__);     \
+        }                                                                                      \
+    } while (false)
+
+/**
+ * @brief A --debug message: recorded in the binary log if one runs, else printed if @p print
+ */
+#define CAPAROC_DEBUG(print, format, ...)                                 \
+    do                                                                    \
+    {                                                                     \
+        if (::cli::binary_log_active())                                   \
+        {                                                                 \
+            CAPAROC_LOG(format __VA_OPT__(, ) __VA_ARGS__);               \
+        }                                                                 \
+        else if (print)                                                   \
+        {                                                                 \
+            portable::println(format __VA_OPT__(, ) __VA_ARGS__);         \
+        }                                                                 \
+    } while (false)
+
+/**
+ * @brief Writes the records of all threads to a log file while it exists
+ *
+ * A background thread collects the per-thread buffers every 10 ms and
+ * appends their records to the file, with the format string and source
+ * location of every log statement the first time it occurs. Threads that
+ * have never logged pay nothing; a thread's buffer is 64 KiB.
+ *
+ * Only one logger may run at a time.
+ *
+ * File layout (little-endian): a 24-byte header (magic: u32, version: u16,
+ * reserved: u16, start_time_ns: u64 system clock, steady_start_ns: u64),
+ * then entries starting with a kind byte:
+ *
+ *     0 site:    id: u32, line: u32, argc: u8, types: u8[argc],
+ *                file_length: u16, file, format_length: u16, format
+ *     1 record:  thread: u16, id: u32, time_ns: u64 steady clock, arguments
+ *     2 dropped: thread: u16, count: u64
+ *
+ * @throws std::runtime_error if the file cannot be created
+ * @throws std::logic_error if another logger runs
+ */
+class BinaryLogger {
+public:
+    explicit BinaryLogger(const std::string &path);
+
+    /// Calls stop()
+    ~BinaryLogger();
+
+    BinaryLogger(const BinaryLogger &) = delete;
+    BinaryLogger &operator=(const BinaryLogger &) = delete;
+
+    /// Stop recording and write out everything recorded so far
+    void stop();
+
+    const std::string &path() const { return path_; }
+    uint64_t records_written() const;
+    uint64_t records_dropped() const;
+
+private:
+    struct State;
+
+    std::string path_;
+    std::unique_ptr<State> state_;
+};
+
+using LogValue = std::variant<bool, char, int64_t, uint64_t, double, std::string>;
+
+struct LogSiteInfo {
+    std::string file;
+    uint32_t line = 0;
+    std::string format;
+    std::vector<LogArgType> types;
+};
+
+struct LogEntry {
+    uint16_t thread = 0;
+    uint32_t site = 0;
+    uint64_t time_ns = 0;  // system clock
+    std::vector<LogValue> args;
+};
+
+struct BinaryLogFile {
+    uint64_t start_time_ns = 0;
+    std::map<uint32_t, LogSiteInfo> sites;
+    std::vector<LogEntry> entries;
+    std::map<uint16_t, uint64_t> dropped;  // per thread
+};
+
+/**
+ * @brief Load a log written by BinaryLogger
+ *
+ * A truncated last entry (e.g. from a process that was killed) is ignored.
+ *
+ * @throws std::runtime_error if the file cannot be read or is not a binary log
+ */
+BinaryLogFile read_binary_log(const std::string &path);
+
+/// "2026-10-19 08:15:30.123456 T1 message", formatted with the site's format string
+std::string format_log_entry(const BinaryLogFile &log, const LogEntry &entry);
+
+} // namespace cli
+
+#endif  // BINARY_LOG_HPP
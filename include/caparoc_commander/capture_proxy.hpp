@@ -0,0 +1,51 @@
+#ifndef CAPTURE_PROXY_HPP
+#define CAPTURE_PROXY_HPP
+
+#include "caparoc_commander/modbus_trace.hpp"
+
+#include <string>
+#include <thread>
+
+namespace cli {
+
+/**
+ * @brief Loopback TCP proxy that records the Modbus traffic of one device
+ *
+ * Listens on an ephemeral 127.0.0.1 port and forwards every connection made
+ * to it to @p host:@p port. Bytes are passed through unchanged as soon as they
+ * arrive; complete request and response ADUs are recorded with their arrival
+ * time. Pointing a blocking ModbusConnection or an AsyncModbusClient at
+ * local_port() therefore captures the exchange without touching either
+ * client. The proxy runs on its own thread until it is destroyed.
+ *
+ * Only available on Linux.
+ *
+ * @throws std::runtime_error if the listening socket cannot be set up
+ */
+class CaptureProxy {
+public:
+    CaptureProxy(TraceWriter &writer, std::string host, int port, int connect_timeout_seconds);
+    ~CaptureProxy();
+
+    CaptureProxy(const CaptureProxy &) = delete;
+    CaptureProxy &operator=(const CaptureProxy &) = delete;
+
+    /// Loopback port to connect to instead of the device
+    int local_port() const { return local_port_; }
+
+private:
+    void run();
+
+    TraceWriter &writer_;
+    std::string host_;
+    int port_;
+    int connect_timeout_seconds_;
+    int listen_fd_ = -1;
+    int stop_fds_[2] = {-1, -1};
+    int local_port_ = 0;
+    std::thread thread_;
+};
+
+} // namespace cli
+
+#endif  // CAPTURE_PROXY_HPP
@@ -1,6 +1,7 @@
 #ifndef DEMO_CLI_PARSER_HPP
 #define DEMO_CLI_PARSER_HPP
 
+#include <cstddef>
 #include <list>
 #include <string>
 #include <vector>
@@ -34,7 +35,28 @@ enum class CommandLineAction {
     GET_LOAD_CURRENT,
     CONTROL_CHANNEL,
     READ_COIL,
-    WRITE_COIL
+    WRITE_COIL,
+    READ_COILS,
+    WRITE_COILS,
+    SWITCH_SEQUENCE,
+    PUBLISH_SHM,
+    PUBLISH_MQTT,
+    LOAD_STATISTICS,
+    TRIP_CAPTURE,
+    READ_SHM,
+    SHOW_TRIP_EVENT,
+    SHOW_LOG,
+    REPLAY_TRACE,
+    APPLY_PLAN,
+    DISCOVER_DEVICES,
+    INVENTORY_REFRESH,
+    INVENTORY_LIST,
+    INVENTORY_QUERY,
+    PROFILE_DEVICE,
+    SYNC_SAMPLE,
+    CLUSTER_POLL,
+    HEALTH_WATCH,
+    SHELL
 };
 
 struct Uint16Args {
@@ -78,10 +100,30 @@ struct CoilWriteArgs {
     std::string state;  // "on", "off", "true", "false", "1", "0"
 };
 
+struct CoilRangeArgs {
+    std::string start;
+    std::string count;
+};
+
+struct CoilRangeWriteArgs {
+    std::string start;
+    std::string bitmask;  // '0'/'1' per coil, first character = start
+};
+
+struct SwitchSequenceArgs {
+    std::string state;     // "on" or "off"
+    std::string channels;  // "all" or "MODULE.CHANNEL,..." with CHANNEL = '*' for all
+};
+
 struct CommandLineOptions {
-    std::string ip_address; 
+    std::vector<std::string> ip_addresses;  // HOST, HOST:PORT, optionally followed by /UNIT,UNIT...
     int port;
+    std::vector<int> unit_ids{1};           // Modbus unit IDs served at every address without its own list
     int timeout_seconds;
+    double deadline_seconds = 0.0;  // whole invocation, 0 = unlimited
+    bool adaptive_timeout = false;  // response timeout from measured round-trip times
+    int timeout_min_ms = 50;        // bounds of the adaptive response timeout
+    int timeout_max_ms = 0;         // 0 = --timeout
 
     std::list<CommandLineAction> actions;
 
@@ -103,10 +145,106 @@ struct CommandLineOptions {
     std::vector<ChannelControlArgs> control_channel_args;
     std::vector<CoilArgs> read_coil_args;
     std::vector<CoilWriteArgs> write_coil_args;
+    std::vector<CoilRangeArgs> read_coils_args;
+    std::vector<CoilRangeWriteArgs> write_coils_args;
+    std::vector<SwitchSequenceArgs> switch_sequence_args;
+    std::size_t switch_max_simultaneous = 4;
+    int switch_stagger_ms = 50;
+    int switch_verify_timeout_ms = 2000;
+
+    std::string publish_shm_name;
+    std::string read_shm_name;
+    int poll_interval_ms = 1000;
+
+    std::string mqtt_broker;              // HOST[:PORT] for --publish-mqtt
+    std::string mqtt_topic = "caparoc";   // topics are TOPIC/DEVICE/...
+    std::string mqtt_client_id;           // empty = caparoc_commander-DEVICE
+    int mqtt_qos = 0;
+    int mqtt_batch = 1;                   // polls per message
+    int mqtt_full_every = 60;             // polls, 0 = only after connecting
+    int mqtt_deadband_ma = 0;
+    bool mqtt_compress = false;
+    std::string mqtt_queue_file;          // empty = offline queue in memory only
+    std::size_t mqtt_queue_limit = 10000;
+
+    int stats_window_s = 3600;
+    int stats_slide_s = 0;     // 0 = tumbling windows (slide = window)
+    bool stats_json = false;   // one JSON object per window instead of a table
+
+    std::string trip_capture_dir;  // event files of --trip-capture
+    std::size_t trip_pre = 200;    // samples per channel before the trigger
+    std::size_t trip_post = 200;   // polls of the module from the trigger on
+    std::string trip_show_file;
+
+    std::string capture_file;  // record all device traffic, empty = off
+    std::string replay_file;
+    std::string replay_address = "127.0.0.1";  // IPv4 address the --replay server binds
+    int replay_port = 5020;
+    double replay_speed = 1.0;  // 0 = answer immediately
+
+    std::string apply_plan_file;
+    std::size_t apply_workers = 8;
+    bool apply_dry_run = false;
+
+    std::string discover_cidr;
+    std::size_t discover_max_sockets = 1024;
+
+    std::string inventory_file;
+    bool inventory_full = false;     // re-read the topology of every device
+    std::size_t inventory_workers = 8;
+    std::string inventory_query;     // product name filter
+
+    std::string profiles_file;       // empty = default_device_profiles_path()
+    bool no_profiles = false;        // ignore the recorded device profiles
+    int profile_step_ms = 1000;      // duration of each --profile-device load step
+    std::string profile_address = "0x2000";
+    std::size_t profile_max_connections = 8;
+
+    std::string sync_address;        // first register of --sync-sample, empty = off
+    std::size_t sync_count = 1;      // registers per device and tick
+    std::size_t sync_rows = 0;       // 0 = until stopped
+    double sync_max_skew_ms = 5.0;   // rows with more skew are flagged
+    bool sync_json = false;          // one JSON object per row instead of a table
+
+    std::string cluster_bind = "127.0.0.1:7400";  // UDP heartbeat endpoint and name of this poller
+    std::vector<std::string> cluster_peers;       // other pollers to contact first
+    std::string cluster_sink;                     // JSON lines shared by all pollers
+    std::size_t cluster_workers = 8;
+    int cluster_heartbeat_ms = 500;
+
+    std::size_t health_top = 10;        // channels and devices per --health-watch ranking
+    int health_report_s = 60;           // seconds between rankings, 0 = only at the end
+    int health_half_life_s = 21600;     // decay of the trip, warning and near-nominal statistics
+    std::size_t health_workers = 8;
+
+    int rt_priority = 0;             // SCHED_FIFO priority of polling loops, 0 = normal scheduling
+    int rt_cpu = -1;                 // CPU the polling loop is pinned to, -1 = any
+    bool rt_lock_memory = false;
+    int rt_spin_us = 0;              // end of each wait for a poll spent spinning
+    int rt_busy_poll_us = 0;         // SO_BUSY_POLL of the --sync-sample sockets
+    bool jitter_report = false;      // histogram of poll start lateness at the end of a polling loop
+    std::string io_backend = "auto"; // event loop of the concurrent modes: auto, io_uring or epoll
+
+    std::string log_file;            // binary log of the debug diagnostics, empty = off
+    std::string log_show_file;
+
     bool debug = false;
 }; 
 
 CommandLineOptions parse_command_line(int argc, char* argv[]);
+
+/**
+ * @brief Parse one line of the interactive shell with the command-line syntax
+ *
+ * @param words The line split into words, without a program name
+ * @throws std::invalid_argument with CLI11's message, or the help text for --help
+ */
+CommandLineOptions parse_shell_command(const std::vector<std::string>& words);
+
+/// Long names of all command-line options, without the leading "--"
+std::vector<std::string> command_line_option_names();
+
+bool requires_device_connection(CommandLineAction action);
 std::string dump_command_line_options(const CommandLineOptions& options);
     
 } // namespace cli
@@ -0,0 +1,64 @@
+#ifndef COIL_BITSET_HPP
+#define COIL_BITSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Fixed-size set of coil states, packed 64 coils per word
+ *
+ * Bit i of word i / 64 holds coil i, which is the Modbus wire order (LSB of
+ * the first payload byte is the first coil). Conversion from and to the
+ * packed payload of FC 1 / FC 15 therefore moves whole words, and counting
+ * switched-on coils is a popcount per word.
+ */
+class CoilBitset {
+public:
+    CoilBitset() = default;
+
+    /// @param count Number of coils, all initially OFF
+    explicit CoilBitset(std::size_t count);
+
+    /**
+     * @brief Unpack the coil status bytes of a FC 1 response
+     *
+     * @param bytes Packed payload, at least (count + 7) / 8 bytes
+     * @param count Number of coils that were requested
+     */
+    static CoilBitset from_packed_bytes(std::span<const uint8_t> bytes, std::size_t count);
+
+    /**
+     * @brief Parse a string of '0' and '1' characters, first character = first coil
+     *
+     * @return std::optional<CoilBitset> std::nullopt for empty strings or other characters
+     */
+    static std::optional<CoilBitset> parse(std::string_view digits);
+
+    /// Packed payload for a FC 15 request, (size() + 7) / 8 bytes
+    std::vector<uint8_t> to_packed_bytes() const;
+
+    std::size_t size() const { return count_; }
+    bool test(std::size_t index) const;
+    void set(std::size_t index, bool value);
+
+    /// Number of coils that are ON
+    std::size_t count_on() const;
+
+    /// '0'/'1' per coil, first coil first (the format accepted by parse())
+    std::string to_string() const;
+
+private:
+    std::size_t count_ = 0;
+    std::vector<uint64_t> words_;
+};
+
+} // namespace cli
+
+#endif  // COIL_BITSET_HPP
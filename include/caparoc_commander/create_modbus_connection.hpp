@@ -2,10 +2,24 @@
 #define CREATE_MODBUS_CONNECTION_HPP
 
 #include <string>
+#include "caparoc_commander/device_error.hpp"
 #include "libmodbus_cpp/modbus_connection.hpp"
 
 namespace cli {
 
+/**
+ * @brief Establish a Modbus TCP connection, reporting failure as a value
+ *
+ * Meant for paths where unreachable devices are routine (fleet operations):
+ * a failed connect costs no exception and no string formatting.
+ *
+ * @param ip_address IP address of the device
+ * @param port Modbus TCP port
+ * @param timeout_seconds Connection timeout in seconds
+ * @return DeviceResult<libmodbus_cpp::ModbusConnection> Connected ModbusConnection, or why it failed
+ */
+DeviceResult<libmodbus_cpp::ModbusConnection> connect_modbus_device(const std::string& ip_address, int port, int timeout_seconds);
+
 /**
  * @brief Create and establish a Modbus TCP connection
  * 
@@ -17,6 +31,11 @@ namespace cli {
  */
 libmodbus_cpp::ModbusConnection create_modbus_connection(const std::string& ip_address, int port, int timeout_seconds);
 
+/**
+ * @brief The message create_modbus_connection() throws for @p error
+ */
+std::string format_connect_error(const DeviceError& error, const std::string& ip_address, int port);
+
 } // namespace cli
 
 #endif  // CREATE_MODBUS_CONNECTION_HPP
@@ -0,0 +1,101 @@
+#ifndef DEVICE_ERROR_HPP
+#define DEVICE_ERROR_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace cli {
+
+/**
+ * @brief Kinds of failure when talking to a device
+ *
+ * Unreachable devices and timeouts are routine when polling a fleet, so they
+ * are reported as values rather than exceptions.
+ */
+enum class DeviceErrc : uint8_t {
+    TIMEOUT,             // no connection or response in time
+    CONNECTION_REFUSED,  // nothing listens on the port
+    CONNECTION_RESET,    // connection closed or reset by the device
+    UNREACHABLE,         // no route to the host or network
+    RESOLVE_FAILED,      // host name could not be resolved
+    MODBUS_EXCEPTION,    // the device answered with an exception response
+    INVALID_RESPONSE,    // malformed or unexpected response
+    CANCELLED,           // abandoned at the deadline
+    NOT_CONNECTED,
+    OTHER
+};
+
+inline constexpr std::size_t DEVICE_ERRC_COUNT = static_cast<std::size_t>(DeviceErrc::OTHER) + 1;
+
+/**
+ * @brief A failed device operation
+ *
+ * Trivially copyable and cheap to create; the text is only produced by
+ * describe() when the error is actually shown.
+ */
+struct DeviceError {
+    DeviceErrc code = DeviceErrc::OTHER;
+    int system_error = 0;        // errno (or libmodbus error number) the error was derived from, 0 if none
+    uint8_t exception_code = 0;  // Modbus exception code for MODBUS_EXCEPTION
+};
+
+/// Value of a device operation, or why it failed
+template <typename T>
+using DeviceResult = std::expected<T, DeviceError>;
+
+/**
+ * @brief Classify an errno value
+ *
+ * Understands the error numbers libmodbus reports above its own base,
+ * including Modbus exception responses.
+ */
+DeviceError device_error_from_errno(int error);
+
+/**
+ * @brief Classify a Modbus TCP response ADU that was not the expected answer
+ *
+ * @return MODBUS_EXCEPTION with its code for exception responses,
+ *         INVALID_RESPONSE otherwise
+ */
+DeviceError device_error_from_response(std::span<const uint8_t> adu);
+
+std::string_view to_string(DeviceErrc code);
+
+/// Human-readable description, e.g. "Response timeout" or "Modbus exception 0x02 (illegal data address)"
+std::string describe(const DeviceError &error);
+
+/**
+ * @brief Failure counts per DeviceErrc
+ *
+ * May be updated from several threads.
+ */
+class DeviceErrorCounters {
+public:
+    void record(const DeviceError &error)
+    {
+        counts_[static_cast<std::size_t>(error.code)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count(DeviceErrc code) const
+    {
+        return counts_[static_cast<std::size_t>(code)].load(std::memory_order_relaxed);
+    }
+
+    uint64_t total() const;
+
+    /// "2 timeout, 1 connection refused", or "none"
+    std::string format() const;
+
+private:
+    std::array<std::atomic<uint64_t>, DEVICE_ERRC_COUNT> counts_{};
+};
+
+} // namespace cli
+
+#endif  // DEVICE_ERROR_HPP
@@ -0,0 +1,148 @@
+#ifndef DEVICE_PROFILE_HPP
+#define DEVICE_PROFILE_HPP
+
+#include "caparoc_commander/device_error.hpp"
+#include "caparoc_commander/event_loop.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Measured capacity of one device and the request shape derived from it
+ */
+struct DeviceProfile {
+    std::string endpoint;            // HOST:PORT
+    uint16_t block_words = 1;        // FC 3 block size below the latency knee
+    uint16_t max_block_words = 1;    // largest FC 3 block the device answered
+    uint16_t pipeline_depth = 1;     // requests in flight per connection at the throughput knee
+    uint16_t connections = 1;        // concurrent connections at the throughput knee
+    double max_rate_hz = 0.0;        // highest request rate served without queueing
+    uint32_t latency_p50_us = 0;     // unloaded response time
+    uint32_t latency_p99_us = 0;
+    uint64_t profiled_ns = 0;        // nanoseconds since the Unix epoch
+};
+
+/**
+ * @brief Tuning profiles of a fleet, one section per device
+ *
+ *     [192.168.1.10:502]
+ *     block_words = 32
+ *     pipeline_depth = 4
+ *     ...
+ *
+ * '#' starts a comment; unknown keys are ignored so older binaries can read
+ * newer files.
+ */
+struct DeviceProfiles {
+    std::vector<DeviceProfile> devices;  // sorted by endpoint
+
+    const DeviceProfile *find(std::string_view endpoint) const;
+
+    /// Insert @p profile or replace the entry with the same endpoint
+    void update(DeviceProfile profile);
+};
+
+/// @throws std::invalid_argument with the line number on syntax errors
+DeviceProfiles parse_device_profiles(std::string_view text);
+
+std::string format_device_profiles(const DeviceProfiles &profiles);
+
+/**
+ * @brief Read a profile file
+ *
+ * @return No profiles if @p path does not exist
+ * @throws std::runtime_error if the file cannot be read
+ * @throws std::invalid_argument if it is malformed
+ */
+DeviceProfiles load_device_profiles(const std::string &path);
+
+/**
+ * @brief Write a profile file, replacing @p path atomically and creating its directory
+ *
+ * @throws std::runtime_error if the file cannot be written
+ */
+void save_device_profiles(const DeviceProfiles &profiles, const std::string &path);
+
+/// $XDG_CONFIG_HOME/caparoc_commander/profiles.ini or ~/.config/...; empty if neither is set
+std::string default_device_profiles_path();
+
+/**
+ * @brief Parameters of a profiling run
+ */
+struct ProfileSettings {
+    std::string host;
+    int port = 502;
+    uint8_t unit_id = 1;
+    uint16_t address = 0x2000;  // first register of the FC 3 reads
+    std::chrono::milliseconds step{1000};  // duration of each load step
+    std::chrono::milliseconds timeout{3000};
+    uint16_t max_connections = 8;
+    IoBackend io_backend = IoBackend::AUTO;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();  // steps still running are cancelled
+};
+
+/**
+ * @brief Result of one load step of the ramp
+ */
+struct ProfileStep {
+    std::string_view stage;    // "block", "depth", "connections" or "rate"
+    uint32_t value = 0;        // words, depth, connections or offered requests/s
+    uint64_t requests = 0;     // answered
+    uint64_t errors = 0;
+    double throughput_rps = 0.0;
+    double words_per_s = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    std::optional<DeviceError> error;  // first failure
+};
+
+struct ProfileResult {
+    DeviceProfile profile;
+    std::vector<ProfileStep> steps;
+    std::optional<DeviceError> error;  // the device could not be profiled at all
+};
+
+/**
+ * @brief Find the throughput/latency knee of a device with a controlled load ramp
+ *
+ * Four ramps, each stopped at the first step with failures so the device is
+ * never driven far past what it handles:
+ *
+ *  - block: FC 3 block sizes from 1 to 125 words at one request in flight;
+ *    the profile takes the largest block whose median latency stays within
+ *    twice that of a single word (or 1 ms of it, against timer granularity).
+ *  - depth: 1 to 16 pipelined requests on one connection; the knee is the
+ *    smallest depth reaching 90 % of the best throughput.
+ *  - connections: 1 to max_connections connections with one request each,
+ *    with the same knee rule.
+ *  - rate: open-loop request rates up to 1.2 times the throughput at the
+ *    depth knee; the highest rate that is served in full without the
+ *    median latency rising above twice its unloaded value (same slack) is
+ *    max_rate_hz. Beyond the capacity of the device requests queue up, and
+ *    the median grows with every step.
+ *
+ * Latencies of the rate ramp are measured from the scheduled send time, so
+ * queueing delay is not hidden when the sender falls behind.
+ *
+ * Linux only; elsewhere the result carries DeviceErrc::OTHER.
+ *
+ * @param on_step Called after every step, e.g. to print progress
+ */
+ProfileResult profile_device(const ProfileSettings &settings, const std::function<void(const ProfileStep &)> &on_step);
+
+/// One line per step, for progress output
+std::string format_profile_step(const ProfileStep &step);
+
+/// Summary of a profile
+std::string format_device_profile(const DeviceProfile &profile);
+
+} // namespace cli
+
+#endif  // DEVICE_PROFILE_HPP
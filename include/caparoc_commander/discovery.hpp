@@ -0,0 +1,53 @@
+#ifndef DISCOVERY_HPP
+#define DISCOVERY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief A CAPAROC device that answered the discovery identification read
+ */
+struct DiscoveredDevice {
+    std::string ip_address;
+    uint16_t connected_modules = 0;
+    std::string power_module_name;  // empty if the name read failed
+    std::chrono::milliseconds response_time{0};
+};
+
+/**
+ * @brief Result of a discovery scan
+ */
+struct DiscoveryResult {
+    std::size_t hosts_scanned = 0;
+    std::chrono::milliseconds elapsed{0};
+    std::vector<DiscoveredDevice> devices;  // sorted by address
+};
+
+/**
+ * @brief Scan an IPv4 range for CAPAROC devices
+ *
+ * Opens non-blocking connections to every host of the range, multiplexed via
+ * epoll with at most @p max_sockets sockets in flight. Hosts that accept the
+ * connection are asked for the number of connected modules (0x2000) and the
+ * Power Module product name (0x1000); only hosts answering the first read are
+ * reported. The whole scan takes roughly one @p timeout_seconds period as
+ * long as the range fits into @p max_sockets.
+ *
+ * @param cidr Address range in CIDR notation (e.g. 192.168.1.0/24, prefix >= 16)
+ * @param port Modbus TCP port
+ * @param timeout_seconds Per-host timeout covering connect and both reads
+ * @param max_sockets Maximum number of concurrently open sockets
+ * @return DiscoveryResult Inventory of responsive devices
+ * @throws std::invalid_argument if @p cidr is malformed
+ * @throws std::runtime_error if the scan cannot be set up
+ */
+DiscoveryResult discover_devices(const std::string& cidr, int port, int timeout_seconds, std::size_t max_sockets);
+
+} // namespace cli
+
+#endif  // DISCOVERY_HPP
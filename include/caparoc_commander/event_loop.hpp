@@ -0,0 +1,221 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include "caparoc_commander/task.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Outcome of an EventLoop wait
+ */
+enum class WaitStatus {
+    READY,      // the awaited condition occurred
+    TIMEOUT,    // the per-operation deadline passed
+    CANCELLED   // the loop deadline passed or the wait was cancelled explicitly
+};
+
+/**
+ * @brief How an EventLoop talks to the kernel about its sockets
+ */
+enum class IoBackend {
+    AUTO,      // io_uring where the kernel provides it, else epoll
+    IO_URING,  // batched submission, multishot receives into provided buffers (Linux 5.19)
+    EPOLL      // readiness notification, one system call per send and receive
+};
+
+/// Parse "auto", "io_uring" or "epoll"; throws std::invalid_argument otherwise.
+IoBackend parse_io_backend(std::string_view name);
+std::string_view to_string(IoBackend backend);
+
+/**
+ * @brief Outcome of EventLoop::send() and EventLoop::receive()
+ */
+struct IoResult {
+    WaitStatus status = WaitStatus::READY;
+    int result = 0;  // if READY: bytes transferred (0 = peer closed) or -errno
+};
+
+class IoRing;
+
+/**
+ * @brief Single-threaded reactor driving Task coroutines
+ *
+ * All coroutines run on the thread calling run(). A loop-wide deadline
+ * (set_deadline) caps every wait: once it passes, all outstanding waits
+ * resume with WaitStatus::CANCELLED so that pending work unwinds cleanly.
+ *
+ * With the io_uring backend, send() and receive() are kernel operations:
+ * everything the coroutines queued while running goes to the kernel in one
+ * system call, which also collects the completions, and each socket has a
+ * single multishot receive armed for as long as it is open. With epoll they
+ * are plain system calls after a readiness wait. readable() and writable()
+ * work with both.
+ *
+ * Only available on Linux.
+ */
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    /**
+     * @brief Registration record of a suspended coroutine
+     *
+     * Owned by the waiting coroutine; complete() may be called before the
+     * coroutine suspends, in which case the following wait returns at once.
+     */
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        WaitStatus status = WaitStatus::READY;
+        uint64_t id = 0;  // 0 while not registered
+        int fd = -1;
+        bool for_write = false;
+        bool cancellable = true;
+        bool signalled = false;
+    };
+
+    class WaitAwaiter {
+    public:
+        WaitAwaiter(EventLoop &loop, Waiter *external, int fd, bool for_write, TimePoint deadline, bool cancellable)
+            : loop_(loop), external_(external), fd_(fd), for_write_(for_write), deadline_(deadline), cancellable_(cancellable) {}
+
+        bool await_ready() noexcept;
+        void await_suspend(std::coroutine_handle<> handle);
+        WaitStatus await_resume() noexcept { return waiter().status; }
+
+    private:
+        Waiter &waiter() noexcept { return external_ ? *external_ : own_; }
+
+        EventLoop &loop_;
+        Waiter own_;
+        Waiter *external_;
+        int fd_;
+        bool for_write_;
+        TimePoint deadline_;
+        bool cancellable_;
+    };
+
+    /// @throws std::runtime_error if @p backend is IO_URING and the kernel does not provide it
+    explicit EventLoop(IoBackend backend = IoBackend::AUTO);
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /// IO_URING or EPOLL, whichever the loop ended up with
+    IoBackend backend() const { return ring_ ? IoBackend::IO_URING : IoBackend::EPOLL; }
+
+    /// Set the loop-wide deadline after which every wait is cancelled.
+    void set_deadline(TimePoint deadline) { deadline_ = deadline; }
+    TimePoint deadline() const { return deadline_; }
+
+    /// True once the loop-wide deadline has passed.
+    bool deadline_exceeded() const { return Clock::now() >= deadline_; }
+
+    /// Run @p root to completion, driving all spawned tasks meanwhile.
+    void run(Task<void> root);
+
+    /// Start a detached task. It is destroyed when it finishes or when the loop is destroyed.
+    void spawn(Task<void> task);
+
+    /// Run all @p tasks concurrently and wait until every one has finished.
+    Task<void> when_all(std::vector<Task<void>> tasks);
+
+    WaitAwaiter readable(int fd, TimePoint deadline) { return {*this, nullptr, fd, false, deadline, true}; }
+    WaitAwaiter writable(int fd, TimePoint deadline) { return {*this, nullptr, fd, true, deadline, true}; }
+    WaitAwaiter sleep_until(TimePoint deadline) { return {*this, nullptr, -1, false, deadline, true}; }
+
+    /// Wait until complete(@p waiter) is called or @p deadline passes.
+    WaitAwaiter wait(Waiter &waiter, TimePoint deadline, bool cancellable = true)
+    {
+        return {*this, &waiter, -1, false, deadline, cancellable};
+    }
+
+    /// Wake the coroutine waiting on @p waiter with @p status.
+    void complete(Waiter &waiter, WaitStatus status = WaitStatus::READY);
+
+    /// Wake every coroutine waiting on @p fd with WaitStatus::CANCELLED (call before closing it).
+    void cancel_fd(int fd);
+
+    /**
+     * @brief Send from @p data on the non-blocking stream socket @p fd
+     *
+     * Waits for buffer space until @p deadline if the socket has none.
+     * @p data must stay valid until the task has finished.
+     *
+     * @return IoResult Bytes sent, possibly fewer than data.size()
+     */
+    Task<IoResult> send(int fd, std::span<const uint8_t> data, TimePoint deadline);
+
+    /**
+     * @brief Wait for data on the non-blocking stream socket @p fd and append it to @p out
+     *
+     * Only one coroutine may receive from a socket at a time.
+     *
+     * @return IoResult Bytes appended, 0 once the peer has closed the connection
+     */
+    Task<IoResult> receive(int fd, std::vector<uint8_t> &out, TimePoint deadline);
+
+private:
+    struct FdEntry {
+        Waiter *reader = nullptr;
+        Waiter *writer = nullptr;
+        uint32_t registered_events = 0;
+
+        // io_uring receive stream
+        Waiter *receiver = nullptr;
+        uint64_t receive_op = 0;        // id of the armed receive, 0 = none
+        std::vector<uint8_t> received;  // arrived before receive() asked for it
+        std::optional<int> receive_end; // 0 = closed by the peer, else -errno
+    };
+
+    // An io_uring send in flight
+    struct Operation {
+        Waiter waiter;
+        int result = 0;
+    };
+
+    struct Timer {
+        TimePoint deadline;
+        uint64_t id;
+        bool operator>(const Timer &other) const { return deadline > other.deadline; }
+    };
+
+    void register_wait(Waiter &waiter, int fd, bool for_write, TimePoint deadline, bool cancellable);
+    void update_interest(int fd);
+    void arm_receive(int fd, FdEntry &entry);
+    void handle_completion(uint64_t user_data, int32_t result, uint32_t flags);
+    std::optional<Clock::duration> poll_timeout(bool block);
+    void poll(bool block);
+    void expire_timers();
+    void sweep_spawned();
+
+    int epoll_fd_ = -1;
+    std::unique_ptr<IoRing> ring_;
+    bool multishot_receive_ = true;
+    TimePoint deadline_ = TimePoint::max();
+    uint64_t next_id_ = 0;
+    std::unordered_map<uint64_t, Waiter *> waiters_;
+    std::unordered_map<int, FdEntry> fds_;
+    std::unordered_map<uint64_t, int> receive_ops_;  // armed io_uring receive -> fd
+    std::unordered_map<uint64_t, Operation *> operations_;
+    std::vector<Timer> timers_;  // min-heap on deadline
+    std::deque<std::coroutine_handle<>> ready_;
+    std::list<Task<void>> spawned_;
+};
+
+} // namespace cli
+
+#endif  // EVENT_LOOP_HPP
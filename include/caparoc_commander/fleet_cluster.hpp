@@ -0,0 +1,161 @@
+#ifndef FLEET_CLUSTER_HPP
+#define FLEET_CLUSTER_HPP
+
+#include "caparoc_commander/device_error.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cli {
+
+/// Default UDP endpoint of a --cluster-poll instance
+inline constexpr const char *CLUSTER_DEFAULT_BIND = "127.0.0.1:7400";
+
+/**
+ * @brief Assigns keys to members by consistent hashing
+ *
+ * Every member is placed on a 64-bit ring at virtual_nodes points, and a key
+ * belongs to the member of the first point at or after the key's hash. When
+ * a member joins or leaves, only the keys on its arcs move, about 1/N of
+ * them; the rest keep their owner. The hash (FNV-1a with a final mix) does
+ * not depend on the platform or the build, so every instance computes the
+ * same assignment from the same member list.
+ */
+class HashRing {
+public:
+    explicit HashRing(std::size_t virtual_nodes = 64);
+
+    /// Replace the members; duplicates are ignored
+    void set_members(std::vector<std::string> members);
+
+    /// Owner of @p key, empty without members
+    const std::string &owner(std::string_view key) const;
+
+    /// Sorted
+    const std::vector<std::string> &members() const { return members_; }
+
+private:
+    std::size_t virtual_nodes_;
+    std::vector<std::string> members_;
+    std::vector<std::pair<uint64_t, std::size_t>> points_;  // sorted by hash, index into members_
+};
+
+/// Hash of HashRing, exposed for tests and tooling
+uint64_t ring_hash(std::string_view text);
+
+struct ClusterSettings {
+    std::string bind = CLUSTER_DEFAULT_BIND;   // IPv4:PORT, also the member's name
+    std::vector<std::string> seeds;            // IPv4:PORT of other members to contact first
+    std::chrono::milliseconds heartbeat{500};
+    std::chrono::milliseconds expiry{2000};    // silence after which a member counts as gone
+};
+
+/**
+ * @brief Membership of a poller cluster, from UDP heartbeats
+ *
+ * Every member sends a datagram to every member it knows, once per
+ * heartbeat interval:
+ *
+ *     CAPAROC-CLUSTER 1 HELLO <self> <member> <member> ...
+ *
+ * listing the members it currently hears. The list is gossip: a receiver
+ * starts sending heartbeats to members it learns of this way, so a new
+ * instance only needs one seed. A member counts as present only once its
+ * own heartbeat arrived, and as gone after expiry without one. Leaving
+ * sends "CAPAROC-CLUSTER 1 BYE <self>", so the others rebalance at once
+ * rather than after the expiry. No further coordination is needed: all
+ * members that hear each other compute the same HashRing.
+ *
+ * Linux only; elsewhere the constructor throws std::runtime_error.
+ */
+class ClusterMembership {
+public:
+    /// @throws std::invalid_argument for malformed endpoints, std::runtime_error if the port cannot be bound
+    explicit ClusterMembership(ClusterSettings settings);
+
+    /// Says BYE to every known member
+    ~ClusterMembership();
+
+    ClusterMembership(const ClusterMembership &) = delete;
+    ClusterMembership &operator=(const ClusterMembership &) = delete;
+
+    /**
+     * @brief Send heartbeats when due, receive those of the others and expire silent members
+     *
+     * Waits at most @p wait for datagrams.
+     *
+     * @return true if the set of members changed
+     */
+    bool service(std::chrono::milliseconds wait);
+
+    /// Present members including this one, sorted
+    std::vector<std::string> members() const;
+
+    const std::string &self() const { return settings_.bind; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Peer {
+        Clock::time_point heard{};      // last heartbeat of its own
+        Clock::time_point mentioned{};  // last time it was a seed or in someone's list
+        bool present = false;
+        bool seed = false;
+    };
+
+    void send_to(const std::string &endpoint, const std::string &message);
+    bool receive(Clock::time_point now);
+    bool expire(Clock::time_point now);
+
+    ClusterSettings settings_;
+    int fd_ = -1;
+    std::map<std::string, Peer> peers_;
+    Clock::time_point next_heartbeat_{};
+};
+
+/**
+ * @brief Appends lines to a file shared by several processes
+ *
+ * The file is opened with O_APPEND and every line is written with a single
+ * write(), so lines of concurrent writers, threads or processes on the same
+ * machine, never interleave.
+ */
+class AppendSink {
+public:
+    /// @throws std::runtime_error if the file cannot be opened
+    explicit AppendSink(const std::string &path);
+    ~AppendSink();
+
+    AppendSink(const AppendSink &) = delete;
+    AppendSink &operator=(const AppendSink &) = delete;
+
+    /// Thread-safe; appends '\n'. false if the write failed or was short.
+    bool write_line(std::string line);
+
+private:
+    int fd_ = -1;
+};
+
+/**
+ * @brief One JSON line of the cluster sink
+ *
+ *     {"device":"HOST:PORT","poller":"IPv4:PORT","system":{...},"modules":[{...},...]}
+ *
+ * with the objects of rack_system_json() and rack_module_json(), the same
+ * as the MQTT payloads.
+ */
+std::string format_cluster_record(std::string_view device, std::string_view poller, const RackSnapshot &snapshot);
+
+/// {"device":"HOST:PORT","poller":"IPv4:PORT","ts":ms,"error":"..."}
+std::string format_cluster_error(std::string_view device, std::string_view poller, uint64_t timestamp_ns, const DeviceError &error);
+
+} // namespace cli
+
+#endif  // FLEET_CLUSTER_HPP
@@ -0,0 +1,164 @@
+#ifndef FLEET_HEALTH_HPP
+#define FLEET_HEALTH_HPP
+
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Binary max-heap of scores that are updated in place
+ *
+ * Holds ids 0 .. capacity - 1, each at most once, with a position index, so
+ * changing the score of an id sifts it in O(log n) instead of rebuilding
+ * the heap. top() walks the heap with a second, small heap of candidates:
+ * the k highest scores cost O(k log k), independent of the number of ids.
+ */
+class ScoreHeap {
+public:
+    explicit ScoreHeap(std::size_t capacity);
+
+    /// Insert @p id, or move it to its new @p score
+    void update(uint32_t id, double score);
+
+    bool contains(uint32_t id) const { return position_[id] != ABSENT; }
+    std::size_t size() const { return heap_.size(); }
+
+    /// Ids of the @p k highest scores, highest first
+    std::vector<uint32_t> top(std::size_t k) const;
+
+private:
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+
+    struct Entry {
+        double score;
+        uint32_t id;
+    };
+
+    void sift_up(std::size_t index);
+    void sift_down(std::size_t index);
+    void place(std::size_t index, Entry entry);
+
+    std::vector<Entry> heap_;
+    std::vector<uint32_t> position_;  // index into heap_ per id, ABSENT if not inserted
+};
+
+/**
+ * @brief Decayed statistics of one channel, fixed size
+ *
+ * A trip is a poll that shows a fault bit (overload, short circuit,
+ * hardware or voltage error) the previous poll of the channel did not, a
+ * warning one that newly shows WARNING_80_PERCENT. The rates are
+ * exponentially decayed counts: an event weighs half as much after one
+ * half-life, and count x ln 2 / half-life estimates the events per hour
+ * once a channel has been polled for a few half-lives.
+ */
+struct ChannelHealth {
+    uint64_t last_ns = 0;          // time of the last valid poll, 0 before the first
+    uint64_t observed_ns = 0;      // time covered by polls
+    uint64_t near_nominal_ns = 0;  // of which with WARNING_80_PERCENT
+    uint32_t polls = 0;
+    uint32_t trips = 0;
+    uint32_t warnings = 0;
+    uint16_t last_flags = 0;       // channel_flag::* of the last valid poll
+    uint16_t tripped_flags = 0;    // fault bits of all trips
+    float trip_count = 0.0f;       // decayed
+    float warning_count = 0.0f;    // decayed
+    float near_nominal = 0.0f;     // decayed fraction of time with WARNING_80_PERCENT
+    float score = 0.0f;
+};
+
+static_assert(sizeof(ChannelHealth) == 56);
+
+/// Decayed statistics of one device
+struct DeviceHealth {
+    uint64_t last_ns = 0;
+    uint32_t polls = 0;
+    uint32_t failures = 0;
+    float failed = 0.0f;           // decayed fraction of failed polls
+    double channel_score = 0.0;    // sum of the scores of its channels
+    double score = 0.0;
+};
+
+struct HealthSettings {
+    std::chrono::seconds half_life{std::chrono::hours(6)};
+    std::chrono::milliseconds max_gap{std::chrono::minutes(1)};  // longer gaps between polls do not count as observed time
+};
+
+/// One line of a ranking
+struct ChannelRank {
+    std::size_t device = 0;
+    uint8_t module = 0;   // 1-based
+    uint8_t channel = 0;  // 1-based
+    double trips_per_hour = 0.0;
+    ChannelHealth health;
+};
+
+struct DeviceRank {
+    std::size_t device = 0;
+    DeviceHealth health;
+};
+
+/**
+ * @brief Incremental health scores of every channel of a fleet
+ *
+ * Each poll updates the statistics of the channels it read and their
+ * place in a heap of all channels, and likewise of its device, so a
+ * ranking never rescans the fleet. Memory is fixed at construction:
+ * RACK_MAX_MODULES x RACK_MAX_CHANNELS ChannelHealth per device.
+ *
+ * Channel score: 10 per trip per hour, 1 per warning per hour, up to 5 for
+ * the time spent near nominal current, and 20 while a fault bit is set.
+ * Device score: the sum of its channel scores and up to 20 for failed
+ * polls. Scores only decay while a channel is being polled, so those of an
+ * unreachable device stay as they were.
+ *
+ * Not thread-safe.
+ */
+class FleetHealth {
+public:
+    FleetHealth(std::size_t device_count, HealthSettings settings);
+
+    /// Add one poll of @p device; channels without channel_flag::VALID are skipped
+    void add(std::size_t device, const RackSnapshot &snapshot);
+
+    /// Record a poll of @p device that failed at @p timestamp_ns
+    void add_failure(std::size_t device, uint64_t timestamp_ns);
+
+    /// The @p k channels with the highest scores, of those polled at least once
+    std::vector<ChannelRank> worst_channels(std::size_t k) const;
+
+    /// The @p k devices with the highest scores, of those polled at least once
+    std::vector<DeviceRank> worst_devices(std::size_t k) const;
+
+    std::size_t device_count() const { return devices_.size(); }
+
+    /// Channels polled at least once
+    std::size_t channel_count() const { return channel_heap_.size(); }
+
+private:
+    static constexpr std::size_t SLOTS = RACK_MAX_MODULES * RACK_MAX_CHANNELS;
+
+    double decay(uint64_t elapsed_ns) const;
+    double per_hour(double decayed_count) const;
+    void update_device(std::size_t device);
+
+    double half_life_ns_;
+    uint64_t max_gap_ns_;
+    std::vector<ChannelHealth> channels_;  // SLOTS per device
+    std::vector<DeviceHealth> devices_;
+    ScoreHeap channel_heap_;
+    ScoreHeap device_heap_;
+};
+
+/// Rankings as human-readable tables; @p endpoints names the devices by index
+std::string format_health_ranking(const FleetHealth &health, const std::vector<std::string> &endpoints, std::size_t k);
+
+} // namespace cli
+
+#endif  // FLEET_HEALTH_HPP
@@ -0,0 +1,121 @@
+#ifndef INVENTORY_HPP
+#define INVENTORY_HPP
+
+#include "caparoc_commander/device_error.hpp"
+#include "libmodbus_cpp/modbus_connection.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/// Identifies a caparoc_commander inventory file ("CPIV")
+inline constexpr uint32_t INVENTORY_MAGIC = 0x43504956;
+
+/// Incremented whenever the layout of the inventory file changes
+inline constexpr uint16_t INVENTORY_FORMAT_VERSION = 1;
+
+struct InventoryModule {
+    uint8_t position = 0;  // 1-based slot next to the power module
+    uint8_t channels = 0;
+    std::string product_name;  // empty if it could not be read
+};
+
+struct InventoryDevice {
+    std::string endpoint;  // HOST or HOST:PORT as given with -i
+    std::string power_module_name;
+    std::vector<InventoryModule> modules;
+    uint64_t checked_ns = 0;        // last successful contact, nanoseconds since the Unix epoch
+    uint64_t topology_read_ns = 0;  // last full read of the product names
+    bool reachable = true;          // false if the last refresh could not reach the device
+};
+
+/**
+ * @brief What is installed where, for a fleet of devices
+ *
+ * On disk the inventory is a single file of fixed-size records in host byte
+ * order, so it can be mapped and indexed without parsing: a 24-byte header
+ * (magic: u32, version: u16, reserved: u16, device count: u32, module
+ * count: u32, saved_ns: u64), then one 128-byte record per device and one
+ * 48-byte record per module, the modules of each device contiguous and in
+ * slot order. Strings are NUL-padded.
+ */
+struct Inventory {
+    std::vector<InventoryDevice> devices;  // sorted by endpoint
+
+    const InventoryDevice *find(std::string_view endpoint) const;
+
+    /// Insert @p device or replace the entry with the same endpoint
+    void update(InventoryDevice device);
+};
+
+/**
+ * @brief Read an inventory file
+ *
+ * @return An empty inventory if @p path does not exist
+ * @throws std::runtime_error if the file is not an inventory or is truncated
+ */
+Inventory load_inventory(const std::string &path);
+
+/**
+ * @brief Write an inventory file, replacing @p path atomically
+ *
+ * @throws std::runtime_error if the file cannot be written
+ */
+void save_inventory(const Inventory &inventory, const std::string &path);
+
+enum class RefreshOutcome {
+    UNCHANGED,   // module count as recorded, nothing else read
+    ADDED,       // device was not in the inventory
+    CHANGED,     // module count differed (or a full read was forced); topology re-read
+    UNREACHABLE  // connect or a read failed; the recorded topology is kept
+};
+
+struct InventoryRefresh {
+    InventoryDevice device;  // the new entry, or the recorded one for UNREACHABLE
+    RefreshOutcome outcome = RefreshOutcome::UNREACHABLE;
+    std::size_t reads = 0;   // register reads issued
+    std::optional<DeviceError> error;  // why the device was unreachable
+    std::string message;     // what failed, or why the device was rejected
+    std::chrono::microseconds elapsed{0};
+};
+
+/**
+ * @brief Bring the inventory entry of one device up to date
+ *
+ * Reads the number of connected modules first. Only if it differs from the
+ * recorded one, the device is new or @p full is set, the power module name
+ * and the product names of all modules are read and the channel layout is
+ * derived from them. A module swapped for another type in the same slot is
+ * therefore only noticed by a full refresh.
+ *
+ * @param known Recorded entry of the device, nullptr if there is none
+ */
+InventoryRefresh refresh_inventory_device(libmodbus_cpp::ModbusConnection &conn, std::string endpoint, const InventoryDevice *known, bool full);
+
+std::string_view to_string(RefreshOutcome outcome);
+
+struct InventoryMatch {
+    const InventoryDevice *device;
+    const InventoryModule *module;
+};
+
+/**
+ * @brief All modules whose product name contains @p product_filter
+ *
+ * Case-insensitive; an empty filter matches every module. Results are in
+ * inventory order (by endpoint, then slot).
+ */
+std::vector<InventoryMatch> find_modules(const Inventory &inventory, std::string_view product_filter);
+
+/// Human-readable listing of all devices and their modules
+std::string format_inventory(const Inventory &inventory);
+
+} // namespace cli
+
+#endif  // INVENTORY_HPP
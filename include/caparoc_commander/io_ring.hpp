@@ -0,0 +1,123 @@
+#ifndef IO_RING_HPP
+#define IO_RING_HPP
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <optional>
+#include <span>
+
+namespace cli {
+
+/**
+ * @brief io_uring instance with a pool of provided receive buffers
+ *
+ * Uses the system calls directly, there is no liburing dependency.
+ *
+ * prepare() only fills in a submission queue entry; the kernel sees all
+ * prepared entries at the next submit_and_wait(), in one io_uring_enter().
+ *
+ * BUFFER_COUNT buffers of BUFFER_SIZE bytes are handed to the kernel as
+ * buffer group BUFFER_GROUP. A receive submitted with IOSQE_BUFFER_SELECT
+ * takes a buffer only once data has arrived, so idle sockets hold none, and
+ * a multishot receive keeps filling buffers until it is cancelled. Hand every
+ * buffer named in a completion back with recycle(); that is one more entry
+ * in the next submission, not a system call of its own.
+ *
+ * Needs Linux 5.11 (wait timeouts in io_uring_enter()). Not thread-safe.
+ */
+class IoRing {
+public:
+    static constexpr unsigned BUFFER_COUNT = 256;  // a power of two
+    static constexpr std::size_t BUFFER_SIZE = 4096;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+
+    /**
+     * @param entries Size of the submission queue; the completion queue is eight times larger
+     * @throws std::runtime_error if the kernel does not provide io_uring or one of the features above
+     */
+    explicit IoRing(unsigned entries);
+    ~IoRing();
+
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    /// Zeroed entry for @p opcode on @p fd; submits the prepared ones first if the queue is full
+    io_uring_sqe &prepare(uint8_t opcode, int fd, uint64_t user_data);
+
+    /**
+     * @brief Submit the prepared entries and wait for completions
+     *
+     * @param wait_for Completions to wait for, 0 to only submit
+     * @param timeout Longest wait, std::nullopt for no limit
+     */
+    void submit_and_wait(unsigned wait_for, std::optional<std::chrono::nanoseconds> timeout);
+
+    /// Call @p handler(user_data, res, flags) for every completion available, except the ring's own
+    template <typename Handler>
+    void drain(Handler handler)
+    {
+        std::atomic_ref<unsigned> head_ref(*cq_head_);
+        std::atomic_ref<unsigned> tail_ref(*cq_tail_);
+        auto head = head_ref.load(std::memory_order_relaxed);
+        while (head != tail_ref.load(std::memory_order_acquire))
+        {
+            auto cqe = cqes_[head & *cq_mask_];
+            // Released before the handler runs, which may prepare new entries.
+            head_ref.store(++head, std::memory_order_release);
+            if (cqe.user_data < AWAITED)
+            {
+                handler(cqe.user_data, cqe.res, cqe.flags);
+            }
+        }
+    }
+
+    /// Data of provided buffer @p id, as reported by a completion
+    std::span<const uint8_t> buffer(uint16_t id, std::size_t length) const;
+
+    /// Hand provided buffer @p id back to the kernel
+    void recycle(uint16_t id);
+
+private:
+    // user_data of the ring's own requests, which drain() skips
+    static constexpr uint64_t RECYCLED = UINT64_MAX;
+    static constexpr uint64_t AWAITED = UINT64_MAX - 1;
+
+    void provide_buffers(uint16_t first, unsigned count, uint64_t user_data);
+    std::optional<int32_t> await_own();
+    void release();
+
+    int fd_ = -1;
+    void *sq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void *cq_ring_ = nullptr;  // == sq_ring_ with IORING_FEAT_SINGLE_MMAP
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    unsigned sq_local_tail_ = 0;  // includes prepared, not yet submitted entries
+
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+
+    uint8_t *buffers_ = nullptr;
+    std::size_t buffers_size_ = 0;
+    bool buffers_provided_ = false;
+};
+
+} // namespace cli
+
+#endif
+
+#endif  // IO_RING_HPP
@@ -0,0 +1,183 @@
+#ifndef LOAD_STATISTICS_HPP
+#define LOAD_STATISTICS_HPP
+
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Count, mean, variance and range of a series in O(1) memory
+ *
+ * Welford's update per value; two instances are combined with the
+ * parallel formula of Chan et al., so per-pane results can be merged into
+ * a window without revisiting the values.
+ */
+struct RunningStats {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;  // sum of squared differences from the mean
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void add(double value);
+    void merge(const RunningStats &other);
+
+    /// Sample standard deviation, 0 for fewer than two values
+    double stddev() const;
+};
+
+/**
+ * @brief Quantiles of a series with bounded relative error (DDSketch)
+ *
+ * Values are counted in logarithmically sized buckets, so every quantile is
+ * returned within @p relative_accuracy of a value of the series. The buckets
+ * cover [min_value, max_value] in a fixed array: values below min_value are
+ * counted as 0, values above max_value fall into the last bucket. Memory is
+ * therefore fixed at construction however many values are added, and
+ * sketches with the same parameters merge by adding their counts.
+ */
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double relative_accuracy = 0.01, double min_value = 1.0, double max_value = 65535.0);
+
+    void add(double value);
+    void merge(const QuantileSketch &other);
+    void clear();
+
+    /// Value at quantile @p q in [0, 1]; 0 for an empty sketch
+    double quantile(double q) const;
+
+    uint64_t count() const { return count_; }
+
+private:
+    int key(double value) const;
+
+    double gamma_;
+    double log_gamma_;
+    double min_value_;
+    int first_key_;
+    uint64_t count_ = 0;
+    uint64_t zero_count_ = 0;
+    std::vector<uint32_t> buckets_;
+};
+
+/// Statistics of one series over a window
+struct LoadSummary {
+    uint64_t count = 0;
+    double min = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+struct ChannelLoadSummary {
+    uint8_t module = 0;
+    uint8_t channel = 0;
+    LoadSummary current_a;
+    double energy_wh = 0.0;  // load current x input voltage over time
+};
+
+/**
+ * @brief Results of one window
+ */
+struct LoadWindow {
+    uint64_t start_ns = 0;  // nanoseconds since the Unix epoch
+    uint64_t end_ns = 0;
+    bool partial = false;   // the window was cut short (publisher stopped)
+    uint64_t polls = 0;
+    LoadSummary input_voltage_v;
+    LoadSummary total_current_a;
+    double energy_wh = 0.0;  // total system current x input voltage over time
+    std::vector<ChannelLoadSummary> channels;  // channels with samples, in rack order
+};
+
+/**
+ * @brief Streaming per-channel load statistics over tumbling or sliding windows
+ *
+ * Windows are @p window long and a result is produced every @p slide; with
+ * slide == window they are tumbling. Both are aligned to multiples of their
+ * length since the Unix epoch (UTC), so 8 h windows end at 00:00, 08:00 and
+ * 16:00. Internally the samples are kept in window / slide panes of
+ * mergeable statistics, so memory per channel depends only on that ratio.
+ *
+ * Energy is integrated per sample over the time since the previous valid
+ * sample of the same series; gaps longer than @p max_gap (e.g. while the
+ * device was unreachable) are not integrated.
+ */
+class LoadAggregator {
+public:
+    /// Maximum window / slide ratio
+    static constexpr std::size_t MAX_PANES = 120;
+
+    /**
+     * @throws std::invalid_argument unless window is a multiple of slide
+     *         with at most MAX_PANES panes
+     */
+    LoadAggregator(std::chrono::seconds window, std::chrono::seconds slide, std::chrono::milliseconds max_gap);
+
+    /// Add one poll; returns the windows it completed, usually none
+    std::vector<LoadWindow> add(const RackSnapshot &snapshot);
+
+    /// The window in progress, marked partial; std::nullopt before the first poll
+    std::optional<LoadWindow> current() const;
+
+private:
+    struct Series {
+        RunningStats moments;
+        QuantileSketch sketch;
+        double energy_wh = 0.0;
+
+        explicit Series(double relative_accuracy, double min_value, double max_value)
+            : sketch(relative_accuracy, min_value, max_value) {}
+
+        void merge(const Series &other);
+        void clear();
+    };
+
+    struct Pane {
+        uint64_t polls = 0;
+        Series input_voltage_v;
+        Series total_current_a;
+        std::vector<Series> channels;  // RACK_MAX_MODULES x RACK_MAX_CHANNELS
+
+        Pane();
+        void merge(const Pane &other);
+        void clear();
+    };
+
+    LoadWindow summarize(uint64_t start_ns, uint64_t end_ns, bool partial) const;
+    void advance_to(uint64_t timestamp_ns, std::vector<LoadWindow> &completed);
+
+    uint64_t window_ns_;
+    uint64_t slide_ns_;
+    uint64_t max_gap_ns_;
+    std::vector<Pane> panes_;  // ring, panes_[head_] is the current pane
+    std::size_t head_ = 0;
+    uint64_t pane_start_ns_ = 0;  // 0 until the first poll
+    uint64_t last_timestamp_ns_ = 0;
+    double last_voltage_v_ = 0.0;
+    uint64_t last_total_ns_ = 0;
+    std::array<uint64_t, RACK_MAX_MODULES * RACK_MAX_CHANNELS> last_channel_ns_{};
+};
+
+/// Window as a single line of JSON
+std::string format_load_window_json(const LoadWindow &window);
+
+/// Window as a human-readable table
+std::string format_load_window(const LoadWindow &window);
+
+} // namespace cli
+
+#endif  // LOAD_STATISTICS_HPP
@@ -0,0 +1,127 @@
+#ifndef MODBUS_FRAME_HPP
+#define MODBUS_FRAME_HPP
+
+#include "caparoc_commander/coil_bitset.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Modbus function codes used by the raw Modbus TCP frame layer
+ */
+enum class FunctionCode : uint8_t {
+    READ_COILS = 0x01,
+    READ_HOLDING_REGISTERS = 0x03,
+    WRITE_SINGLE_COIL = 0x05,
+    WRITE_SINGLE_REGISTER = 0x06,
+    WRITE_MULTIPLE_COILS = 0x0F,
+    WRITE_MULTIPLE_REGISTERS = 0x10
+};
+
+/// Size of the MBAP header (transaction id, protocol id, length, unit id)
+inline constexpr std::size_t MBAP_HEADER_LENGTH = 7;
+
+/// Largest ADU allowed by the Modbus TCP specification
+inline constexpr std::size_t MAX_ADU_LENGTH = 260;
+
+/// Largest number of holding registers a single FC 3 request may return
+inline constexpr uint16_t MAX_READ_REGISTERS = 125;
+
+/// Largest number of coils a single FC 1 request may return
+inline constexpr uint16_t MAX_READ_COILS = 2000;
+
+/// Largest number of coils a single FC 15 request may write
+inline constexpr uint16_t MAX_WRITE_COILS = 1968;
+
+/// Number of registers occupied by a CAPAROC STRING32 value
+inline constexpr uint16_t STRING32_REGISTER_COUNT = 16;
+
+/**
+ * @brief Build a "read holding registers" (FC 3) request ADU
+ *
+ * @param transaction_id MBAP transaction identifier echoed by the device
+ * @param unit_id Modbus unit identifier
+ * @param address First register address
+ * @param count Number of registers (1-125)
+ * @return std::vector<uint8_t> Complete request ADU
+ */
+std::vector<uint8_t> encode_read_holding_registers(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t count);
+
+/**
+ * @brief Build a "write single register" (FC 6) request ADU
+ */
+std::vector<uint8_t> encode_write_single_register(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t value);
+
+/**
+ * @brief Build a "write multiple registers" (FC 16) request ADU
+ */
+std::vector<uint8_t> encode_write_multiple_registers(uint16_t transaction_id, uint8_t unit_id, uint16_t address, std::span<const uint16_t> values);
+
+/**
+ * @brief Build a "read coils" (FC 1) request ADU
+ *
+ * @param count Number of coils (1-2000)
+ */
+std::vector<uint8_t> encode_read_coils(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t count);
+
+/**
+ * @brief Build a "write multiple coils" (FC 15) request ADU
+ *
+ * @param coils Coil states starting at @p address (1-1968 coils), sent bit-packed
+ */
+std::vector<uint8_t> encode_write_multiple_coils(uint16_t transaction_id, uint8_t unit_id, uint16_t address, const CoilBitset &coils);
+
+/**
+ * @brief Determine whether a receive buffer holds a complete ADU
+ *
+ * @param buffer Bytes received so far, starting at an MBAP header
+ * @return std::size_t Length of the first complete ADU, or 0 if more bytes are needed
+ */
+std::size_t complete_adu_length(std::span<const uint8_t> buffer);
+
+/**
+ * @brief Read the MBAP transaction identifier of an ADU
+ */
+uint16_t adu_transaction_id(std::span<const uint8_t> adu);
+
+/**
+ * @brief Decode the register values of a FC 3 response ADU
+ *
+ * @param adu Complete response ADU
+ * @return std::optional<std::vector<uint16_t>> Register values, or std::nullopt
+ *         for exception responses and malformed frames
+ */
+std::optional<std::vector<uint16_t>> decode_read_registers_response(std::span<const uint8_t> adu);
+
+/**
+ * @brief Decode the coil states of a FC 1 response ADU
+ *
+ * @param adu Complete response ADU
+ * @param count Number of coils that were requested
+ * @return std::optional<CoilBitset> Coil states, or std::nullopt for exception
+ *         responses and frames too short for @p count coils
+ */
+std::optional<CoilBitset> decode_read_coils_response(std::span<const uint8_t> adu, uint16_t count);
+
+/**
+ * @brief Check that a response ADU acknowledges a write request (FC 6, 15 or 16)
+ */
+bool is_write_acknowledged(std::span<const uint8_t> adu, FunctionCode function_code);
+
+/**
+ * @brief Convert STRING32 register contents into a string
+ *
+ * Each register holds two characters, high byte first. Trailing NUL and
+ * space characters are removed.
+ */
+std::string decode_string_registers(std::span<const uint16_t> registers);
+
+} // namespace cli
+
+#endif  // MODBUS_FRAME_HPP
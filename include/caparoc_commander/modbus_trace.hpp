@@ -0,0 +1,94 @@
+#ifndef MODBUS_TRACE_HPP
+#define MODBUS_TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/// Identifies a caparoc_commander Modbus trace file ("CPTR")
+inline constexpr uint32_t TRACE_MAGIC = 0x43505452;
+
+/// Incremented whenever the file or record layout changes
+inline constexpr uint16_t TRACE_FORMAT_VERSION = 1;
+
+/**
+ * @brief Kind of a trace record
+ */
+enum class TraceRecordKind : uint8_t {
+    OPEN = 0,      // a connection was opened; payload is the device "HOST:PORT"
+    REQUEST = 1,   // complete request ADU sent to the device
+    RESPONSE = 2,  // complete response ADU received from the device
+    CLOSE = 3      // the connection was closed; empty payload
+};
+
+/**
+ * @brief One record of a trace
+ *
+ * On disk every record is a 14-byte little-endian header (time_ns: u64,
+ * stream: u16, kind: u8, reserved: u8, length: u16) followed by the payload.
+ */
+struct TraceRecord {
+    uint64_t time_ns = 0;  // since the start of the capture
+    uint16_t stream = 0;   // connection number, unique within the trace
+    TraceRecordKind kind = TraceRecordKind::OPEN;
+    std::vector<uint8_t> data;
+};
+
+struct ModbusTrace {
+    uint64_t start_time_ns = 0;  // system_clock time of the first record
+    std::vector<TraceRecord> records;
+};
+
+/**
+ * @brief Appends records to a trace file
+ *
+ * The file starts with a 16-byte header (magic: u32, version: u16,
+ * reserved: u16, start_time_ns: u64). Record timestamps are taken from a
+ * steady clock relative to the construction of the writer. May be shared
+ * between threads.
+ *
+ * @throws std::runtime_error if the file cannot be created
+ */
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string &path);
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    /// Reserve a stream number for a new connection.
+    uint16_t open_stream(std::string_view endpoint);
+    void write(uint16_t stream, TraceRecordKind kind, std::span<const uint8_t> data);
+    void close_stream(uint16_t stream);
+
+    const std::string &path() const { return path_; }
+    std::size_t records_written() const;
+
+private:
+    std::string path_;
+    std::ofstream file_;
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    uint16_t next_stream_ = 0;
+    std::size_t records_ = 0;
+};
+
+/**
+ * @brief Load a trace written by TraceWriter
+ *
+ * A truncated last record (e.g. from a capture that was killed) is ignored.
+ *
+ * @throws std::runtime_error if the file cannot be read or is not a trace
+ */
+ModbusTrace read_trace(const std::string &path);
+
+} // namespace cli
+
+#endif  // MODBUS_TRACE_HPP
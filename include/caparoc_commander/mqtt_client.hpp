@@ -0,0 +1,113 @@
+#ifndef MQTT_CLIENT_HPP
+#define MQTT_CLIENT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cli {
+
+/// Default port of an MQTT broker without TLS
+inline constexpr int MQTT_DEFAULT_PORT = 1883;
+
+struct MqttMessage {
+    std::string topic;
+    std::string payload;  // binary-safe
+    uint8_t qos = 0;      // 0 or 1
+    bool retain = false;
+};
+
+/**
+ * @brief Minimal publish-only MQTT 3.1.1 client
+ *
+ * Speaks just enough of the protocol to publish with QoS 0 or 1: CONNECT
+ * (clean session, with a last will), PUBLISH, PUBACK, PINGREQ and
+ * DISCONNECT. Nothing is subscribed to. Published packets are collected in
+ * an output buffer and written with as few send() calls as possible; call
+ * flush() or service() to push them out.
+ *
+ * QoS 1 messages stay in flight until the broker acknowledges them. At most
+ * MAX_INFLIGHT are outstanding; publish() waits for acknowledgements beyond
+ * that. After a connection loss take_unacknowledged() returns them so they
+ * can be sent again.
+ *
+ * Any socket or protocol error closes the connection; the reason is kept
+ * in last_error(). Only available on Linux, elsewhere connect() fails.
+ */
+class MqttClient {
+public:
+    static constexpr std::size_t MAX_INFLIGHT = 64;
+
+    MqttClient(std::string host, int port, std::string client_id, uint16_t keepalive_seconds);
+    ~MqttClient();
+
+    MqttClient(const MqttClient &) = delete;
+    MqttClient &operator=(const MqttClient &) = delete;
+
+    /**
+     * @brief Open the connection and wait for the broker to accept it
+     *
+     * @param will Published by the broker if the connection is lost without DISCONNECT
+     */
+    bool connect(const MqttMessage &will, int timeout_seconds);
+
+    bool connected() const { return fd_ >= 0; }
+
+    /// Queue one message for sending; false if the connection failed
+    bool publish(const MqttMessage &message);
+
+    /// Send everything buffered by publish(); false if the connection failed
+    bool flush();
+
+    /**
+     * @brief Flush, read acknowledgements and keep the connection alive
+     *
+     * Waits at most @p wait for data from the broker.
+     * @return false if the connection failed
+     */
+    bool service(std::chrono::milliseconds wait);
+
+    std::size_t inflight() const { return inflight_.size(); }
+
+    /// QoS 1 messages of a lost connection that were never acknowledged, oldest first
+    std::vector<MqttMessage> take_unacknowledged();
+
+    /// Send DISCONNECT (the broker discards the will) and close the socket
+    void disconnect();
+
+    const std::string &last_error() const { return last_error_; }
+
+    /// Bytes written to the broker since construction
+    uint64_t bytes_sent() const { return bytes_sent_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool send_buffered();
+    bool read_packets(std::chrono::milliseconds wait);
+    bool fail(std::string error);
+
+    std::string host_;
+    int port_;
+    std::string client_id_;
+    uint16_t keepalive_seconds_;
+
+    int fd_ = -1;
+    std::vector<uint8_t> output_;
+    std::vector<uint8_t> input_;
+    uint16_t next_packet_id_ = 1;
+    std::deque<std::pair<uint16_t, MqttMessage>> inflight_;  // packet id and message, oldest first
+    Clock::time_point last_sent_{};
+    Clock::time_point ping_sent_{};
+    bool ping_outstanding_ = false;
+    uint64_t bytes_sent_ = 0;
+    std::string last_error_;
+};
+
+} // namespace cli
+
+#endif  // MQTT_CLIENT_HPP
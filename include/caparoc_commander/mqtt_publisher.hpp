@@ -0,0 +1,143 @@
+#ifndef MQTT_PUBLISHER_HPP
+#define MQTT_PUBLISHER_HPP
+
+#include "caparoc_commander/mqtt_client.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+
+namespace cli {
+
+/// Identifies a caparoc_commander MQTT offline queue file ("CPMQ")
+inline constexpr uint32_t MQTT_QUEUE_MAGIC = 0x43504D51;
+
+/// Incremented whenever the layout of the queue file changes
+inline constexpr uint16_t MQTT_QUEUE_FORMAT_VERSION = 1;
+
+/// Whether --mqtt-compress is available (zlib was found at build time)
+bool mqtt_compression_supported();
+
+struct MqttPublisherSettings {
+    std::string host;
+    int port = MQTT_DEFAULT_PORT;
+    std::string client_id;
+    std::string topic_prefix;         // topics are PREFIX/state, PREFIX/system, PREFIX/module/N
+    uint8_t qos = 0;                  // of the measurement messages; the state topic always uses 1
+    int batch = 1;                    // polls collected into one message per topic
+    int full_every = 0;               // publish every topic each N polls, 0 = only after (re)connecting
+    uint16_t deadband_ma = 0;         // load current change that counts as a change
+    bool compress = false;            // zlib-compress payloads
+    std::string queue_file;           // persists the offline queue, empty = memory only
+    std::size_t queue_limit = 10000;  // messages; the oldest are dropped beyond it
+    int connect_timeout_seconds = 5;
+    uint16_t keepalive_seconds = 30;
+};
+
+struct MqttPublisherStats {
+    uint64_t polls = 0;
+    uint64_t samples = 0;          // topic updates that passed report-by-exception
+    uint64_t messages = 0;         // handed to the broker
+    uint64_t json_bytes = 0;       // payload bytes before compression
+    uint64_t payload_bytes = 0;    // payload bytes as queued
+    uint64_t dropped = 0;          // lost to the queue limit
+    uint32_t connects = 0;
+};
+
+/**
+ * @brief Publishes rack snapshots to an MQTT broker
+ *
+ * Every snapshot is split into a system topic (rack-level values) and one
+ * topic per circuit breaker module. A topic only receives a sample when it
+ * changed since the last sample it received (report by exception): any
+ * flag, module or rack value, or a load current by more than the deadband.
+ * After every (re)connect, and every full_every polls, all topics are sent.
+ *
+ * Samples are collected per topic for @p batch polls and published as one
+ * JSON array, optionally zlib-compressed. A retained "ONLINE" on PREFIX/state
+ * announces the publisher; the broker replaces it with "OFFLINE" (the last
+ * will) if the connection is lost.
+ *
+ * Messages wait in a bounded queue until they are sent. While the broker is
+ * unreachable the queue is appended to the queue file, so it survives a
+ * restart; the oldest messages are dropped beyond the limit. Connecting is
+ * retried with an exponential backoff of up to 30 s. QoS 1 gives
+ * at-least-once delivery across reconnects and restarts, so consumers may
+ * see a message twice.
+ *
+ * @throws std::runtime_error if the queue file cannot be used or compression
+ *         is requested without zlib support
+ */
+class MqttPublisher {
+public:
+    explicit MqttPublisher(MqttPublisherSettings settings);
+
+    /// Sends the pending samples and announces OFFLINE; what cannot be sent stays in the queue file.
+    ~MqttPublisher();
+
+    MqttPublisher(const MqttPublisher &) = delete;
+    MqttPublisher &operator=(const MqttPublisher &) = delete;
+
+    /// Add the samples of one poll
+    void publish(const RackSnapshot &snapshot);
+
+    /**
+     * @brief Connect if due, send queued messages and process acknowledgements
+     *
+     * Waits at most @p wait for the broker, longer only while connecting.
+     */
+    void service(std::chrono::milliseconds wait);
+
+    bool connected() const { return client_.connected(); }
+    std::size_t queued() const { return queue_.size(); }
+    const MqttPublisherStats &stats() const { return stats_; }
+    const std::string &last_error() const { return client_.last_error(); }
+    std::string state_topic() const { return settings_.topic_prefix + "/state"; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Latest reported values and unpublished samples of one topic
+    struct TopicState {
+        bool reported = false;
+        RackSnapshot last{};
+        std::string pending;  // JSON array elements, comma separated
+    };
+
+    bool system_changed(const RackSnapshot &snapshot) const;
+    bool module_changed(const RackSnapshot &snapshot, std::size_t module) const;
+    void add_sample(TopicState &topic, const RackSnapshot &snapshot, std::string sample);
+    void flush_samples();
+    void enqueue(MqttMessage message);
+    bool connect();
+    void lost_connection();
+    void drain();
+    void load_queue_file();
+    void rewrite_queue_file();
+    void append_to_queue_file(const MqttMessage &message);
+    void remove_queue_file();
+
+    MqttPublisherSettings settings_;
+    MqttClient client_;
+    MqttPublisherStats stats_;
+
+    TopicState system_;
+    std::array<TopicState, RACK_MAX_MODULES> modules_;
+    bool full_publish_ = true;
+
+    std::deque<MqttMessage> queue_;
+    std::ofstream queue_out_;
+    std::size_t queue_file_records_ = 0;  // records in the queue file, including dropped ones
+
+    Clock::time_point next_connect_{};
+    std::chrono::seconds backoff_{1};
+};
+
+} // namespace cli
+
+#endif  // MQTT_PUBLISHER_HPP
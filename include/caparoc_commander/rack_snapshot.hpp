@@ -0,0 +1,131 @@
+#ifndef RACK_SNAPSHOT_HPP
+#define RACK_SNAPSHOT_HPP
+
+#include "libmodbus_cpp/modbus_connection.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace cli {
+
+/// A CAPAROC power module carries at most 16 circuit breaker modules ...
+inline constexpr std::size_t RACK_MAX_MODULES = 16;
+/// ... with at most 4 channels each.
+inline constexpr std::size_t RACK_MAX_CHANNELS = 4;
+
+/// Bits of ChannelSnapshot::flags
+namespace channel_flag {
+inline constexpr uint16_t VALID = 1u << 0;  // status and current were read
+inline constexpr uint16_t WARNING_80_PERCENT = 1u << 1;
+inline constexpr uint16_t OVERLOAD = 1u << 2;
+inline constexpr uint16_t SHORT_CIRCUIT = 1u << 3;
+inline constexpr uint16_t HARDWARE_ERROR = 1u << 4;
+inline constexpr uint16_t VOLTAGE_ERROR = 1u << 5;
+inline constexpr uint16_t MODULE_CURRENT_TOO_HIGH = 1u << 6;
+inline constexpr uint16_t SYSTEM_CURRENT_TOO_HIGH = 1u << 7;
+} // namespace channel_flag
+
+/// Bits of RackSnapshot::global_flags
+namespace global_flag {
+inline constexpr uint16_t UNDERVOLTAGE = 1u << 0;
+inline constexpr uint16_t OVERVOLTAGE = 1u << 1;
+inline constexpr uint16_t CUMULATIVE_CHANNEL_ERROR = 1u << 2;
+inline constexpr uint16_t CUMULATIVE_80_WARNING = 1u << 3;
+inline constexpr uint16_t SYSTEM_CURRENT_TOO_HIGH = 1u << 4;
+} // namespace global_flag
+
+/// Bits of RackSnapshot::valid, one per rack-level value
+namespace rack_valid {
+inline constexpr uint16_t MODULE_COUNT = 1u << 0;
+inline constexpr uint16_t GLOBAL_STATUS = 1u << 1;
+inline constexpr uint16_t INPUT_VOLTAGE = 1u << 2;
+inline constexpr uint16_t TOTAL_CURRENT = 1u << 3;
+inline constexpr uint16_t SUM_NOMINAL_CURRENT = 1u << 4;
+inline constexpr uint16_t TEMPERATURE = 1u << 5;
+} // namespace rack_valid
+
+struct ChannelSnapshot {
+    uint16_t load_current_ma;
+    uint16_t flags;  // channel_flag::*
+};
+
+/**
+ * @brief All values of one rack at one point in time
+ *
+ * Fixed layout without pointers, so it can be copied into shared memory or
+ * files as is. Changing it requires bumping SNAPSHOT_LAYOUT_VERSION.
+ */
+struct RackSnapshot {
+    uint64_t timestamp_ns;            // end of the poll, nanoseconds since the Unix epoch
+    uint32_t poll_duration_us;
+    uint16_t valid;                   // rack_valid::*
+    uint16_t module_count;
+    uint16_t input_voltage_cv;        // 1/100 V
+    uint16_t total_current_a;
+    uint16_t sum_nominal_current_a;
+    int16_t temperature_c;
+    uint16_t global_flags;            // global_flag::*
+    uint16_t reserved[3];
+    std::array<uint8_t, RACK_MAX_MODULES> channel_count;
+    std::array<std::array<ChannelSnapshot, RACK_MAX_CHANNELS>, RACK_MAX_MODULES> channels;
+};
+
+static_assert(std::is_trivially_copyable_v<RackSnapshot> && std::is_standard_layout_v<RackSnapshot>);
+static_assert(sizeof(RackSnapshot) % 8 == 0, "RackSnapshot is copied in 64-bit words");
+
+/**
+ * @brief Number of channels of a circuit breaker module, from its product name
+ *
+ * CAPAROC module names carry the channel count after an 'E' (e.g.
+ * "CAPAROC E4 12-24DC/1-10A"). Unknown names yield 4, the largest module.
+ */
+int channels_from_product_name(std::string_view product_name);
+
+/**
+ * @brief Reads complete rack snapshots from one device
+ *
+ * The product names that determine the channel count of each module are
+ * only read again when the number of connected modules changes.
+ */
+class RackPoller {
+public:
+    RackSnapshot poll(libmodbus_cpp::ModbusConnection &conn);
+
+    /**
+     * @brief Read only the channels of one module, and the input voltage
+     *
+     * For fast sampling around an event: a fraction of the reads of poll().
+     * Channels of other modules are left without channel_flag::VALID.
+     * Needs a preceding poll() for the module layout.
+     *
+     * @param module 1-based module number
+     */
+    RackSnapshot poll_module(libmodbus_cpp::ModbusConnection &conn, uint8_t module);
+
+private:
+    int module_count_ = -1;
+    std::array<uint8_t, RACK_MAX_MODULES> channel_count_{};
+};
+
+/// Comma-separated names of the set channel_flag bits, "ok" or "no data" without VALID
+std::string describe_channel_flags(uint16_t flags);
+
+/// Comma-separated names of the set global_flag bits, or "ok"
+std::string describe_global_flags(uint16_t flags);
+
+/// Human-readable multi-line rendering of a snapshot
+std::string format_rack_snapshot(const RackSnapshot &snapshot);
+
+/// {"ts":ms,"modules":N,"input_voltage":V,...}; values that could not be read are left out
+std::string rack_system_json(const RackSnapshot &snapshot);
+
+/// {"ts":ms,"current_ma":[...],"flags":[...]} of one module (0-based); channels that could not be read have a null current
+std::string rack_module_json(const RackSnapshot &snapshot, std::size_t module);
+
+} // namespace cli
+
+#endif  // RACK_SNAPSHOT_HPP
@@ -0,0 +1,169 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Scheduling of the thread that runs a polling loop
+ */
+struct RealtimeSettings {
+    int priority = 0;                 // SCHED_FIFO priority 1-99, 0 = normal scheduling
+    int cpu = -1;                     // CPU to pin the thread to, -1 = any
+    bool lock_memory = false;         // mlockall() and pre-fault stack and heap
+    std::chrono::microseconds spin{0};  // end of every wait spent spinning instead of sleeping
+
+    bool active() const { return priority > 0 || cpu >= 0 || lock_memory; }
+};
+
+/**
+ * @brief Puts the calling thread into real-time mode for the lifetime of the object
+ *
+ * SCHED_FIFO keeps ordinary processes from delaying a poll that is due; the
+ * CPU affinity keeps the thread's cache warm and away from other cores'
+ * interrupts. With lock_memory all pages of the process are locked and
+ * malloc is told to keep freed memory rather than return it to the system,
+ * after 8 MiB of heap and 256 KiB of stack have been touched once: memory
+ * the loop allocates later comes from pages that are already resident, so
+ * it does not page-fault.
+ *
+ * Threads started afterwards inherit the policy and affinity; start helper
+ * threads that should not compete with the loop before entering.
+ *
+ * The previous policy, priority and affinity are restored on destruction,
+ * and memory is unlocked again. malloc's trim threshold and mmap limit go
+ * back to glibc's defaults, as their previous values cannot be read; a
+ * MALLOC_TRIM_THRESHOLD_ or MALLOC_MMAP_MAX_ set in the environment is
+ * not reapplied.
+ *
+ * Linux only; elsewhere the constructor throws std::runtime_error if any
+ * setting is active.
+ *
+ * @throws std::runtime_error naming the missing privilege (CAP_SYS_NICE,
+ *         CAP_IPC_LOCK or the rtprio/memlock limits) if a setting cannot
+ *         be applied; nothing stays changed in that case
+ */
+class RealtimeScope {
+public:
+    explicit RealtimeScope(const RealtimeSettings &settings);
+    ~RealtimeScope();
+
+    RealtimeScope(const RealtimeScope &) = delete;
+    RealtimeScope &operator=(const RealtimeScope &) = delete;
+
+    /// One line describing what was applied, e.g. for the banner of a polling mode
+    std::string describe() const;
+
+private:
+    void restore();
+
+    RealtimeSettings settings_;
+    bool scheduler_changed_ = false;
+    bool affinity_changed_ = false;
+    bool memory_locked_ = false;
+    int old_policy_ = 0;
+    int old_priority_ = 0;
+    std::vector<uint8_t> old_affinity_;  // cpu_set_t bytes
+};
+
+/**
+ * @brief Histogram of how late polls started, in 1-2-5 steps from 10 µs to 50 ms
+ *
+ * Fixed-size, so recording never allocates.
+ */
+class JitterHistogram {
+public:
+    void add(std::chrono::nanoseconds lateness);
+
+    uint64_t count() const { return count_; }
+
+    /// Upper bound of the bucket that holds quantile @p q, in microseconds
+    double quantile_bound_us(double q) const;
+
+    /// Summary line and one line per bucket up to the largest lateness
+    std::string format() const;
+
+private:
+    static constexpr std::array<uint32_t, 12> BOUNDS_US{10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+    std::array<uint64_t, BOUNDS_US.size() + 1> buckets_{};
+    uint64_t count_ = 0;
+    double sum_us_ = 0.0;
+    double max_us_ = 0.0;
+};
+
+/// Busy-wait until @p deadline, with a CPU pause hint between reads of the clock
+void spin_until(std::chrono::steady_clock::time_point deadline);
+
+/**
+ * @brief Fixed-rate schedule of a polling loop that records its jitter
+ *
+ * Polls that overrun the interval are not made up for.
+ */
+class PollSchedule {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PollSchedule(Clock::duration interval, std::chrono::microseconds spin = std::chrono::microseconds(0))
+        : interval_(interval), spin_(spin), due_(Clock::now())
+    {
+    }
+
+    Clock::time_point due() const { return due_; }
+
+    /// Call as a due poll starts: records its lateness and schedules the next one
+    void start_poll()
+    {
+        auto now = Clock::now();
+        jitter_.add(now - due_);
+        due_ = std::max(due_ + interval_, now);
+    }
+
+    /**
+     * @brief Sleep until the next poll is due
+     *
+     * Sleeps in steps of at most 100 ms so @p running is checked regularly;
+     * the last spin microseconds are spent in spin_until(), because a
+     * sleeping thread wakes up late by the timer slack and the scheduler.
+     *
+     * @return false if running() turned false first
+     */
+    template <typename Running>
+    bool wait(Running running)
+    {
+        auto wake = due_ - spin_;
+        while (Clock::now() < wake)
+        {
+            if (!running())
+            {
+                return false;
+            }
+            std::this_thread::sleep_until(std::min(wake, Clock::now() + std::chrono::milliseconds(100)));
+        }
+        if (spin_.count() > 0)
+        {
+            spin_until(due_);
+        }
+        return running();
+    }
+
+    const JitterHistogram &jitter() const { return jitter_; }
+
+private:
+    Clock::duration interval_;
+    std::chrono::microseconds spin_;
+    Clock::time_point due_;
+    JitterHistogram jitter_;
+};
+
+} // namespace cli
+
+#endif  // REALTIME_HPP
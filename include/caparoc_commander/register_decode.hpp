@@ -0,0 +1,46 @@
+#ifndef REGISTER_DECODE_HPP
+#define REGISTER_DECODE_HPP
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Instruction sets the block decoder can use
+ */
+enum class DecodeBackend {
+    SCALAR,
+    SSE2,  // x86_64 baseline
+    AVX2,  // x86_64, selected at run time if the CPU supports it
+    NEON   // aarch64 baseline
+};
+
+/// Backends usable on this machine, fastest last; SCALAR is always included.
+std::vector<DecodeBackend> available_decode_backends();
+
+/// Backend used by the decode functions; the fastest available one by default.
+DecodeBackend active_decode_backend();
+
+/**
+ * @brief Switch the decode functions to another backend (for benchmarks)
+ *
+ * @return false if @p backend is not available; the active one is kept
+ */
+bool select_decode_backend(DecodeBackend backend);
+
+std::string_view to_string(DecodeBackend backend);
+
+/**
+ * @brief Convert a big-endian register payload into host-order words
+ *
+ * @param bytes Register contents as sent on the wire (2 bytes per register)
+ * @param out Receives bytes.size() / 2 words
+ */
+void decode_be_words(std::span<const uint8_t> bytes, std::span<uint16_t> out);
+
+} // namespace cli
+
+#endif  // REGISTER_DECODE_HPP
@@ -0,0 +1,209 @@
+#ifndef REGISTER_DESCRIPTOR_HPP
+#define REGISTER_DESCRIPTOR_HPP
+
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/register_table.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Data types of CAPAROC registers
+ */
+enum class RegisterType : uint8_t {
+    UINT16,
+    UINT32,   // high word first
+    STRING32  // 32 characters in STRING32_REGISTER_COUNT registers
+};
+
+template <RegisterType Type>
+struct RegisterTraits;
+
+template <>
+struct RegisterTraits<RegisterType::UINT16> {
+    using value_type = uint16_t;
+    static constexpr uint16_t words = 1;
+    static constexpr std::string_view name = "UINT16";
+};
+
+template <>
+struct RegisterTraits<RegisterType::UINT32> {
+    using value_type = uint32_t;
+    static constexpr uint16_t words = 2;
+    static constexpr std::string_view name = "UINT32";
+};
+
+template <>
+struct RegisterTraits<RegisterType::STRING32> {
+    using value_type = std::string;
+    static constexpr uint16_t words = STRING32_REGISTER_COUNT;
+    static constexpr std::string_view name = "STRING32";
+};
+
+/**
+ * @brief Address of a register whose type and access are part of its C++ type
+ *
+ * The width of a read, the decoding of the words and whether the register
+ * may be written all follow from the template arguments, so a UINT32
+ * register cannot be read as one word and a read-only register cannot be
+ * passed to write_register().
+ */
+template <RegisterType Type, RegisterAccess Access = RegisterAccess::READ_ONLY>
+struct Register {
+    using traits = RegisterTraits<Type>;
+    using value_type = typename traits::value_type;
+
+    static constexpr RegisterType type = Type;
+    static constexpr RegisterAccess access = Access;
+    static constexpr uint16_t words = traits::words;
+    static constexpr bool readable = Access != RegisterAccess::WRITE_ONLY;
+    static constexpr bool writable = Access != RegisterAccess::READ_ONLY;
+
+    uint16_t address;
+};
+
+/**
+ * @brief A block of per-channel registers, laid out module by module
+ *
+ * The register of channel C on module M is at
+ * Base + (M - 1) * RACK_MAX_CHANNELS + (C - 1).
+ */
+template <RegisterType Type, RegisterAccess Access, uint16_t Base>
+struct ChannelRegister {
+    static_assert(Base + RACK_MAX_MODULES * RACK_MAX_CHANNELS * RegisterTraits<Type>::words <= 0x10000,
+                  "channel block exceeds the register address space");
+
+    /// Register of a constant channel; out-of-range channels do not compile.
+    template <int Module, int Channel>
+    static consteval Register<Type, Access> at()
+    {
+        static_assert(Module >= 1 && Module <= static_cast<int>(RACK_MAX_MODULES), "module out of range");
+        static_assert(Channel >= 1 && Channel <= static_cast<int>(RACK_MAX_CHANNELS), "channel out of range");
+        return at(Module, Channel);
+    }
+
+    /**
+     * @brief Register of a channel known at run time
+     *
+     * @throws std::out_of_range for a module or channel outside the rack
+     *         (a compile error in constant expressions)
+     */
+    static constexpr Register<Type, Access> at(int module, int channel)
+    {
+        if (module < 1 || module > static_cast<int>(RACK_MAX_MODULES) || channel < 1 || channel > static_cast<int>(RACK_MAX_CHANNELS))
+        {
+            throw std::out_of_range(std::format("channel {}.{} is outside the rack", module, channel));
+        }
+        return {static_cast<uint16_t>(Base + ((module - 1) * static_cast<int>(RACK_MAX_CHANNELS) + (channel - 1)) * RegisterTraits<Type>::words)};
+    }
+};
+
+/**
+ * @brief Registers caparoc_commander addresses directly instead of through libcaparoc
+ */
+namespace registers {
+inline constexpr Register<RegisterType::STRING32> PRODUCT_NAME_POWER_MODULE{0x1000};
+inline constexpr Register<RegisterType::UINT16> NUM_CONNECTED_MODULES{0x2000};
+
+/// Global parametrization lock; 0 = unlocked
+inline constexpr Register<RegisterType::UINT16, RegisterAccess::READ_WRITE> GLOBAL_LOCK{0xC001};
+
+/// Per-channel parametrization locks; 0 = unlocked
+inline constexpr ChannelRegister<RegisterType::UINT16, RegisterAccess::READ_WRITE, 0xC090> CHANNEL_LOCK{};
+
+static_assert(CHANNEL_LOCK.at<1, 1>().address == 0xC090);
+static_assert(CHANNEL_LOCK.at<2, 3>().address == 0xC096);
+static_assert(CHANNEL_LOCK.at<16, 4>().address == 0xC0CF);
+} // namespace registers
+
+/**
+ * @brief Address given on the command line as hex, with or without "0x"
+ *
+ * @throws std::invalid_argument if @p text is not a hex number in 0x0000-0xFFFF
+ */
+uint16_t parse_register_address(std::string_view text);
+
+/**
+ * @brief Decode the words of an FC 3 response into the register's value type
+ *
+ * @param words Exactly Reg::words registers in host byte order
+ */
+template <typename Reg>
+typename Reg::value_type decode_register(std::span<const uint16_t, Reg::words> words)
+{
+    if constexpr (Reg::type == RegisterType::UINT16)
+    {
+        return words[0];
+    }
+    else if constexpr (Reg::type == RegisterType::UINT32)
+    {
+        return (static_cast<uint32_t>(words[0]) << 16) | words[1];
+    }
+    else
+    {
+        return decode_string_registers(words);
+    }
+}
+
+/// Words to send with FC 6 / FC 16 to store @p value
+template <typename Reg>
+    requires(Reg::type != RegisterType::STRING32)
+std::vector<uint16_t> encode_register(typename Reg::value_type value)
+{
+    if constexpr (Reg::type == RegisterType::UINT16)
+    {
+        return {value};
+    }
+    else
+    {
+        return {static_cast<uint16_t>(value >> 16), static_cast<uint16_t>(value & 0xFFFF)};
+    }
+}
+
+/// Blocking read through libcaparoc, std::nullopt if the read failed
+template <typename Reg>
+    requires(Reg::readable)
+std::optional<typename Reg::value_type> read_register(libmodbus_cpp::ModbusConnection &conn, Reg reg)
+{
+    if constexpr (Reg::type == RegisterType::UINT16)
+    {
+        return caparoc::read_uint16(conn, reg.address);
+    }
+    else if constexpr (Reg::type == RegisterType::UINT32)
+    {
+        return caparoc::read_uint32(conn, reg.address);
+    }
+    else
+    {
+        return caparoc::read_string32(conn, reg.address);
+    }
+}
+
+/// Blocking write through libcaparoc
+template <typename Reg>
+    requires(Reg::writable && Reg::type != RegisterType::STRING32)
+bool write_register(libmodbus_cpp::ModbusConnection &conn, Reg reg, typename Reg::value_type value)
+{
+    if constexpr (Reg::type == RegisterType::UINT16)
+    {
+        return caparoc::write_uint16(conn, reg.address, value);
+    }
+    else
+    {
+        return caparoc::write_uint32(conn, reg.address, value);
+    }
+}
+
+} // namespace cli
+
+#endif  // REGISTER_DESCRIPTOR_HPP
@@ -0,0 +1,47 @@
+#ifndef REGISTER_TABLE_HPP
+#define REGISTER_TABLE_HPP
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace cli {
+
+enum class RegisterAccess : uint8_t {
+    READ_ONLY,
+    WRITE_ONLY,
+    READ_WRITE
+};
+
+/**
+ * @brief One entry of the CAPAROC register map
+ *
+ * Entries reference string literals only, so the whole table is constant
+ * initialized and lives in read-only data.
+ */
+struct RegisterEntry {
+    uint16_t address;
+    RegisterAccess access;
+    std::string_view name;
+    std::string_view description;
+    std::string_view info;  // caparoc::get_register_info() of the address
+};
+
+/**
+ * @brief The register map generated from libcaparoc at build time, sorted by address
+ *
+ * Registers sharing an address keep libcaparoc's order. Empty if the build
+ * was configured with CAPAROC_COMMANDER_PRECOMPUTED_REGISTER_TABLE=OFF;
+ * callers then fall back to libcaparoc.
+ */
+std::span<const RegisterEntry> register_table();
+
+/// caparoc::list_all_registers() as generated at build time, empty without the table
+std::string_view register_list();
+
+/// Look up a register by address (binary search), the first one if several share it, nullptr if unknown.
+const RegisterEntry* find_register(uint16_t address);
+
+} // namespace cli
+
+#endif  // REGISTER_TABLE_HPP
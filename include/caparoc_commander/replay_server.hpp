@@ -0,0 +1,96 @@
+#ifndef REPLAY_SERVER_HPP
+#define REPLAY_SERVER_HPP
+
+#include "caparoc_commander/modbus_trace.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief Counters of a replay run
+ */
+struct ReplayStats {
+    std::size_t connections = 0;
+    std::size_t matched = 0;     // answered with the next unused recorded exchange
+    std::size_t repeated = 0;    // all matching exchanges used up, the last one was answered again
+    std::size_t unanswered = 0;  // of matched + repeated: not answered by the device in the trace either
+    std::size_t from_registers = 0;  // register read or write not in the trace, served from the register map
+    std::size_t unmatched = 0;   // any other request not in the trace, answered with exception 0x04
+};
+
+/**
+ * @brief Modbus TCP server answering requests from a captured trace
+ *
+ * The trace is turned into request/response exchanges (matched by stream and
+ * transaction id). An incoming request is answered with the next unused
+ * exchange whose unit id and PDU are identical, in trace order, so that a
+ * client issuing the captured sequence again sees exactly the captured
+ * responses. Each response is delayed by the recorded device latency divided
+ * by the speed factor; requests the device never answered are left
+ * unanswered as well, reproducing field timeouts.
+ *
+ * Register reads and writes (FC 3, 6 and 16) that are not in the trace are
+ * served from a register map instead: the last value the trace shows for
+ * each address, 0 for addresses it never shows, updated by writes. Their
+ * response is delayed by the median recorded latency. A client free to
+ * choose its requests, such as the device profiler, thus sees a device
+ * that answers every read.
+ *
+ * Listens on one IPv4 address, 127.0.0.1 unless given. Any 127.0.0.0/8
+ * address is local, so several servers on the same port form a simulated
+ * fleet. Only available on Linux.
+ *
+ * @throws std::runtime_error if the address is invalid or cannot be bound
+ */
+class ReplayServer {
+public:
+    ReplayServer(const ModbusTrace &trace, int port, const std::string &address = "127.0.0.1");
+    ~ReplayServer();
+
+    ReplayServer(const ReplayServer &) = delete;
+    ReplayServer &operator=(const ReplayServer &) = delete;
+
+    const std::string &address() const { return address_; }
+    int port() const { return port_; }
+    std::size_t exchange_count() const { return exchanges_.size(); }
+
+    /**
+     * @brief Serve clients until @p should_stop returns true
+     *
+     * @param speed Timing factor: 1 replays the recorded latency, 10 is ten
+     *        times faster, 0 answers immediately
+     * @param should_stop Polled at least every 100 ms
+     */
+    ReplayStats run(double speed, const std::function<bool()> &should_stop);
+
+private:
+    struct Exchange {
+        std::vector<uint8_t> response;  // empty if the device did not answer
+        std::chrono::nanoseconds latency{0};
+    };
+
+    std::optional<std::vector<uint8_t>> register_response(std::span<const uint8_t> request);
+
+    std::vector<Exchange> exchanges_;
+    std::unordered_map<uint16_t, uint16_t> registers_;  // address -> last value in the trace
+    std::chrono::nanoseconds typical_latency_{0};
+    // Unit id + PDU of a request -> indices of its exchanges in trace order
+    std::map<std::vector<uint8_t>, std::vector<std::size_t>> by_request_;
+    int listen_fd_ = -1;
+    std::string address_;
+    int port_ = 0;
+};
+
+} // namespace cli
+
+#endif  // REPLAY_SERVER_HPP
@@ -0,0 +1,61 @@
+#ifndef RTT_ESTIMATOR_HPP
+#define RTT_ESTIMATOR_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace cli {
+
+/**
+ * @brief Response timeout derived from measured round-trip times
+ *
+ * Jacobson/Karels estimation as used for TCP retransmission (RFC 6298):
+ * a smoothed round-trip time SRTT and its mean deviation RTTVAR are updated
+ * with gains 1/8 and 1/4 per sample, and the timeout is
+ * SRTT + max(1 ms, 4 * RTTVAR), clamped to [min, max]. Until the first sample
+ * the timeout is min(1 s, max).
+ *
+ * Every timeout doubles the current value (up to max) until the next sample,
+ * so a device that became slower is not retried at a pace it cannot follow.
+ * Following Karn's rule, the caller must only sample requests that were
+ * answered on their first attempt.
+ */
+class RttEstimator {
+public:
+    using Duration = std::chrono::microseconds;
+
+    /// @throws std::invalid_argument if min is not positive or max < min
+    RttEstimator(Duration min_timeout, Duration max_timeout);
+
+    /// Account for a request answered after @p rtt
+    void sample(Duration rtt);
+
+    /// Account for a request that was not answered within timeout()
+    void timed_out();
+
+    /// Response timeout for the next request
+    Duration timeout() const { return timeout_; }
+
+    Duration min_timeout() const { return min_; }
+    Duration max_timeout() const { return max_; }
+
+    Duration smoothed() const { return Duration(static_cast<int64_t>(srtt_us_)); }
+    Duration variation() const { return Duration(static_cast<int64_t>(rttvar_us_)); }
+    uint64_t samples() const { return samples_; }
+    uint64_t timeouts() const { return timeouts_; }
+
+private:
+    void update_timeout();
+
+    Duration min_;
+    Duration max_;
+    Duration timeout_;
+    double srtt_us_ = 0.0;
+    double rttvar_us_ = 0.0;
+    uint64_t samples_ = 0;
+    uint64_t timeouts_ = 0;
+};
+
+} // namespace cli
+
+#endif  // RTT_ESTIMATOR_HPP
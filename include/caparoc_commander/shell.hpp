@@ -0,0 +1,34 @@
+#ifndef SHELL_HPP
+#define SHELL_HPP
+
+#include "caparoc_commander/cli_parser.hpp"
+
+#include <functional>
+#include <string>
+
+namespace cli {
+
+/**
+ * @brief Interactive command loop of --shell
+ *
+ * Every line uses the command-line syntax, with the leading "--" of the
+ * first option optional ("read-uint16 0x2004", "get-load-current 1 2").
+ * Register names from the register map may be given instead of hex
+ * addresses. Connection options (--ip, --port, --timeout) of a line are
+ * ignored; all lines share the connection of @p options.
+ *
+ * Built-in commands: help, history, watch [SECONDS] COMMAND,
+ * repeat N COMMAND, exit/quit. On a terminal the line editor supports
+ * cursor movement, history (kept in ~/.caparoc_commander_history) and
+ * Tab completion of option and register names.
+ *
+ * @param endpoint Shown in the prompt
+ * @param execute Runs the actions of one parsed line; false if one of them failed
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE if the last command failed
+ */
+int run_shell(const CommandLineOptions &options, const std::string &endpoint,
+              const std::function<bool(const CommandLineOptions &)> &execute);
+
+} // namespace cli
+
+#endif  // SHELL_HPP
@@ -0,0 +1,97 @@
+#ifndef SHM_SNAPSHOT_HPP
+#define SHM_SNAPSHOT_HPP
+
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace cli {
+
+/// Identifies a caparoc_commander snapshot segment ("CPRC")
+inline constexpr uint32_t SNAPSHOT_MAGIC = 0x43505243;
+
+/// Incremented whenever the layout of the segment or of RackSnapshot changes
+inline constexpr uint16_t SNAPSHOT_LAYOUT_VERSION = 1;
+
+/// Default segment name for --publish-shm / --read-shm
+inline constexpr std::string_view DEFAULT_SHM_NAME = "/caparoc_commander";
+
+/// Prepends the '/' that shm_open() expects, if missing.
+std::string normalize_shm_name(std::string_view name);
+
+/**
+ * @brief Single writer of a shared-memory rack snapshot
+ *
+ * Creates (or takes over) a POSIX shared-memory segment holding a header
+ * and one RackSnapshot, protected by a seqlock: the sequence number is odd
+ * while an update is in progress and advances by two per published snapshot.
+ * Readers never block the writer and the writer never waits for readers.
+ * The segment is removed when the publisher is destroyed.
+ *
+ * Only available on Linux.
+ *
+ * @throws std::runtime_error if the segment cannot be created
+ */
+class SnapshotPublisher {
+public:
+    SnapshotPublisher(std::string name, uint32_t poll_interval_ms);
+    ~SnapshotPublisher();
+
+    SnapshotPublisher(const SnapshotPublisher &) = delete;
+    SnapshotPublisher &operator=(const SnapshotPublisher &) = delete;
+
+    void publish(const RackSnapshot &snapshot);
+
+    const std::string &name() const { return name_; }
+
+private:
+    std::string name_;
+    void *segment_ = nullptr;
+};
+
+struct SnapshotReading {
+    RackSnapshot snapshot;
+    uint64_t sequence;          // even, 2 * number of snapshots published so far
+    uint32_t publisher_pid;
+    uint32_t poll_interval_ms;
+    std::chrono::nanoseconds read_duration;
+};
+
+/**
+ * @brief Lock-free reader of a segment written by SnapshotPublisher
+ *
+ * Maps the segment read-only; any number of readers may coexist.
+ *
+ * @throws std::runtime_error if the segment does not exist or has another layout
+ */
+class SnapshotReader {
+public:
+    explicit SnapshotReader(std::string name);
+    ~SnapshotReader();
+
+    SnapshotReader(const SnapshotReader &) = delete;
+    SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+    /**
+     * @brief Copy the current snapshot
+     *
+     * @return std::optional<SnapshotReading> std::nullopt if nothing has been
+     *         published yet, or if the writer kept updating during every attempt
+     */
+    std::optional<SnapshotReading> read() const;
+
+private:
+    std::string name_;
+    const void *segment_ = nullptr;
+};
+
+/// true if the process that published a reading is still alive
+bool is_publisher_alive(const SnapshotReading &reading);
+
+} // namespace cli
+
+#endif  // SHM_SNAPSHOT_HPP
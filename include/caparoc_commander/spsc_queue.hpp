@@ -0,0 +1,69 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace cli {
+
+/**
+ * @brief Bounded lock-free queue between exactly one producer and one consumer thread
+ *
+ * push() and pop() never block and never allocate: the slots are a fixed
+ * array, and each side only publishes its own index with release ordering.
+ * The indices live on separate cache lines so the two threads do not
+ * invalidate each other's line on every operation.
+ *
+ * @tparam Capacity Number of slots, a power of two
+ */
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /// Called by the producer; false (and @p value untouched) if the queue is full
+    bool push(T &value)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Called by the consumer; std::nullopt if the queue is empty
+    std::optional<T> pop()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(slots_[head & (Capacity - 1)]));
+        head_.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    /// Approximate when called while the other side is active
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{0};  // next slot to pop, written by the consumer
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{0};  // next slot to push, written by the producer
+    alignas(CACHE_LINE) std::array<T, Capacity> slots_{};
+};
+
+} // namespace cli
+
+#endif  // SPSC_QUEUE_HPP
@@ -0,0 +1,22 @@
+#ifndef STOP_SIGNAL_HPP
+#define STOP_SIGNAL_HPP
+
+namespace cli {
+
+/**
+ * @brief Make SIGINT and SIGTERM request a graceful stop of long-running modes
+ *
+ * Daemon-style loops poll stop_requested() instead of being killed, so they
+ * can release resources such as shared-memory segments on the way out.
+ */
+void install_stop_handlers();
+
+/// true once SIGINT or SIGTERM was received after install_stop_handlers()
+bool stop_requested();
+
+/// Forget a received SIGINT/SIGTERM, e.g. after the interactive shell stopped a command with it
+void clear_stop_request();
+
+} // namespace cli
+
+#endif  // STOP_SIGNAL_HPP
@@ -0,0 +1,91 @@
+#ifndef SWITCHING_SEQUENCER_HPP
+#define SWITCHING_SEQUENCER_HPP
+
+#include "libmodbus_cpp/modbus_connection.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+struct ChannelRef {
+    uint8_t module;
+    uint8_t channel;
+};
+
+/**
+ * @brief A set of channels to switch to one state, in bounded batches
+ */
+struct SwitchingPlan {
+    bool on = true;
+    std::vector<ChannelRef> channels;
+    std::size_t max_simultaneous = 4;                 // channels per batch
+    std::chrono::milliseconds stagger{50};            // between batch starts
+    std::chrono::milliseconds verify_timeout{2000};   // per channel, from its write
+    std::chrono::milliseconds poll_interval{20};      // between status rounds
+};
+
+enum class SwitchOutcome {
+    CONFIRMED,      // ON: load current flows, OFF: load current is zero
+    NO_LOAD,        // ON without faults, but no load current within the verify timeout
+    TRIPPED,        // channel reported overload, short circuit, hardware or voltage error
+    NOT_CONFIRMED,  // expected state not observed within the verify timeout
+    WRITE_FAILED,   // device rejected the switching command
+    SKIPPED         // not issued: the supply reported overcurrent or the deadline passed
+};
+
+struct ChannelSwitchResult {
+    ChannelRef ref;
+    SwitchOutcome outcome = SwitchOutcome::NOT_CONFIRMED;
+    std::chrono::microseconds issued_at{};                      // since start of the sequence
+    std::chrono::microseconds write_latency{};                  // command round trip
+    std::optional<std::chrono::microseconds> confirm_latency{}; // from issuing to confirmation
+    std::optional<uint16_t> load_current_ma{};                  // last reading
+};
+
+struct SwitchingReport {
+    bool on = true;
+    std::vector<ChannelSwitchResult> channels;
+    std::chrono::microseconds elapsed{};
+    std::size_t status_reads = 0;
+    bool aborted_on_overcurrent = false;
+};
+
+/**
+ * @brief Expand a channel selection into a list of channels
+ *
+ * @param selection "all", or a comma-separated list of MODULE.CHANNEL entries
+ *        where CHANNEL may be '*' for every channel of the module (e.g. "1.1,1.2,3.*")
+ * @throws std::invalid_argument on malformed selections
+ * @throws std::runtime_error if the module configuration cannot be read
+ */
+std::vector<ChannelRef> resolve_channel_selection(libmodbus_cpp::ModbusConnection &conn, std::string_view selection);
+
+/**
+ * @brief Execute a switching plan and verify the result
+ *
+ * Batch k starts at k * stagger after the first one, on an absolute schedule
+ * so that slow writes do not push later batches back. A batch is written one
+ * channel at a time, each with its own blocking control_channel() call.
+ * Between batches every written but unconfirmed channel is verified in
+ * rounds, again per channel: one status read and, unless it tripped, one
+ * load current read, until it is confirmed, trips or reaches its verify
+ * timeout. If a channel reports module or system overcurrent, no further
+ * batches are issued.
+ *
+ * @param deadline Optional point in time after which the sequence stops
+ */
+SwitchingReport run_switching_plan(libmodbus_cpp::ModbusConnection &conn, const SwitchingPlan &plan,
+                                   std::optional<std::chrono::steady_clock::time_point> deadline);
+
+/// Per-channel table plus latency summary
+std::string format_switching_report(const SwitchingReport &report);
+
+} // namespace cli
+
+#endif  // SWITCHING_SEQUENCER_HPP
@@ -0,0 +1,118 @@
+#ifndef SYNC_SAMPLER_HPP
+#define SYNC_SAMPLER_HPP
+
+#include "caparoc_commander/device_error.hpp"
+#include "caparoc_commander/event_loop.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/**
+ * @brief One device of a synchronized sampling run
+ */
+struct SyncTarget {
+    std::string label;  // HOST:PORT as given, for output
+    std::string host;   // where to connect (a capture proxy, if any)
+    int port = 502;
+    uint8_t unit_id = 1;
+};
+
+/**
+ * @brief Parameters of a synchronized sampling run
+ */
+struct SyncSettings {
+    std::vector<SyncTarget> targets;
+    uint16_t address = 0;  // first register of the FC 3 read
+    uint16_t count = 1;
+    std::chrono::milliseconds interval{1000};  // tick spacing, ticks fall on multiples of it in UTC
+    std::chrono::milliseconds timeout{1000};   // per read, cut to the interval
+    std::chrono::microseconds max_skew{5000};  // rows beyond this are flagged
+    std::chrono::microseconds busy_poll{0};    // SO_BUSY_POLL budget of the sockets, 0 = off
+    std::chrono::microseconds spin{0};         // end of the wait before each send spent spinning
+    IoBackend io_backend = IoBackend::AUTO;
+    uint64_t rows = 0;                         // 0 = until stopped
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::function<bool()> stop_requested;      // checked between rows
+};
+
+/**
+ * @brief The read of one device at one tick
+ *
+ * Times are offsets from the tick in microseconds; negative when the request
+ * was sent early to make up for the device's latency.
+ */
+struct SyncReading {
+    std::optional<DeviceError> error;
+    std::vector<uint16_t> values;
+    int64_t sent_us = 0;
+    int64_t received_us = 0;
+    bool kernel_timestamps = false;  // both times taken by the kernel
+};
+
+/**
+ * @brief All reads of one tick, in the order of SyncSettings::targets
+ */
+struct SyncRow {
+    uint64_t tick = 0;
+    uint64_t time_ns = 0;  // tick time, nanoseconds since the Unix epoch
+    std::vector<SyncReading> readings;
+    std::optional<int64_t> skew_us;  // spread of the request midpoints; none with fewer than two answers
+    bool skewed = false;             // skew_us above SyncSettings::max_skew
+};
+
+struct SyncSummary {
+    uint64_t rows = 0;
+    uint64_t complete_rows = 0;  // every device answered
+    uint64_t skewed_rows = 0;
+    uint64_t missed_ticks = 0;   // skipped because the previous row took too long
+    uint64_t readings = 0;
+    uint64_t kernel_stamped = 0;
+    double skew_p50_us = 0.0;
+    double skew_p99_us = 0.0;
+    double skew_max_us = 0.0;
+};
+
+/**
+ * @brief Read the same registers of several devices at shared ticks
+ *
+ * Ticks lie on a grid of the monotonic clock, anchored so that they fall on
+ * multiples of the interval in UTC. One connection per device; all requests
+ * of a tick are sent in order of their send times by one thread, the last
+ * two milliseconds before each waited out with a precise sleep rather than
+ * the event loop's millisecond timer.
+ *
+ * Send and receive times come from kernel socket timestamps (SO_TIMESTAMPING)
+ * where available. The midpoint of the two is the estimate of when a device
+ * took its sample; the skew of a row is the spread of these midpoints.
+ * Each device's request is sent early by its smoothed half round-trip time
+ * (gain 1/8, at most a quarter of the interval), so that devices behind slow
+ * links sample at the same instant as local ones.
+ *
+ * Devices that fail are reconnected before the next tick. Linux only;
+ * elsewhere a std::runtime_error is thrown.
+ *
+ * @param on_row Called with every row as soon as all its reads finished
+ * @throws std::invalid_argument without targets or with a zero interval or count
+ */
+SyncSummary run_sync_sampling(const SyncSettings &settings, const std::function<void(const SyncRow &)> &on_row);
+
+/// Column headings matching format_sync_row()
+std::string format_sync_header(const SyncSettings &settings);
+
+/// One line: tick time, the values of every device and the skew
+std::string format_sync_row(const SyncSettings &settings, const SyncRow &row);
+
+/// One JSON object per line, with the times of every read
+std::string format_sync_row_json(const SyncSettings &settings, const SyncRow &row);
+
+std::string format_sync_summary(const SyncSummary &summary);
+
+} // namespace cli
+
+#endif  // SYNC_SAMPLER_HPP
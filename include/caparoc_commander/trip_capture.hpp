@@ -0,0 +1,159 @@
+#ifndef TRIP_CAPTURE_HPP
+#define TRIP_CAPTURE_HPP
+
+#include "caparoc_commander/rack_snapshot.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/// Identifies a caparoc_commander trip event file ("CPTE")
+inline constexpr uint32_t TRIP_EVENT_MAGIC = 0x43505445;
+
+/// Incremented whenever the file layout changes
+inline constexpr uint16_t TRIP_EVENT_FORMAT_VERSION = 1;
+
+/// Channel status bits whose rising edge opens a capture window
+inline constexpr uint16_t TRIP_CHANNEL_TRIGGERS = channel_flag::WARNING_80_PERCENT | channel_flag::OVERLOAD | channel_flag::SHORT_CIRCUIT |
+                                                  channel_flag::HARDWARE_ERROR | channel_flag::VOLTAGE_ERROR;
+
+/// Global status bits whose rising edge opens a capture window over the whole rack
+inline constexpr uint16_t TRIP_GLOBAL_TRIGGERS = global_flag::UNDERVOLTAGE | global_flag::OVERVOLTAGE | global_flag::SYSTEM_CURRENT_TOO_HIGH;
+
+struct TripSample {
+    uint64_t timestamp_ns = 0;      // nanoseconds since the Unix epoch
+    uint16_t load_current_ma = 0;
+    uint16_t flags = 0;             // channel_flag::*
+    uint16_t input_voltage_cv = 0;  // 1/100 V, 0 if it could not be read
+};
+
+/// Samples of one channel, oldest first
+struct TripTrace {
+    uint8_t module = 0;
+    uint8_t channel = 0;
+    std::vector<TripSample> samples;
+};
+
+/**
+ * @brief A frozen window of samples around a status transition
+ *
+ * Module events carry a trace for every channel of the module, rack events
+ * (global status transitions) one for every channel of the rack.
+ */
+struct TripEvent {
+    uint64_t trigger_ns = 0;  // time of the first sample that showed the transition
+    uint8_t module = 0;       // 1-based, 0 = rack event
+    uint8_t channel = 0;      // first channel that changed, 0 for rack events
+    uint16_t cause = 0;       // rising channel_flag bits, global_flag bits for rack events
+    std::vector<TripTrace> traces;
+};
+
+/**
+ * @brief Keeps a short history of every channel and cuts it into events
+ *
+ * Every channel has a fixed-size ring of its last pre_samples samples,
+ * allocated up front and overwritten in place, so continuous polling costs
+ * no memory beyond it. When a TRIP_CHANNEL_TRIGGERS bit of a channel rises,
+ * the rings of its module are frozen into a TripEvent, and the next
+ * post_samples polls that include the module are appended to it; a rising
+ * TRIP_GLOBAL_TRIGGERS bit does the same for the whole rack. Further
+ * transitions inside an open window only show in its samples.
+ *
+ * The first sample of a channel sets its baseline: a channel that is already
+ * tripped when the capture starts does not produce an event.
+ *
+ * Not thread-safe; the rings belong to the polling thread, and completed
+ * events are handed over with take_completed().
+ */
+class TripRecorder {
+public:
+    /// @throws std::invalid_argument if post_samples is 0
+    TripRecorder(std::size_t pre_samples, std::size_t post_samples);
+
+    /**
+     * @brief Record a snapshot from RackPoller::poll() or poll_module()
+     *
+     * Channels without channel_flag::VALID are skipped, and the global
+     * status only counts with rack_valid::GLOBAL_STATUS.
+     */
+    void add(const RackSnapshot &snapshot);
+
+    /// Modules with an open window, 0 for an open rack window
+    std::vector<uint8_t> burst_modules() const;
+
+    /// Events whose post-trigger window is complete, in trigger order
+    std::vector<TripEvent> take_completed();
+
+    /// Close all open windows early, e.g. when the capture stops
+    void flush();
+
+    uint64_t events() const { return events_; }
+
+private:
+    // Overwriting ring over a buffer of fixed size
+    class History {
+    public:
+        void reset(std::size_t capacity);
+        void push(const TripSample &sample);
+        void copy_to(std::vector<TripSample> &out) const;
+
+    private:
+        std::vector<TripSample> slots_;
+        std::size_t next_ = 0;
+        std::size_t size_ = 0;
+    };
+
+    struct ChannelState {
+        History history;
+        uint16_t flags = 0;
+        bool seen = false;
+    };
+
+    struct Window {
+        TripEvent event;
+        std::size_t remaining = 0;  // polls still to append
+    };
+
+    void open_window(const RackSnapshot &snapshot, uint8_t module, uint8_t channel, uint16_t cause);
+
+    std::size_t pre_samples_;
+    std::size_t post_samples_;
+    std::array<std::array<ChannelState, RACK_MAX_CHANNELS>, RACK_MAX_MODULES> channels_{};
+    uint16_t global_flags_ = 0;
+    bool global_seen_ = false;
+    std::array<std::optional<Window>, RACK_MAX_MODULES + 1> windows_{};  // index 0 = rack
+    std::vector<TripEvent> completed_;
+    uint64_t events_ = 0;
+};
+
+/**
+ * @brief Write an event file into @p directory, creating it if necessary
+ *
+ * Little-endian layout: a 32-byte header (magic: u32, version: u16,
+ * reserved: u16, trigger_ns: u64, cause: u16, module: u8, channel: u8,
+ * trace_count: u16, reserved: u16, sample_count: u32, reserved: u32), one
+ * 12-byte record per trace (module: u8, channel: u8, reserved: u16,
+ * first_sample: u32, sample_count: u32) and one 12-byte record per sample
+ * (offset_us: i32 from trigger_ns, saturated; load_current_ma: u16;
+ * flags: u16; input_voltage_cv: u16; reserved: u16).
+ *
+ * @return Path of the file, trip_<UTC time>_<module>.<channel>.cpte or
+ *         trip_<UTC time>_rack.cpte
+ * @throws std::runtime_error if the file cannot be written
+ */
+std::string save_trip_event(const TripEvent &event, const std::string &directory);
+
+/// @throws std::runtime_error if the file cannot be read or is not an event file
+TripEvent load_trip_event(const std::string &path);
+
+/// Summary of every trace and the samples of the channel that triggered
+std::string format_trip_event(const TripEvent &event);
+
+} // namespace cli
+
+#endif  // TRIP_CAPTURE_HPP
@@ -0,0 +1,2921 @@
+#include "caparoc_commander/action_executor.hpp"
+#include "caparoc/caparoc.hpp"
+#include "libmodbus_cpp/modbus_connection.hpp"
+#include "caparoc_commander/create_modbus_connection.hpp"
+#include "caparoc_commander/apply_plan.hpp"
+#include "caparoc_commander/binary_log.hpp"
+#include "caparoc_commander/capture_proxy.hpp"
+#include "caparoc_commander/coil_bitset.hpp"
+#include "caparoc_commander/device_profile.hpp"
+#include "caparoc_commander/discovery.hpp"
+#include "caparoc_commander/fleet_cluster.hpp"
+#include "caparoc_commander/fleet_health.hpp"
+#include "caparoc_commander/inventory.hpp"
+#include "caparoc_commander/load_statistics.hpp"
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/modbus_trace.hpp"
+#include "caparoc_commander/mqtt_publisher.hpp"
+#include "caparoc_commander/portable_print.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/realtime.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+#include "caparoc_commander/register_table.hpp"
+#include "caparoc_commander/replay_server.hpp"
+#include "caparoc_commander/rtt_estimator.hpp"
+#include "caparoc_commander/shell.hpp"
+#include "caparoc_commander/shm_snapshot.hpp"
+#include "caparoc_commander/stop_signal.hpp"
+#include "caparoc_commander/spsc_queue.hpp"
+#include "caparoc_commander/switching_sequencer.hpp"
+#include "caparoc_commander/sync_sampler.hpp"
+#include "caparoc_commander/trip_capture.hpp"
+
+#ifdef __linux__
+#include "caparoc_commander/async_modbus_client.hpp"
+#include "caparoc_commander/event_loop.hpp"
+#include "caparoc_commander/task.hpp"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cli
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+        using TimePoint = Clock::time_point;
+
+        struct DeviceSession
+        {
+            std::string host;
+            int port;
+            std::optional<libmodbus_cpp::ModbusConnection> conn{};
+#ifdef __linux__
+            std::unique_ptr<AsyncModbusClient> client{};
+#endif
+            std::vector<uint8_t> units{1};  // Modbus unit IDs served over this connection
+            std::unique_ptr<RttEstimator> rtt{};  // with --adaptive-timeout, shared by conn and client
+            std::optional<DeviceProfile> profile{};  // recorded by --profile-device
+            bool failed = false;
+            int capture_port = 0;  // loopback port of the device's CaptureProxy, 0 = connect directly
+
+            std::string connect_host() const { return capture_port ? "127.0.0.1" : host; }
+            int connect_port() const { return capture_port ? capture_port : port; }
+        };
+
+        // Accepts "HOST" or "HOST:PORT"; throws std::invalid_argument for
+        // an empty host or a port that is not a number in 1-65535. Worker
+        // pools call it for every endpoint before they start.
+        DeviceSession make_session(const std::string &endpoint, int default_port)
+        {
+            auto colon = endpoint.rfind(':');
+            if (colon == std::string::npos)
+            {
+                if (endpoint.empty())
+                {
+                    throw std::invalid_argument("Empty device address");
+                }
+                return {endpoint, default_port};
+            }
+            std::string_view text(endpoint);
+            text.remove_prefix(colon + 1);
+            int port = 0;
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), port);
+            if (colon == 0 || ec != std::errc{} || end != text.data() + text.size() || port < 1 || port > 65535)
+            {
+                throw std::invalid_argument(std::format("Invalid device address '{}' (expected HOST or HOST:PORT with a port of 1-65535)", endpoint));
+            }
+            return {endpoint.substr(0, colon), port};
+        }
+
+        uint8_t parse_unit_id(int unit)
+        {
+            if (unit < 0 || unit > 255)
+            {
+                throw std::invalid_argument(std::format("Invalid unit ID {} (expected 0-255)", unit));
+            }
+            return static_cast<uint8_t>(unit);
+        }
+
+        // Longest wait for one response: --timeout, or --timeout-max with --adaptive-timeout
+        std::chrono::microseconds response_timeout_limit(const CommandLineOptions &options)
+        {
+            if (options.adaptive_timeout && options.timeout_max_ms > 0)
+            {
+                return std::chrono::milliseconds(options.timeout_max_ms);
+            }
+            return std::chrono::seconds(options.timeout_seconds);
+        }
+
+        RealtimeSettings realtime_settings(const CommandLineOptions &options)
+        {
+            if (options.rt_priority < 0 || options.rt_priority > 99 || options.rt_cpu < -1 || options.rt_spin_us < 0 || options.rt_busy_poll_us < 0)
+            {
+                throw std::invalid_argument("--rt-priority must be between 0 and 99, --rt-cpu, --rt-spin and --rt-busy-poll not negative");
+            }
+            RealtimeSettings settings;
+            settings.priority = options.rt_priority;
+            settings.cpu = options.rt_cpu;
+            settings.lock_memory = options.rt_lock_memory;
+            settings.spin = std::chrono::microseconds(options.rt_spin_us);
+            return settings;
+        }
+
+        // Puts the calling thread of a polling loop into the --rt-* mode, if any
+        // is requested; @p scope leaves it again.
+        void enter_realtime(std::optional<RealtimeScope> &scope, const CommandLineOptions &options)
+        {
+            auto settings = realtime_settings(options);
+            if (settings.active() || settings.spin.count() > 0)
+            {
+                scope.emplace(settings);
+                portable::println("Real-time mode: {}", scope->describe());
+            }
+        }
+
+        void print_jitter_report(const CommandLineOptions &options, const PollSchedule &schedule)
+        {
+            if (options.jitter_report)
+            {
+                portable::println("{}", schedule.jitter().format());
+            }
+        }
+
+        // Accepts "HOST[:PORT]" or "HOST[:PORT]/UNIT,UNIT,..."; without a
+        // unit list the --unit IDs apply.
+        std::vector<DeviceSession> make_sessions(const CommandLineOptions &options)
+        {
+            std::vector<uint8_t> default_units;
+            for (auto unit : options.unit_ids)
+            {
+                default_units.push_back(parse_unit_id(unit));
+            }
+            if (default_units.empty())
+            {
+                throw std::invalid_argument("--unit needs at least one unit ID");
+            }
+
+            std::vector<DeviceSession> sessions;
+            for (const auto &endpoint : options.ip_addresses)
+            {
+                auto slash = endpoint.find('/');
+                auto session = make_session(endpoint.substr(0, slash), options.port);
+                session.units = default_units;
+                if (slash != std::string::npos)
+                {
+                    session.units.clear();
+                    std::string_view list(endpoint);
+                    list.remove_prefix(slash + 1);
+                    while (!list.empty())
+                    {
+                        auto comma = std::min(list.find(','), list.size());
+                        auto text = list.substr(0, comma);
+                        int unit = -1;
+                        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), unit);
+                        if (ec != std::errc{} || end != text.data() + text.size())
+                        {
+                            throw std::invalid_argument(std::format("Invalid unit ID '{}' in '{}'", text, endpoint));
+                        }
+                        session.units.push_back(parse_unit_id(unit));
+                        list.remove_prefix(std::min(comma + 1, list.size()));
+                    }
+                    if (session.units.empty())
+                    {
+                        throw std::invalid_argument(std::format("No unit ID after '/' in '{}'", endpoint));
+                    }
+                }
+                if (options.adaptive_timeout)
+                {
+                    session.rtt = std::make_unique<RttEstimator>(std::chrono::milliseconds(options.timeout_min_ms), response_timeout_limit(options));
+                }
+                sessions.push_back(std::move(session));
+            }
+            return sessions;
+        }
+
+        std::string profiles_path(const CommandLineOptions &options)
+        {
+            return options.profiles_file.empty() ? default_device_profiles_path() : options.profiles_file;
+        }
+
+        // Attaches the recorded profile of every device. A broken profile
+        // file only costs the tuning, so it is reported and ignored.
+        void attach_device_profiles(const CommandLineOptions &options, std::vector<DeviceSession> &devices)
+        {
+            auto path = profiles_path(options);
+            if (options.no_profiles || path.empty())
+            {
+                return;
+            }
+            try
+            {
+                auto profiles = load_device_profiles(path);
+                for (auto &device : devices)
+                {
+                    if (const auto *profile = profiles.find(std::format("{}:{}", device.host, device.port)))
+                    {
+                        device.profile = *profile;
+                        if (options.debug)
+                        {
+                            portable::println("Using profile of {} from {}", profile->endpoint, path);
+                        }
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Warning: ignoring device profiles: {}", e.what());
+            }
+        }
+
+        // --profile-device: one device after another, so that the load ramps
+        // of different devices do not compete for the network.
+        bool run_device_profiling(const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            auto path = profiles_path(options);
+            if (path.empty())
+            {
+                portable::println("Error: no profile file; set --profiles FILE");
+                return false;
+            }
+
+            DeviceProfiles profiles;
+            std::vector<DeviceSession> devices;
+            ProfileSettings settings;
+            try
+            {
+                profiles = load_device_profiles(path);
+                devices = make_sessions(options);
+                settings.address = parse_register_address(options.profile_address);
+                settings.io_backend = parse_io_backend(options.io_backend);
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+            settings.step = std::chrono::milliseconds(std::max(options.profile_step_ms, 100));
+            settings.timeout = std::chrono::duration_cast<std::chrono::milliseconds>(response_timeout_limit(options));
+            settings.max_connections = static_cast<uint16_t>(std::clamp<std::size_t>(options.profile_max_connections, 1, UINT16_MAX));
+            if (deadline)
+            {
+                settings.deadline = *deadline;
+            }
+
+            bool succeeded = true;
+            std::size_t profiled = 0;
+            for (const auto &device : devices)
+            {
+                settings.host = device.connect_host();
+                settings.port = device.connect_port();
+                settings.unit_id = device.units.front();
+                portable::println("=== Device Profile ({}:{}) ===", device.host, device.port);
+
+                auto result = profile_device(settings, [](const ProfileStep &step)
+                                             { portable::println("{}", format_profile_step(step)); });
+                if (result.error)
+                {
+                    portable::println("ERROR: {}", format_connect_error(*result.error, device.host, device.port));
+                    succeeded = false;
+                    continue;
+                }
+                result.profile.endpoint = std::format("{}:{}", device.host, device.port);
+                portable::println("{}", format_device_profile(result.profile));
+                profiles.update(std::move(result.profile));
+                ++profiled;
+            }
+
+            if (profiled > 0)
+            {
+                try
+                {
+                    save_device_profiles(profiles, path);
+                    portable::println("Saved {} profile(s) to {}", profiled, path);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+            }
+            return succeeded;
+        }
+
+        // --sync-sample: every unit of every -i device is one column, read
+        // over a connection of its own so that no read waits for another.
+        bool run_sync_sampling_action(const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            SyncSettings settings;
+            try
+            {
+                auto address = parse_register_address(options.sync_address);
+                if (options.sync_count == 0 || options.sync_count > 125)
+                {
+                    throw std::out_of_range("--sync-count must be between 1 and 125");
+                }
+                if (address + options.sync_count > 0x10000)
+                {
+                    throw std::out_of_range(std::format("register range {}+{} exceeds the address space", options.sync_address, options.sync_count));
+                }
+                settings.address = address;
+                settings.io_backend = parse_io_backend(options.io_backend);
+                for (const auto &device : make_sessions(options))
+                {
+                    for (auto unit : device.units)
+                    {
+                        auto label = std::format("{}:{}", device.host, device.port);
+                        if (device.units.size() > 1)
+                        {
+                            label += std::format("/{}", unit);
+                        }
+                        settings.targets.push_back({std::move(label), device.connect_host(), device.connect_port(), unit});
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+            settings.count = static_cast<uint16_t>(options.sync_count);
+            settings.interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+            settings.timeout = std::chrono::duration_cast<std::chrono::milliseconds>(response_timeout_limit(options));
+            settings.max_skew = std::chrono::microseconds(static_cast<int64_t>(std::max(options.sync_max_skew_ms, 0.0) * 1000.0));
+            settings.rows = options.sync_rows;
+            settings.busy_poll = std::chrono::microseconds(std::max(options.rt_busy_poll_us, 0));
+            settings.spin = std::chrono::microseconds(std::max(options.rt_spin_us, 0));
+            if (deadline)
+            {
+                settings.deadline = *deadline;
+            }
+            install_stop_handlers();
+            settings.stop_requested = [] { return stop_requested(); };
+
+            std::optional<RealtimeScope> realtime;
+            try
+            {
+                enter_realtime(realtime, options);
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+
+            if (!options.sync_json)
+            {
+                portable::println("=== Synchronized Sampling ({} device(s), {} register(s) from {}, every {} ms, Ctrl+C to stop) ===",
+                                  settings.targets.size(), settings.count, options.sync_address, settings.interval.count());
+                portable::println("{}", format_sync_header(settings));
+            }
+            try
+            {
+                auto summary = run_sync_sampling(settings, [&](const SyncRow &row)
+                                                 { portable::println("{}", options.sync_json ? format_sync_row_json(settings, row) : format_sync_row(settings, row)); });
+                if (!options.sync_json)
+                {
+                    portable::println("{}", format_sync_summary(summary));
+                }
+                return summary.rows > 0;
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+        }
+
+        std::optional<TimePoint> invocation_deadline(const CommandLineOptions &options, TimePoint start)
+        {
+            if (options.deadline_seconds <= 0)
+            {
+                return std::nullopt;
+            }
+            return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.deadline_seconds));
+        }
+
+        struct CoilRange
+        {
+            uint16_t start;
+            uint16_t count;
+        };
+
+        // Throws std::exception on malformed or out-of-range arguments.
+        CoilRange parse_coil_range(const std::string &start_text, std::size_t count)
+        {
+            auto start = std::stoi(start_text, nullptr, 0);
+            if (start < 0 || start > 0xFFFF || start + static_cast<long>(count) > 0x10000)
+            {
+                throw std::out_of_range(std::format("coil range {}+{} exceeds the address space", start_text, count));
+            }
+            return {static_cast<uint16_t>(start), static_cast<uint16_t>(count)};
+        }
+
+        CoilRange parse_read_coils(const CoilRangeArgs &args)
+        {
+            auto count = std::stoi(args.count, nullptr, 0);
+            if (count < 1 || count > MAX_READ_COILS)
+            {
+                throw std::out_of_range(std::format("coil count must be 1-{}", MAX_READ_COILS));
+            }
+            return parse_coil_range(args.start, static_cast<std::size_t>(count));
+        }
+
+        std::pair<CoilRange, CoilBitset> parse_write_coils(const CoilRangeWriteArgs &args)
+        {
+            auto coils = CoilBitset::parse(args.bitmask);
+            if (!coils || coils->size() > MAX_WRITE_COILS)
+            {
+                throw std::invalid_argument(std::format("bitmask must be 1-{} characters of 0 and 1", MAX_WRITE_COILS));
+            }
+            return {parse_coil_range(args.start, coils->size()), std::move(*coils)};
+        }
+
+        std::string format_coils(CoilRange range, const CoilBitset &coils)
+        {
+            return std::format("Coils 0x{:04X}-0x{:04X}: {} ({} ON)", range.start, range.start + range.count - 1, coils.to_string(), coils.count_on());
+        }
+
+        // Applies the plan with a pool of worker threads, each serving one
+        // device at a time over its own blocking connection. Devices not
+        // started before the deadline are skipped; a started device always
+        // runs to completion so that it cannot be left half-written.
+        // Returns false if any device did not end up as planned.
+        bool run_apply_plan(const CommandLineOptions &options, const std::vector<DevicePlan> &plan, std::optional<TimePoint> deadline)
+        {
+            auto start = Clock::now();
+            std::vector<DeviceApplyResult> results(plan.size());
+            std::atomic<std::size_t> next_device{0};
+            DeviceErrorCounters errors;
+            std::vector<DeviceSession> sessions;
+            for (const auto &device : plan)
+            {
+                sessions.push_back(make_session(device.endpoint, options.port));
+            }
+
+            auto worker = [&]
+            {
+                for (std::size_t i; (i = next_device++) < plan.size();)
+                {
+                    results[i].endpoint = plan[i].endpoint;
+                    if (deadline && Clock::now() >= *deadline)
+                    {
+                        continue;
+                    }
+                    auto conn = connect_modbus_device(sessions[i].host, sessions[i].port, options.timeout_seconds);
+                    if (!conn)
+                    {
+                        errors.record(conn.error());
+                        results[i].outcome = ApplyOutcome::CONNECT_FAILED;
+                        results[i].message = describe(conn.error());
+                        continue;
+                    }
+                    results[i] = apply_device_plan(*conn, plan[i], options.apply_dry_run);
+                }
+            };
+
+            auto worker_count = std::clamp<std::size_t>(options.apply_workers, 1, std::max<std::size_t>(plan.size(), 1));
+            {
+                std::vector<std::jthread> workers;
+                for (std::size_t i = 0; i < worker_count; ++i)
+                {
+                    workers.emplace_back(worker);
+                }
+            }
+            auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            std::size_t succeeded = 0;
+            std::size_t changes = 0;
+            std::size_t writes = 0;
+            for (const auto &result : results)
+            {
+                portable::println("{}", format_apply_result(result));
+                succeeded += is_successful(result.outcome) ? 1 : 0;
+                changes += result.changes.size();
+                writes += result.writes;
+            }
+            portable::println("{} of {} device(s) OK, {} channel change(s), {} write(s) in {:.2f} s with {} worker(s) ({:.1f} devices/s)",
+                              succeeded, results.size(), changes, writes, elapsed, worker_count,
+                              elapsed > 0 ? static_cast<double>(results.size()) / elapsed : 0.0);
+            if (errors.total() > 0)
+            {
+                portable::println("Connect errors: {}", errors.format());
+            }
+            return succeeded == results.size();
+        }
+
+        // Refreshes the -i devices, or every recorded one without -i, and saves the inventory.
+        bool run_inventory_refresh(const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            auto start = Clock::now();
+            auto inventory = load_inventory(options.inventory_file);
+            std::vector<std::string> endpoints = options.ip_addresses;
+            if (endpoints.empty())
+            {
+                for (const auto &device : inventory.devices)
+                {
+                    endpoints.push_back(device.endpoint);
+                }
+            }
+
+            std::vector<DeviceSession> sessions;
+            for (const auto &endpoint : endpoints)
+            {
+                sessions.push_back(make_session(endpoint, options.port));
+            }
+            std::vector<InventoryRefresh> results(endpoints.size());
+            std::atomic<std::size_t> next_device{0};
+            DeviceErrorCounters errors;
+            auto worker = [&]
+            {
+                for (std::size_t i; (i = next_device++) < endpoints.size();)
+                {
+                    const auto *known = inventory.find(endpoints[i]);
+                    if (known)
+                    {
+                        results[i].device = *known;
+                    }
+                    results[i].device.endpoint = endpoints[i];
+                    if (deadline && Clock::now() >= *deadline)
+                    {
+                        results[i].message = "Deadline exceeded";
+                        continue;
+                    }
+                    auto conn = connect_modbus_device(sessions[i].host, sessions[i].port, options.timeout_seconds);
+                    if (!conn)
+                    {
+                        results[i].device.reachable = false;
+                        results[i].error = conn.error();
+                    }
+                    else
+                    {
+                        results[i] = refresh_inventory_device(*conn, endpoints[i], known, options.inventory_full);
+                    }
+                    if (results[i].error)
+                    {
+                        errors.record(*results[i].error);
+                    }
+                }
+            };
+
+            auto worker_count = std::clamp<std::size_t>(options.inventory_workers, 1, std::max<std::size_t>(endpoints.size(), 1));
+            {
+                std::vector<std::jthread> workers;
+                for (std::size_t i = 0; i < worker_count; ++i)
+                {
+                    workers.emplace_back(worker);
+                }
+            }
+
+            std::array<std::size_t, 4> outcomes{};
+            std::size_t reads = 0;
+            for (auto &result : results)
+            {
+                // Errors are only described when printed.
+                auto message = result.message;
+                if (result.error)
+                {
+                    message += std::format("{}{}", message.empty() ? "" : ": ", describe(*result.error));
+                }
+                portable::println("  {:<21} {:<11} {:>3} read(s) {:>2} module(s)  {:.1f} ms{}{}", result.device.endpoint, to_string(result.outcome),
+                                  result.reads, result.device.modules.size(), result.elapsed.count() / 1000.0,
+                                  message.empty() ? "" : "  ", message);
+                ++outcomes[static_cast<std::size_t>(result.outcome)];
+                reads += result.reads;
+                // Devices never reached are not recorded.
+                if (result.outcome != RefreshOutcome::UNREACHABLE || inventory.find(result.device.endpoint))
+                {
+                    inventory.update(std::move(result.device));
+                }
+            }
+            save_inventory(inventory, options.inventory_file);
+
+            auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            portable::println("{} device(s): {} unchanged, {} changed, {} added, {} unreachable; {} read(s) in {:.2f} s",
+                              results.size(), outcomes[static_cast<std::size_t>(RefreshOutcome::UNCHANGED)],
+                              outcomes[static_cast<std::size_t>(RefreshOutcome::CHANGED)], outcomes[static_cast<std::size_t>(RefreshOutcome::ADDED)],
+                              outcomes[static_cast<std::size_t>(RefreshOutcome::UNREACHABLE)], reads, elapsed);
+            if (errors.total() > 0)
+            {
+                portable::println("Device errors: {}", errors.format());
+            }
+            return outcomes[static_cast<std::size_t>(RefreshOutcome::UNREACHABLE)] == 0;
+        }
+
+        // The -i devices, or without -i every device recorded in --inventory
+        std::vector<std::string> fleet_endpoints(const CommandLineOptions &options)
+        {
+            std::vector<std::string> endpoints = options.ip_addresses;
+            if (endpoints.empty())
+            {
+                for (const auto &device : load_inventory(options.inventory_file).devices)
+                {
+                    endpoints.push_back(device.endpoint);
+                }
+            }
+            return endpoints;
+        }
+
+        // A rack polled repeatedly by a worker pool; the connection is kept
+        // between polls.
+        struct FleetDevice
+        {
+            std::string endpoint;
+            std::string host;
+            int port;
+            std::optional<libmodbus_cpp::ModbusConnection> conn{};
+            RackPoller poller{};
+        };
+
+        // Parses every endpoint up front, see make_session()
+        std::vector<FleetDevice> make_fleet_devices(const std::vector<std::string> &endpoints, int default_port)
+        {
+            std::vector<FleetDevice> devices;
+            for (const auto &endpoint : endpoints)
+            {
+                auto session = make_session(endpoint, default_port);
+                devices.push_back({endpoint, std::move(session.host), session.port});
+            }
+            return devices;
+        }
+
+        DeviceResult<RackSnapshot> poll_fleet_device(FleetDevice &device, const CommandLineOptions &options)
+        {
+            if (!device.conn)
+            {
+                auto conn = connect_modbus_device(device.host, device.port, options.timeout_seconds);
+                if (!conn)
+                {
+                    return std::unexpected(conn.error());
+                }
+                device.conn.emplace(std::move(*conn));
+            }
+            errno = 0;
+            auto snapshot = device.poller.poll(*device.conn);
+            if (snapshot.valid == 0)
+            {
+                // Nothing answered: reconnect, and read the module layout again, next time.
+                auto error = errno ? device_error_from_errno(errno) : DeviceError{DeviceErrc::TIMEOUT};
+                device.conn.reset();
+                device.poller = RackPoller{};
+                return std::unexpected(error);
+            }
+            return snapshot;
+        }
+
+        // Polls the devices of a fleet, each every interval, with a pool of
+        // workers. poll(device) runs without the lock and never for the same
+        // device in two workers at once; state it shares with other threads
+        // is guarded by mutex(). Only enabled devices are polled.
+        class FleetScheduler
+        {
+        public:
+            using PollFunction = std::function<void(std::size_t device)>;
+
+            FleetScheduler(std::size_t device_count, std::chrono::milliseconds interval, bool enabled)
+                : slots_(device_count, Slot{TimePoint{}, enabled, false}), interval_(interval)
+            {
+            }
+
+            ~FleetScheduler() { stop(); }
+
+            std::mutex &mutex() { return mutex_; }
+
+            // Call with mutex() held. Enabling a device polls it right away.
+            void enable(std::size_t device, bool enabled)
+            {
+                auto &slot = slots_[device];
+                if (enabled && !slot.enabled)
+                {
+                    slot.next_poll = Clock::now();
+                    wake_.notify_one();
+                }
+                slot.enabled = enabled;
+            }
+
+            // Call with mutex() held.
+            bool enabled(std::size_t device) const { return slots_[device].enabled; }
+            bool busy(std::size_t device) const { return slots_[device].busy; }
+
+            void start(std::size_t worker_count, PollFunction poll)
+            {
+                poll_ = std::move(poll);
+                for (std::size_t i = 0; i < worker_count; ++i)
+                {
+                    workers_.emplace_back([this] { work(); });
+                }
+            }
+
+            // Waits for the polls in progress.
+            void stop()
+            {
+                {
+                    std::lock_guard lock(mutex_);
+                    stopping_ = true;
+                }
+                wake_.notify_all();
+                workers_.clear();
+            }
+
+        private:
+            struct Slot
+            {
+                TimePoint next_poll;
+                bool enabled;
+                bool busy;  // a worker is polling it, without the lock
+            };
+
+            void work()
+            {
+                std::unique_lock lock(mutex_);
+                while (!stopping_)
+                {
+                    Slot *due = nullptr;
+                    for (auto &slot : slots_)
+                    {
+                        if (slot.enabled && !slot.busy && (!due || slot.next_poll < due->next_poll))
+                        {
+                            due = &slot;
+                        }
+                    }
+                    if (!due)
+                    {
+                        wake_.wait(lock);
+                        continue;
+                    }
+                    if (due->next_poll > Clock::now())
+                    {
+                        wake_.wait_until(lock, due->next_poll);
+                        continue;
+                    }
+
+                    due->busy = true;
+                    lock.unlock();
+                    poll_(static_cast<std::size_t>(due - slots_.data()));
+                    lock.lock();
+                    due->busy = false;
+                    due->next_poll = std::max(due->next_poll + interval_, Clock::now());
+                    wake_.notify_one();  // a worker may be waiting because this device was busy
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            bool stopping_ = false;
+            std::vector<Slot> slots_;
+            std::chrono::milliseconds interval_;
+            PollFunction poll_;
+            std::vector<std::jthread> workers_;  // last, so they are joined first
+        };
+
+        // --cluster-poll: the pollers that hear each other's heartbeats split
+        // the devices by consistent hashing; each polls its share with a
+        // worker pool and appends every snapshot to the shared sink. While
+        // a change of members propagates, a device may briefly be polled by
+        // its old and its new owner; the records name the poller.
+        bool run_cluster_polling(const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            std::vector<std::string> endpoints;
+            if (options.cluster_sink.empty())
+            {
+                portable::println("Error: --cluster-poll needs --cluster-sink FILE");
+                return false;
+            }
+
+            std::optional<ClusterMembership> membership;
+            std::optional<AppendSink> sink;
+            ClusterSettings settings;
+            settings.bind = options.cluster_bind;
+            settings.seeds = options.cluster_peers;
+            settings.heartbeat = std::chrono::milliseconds(std::max(options.cluster_heartbeat_ms, 50));
+            settings.expiry = settings.heartbeat * 4;
+            std::vector<FleetDevice> devices;
+            try
+            {
+                endpoints = fleet_endpoints(options);
+                devices = make_fleet_devices(endpoints, options.port);
+                membership.emplace(settings);
+                sink.emplace(options.cluster_sink);
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+            if (endpoints.empty())
+            {
+                portable::println("Error: no devices; give them with -i or record them with --inventory-refresh");
+                return false;
+            }
+
+
+            uint64_t polls = 0;
+            uint64_t failures = 0;
+            uint64_t sink_errors = 0;
+            DeviceErrorCounters errors;
+            auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+            const auto &self = membership->self();
+            FleetScheduler scheduler(devices.size(), interval, false);
+
+            auto poll_device = [&](FleetDevice &device)
+            {
+                auto snapshot = poll_fleet_device(device, options);
+                if (!snapshot)
+                {
+                    errors.record(snapshot.error());
+                    CAPAROC_LOG("{} poll failed: {}", device.endpoint, to_string(snapshot.error().code));
+                    auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    return std::pair{false, sink->write_line(format_cluster_error(device.endpoint, self, static_cast<uint64_t>(now_ns), snapshot.error()))};
+                }
+                CAPAROC_LOG("{} polled: {} modules in {} us", device.endpoint, snapshot->module_count, snapshot->poll_duration_us);
+                return std::pair{true, sink->write_line(format_cluster_record(device.endpoint, self, *snapshot))};
+            };
+
+            auto poll = [&](std::size_t index)
+            {
+                auto [polled, written] = poll_device(devices[index]);
+                std::lock_guard lock(scheduler.mutex());
+                ++polls;
+                failures += polled ? 0 : 1;
+                sink_errors += written ? 0 : 1;
+                if (!scheduler.enabled(index))
+                {
+                    devices[index].conn.reset();  // handed over while it was being polled
+                }
+            };
+
+            HashRing ring;
+            auto rebalance = [&]
+            {
+                ring.set_members(membership->members());
+                std::size_t owned = 0;
+                {
+                    std::lock_guard lock(scheduler.mutex());
+                    for (std::size_t i = 0; i < devices.size(); ++i)
+                    {
+                        bool mine = ring.owner(devices[i].endpoint) == self;
+                        if (!mine && !scheduler.busy(i))
+                        {
+                            devices[i].conn.reset();
+                        }
+                        scheduler.enable(i, mine);
+                        owned += mine ? 1 : 0;
+                    }
+                }
+                std::string names;
+                for (const auto &member : ring.members())
+                {
+                    names += std::format("{}{}{}", names.empty() ? "" : ", ", member, member == self ? " (this)" : "");
+                }
+                portable::println("Members: {}; polling {} of {} device(s)", names, owned, devices.size());
+            };
+
+            install_stop_handlers();
+            auto running = [&]
+            { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+
+            portable::println("=== Cluster Polling ({} device(s) every {} ms, heartbeats on {}, Ctrl+C to stop) ===", devices.size(), interval.count(), self);
+            // Listen for two heartbeats before taking a share, so a poller
+            // joining a running cluster does not start with every device.
+            auto settled = Clock::now() + 2 * settings.heartbeat;
+            while (running() && Clock::now() < settled)
+            {
+                membership->service(std::chrono::duration_cast<std::chrono::milliseconds>(settled - Clock::now()));
+            }
+
+            if (running())
+            {
+                rebalance();
+                scheduler.start(std::clamp<std::size_t>(options.cluster_workers, 1, devices.size()), poll);
+            }
+            while (running())
+            {
+                if (membership->service(std::chrono::milliseconds(100)))
+                {
+                    rebalance();
+                }
+            }
+            scheduler.stop();
+
+            portable::println("{} poll(s), {} failed, {} sink write(s) failed", polls, failures, sink_errors);
+            if (errors.total() > 0)
+            {
+                portable::println("Device errors: {}", errors.format());
+            }
+            return sink_errors == 0;
+        }
+
+        // --health-watch: a worker pool polls every device each interval and
+        // feeds FleetHealth, which keeps the scores ranked as they change;
+        // printing a ranking takes the lock only for the top entries.
+        bool run_health_watch(const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            std::vector<std::string> endpoints;
+            std::vector<FleetDevice> devices;
+            try
+            {
+                endpoints = fleet_endpoints(options);
+                devices = make_fleet_devices(endpoints, options.port);
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return false;
+            }
+            if (endpoints.empty())
+            {
+                portable::println("Error: no devices; give them with -i or record them with --inventory-refresh");
+                return false;
+            }
+
+
+            auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+            HealthSettings settings;
+            settings.half_life = std::chrono::seconds(std::max(options.health_half_life_s, 1));
+            settings.max_gap = interval * 3;
+            FleetHealth health(devices.size(), settings);
+
+            uint64_t polls = 0;
+            uint64_t failures = 0;
+            DeviceErrorCounters errors;
+            FleetScheduler scheduler(devices.size(), interval, true);
+
+            auto poll = [&](std::size_t index)
+            {
+                auto snapshot = poll_fleet_device(devices[index], options);
+                std::lock_guard lock(scheduler.mutex());
+                ++polls;
+                if (snapshot)
+                {
+                    health.add(index, *snapshot);
+                    return;
+                }
+                ++failures;
+                errors.record(snapshot.error());
+                CAPAROC_LOG("{} poll failed: {}", devices[index].endpoint, to_string(snapshot.error().code));
+                auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                health.add_failure(index, static_cast<uint64_t>(now_ns));
+            };
+
+            auto print_ranking = [&]
+            {
+                std::string ranking;
+                {
+                    std::lock_guard lock(scheduler.mutex());
+                    ranking = format_health_ranking(health, endpoints, std::max<std::size_t>(options.health_top, 1));
+                }
+                portable::println("{}", ranking);
+            };
+
+            install_stop_handlers();
+            auto running = [&]
+            { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+
+            portable::println("=== Fleet Health ({} device(s) every {} ms, Ctrl+C to stop) ===", devices.size(), interval.count());
+            scheduler.start(std::clamp<std::size_t>(options.health_workers, 1, devices.size()), poll);
+            auto report = std::chrono::seconds(options.health_report_s);
+            auto next_report = Clock::now() + report;
+            while (running())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (report.count() > 0 && Clock::now() >= next_report)
+                {
+                    print_ranking();
+                    next_report += report;
+                }
+            }
+            scheduler.stop();
+
+            print_ranking();
+            portable::println("{} poll(s), {} failed", polls, failures);
+            if (errors.total() > 0)
+            {
+                portable::println("Device errors: {}", errors.format());
+            }
+            // A ranking of devices that never answered ranks nothing.
+            return polls > failures;
+        }
+
+        bool execute_local_action(const CommandLineOptions &options, CommandLineAction action, std::optional<TimePoint> deadline)
+        {
+            bool succeeded = true;
+            switch (action)
+            {
+            case CommandLineAction::LIST_REGISTERS:
+                portable::println("=== All Registers ===");
+                if (cli::register_table().empty())
+                {
+                    portable::println("{}", caparoc::list_all_registers());
+                }
+                else
+                {
+                    portable::println("{}", cli::register_list());
+                }
+                break;
+
+            case CommandLineAction::REGISTER_INFO:
+                portable::println("=== Register Information ===");
+                portable::println("Address: {}", options.register_info_address);
+                // Parse hex address and get info
+                try
+                {
+                    auto addr = parse_register_address(options.register_info_address);
+                    // Unknown addresses are rare; libcaparoc words their message.
+                    if (const auto *entry = cli::find_register(addr))
+                    {
+                        portable::println("{}", entry->info);
+                    }
+                    else
+                    {
+                        portable::println("{}", caparoc::get_register_info(addr));
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error parsing address: {}", e.what());
+                }
+                break;
+
+            case CommandLineAction::SEARCH_REGISTERS:
+                portable::println("=== Search Results for '{}' ===", options.search_filter);
+                {
+                    // Searched in libcaparoc, whose matching rules the table does not reproduce
+                    auto results = caparoc::find_registers(options.search_filter);
+                    portable::println("Found {} registers", results.size());
+                    for (const auto &reg : results)
+                    {
+                        std::string access_str;
+                        switch (reg.access)
+                        {
+                        case caparoc::RegisterAccess::READ_ONLY:
+                            access_str = "RO";
+                            break;
+                        case caparoc::RegisterAccess::WRITE_ONLY:
+                            access_str = "WO";
+                            break;
+                        case caparoc::RegisterAccess::READ_WRITE:
+                            access_str = "RW";
+                            break;
+                        }
+                        portable::println("  [0x{:04X}] {} | {} - {}", reg.address, access_str, reg.name, reg.description);
+                    }
+                }
+                break;
+
+            case CommandLineAction::READ_SHM:
+                portable::println("=== Shared Memory Snapshot ({}) ===", normalize_shm_name(options.read_shm_name));
+                try
+                {
+                    SnapshotReader reader(options.read_shm_name);
+                    auto reading = reader.read();
+                    if (!reading)
+                    {
+                        portable::println("No snapshot published yet");
+                        break;
+                    }
+                    auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    auto age_s = (static_cast<double>(now_ns) - static_cast<double>(reading->snapshot.timestamp_ns)) / 1e9;
+                    portable::println("Snapshot #{} by pid {}{}, polled every {} ms",
+                                      reading->sequence / 2, reading->publisher_pid,
+                                      is_publisher_alive(*reading) ? "" : " (not running)", reading->poll_interval_ms);
+                    portable::println("Age: {:.3f} s, poll took {:.1f} ms, read in {} ns",
+                                      age_s, reading->snapshot.poll_duration_us / 1000.0, reading->read_duration.count());
+                    portable::println("{}", format_rack_snapshot(reading->snapshot));
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::SHOW_TRIP_EVENT:
+                portable::println("=== Trip Event ({}) ===", options.trip_show_file);
+                try
+                {
+                    portable::println("{}", format_trip_event(load_trip_event(options.trip_show_file)));
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::SHOW_LOG:
+                portable::println("=== Binary Log ({}) ===", options.log_show_file);
+                try
+                {
+                    auto log = read_binary_log(options.log_show_file);
+                    for (const auto &entry : log.entries)
+                    {
+                        portable::println("{}", format_log_entry(log, entry));
+                    }
+                    for (const auto &[thread, count] : log.dropped)
+                    {
+                        portable::println("T{}: {} record(s) dropped, the writer fell behind", thread, count);
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::REPLAY_TRACE:
+                portable::println("=== Replay Trace ({}) ===", options.replay_file);
+                try
+                {
+                    auto trace = read_trace(options.replay_file);
+                    ReplayServer server(trace, options.replay_port, options.replay_address);
+                    install_stop_handlers();
+                    portable::println("Serving {} exchange(s) on {}:{} {} (Ctrl+C to stop)", server.exchange_count(), server.address(), server.port(),
+                                      options.replay_speed > 0 ? std::format("at {}x recorded speed", options.replay_speed) : std::string("without delay"));
+                    auto stats = server.run(options.replay_speed, [&]
+                                            { return stop_requested() || (deadline && Clock::now() >= *deadline); });
+                    portable::println("Served {} connection(s): {} matched, {} repeated, {} unanswered, {} from registers, {} unmatched request(s)",
+                                      stats.connections, stats.matched, stats.repeated, stats.unanswered, stats.from_registers, stats.unmatched);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::APPLY_PLAN:
+                portable::println("=== Apply Plan ({}){} ===", options.apply_plan_file, options.apply_dry_run ? " (dry run)" : "");
+                try
+                {
+                    succeeded = run_apply_plan(options, load_apply_plan(options.apply_plan_file), deadline);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::PROFILE_DEVICE:
+                succeeded = run_device_profiling(options, deadline);
+                break;
+
+            case CommandLineAction::SYNC_SAMPLE:
+                succeeded = run_sync_sampling_action(options, deadline);
+                break;
+
+            case CommandLineAction::CLUSTER_POLL:
+                succeeded = run_cluster_polling(options, deadline);
+                break;
+
+            case CommandLineAction::HEALTH_WATCH:
+                succeeded = run_health_watch(options, deadline);
+                break;
+
+            case CommandLineAction::DISCOVER_DEVICES:
+                portable::println("=== Device Discovery ({}) ===", options.discover_cidr);
+                try
+                {
+                    auto result = cli::discover_devices(options.discover_cidr, options.port, options.timeout_seconds, options.discover_max_sockets);
+                    portable::println("Scanned {} hosts in {:.2f} s", result.hosts_scanned, result.elapsed.count() / 1000.0);
+                    portable::println("Found {} CAPAROC device(s)", result.devices.size());
+                    for (const auto &device : result.devices)
+                    {
+                        portable::println("  {:<15}  modules: {:>2}  power module: {}  ({} ms)",
+                                          device.ip_address, device.connected_modules,
+                                          device.power_module_name.empty() ? "(unknown)" : device.power_module_name,
+                                          device.response_time.count());
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::INVENTORY_REFRESH:
+            case CommandLineAction::INVENTORY_LIST:
+            case CommandLineAction::INVENTORY_QUERY:
+                try
+                {
+                    if (options.inventory_file.empty())
+                    {
+                        throw std::invalid_argument("--inventory FILE is required");
+                    }
+                    if (action == CommandLineAction::INVENTORY_REFRESH)
+                    {
+                        portable::println("=== Inventory Refresh ({}){} ===", options.inventory_file, options.inventory_full ? " (full)" : "");
+                        succeeded = run_inventory_refresh(options, deadline);
+                        break;
+                    }
+
+                    auto inventory = load_inventory(options.inventory_file);
+                    if (action == CommandLineAction::INVENTORY_LIST)
+                    {
+                        portable::println("=== Inventory ({}) ===", options.inventory_file);
+                        portable::println("{}", format_inventory(inventory));
+                        break;
+                    }
+
+                    portable::println("=== Inventory Query '{}' ({}) ===", options.inventory_query, options.inventory_file);
+                    auto query_start = Clock::now();
+                    auto matches = find_modules(inventory, options.inventory_query);
+                    auto query_time = std::chrono::duration<double, std::micro>(Clock::now() - query_start).count();
+                    std::size_t channels = 0;
+                    for (const auto &match : matches)
+                    {
+                        portable::println("  {:<21} module {:>2}  {:<32}  channels 1-{}", match.device->endpoint, match.module->position,
+                                          match.module->product_name, match.module->channels);
+                        channels += match.module->channels;
+                    }
+                    portable::println("{} channel(s) on {} module(s) (query took {:.1f} us)", channels, matches.size(), query_time);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                    succeeded = false;
+                }
+                break;
+
+            case CommandLineAction::NONE:
+            default:
+                break;
+            }
+            return succeeded;
+        }
+
+        // --read-uint16/-uint32/-string32: the register type fixes the width
+        // of the read and how its words are decoded.
+        template <RegisterType Type>
+        void print_register_read(libmodbus_cpp::ModbusConnection &conn, const std::string &address)
+        {
+            portable::println("=== Read {} Register ===", RegisterTraits<Type>::name);
+            portable::println("Address: {}", address);
+            try
+            {
+                auto val = read_register(conn, Register<Type>{parse_register_address(address)});
+                if (!val)
+                {
+                    portable::println("Failed to read register");
+                }
+                else if constexpr (Type == RegisterType::STRING32)
+                {
+                    portable::println("Value: \"{}\"", *val);
+                }
+                else
+                {
+                    portable::println("Value: {}", *val);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+            }
+        }
+
+        // --trip-capture. The polling thread only fills the history rings and
+        // cuts events; frozen events go through a lock-free queue to a writer
+        // thread, so saving a file never stretches the sampling around the
+        // next trip. Events the queue cannot take yet wait in a backlog of the
+        // polling thread instead of blocking it.
+        void run_trip_capture(libmodbus_cpp::ModbusConnection &conn, const CommandLineOptions &options, std::optional<TimePoint> deadline)
+        {
+            auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+            TripRecorder recorder(options.trip_pre, options.trip_post);
+            RackPoller poller;
+            SpscQueue<TripEvent, 64> queue;
+            std::deque<TripEvent> backlog;
+            std::atomic<bool> sampling_done{false};
+            std::atomic<uint64_t> saved{0};
+
+            auto write_events = [&]
+            {
+                for (;;)
+                {
+                    bool done = sampling_done.load(std::memory_order_acquire);
+                    while (auto event = queue.pop())
+                    {
+                        try
+                        {
+                            auto path = save_trip_event(*event, options.trip_capture_dir);
+                            saved.fetch_add(1, std::memory_order_relaxed);
+                            portable::println("Saved {}", path);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            portable::println("Error: {}", e.what());
+                        }
+                    }
+                    if (done)
+                    {
+                        return;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                }
+            };
+            auto hand_over = [&]
+            {
+                for (auto &event : recorder.take_completed())
+                {
+                    backlog.push_back(std::move(event));
+                }
+                while (!backlog.empty() && queue.push(backlog.front()))
+                {
+                    backlog.pop_front();
+                }
+            };
+
+            std::thread writer(write_events);
+            install_stop_handlers();
+            portable::println("=== Trip capture into {}, polling every {} ms, {} samples before and {} from a trigger (Ctrl+C to stop) ===",
+                              options.trip_capture_dir, interval.count(), options.trip_pre, options.trip_post);
+
+            // A full poll every interval keeps the rings of all channels
+            // current; in between, modules with an open window are read in
+            // turn as fast as the device answers. A rack window turns every
+            // read into a full poll.
+            // The writer thread is already running, so it does not inherit
+            // the real-time policy of the sampling thread.
+            PollSchedule schedule(interval, std::chrono::microseconds(std::max(options.rt_spin_us, 0)));
+            auto running = [&] { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+            try
+            {
+                std::optional<RealtimeScope> realtime;
+                enter_realtime(realtime, options);
+                std::size_t next_burst = 0;
+                uint64_t triggers = 0;
+                while (running())
+                {
+                    auto bursting = recorder.burst_modules();
+                    auto now = Clock::now();
+                    if (now >= schedule.due() || (!bursting.empty() && bursting.front() == 0))
+                    {
+                        if (now >= schedule.due())
+                        {
+                            schedule.start_poll();
+                        }
+                        auto snapshot = poller.poll(conn);
+                        recorder.add(snapshot);
+                        CAPAROC_DEBUG(options.debug, "Snapshot: {} modules, poll took {:.1f} ms", snapshot.module_count, snapshot.poll_duration_us / 1000.0);
+                    }
+                    else if (!bursting.empty())
+                    {
+                        recorder.add(poller.poll_module(conn, bursting[next_burst++ % bursting.size()]));
+                    }
+                    else
+                    {
+                        schedule.wait(running);
+                        continue;
+                    }
+
+                    if (recorder.events() != triggers)
+                    {
+                        triggers = recorder.events();
+                        std::string modules;
+                        for (auto module : recorder.burst_modules())
+                        {
+                            modules += modules.empty() ? "" : ", ";
+                            modules += module == 0 ? std::string("rack") : std::format("module {}", module);
+                        }
+                        portable::println("Trigger #{}: burst sampling {}", triggers, modules);
+                    }
+                    hand_over();
+                }
+            }
+            catch (...)
+            {
+                sampling_done.store(true, std::memory_order_release);
+                writer.join();
+                throw;
+            }
+
+            recorder.flush();
+            hand_over();
+            while (!backlog.empty())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                hand_over();
+            }
+            sampling_done.store(true, std::memory_order_release);
+            writer.join();
+            portable::println("Captured {} event(s), saved {}", recorder.events(), saved.load());
+            print_jitter_report(options, schedule);
+        }
+
+        void execute_blocking_action(libmodbus_cpp::ModbusConnection &conn, const CommandLineOptions &options, CommandLineAction action,
+                                     std::optional<TimePoint> deadline)
+        {
+            switch (action)
+            {
+            case CommandLineAction::READ_UINT16:
+                print_register_read<RegisterType::UINT16>(conn, options.read_uint16_address);
+                break;
+
+            case CommandLineAction::READ_UINT32:
+                print_register_read<RegisterType::UINT32>(conn, options.read_uint32_address);
+                break;
+
+            case CommandLineAction::READ_STRING32:
+                print_register_read<RegisterType::STRING32>(conn, options.read_string32_address);
+                break;
+
+            case CommandLineAction::WRITE_UINT16:
+                portable::println("=== Write UINT16 Registers ===");
+                for (const auto &args : options.write_uint16_args)
+                {
+                    try
+                    {
+                        auto addr = parse_register_address(args.address);
+                        auto val = std::stoi(args.value, nullptr, 0);
+                        if (write_register(conn, Register<RegisterType::UINT16, RegisterAccess::READ_WRITE>{addr}, static_cast<uint16_t>(val)))
+                        {
+                            portable::println("  0x{:04X} = {} (SUCCESS)", addr, val);
+                        }
+                        else
+                        {
+                            portable::println("  0x{:04X} = {} (FAILED)", addr, val);
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("  Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::WRITE_UINT32:
+                portable::println("=== Write UINT32 Registers ===");
+                for (const auto &args : options.write_uint32_args)
+                {
+                    try
+                    {
+                        auto addr = parse_register_address(args.address);
+                        auto val = std::stoll(args.value, nullptr, 0);
+                        if (write_register(conn, Register<RegisterType::UINT32, RegisterAccess::READ_WRITE>{addr}, static_cast<uint32_t>(val)))
+                        {
+                            portable::println("  0x{:04X} = {} (SUCCESS)", addr, val);
+                        }
+                        else
+                        {
+                            portable::println("  0x{:04X} = {} (FAILED)", addr, val);
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("  Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::RESET_APPLICATION_PARAMS_POWER_AND_CB:
+                portable::println("=== Reset Application Parameters (Power Module and Circuit Breakers) ===");
+                if (caparoc::reset_application_params_power_and_cb(conn))
+                {
+                    portable::println("SUCCESS");
+                }
+                else
+                {
+                    portable::println("FAILED");
+                }
+                break;
+
+            case CommandLineAction::GLOBAL_CHANNEL_ERROR_RESET_ALL_CB:
+                portable::println("=== Global Channel Error Reset (All Circuit Breakers) ===");
+                if (caparoc::global_channel_error_reset_all_cb(conn))
+                {
+                    portable::println("SUCCESS");
+                }
+                else
+                {
+                    portable::println("FAILED");
+                }
+                break;
+
+            case CommandLineAction::ERROR_COUNTER_RESET_ALL_CB:
+                portable::println("=== Error Counter Reset (All Circuit Breakers) ===");
+                if (caparoc::error_counter_reset_all_cb(conn))
+                {
+                    portable::println("SUCCESS");
+                }
+                else
+                {
+                    portable::println("FAILED");
+                }
+                break;
+
+            case CommandLineAction::RESET_APPLICATION_PARAMS_QUINT:
+                portable::println("=== Reset Application Parameters (QUINT Power Supply) ===");
+                if (caparoc::reset_application_params_quint(conn))
+                {
+                    portable::println("SUCCESS");
+                }
+                else
+                {
+                    portable::println("FAILED");
+                }
+                break;
+
+            case CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE:
+                portable::println("=== Product Name (Power Module) ===");
+                {
+                    auto name = caparoc::get_product_name_power_module(conn);
+                    if (name)
+                    {
+                        portable::println("Name: {}", *name);
+                    }
+                    else
+                    {
+                        portable::println("Failed to read product name");
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_PRODUCT_NAME_MODULE:
+                for (const auto &module_num : options.product_module_numbers)
+                {
+                    portable::println("=== Product Name (Module {}) ===", module_num);
+                    auto name = caparoc::get_product_name_module(conn, static_cast<uint8_t>(module_num));
+                    if (name)
+                    {
+                        portable::println("Name: {}", *name);
+                    }
+                    else
+                    {
+                        portable::println("Failed to read product name (module might not be installed)");
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_PRODUCT_NAME_QUINT:
+                portable::println("=== Product Name (QUINT Power Supply) ===");
+                {
+                    auto name = caparoc::get_product_name_quint(conn);
+                    if (name)
+                    {
+                        portable::println("Name: {}", *name);
+                    }
+                    else
+                    {
+                        portable::println("Failed to read product name");
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_NUM_CONNECTED_MODULES:
+                portable::println("=== Number of Currently Connected Modules ===");
+                {
+                    auto num = read_register(conn, registers::NUM_CONNECTED_MODULES);
+                    if (num)
+                    {
+                        portable::println("Connected modules: {}", *num);
+                    }
+                    else
+                    {
+                        portable::println("Failed to read number of connected modules");
+                    }
+                }
+                break;
+
+            case CommandLineAction::PRINT_DEVICE_INFO:
+                portable::println("=== Device Information ===");
+                {
+                    try
+                    {
+                        portable::println("{}", caparoc::print_device_info(conn));
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error reading device information: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_SYSTEM_STATUS:
+                portable::println("=== System Status ===");
+                {
+                    auto global_status = caparoc::get_global_status(conn);
+                    if (global_status)
+                    {
+                        portable::println("Global Status Bits:");
+                        portable::println("  Undervoltage: {}", global_status->undervoltage ? "YES" : "no");
+                        portable::println("  Overvoltage: {}", global_status->overvoltage ? "YES" : "no");
+                        portable::println("  Cumulative Channel Error: {}", global_status->cumulative_channel_error ? "YES" : "no");
+                        portable::println("  Cumulative 80% Warning: {}", global_status->cumulative_80_warning ? "YES" : "no");
+                        portable::println("  System Current Too High: {}", global_status->system_current_too_high ? "YES" : "no");
+                    }
+                    else
+                    {
+                        portable::println("Failed to read global status");
+                    }
+
+                    auto total_current = caparoc::get_total_system_current(conn);
+                    if (total_current)
+                    {
+                        portable::println("Total System Current: {} A", *total_current);
+                    }
+
+                    auto input_voltage = caparoc::get_input_voltage(conn);
+                    if (input_voltage)
+                    {
+                        portable::println("Input Voltage: {:.2f} V", *input_voltage / 100.0);
+                    }
+
+                    auto sum_nominal = caparoc::get_sum_of_nominal_currents(conn);
+                    if (sum_nominal)
+                    {
+                        portable::println("Sum of Nominal Currents: {} A", *sum_nominal);
+                    }
+
+                    auto temperature = caparoc::get_internal_temperature(conn);
+                    if (temperature)
+                    {
+                        portable::println("Internal Temperature: {} °C", *temperature);
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_CHANNEL_STATUS:
+                for (const auto &args : options.get_channel_status_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        portable::println("=== Channel Status (Module {}, Channel {}) ===", module, channel);
+
+                        auto status = caparoc::get_channel_status(conn, static_cast<uint8_t>(module), static_cast<uint8_t>(channel));
+                        if (status)
+                        {
+                            portable::println("  80% Warning: {}", status->warning_80_percent ? "YES" : "no");
+                            portable::println("  Overload: {}", status->overload ? "YES" : "no");
+                            portable::println("  Short Circuit: {}", status->short_circuit ? "YES" : "no");
+                            portable::println("  Hardware Error: {}", status->hardware_error ? "YES" : "no");
+                            portable::println("  Voltage Error: {}", status->voltage_error ? "YES" : "no");
+                            portable::println("  Module Current Too High: {}", status->module_current_too_high ? "YES" : "no");
+                            portable::println("  System Current Too High: {}", status->system_current_too_high ? "YES" : "no");
+                        }
+                        else
+                        {
+                            portable::println("FAILED");
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_LOAD_CURRENT:
+                for (const auto &args : options.get_load_current_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        portable::println("=== Load Current (Module {}, Channel {}) ===", module, channel);
+
+                        auto current = caparoc::get_load_current(conn, static_cast<uint8_t>(module), static_cast<uint8_t>(channel));
+                        if (current)
+                        {
+                            double amps = *current / 1000.0;
+                            portable::println("{:.1f} A ({} mA)", amps, *current);
+                        }
+                        else
+                        {
+                            portable::println("FAILED");
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::CONTROL_CHANNEL:
+                for (const auto &args : options.control_channel_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        bool on = (args.state == "on" || args.state == "ON" || args.state == "1");
+                        portable::println("=== Control Channel (Module {}, Channel {} -> {}) ===", module, channel, on ? "ON" : "OFF");
+
+                        if (caparoc::control_channel(conn, static_cast<uint8_t>(module), static_cast<uint8_t>(channel), on))
+                        {
+                            portable::println("SUCCESS");
+                        }
+                        else
+                        {
+                            portable::println("FAILED");
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::SWITCH_SEQUENCE:
+                for (const auto &args : options.switch_sequence_args)
+                {
+                    try
+                    {
+                        if (args.state != "on" && args.state != "ON" && args.state != "off" && args.state != "OFF")
+                        {
+                            throw std::invalid_argument(std::format("invalid state '{}' (expected on|off)", args.state));
+                        }
+                        SwitchingPlan plan;
+                        plan.on = args.state == "on" || args.state == "ON";
+                        plan.channels = resolve_channel_selection(conn, args.channels);
+                        plan.max_simultaneous = options.switch_max_simultaneous;
+                        plan.stagger = std::chrono::milliseconds(options.switch_stagger_ms);
+                        plan.verify_timeout = std::chrono::milliseconds(options.switch_verify_timeout_ms);
+
+                        portable::println("=== Switching Sequence ({} -> {}, {} at a time, {} ms stagger) ===",
+                                          args.channels, plan.on ? "ON" : "OFF", plan.max_simultaneous, options.switch_stagger_ms);
+                        portable::println("{}", format_switching_report(run_switching_plan(conn, plan, deadline)));
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::PUBLISH_SHM:
+                try
+                {
+                    auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+                    SnapshotPublisher publisher(options.publish_shm_name, static_cast<uint32_t>(interval.count()));
+                    RackPoller poller;
+                    install_stop_handlers();
+                    portable::println("=== Publishing snapshots to {} every {} ms (Ctrl+C to stop) ===", publisher.name(), interval.count());
+
+                    std::optional<RealtimeScope> realtime;
+                    enter_realtime(realtime, options);
+
+                    std::size_t published = 0;
+                    PollSchedule schedule(interval, std::chrono::microseconds(options.rt_spin_us));
+                    auto running = [&] { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+                    while (running())
+                    {
+                        schedule.start_poll();
+                        auto snapshot = poller.poll(conn);
+                        publisher.publish(snapshot);
+                        ++published;
+                        CAPAROC_DEBUG(options.debug, "Snapshot #{}: {} modules, poll took {:.1f} ms", published, snapshot.module_count,
+                                      snapshot.poll_duration_us / 1000.0);
+                        schedule.wait(running);
+                    }
+                    portable::println("Published {} snapshot(s), removed {}", published, publisher.name());
+                    print_jitter_report(options, schedule);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                }
+                break;
+
+            case CommandLineAction::PUBLISH_MQTT:
+                try
+                {
+                    if (options.mqtt_qos < 0 || options.mqtt_qos > 1 || options.mqtt_batch < 1 || options.mqtt_full_every < 0 ||
+                        options.mqtt_deadband_ma < 0 || options.mqtt_deadband_ma > UINT16_MAX || options.mqtt_queue_limit == 0)
+                    {
+                        throw std::invalid_argument("--mqtt-qos must be 0 or 1, --mqtt-batch and --mqtt-queue-limit at least 1, "
+                                                    "--mqtt-full-every and --mqtt-deadband not negative");
+                    }
+                    auto broker = make_session(options.mqtt_broker, MQTT_DEFAULT_PORT);
+                    const auto &device = options.ip_addresses.front();
+
+                    MqttPublisherSettings settings;
+                    settings.host = broker.host;
+                    settings.port = broker.port;
+                    settings.client_id = options.mqtt_client_id.empty() ? "caparoc_commander-" + device : options.mqtt_client_id;
+                    settings.topic_prefix = options.mqtt_topic + "/" + device;
+                    settings.qos = static_cast<uint8_t>(options.mqtt_qos);
+                    settings.batch = options.mqtt_batch;
+                    settings.full_every = options.mqtt_full_every;
+                    settings.deadband_ma = static_cast<uint16_t>(options.mqtt_deadband_ma);
+                    settings.compress = options.mqtt_compress;
+                    settings.queue_file = options.mqtt_queue_file;
+                    settings.queue_limit = options.mqtt_queue_limit;
+                    settings.connect_timeout_seconds = options.timeout_seconds;
+
+                    auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+                    MqttPublisher publisher(settings);
+                    RackPoller poller;
+                    install_stop_handlers();
+                    portable::println("=== Publishing snapshots to mqtt://{}:{}/{} every {} ms (Ctrl+C to stop) ===",
+                                      settings.host, settings.port, settings.topic_prefix, interval.count());
+                    if (publisher.queued() > 0)
+                    {
+                        portable::println("{} message(s) left from an earlier run are queued in {}", publisher.queued(), settings.queue_file);
+                    }
+
+                    std::optional<RealtimeScope> realtime;
+                    enter_realtime(realtime, options);
+
+                    bool was_connected = false;
+                    auto spin = std::chrono::microseconds(options.rt_spin_us);
+                    PollSchedule schedule(interval, spin);
+                    auto running = [&] { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+                    while (running())
+                    {
+                        schedule.start_poll();
+                        auto snapshot = poller.poll(conn);
+                        publisher.publish(snapshot);
+                        CAPAROC_DEBUG(options.debug, "Snapshot #{}: {} modules, poll took {:.1f} ms, {} message(s) queued", publisher.stats().polls,
+                                      snapshot.module_count, snapshot.poll_duration_us / 1000.0, publisher.queued());
+
+                        // The time between polls is spent talking to the broker.
+                        do
+                        {
+                            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(schedule.due() - spin - Clock::now());
+                            publisher.service(std::clamp(remaining, std::chrono::milliseconds(0), std::chrono::milliseconds(100)));
+                            if (publisher.connected() != was_connected)
+                            {
+                                was_connected = publisher.connected();
+                                if (was_connected)
+                                {
+                                    portable::println("Connected to broker {}:{}", settings.host, settings.port);
+                                }
+                                else
+                                {
+                                    portable::println("Broker unreachable ({}), queueing messages", publisher.last_error());
+                                }
+                            }
+                        } while (running() && Clock::now() < schedule.due() - spin);
+                        schedule.wait(running);
+                    }
+
+                    const auto &stats = publisher.stats();
+                    portable::println("Published {} poll(s) as {} sample(s) in {} message(s), {} payload bytes ({} before compression), "
+                                      "{} dropped, {} connect(s)",
+                                      stats.polls, stats.samples, stats.messages, stats.payload_bytes, stats.json_bytes, stats.dropped, stats.connects);
+                    print_jitter_report(options, schedule);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                }
+                break;
+
+            case CommandLineAction::LOAD_STATISTICS:
+                try
+                {
+                    auto interval = std::chrono::milliseconds(std::max(options.poll_interval_ms, 1));
+                    auto window = std::chrono::seconds(options.stats_window_s);
+                    auto slide = options.stats_slide_s == 0 ? window : std::chrono::seconds(options.stats_slide_s);
+                    // Polls further apart than this (device unreachable) are not integrated into energy.
+                    auto max_gap = std::max<std::chrono::milliseconds>(5 * interval, std::chrono::seconds(10));
+                    LoadAggregator aggregator(window, slide, max_gap);
+                    RackPoller poller;
+                    install_stop_handlers();
+                    if (!options.stats_json)
+                    {
+                        portable::println("=== Load statistics over {} s windows every {} s, polling every {} ms (Ctrl+C to stop) ===",
+                                          window.count(), slide.count(), interval.count());
+                    }
+
+                    auto report = [&](const LoadWindow &result)
+                    {
+                        portable::println("{}", options.stats_json ? format_load_window_json(result) : format_load_window(result));
+                    };
+
+                    std::optional<RealtimeScope> realtime;
+                    enter_realtime(realtime, options);
+
+                    PollSchedule schedule(interval, std::chrono::microseconds(options.rt_spin_us));
+                    auto running = [&] { return !stop_requested() && !(deadline && Clock::now() >= *deadline); };
+                    while (running())
+                    {
+                        schedule.start_poll();
+                        auto snapshot = poller.poll(conn);
+                        for (const auto &result : aggregator.add(snapshot))
+                        {
+                            report(result);
+                        }
+                        CAPAROC_DEBUG(options.debug, "Snapshot: {} modules, poll took {:.1f} ms", snapshot.module_count, snapshot.poll_duration_us / 1000.0);
+                        schedule.wait(running);
+                    }
+                    if (auto partial = aggregator.current(); partial && partial->polls > 0)
+                    {
+                        report(*partial);
+                    }
+                    print_jitter_report(options, schedule);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                }
+                break;
+
+            case CommandLineAction::TRIP_CAPTURE:
+                try
+                {
+                    run_trip_capture(conn, options, deadline);
+                }
+                catch (const std::exception &e)
+                {
+                    portable::println("Error: {}", e.what());
+                }
+                break;
+
+            case CommandLineAction::READ_COIL:
+                portable::println("=== Read Coil ===");
+
+                for (const auto &args : options.read_coil_args)
+                {
+                    try
+                    {
+                        auto addr = std::stoi(args.address, nullptr, 0);
+                        bool value;
+
+                        if (conn.read_coil(static_cast<uint16_t>(addr), value))
+                        {
+                            portable::println("Coil 0x{:04X}: {} ({})", addr, value ? "ON" : "OFF", value);
+                        }
+                        else
+                        {
+                            portable::println("Failed to read coil 0x{:04X}: {}", addr, conn.get_last_error());
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::WRITE_COIL:
+                portable::println("=== Write Coil ===");
+                for (const auto &args : options.write_coil_args)
+                {
+                    try
+                    {
+                        auto addr = std::stoi(args.address, nullptr, 0);
+                        bool state = (args.state == "on" || args.state == "ON" || 
+                                     args.state == "true" || args.state == "TRUE" || 
+                                     args.state == "1");
+                
+                        if (conn.write_coil(static_cast<uint16_t>(addr), state))
+                        {
+                            portable::println("Coil 0x{:04X} = {} (SUCCESS)", addr, state ? "ON" : "OFF");
+                        }
+                        else
+                        {
+                            portable::println("Coil 0x{:04X} = {} (FAILED): {}", addr, state ? "ON" : "OFF", conn.get_last_error());
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            // Only reached where the raw Modbus client is unavailable; the
+            // connection API has no bulk coil access, so go coil by coil.
+            case CommandLineAction::READ_COILS:
+                portable::println("=== Read Coils ===");
+                for (const auto &args : options.read_coils_args)
+                {
+                    try
+                    {
+                        auto range = parse_read_coils(args);
+                        CoilBitset coils(range.count);
+                        bool ok = true;
+                        for (uint16_t i = 0; ok && i < range.count; ++i)
+                        {
+                            bool value = false;
+                            ok = conn.read_coil(static_cast<uint16_t>(range.start + i), value);
+                            coils.set(i, value);
+                        }
+                        if (ok)
+                        {
+                            portable::println("{}", format_coils(range, coils));
+                        }
+                        else
+                        {
+                            portable::println("Failed to read coils at 0x{:04X}: {}", range.start, conn.get_last_error());
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::WRITE_COILS:
+                portable::println("=== Write Coils ===");
+                for (const auto &args : options.write_coils_args)
+                {
+                    try
+                    {
+                        auto [range, coils] = parse_write_coils(args);
+                        bool ok = true;
+                        for (uint16_t i = 0; ok && i < range.count; ++i)
+                        {
+                            ok = conn.write_coil(static_cast<uint16_t>(range.start + i), coils.test(i));
+                        }
+                        portable::println("Coils 0x{:04X} = {} ({})", range.start, coils.to_string(), ok ? "SUCCESS" : std::format("FAILED: {}", conn.get_last_error()));
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::GET_NOMINAL_CURRENT:
+                for (const auto &args : options.get_nominal_current_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        portable::println("=== Get Nominal Current (Module {}, Channel {}) ===", module, channel);
+                        auto value = caparoc::get_nominal_current(conn, static_cast<uint8_t>(module), static_cast<uint8_t>(channel));
+                        if (value)
+                        {
+                            portable::println("Nominal current: {} A", *value);
+                        }
+                        else
+                        {
+                            portable::println("Failed to read nominal current");
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::SET_NOMINAL_CURRENT:
+                for (const auto &args : options.set_nominal_current_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        auto value = std::stoi(args.value);
+                        portable::println("=== Set Nominal Current (Module {}, Channel {} to {} A) ===", module, channel, value);
+                        if (caparoc::set_nominal_current(conn, static_cast<uint8_t>(module), static_cast<uint8_t>(channel), static_cast<uint16_t>(value)))
+                        {
+                            portable::println("SUCCESS");
+                        }
+                        else
+                        {
+                            portable::println("FAILED");
+                        }
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::UNLOCK_NOMINAL_CURRENT:
+                for (const auto &args : options.unlock_nominal_current_args)
+                {
+                    try
+                    {
+                        auto module = std::stoi(args.module_number);
+                        auto channel = std::stoi(args.channel_number);
+                        auto channel_lock = registers::CHANNEL_LOCK.at(module, channel);
+                        portable::println("=== Unlock Nominal Current (Module {}, Channel {}) ===", module, channel);
+
+                        if (!write_register(conn, registers::GLOBAL_LOCK, 0))
+                        {
+                            portable::println("FAILED (global lock)");
+                            continue;
+                        }
+                        if (!write_register(conn, channel_lock, 0))
+                        {
+                            portable::println("FAILED (channel lock)");
+                            continue;
+                        }
+
+                        portable::println("SUCCESS");
+                    }
+                    catch (const std::exception &e)
+                    {
+                        portable::println("Error parsing arguments: {}", e.what());
+                    }
+                }
+                break;
+
+            case CommandLineAction::NONE:
+            default:
+                break;
+            }
+        }
+
+        // Seeds the estimator of a fresh blocking connection with a few timed
+        // register reads. libcaparoc issues its requests internally, so these
+        // probes are the only round trips of this path that can be measured.
+        void calibrate_rtt(libmodbus_cpp::ModbusConnection &conn, RttEstimator &rtt, uint8_t unit)
+        {
+            constexpr int PROBES = 3;
+            auto limit = rtt.max_timeout();
+            conn.set_response_timeout(static_cast<int>(limit.count() / 1'000'000), static_cast<int>(limit.count() % 1'000'000));
+            if (!conn.set_slave_id(unit))
+            {
+                return;
+            }
+            for (int i = 0; i < PROBES; ++i)
+            {
+                auto start = Clock::now();
+                if (!read_register(conn, registers::NUM_CONNECTED_MODULES))
+                {
+                    return;
+                }
+                rtt.sample(std::chrono::duration_cast<RttEstimator::Duration>(Clock::now() - start));
+            }
+        }
+
+        // Runs one libcaparoc-backed action on the device's blocking connection.
+        // The response timeout is clamped to what is left of the invocation
+        // deadline, so a blocking call cannot outlive it. With an RTT estimator
+        // it follows the measured round-trip time; libcaparoc does not resend,
+        // so unlike the async path a timeout here fails the action.
+        // Returns false if the device could not be used.
+        bool run_blocking_action(DeviceSession &device, const CommandLineOptions &options, CommandLineAction action, std::optional<TimePoint> deadline,
+                                 DeviceErrorCounters *errors = nullptr)
+        {
+            if (deadline && Clock::now() >= *deadline)
+            {
+                return false;
+            }
+
+            if (!device.conn)
+            {
+                auto conn = connect_modbus_device(device.connect_host(), device.connect_port(), options.timeout_seconds);
+                if (!conn)
+                {
+                    if (errors)
+                    {
+                        errors->record(conn.error());
+                    }
+                    portable::println("ERROR: {}", format_connect_error(conn.error(), device.connect_host(), device.connect_port()));
+                    device.failed = true;
+                    return false;
+                }
+                device.conn.emplace(std::move(*conn));
+
+                if (options.debug)
+                {
+                    portable::println("Connected successfully!");
+                    portable::println("");
+                }
+                if (device.rtt && device.rtt->samples() == 0)
+                {
+                    if (device.profile)
+                    {
+                        // The profiled latencies stand in for the probes.
+                        device.rtt->sample(std::chrono::microseconds(device.profile->latency_p50_us));
+                        device.rtt->sample(std::chrono::microseconds(device.profile->latency_p99_us));
+                    }
+                    else
+                    {
+                        calibrate_rtt(*device.conn, *device.rtt, device.units.front());
+                    }
+                }
+            }
+
+            auto timeout = device.rtt ? device.rtt->timeout() : std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::seconds(options.timeout_seconds));
+            bool polling = action == CommandLineAction::PUBLISH_SHM || action == CommandLineAction::PUBLISH_MQTT || action == CommandLineAction::LOAD_STATISTICS ||
+                           action == CommandLineAction::TRIP_CAPTURE;
+            if (polling && !device.rtt && device.profile && device.profile->latency_p99_us > 0)
+            {
+                // The polling modes only read, so they can use a timeout of four
+                // times the profiled 99th percentile and notice a dead device
+                // quickly; writes may take the device longer and keep --timeout.
+                auto profiled = std::max<std::chrono::microseconds>(std::chrono::microseconds(4 * uint64_t{device.profile->latency_p99_us}),
+                                                                    std::chrono::milliseconds(options.timeout_min_ms));
+                timeout = std::min(timeout, profiled);
+            }
+            if (deadline)
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(*deadline - Clock::now());
+                if (remaining.count() <= 0)
+                {
+                    return false;
+                }
+                timeout = std::min(timeout, remaining);
+            }
+            device.conn->set_response_timeout(static_cast<int>(timeout.count() / 1'000'000), static_cast<int>(timeout.count() % 1'000'000));
+            // The unit ID is a field of each request; switching it costs no
+            // round trip, so it is set once per unit rather than per request.
+            for (auto unit : device.units)
+            {
+                if (!device.conn->set_slave_id(unit))
+                {
+                    portable::println("ERROR: Cannot address unit {}: {}", unit, device.conn->get_last_error());
+                    return false;
+                }
+                if (device.units.size() > 1)
+                {
+                    portable::println("--- unit {} ---", unit);
+                }
+                execute_blocking_action(*device.conn, options, action, deadline);
+            }
+            return true;
+        }
+
+#ifdef __linux__
+        struct ExecutionContext
+        {
+            const CommandLineOptions &options;
+            EventLoop &loop;
+            std::vector<DeviceSession> devices;
+            bool failed = false;
+            bool deadline_exceeded = false;
+            DeviceErrorCounters errors{};
+
+            // Every Modbus transaction gets its own deadline of --timeout seconds
+            // (--timeout-max with --adaptive-timeout, which resends within it).
+            TimePoint transaction_deadline() const
+            {
+                return Clock::now() + response_timeout_limit(options);
+            }
+        };
+
+        std::optional<TimePoint> deadline_of(const EventLoop &loop)
+        {
+            if (loop.deadline() == TimePoint::max())
+            {
+                return std::nullopt;
+            }
+            return loop.deadline();
+        }
+
+        bool is_async_action(CommandLineAction action)
+        {
+            switch (action)
+            {
+            case CommandLineAction::READ_UINT16:
+            case CommandLineAction::READ_UINT32:
+            case CommandLineAction::READ_STRING32:
+            case CommandLineAction::WRITE_UINT16:
+            case CommandLineAction::WRITE_UINT32:
+            case CommandLineAction::GET_NUM_CONNECTED_MODULES:
+            case CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE:
+            case CommandLineAction::UNLOCK_NOMINAL_CURRENT:
+            case CommandLineAction::READ_COILS:
+            case CommandLineAction::WRITE_COILS:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        template <typename... Args>
+        void append_line(std::string &out, std::format_string<Args...> fmt, Args &&...args)
+        {
+            if (!out.empty())
+            {
+                out += '\n';
+            }
+            out += std::format(fmt, std::forward<Args>(args)...);
+        }
+
+        // Counts a failed device operation and passes its result on.
+        template <typename T>
+        DeviceResult<T> counted(ExecutionContext &ctx, DeviceResult<T> result)
+        {
+            if (!result)
+            {
+                ctx.errors.record(result.error());
+            }
+            return result;
+        }
+
+        // FC 3 read of a typed register
+        template <typename Reg>
+            requires(Reg::readable)
+        Task<DeviceResult<typename Reg::value_type>> read_register_async(ExecutionContext &ctx, AsyncModbusClient &client, uint8_t unit_id, Reg reg)
+        {
+            auto words = counted(ctx, co_await client.read_holding_registers(unit_id, reg.address, Reg::words, ctx.transaction_deadline()));
+            if (!words)
+            {
+                co_return std::unexpected(words.error());
+            }
+            co_return decode_register<Reg>(std::span<const uint16_t, Reg::words>(words->data(), Reg::words));
+        }
+
+        // FC 6 for one word, FC 16 for more
+        template <typename Reg>
+            requires(Reg::writable && Reg::type != RegisterType::STRING32)
+        Task<DeviceResult<void>> write_register_async(ExecutionContext &ctx, AsyncModbusClient &client, uint8_t unit_id, Reg reg, typename Reg::value_type value)
+        {
+            if constexpr (Reg::words == 1)
+            {
+                co_return counted(ctx, co_await client.write_single_register(unit_id, reg.address, value, ctx.transaction_deadline()));
+            }
+            else
+            {
+                co_return counted(ctx, co_await client.write_multiple_registers(unit_id, reg.address, encode_register<Reg>(value), ctx.transaction_deadline()));
+            }
+        }
+
+        template <RegisterType Type>
+        Task<std::string> format_register_read(ExecutionContext &ctx, AsyncModbusClient &client, uint8_t unit_id, const std::string &address)
+        {
+            std::string out;
+            append_line(out, "=== Read {} Register ===", RegisterTraits<Type>::name);
+            append_line(out, "Address: {}", address);
+
+            Register<Type> reg{};
+            try
+            {
+                reg = Register<Type>{parse_register_address(address)};
+            }
+            catch (const std::exception &e)
+            {
+                append_line(out, "Error: {}", e.what());
+                co_return out;
+            }
+
+            auto value = co_await read_register_async(ctx, client, unit_id, reg);
+            if (!value)
+            {
+                append_line(out, "Failed to read register: {}", describe(value.error()));
+            }
+            else if constexpr (Type == RegisterType::STRING32)
+            {
+                append_line(out, "Value: \"{}\"", *value);
+            }
+            else
+            {
+                append_line(out, "Value: {}", *value);
+            }
+            co_return out;
+        }
+
+        // Asynchronous counterparts of the raw register actions. Output is
+        // collected and printed in one piece so that concurrently served
+        // devices do not interleave their lines.
+        Task<std::string> execute_async_action(ExecutionContext &ctx, AsyncModbusClient &client, CommandLineAction action, uint8_t unit_id)
+        {
+            const auto &options = ctx.options;
+            std::string out;
+
+            switch (action)
+            {
+            case CommandLineAction::READ_UINT16:
+                out = co_await format_register_read<RegisterType::UINT16>(ctx, client, unit_id, options.read_uint16_address);
+                break;
+
+            case CommandLineAction::READ_UINT32:
+                out = co_await format_register_read<RegisterType::UINT32>(ctx, client, unit_id, options.read_uint32_address);
+                break;
+
+            case CommandLineAction::READ_STRING32:
+                out = co_await format_register_read<RegisterType::STRING32>(ctx, client, unit_id, options.read_string32_address);
+                break;
+
+            case CommandLineAction::WRITE_UINT16:
+                append_line(out, "=== Write UINT16 Registers ===");
+                for (const auto &args : options.write_uint16_args)
+                {
+                    uint16_t addr = 0;
+                    int val = 0;
+                    try
+                    {
+                        addr = parse_register_address(args.address);
+                        val = std::stoi(args.value, nullptr, 0);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        append_line(out, "  Error: {}", e.what());
+                        continue;
+                    }
+                    auto written = co_await write_register_async(ctx, client, unit_id, Register<RegisterType::UINT16, RegisterAccess::READ_WRITE>{addr}, static_cast<uint16_t>(val));
+                    append_line(out, "  0x{:04X} = {} ({})", addr, val, written ? "SUCCESS" : std::format("FAILED: {}", describe(written.error())));
+                }
+                break;
+
+            case CommandLineAction::WRITE_UINT32:
+                append_line(out, "=== Write UINT32 Registers ===");
+                for (const auto &args : options.write_uint32_args)
+                {
+                    uint16_t addr = 0;
+                    long long val = 0;
+                    try
+                    {
+                        addr = parse_register_address(args.address);
+                        val = std::stoll(args.value, nullptr, 0);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        append_line(out, "  Error: {}", e.what());
+                        continue;
+                    }
+                    auto written = co_await write_register_async(ctx, client, unit_id, Register<RegisterType::UINT32, RegisterAccess::READ_WRITE>{addr}, static_cast<uint32_t>(val));
+                    append_line(out, "  0x{:04X} = {} ({})", addr, val, written ? "SUCCESS" : std::format("FAILED: {}", describe(written.error())));
+                }
+                break;
+
+            case CommandLineAction::GET_NUM_CONNECTED_MODULES:
+            {
+                append_line(out, "=== Number of Currently Connected Modules ===");
+                auto count = co_await read_register_async(ctx, client, unit_id, registers::NUM_CONNECTED_MODULES);
+                if (count)
+                {
+                    append_line(out, "Connected modules: {}", *count);
+                }
+                else
+                {
+                    append_line(out, "Failed to read number of connected modules: {}", describe(count.error()));
+                }
+                break;
+            }
+
+            case CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE:
+            {
+                append_line(out, "=== Product Name (Power Module) ===");
+                auto name = co_await read_register_async(ctx, client, unit_id, registers::PRODUCT_NAME_POWER_MODULE);
+                if (name)
+                {
+                    append_line(out, "Name: {}", *name);
+                }
+                else
+                {
+                    append_line(out, "Failed to read product name: {}", describe(name.error()));
+                }
+                break;
+            }
+
+            case CommandLineAction::UNLOCK_NOMINAL_CURRENT:
+                for (const auto &args : options.unlock_nominal_current_args)
+                {
+                    int module = 0;
+                    int channel = 0;
+                    Register<RegisterType::UINT16, RegisterAccess::READ_WRITE> channel_lock{};
+                    try
+                    {
+                        module = std::stoi(args.module_number);
+                        channel = std::stoi(args.channel_number);
+                        channel_lock = registers::CHANNEL_LOCK.at(module, channel);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        append_line(out, "Error parsing arguments: {}", e.what());
+                        continue;
+                    }
+                    append_line(out, "=== Unlock Nominal Current (Module {}, Channel {}) ===", module, channel);
+
+                    if (auto written = co_await write_register_async(ctx, client, unit_id, registers::GLOBAL_LOCK, 0); !written)
+                    {
+                        append_line(out, "FAILED (global lock): {}", describe(written.error()));
+                        continue;
+                    }
+                    if (auto written = co_await write_register_async(ctx, client, unit_id, channel_lock, 0); !written)
+                    {
+                        append_line(out, "FAILED (channel lock): {}", describe(written.error()));
+                        continue;
+                    }
+                    append_line(out, "SUCCESS");
+                }
+                break;
+
+            // One FC 1 / FC 15 round trip per range.
+            case CommandLineAction::READ_COILS:
+                append_line(out, "=== Read Coils ===");
+                for (const auto &args : options.read_coils_args)
+                {
+                    CoilRange range{};
+                    try
+                    {
+                        range = parse_read_coils(args);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        append_line(out, "Error: {}", e.what());
+                        continue;
+                    }
+                    auto coils = counted(ctx, co_await client.read_coils(unit_id, range.start, range.count, ctx.transaction_deadline()));
+                    if (coils)
+                    {
+                        append_line(out, "{}", format_coils(range, *coils));
+                    }
+                    else
+                    {
+                        append_line(out, "Failed to read coils at 0x{:04X}: {}", range.start, describe(coils.error()));
+                    }
+                }
+                break;
+
+            case CommandLineAction::WRITE_COILS:
+                append_line(out, "=== Write Coils ===");
+                for (const auto &args : options.write_coils_args)
+                {
+                    std::optional<std::pair<CoilRange, CoilBitset>> parsed;
+                    try
+                    {
+                        parsed = parse_write_coils(args);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        append_line(out, "Error: {}", e.what());
+                        continue;
+                    }
+                    auto &[range, coils] = *parsed;
+                    auto digits = coils.to_string();
+                    auto written = counted(ctx, co_await client.write_multiple_coils(unit_id, range.start, std::move(coils), ctx.transaction_deadline()));
+                    append_line(out, "Coils 0x{:04X} = {} ({})", range.start, digits, written ? "SUCCESS" : std::format("FAILED: {}", describe(written.error())));
+                }
+                break;
+
+            default:
+                break;
+            }
+
+            co_return out;
+        }
+
+        Task<void> run_unit_action(ExecutionContext &ctx, AsyncModbusClient &client, CommandLineAction action, uint8_t unit_id, std::string &out)
+        {
+            out = co_await execute_async_action(ctx, client, action, unit_id);
+        }
+
+        Task<void> run_device_actions(ExecutionContext &ctx, DeviceSession &device, std::vector<CommandLineAction> actions)
+        {
+            const auto &options = ctx.options;
+            bool many_devices = ctx.devices.size() > 1;
+
+            for (auto action : actions)
+            {
+                if (device.failed)
+                {
+                    co_return;
+                }
+                if (ctx.loop.deadline_exceeded())
+                {
+                    ctx.deadline_exceeded = true;
+                    co_return;
+                }
+
+                auto header = many_devices ? std::format("--- {}:{} ---\n", device.host, device.port) : std::string{};
+
+                if (!is_async_action(action))
+                {
+                    if (!header.empty())
+                    {
+                        portable::println("{}", header.substr(0, header.size() - 1));
+                    }
+                    if (!run_blocking_action(device, options, action, deadline_of(ctx.loop), &ctx.errors))
+                    {
+                        ctx.failed = true;
+                        ctx.deadline_exceeded = ctx.deadline_exceeded || ctx.loop.deadline_exceeded();
+                    }
+                    continue;
+                }
+
+                if (!device.client)
+                {
+                    device.client = std::make_unique<AsyncModbusClient>(ctx.loop, device.connect_host(), device.connect_port());
+                    device.client->set_rtt_estimator(device.rtt.get());
+                    if (device.profile)
+                    {
+                        device.client->set_request_shape(device.profile->block_words, device.profile->pipeline_depth);
+                    }
+                }
+                if (!device.client->is_connected())
+                {
+                    if (auto connected = counted(ctx, co_await device.client->connect(ctx.transaction_deadline())); !connected)
+                    {
+                        portable::println("{}ERROR: {}", header, format_connect_error(connected.error(), device.host, device.port));
+                        device.failed = true;
+                        ctx.failed = true;
+                        ctx.deadline_exceeded = ctx.deadline_exceeded || ctx.loop.deadline_exceeded();
+                        co_return;
+                    }
+                    if (options.debug)
+                    {
+                        portable::println("{}Connected successfully!\n", header);
+                    }
+                }
+
+                if (device.units.size() == 1)
+                {
+                    auto out = co_await execute_async_action(ctx, *device.client, action, device.units.front());
+                    portable::println("{}{}", header, out);
+                    continue;
+                }
+
+                // All units at once over the one connection; their requests
+                // interleave on the socket and are matched by transaction id.
+                std::vector<std::string> outs(device.units.size());
+                std::vector<Task<void>> tasks;
+                for (std::size_t i = 0; i < device.units.size(); ++i)
+                {
+                    tasks.push_back(run_unit_action(ctx, *device.client, action, device.units[i], outs[i]));
+                }
+                co_await ctx.loop.when_all(std::move(tasks));
+                for (std::size_t i = 0; i < device.units.size(); ++i)
+                {
+                    portable::println("--- {}:{} unit {} ---\n{}", device.host, device.port, device.units[i], outs[i]);
+                }
+            }
+        }
+
+        Task<void> run_stage(ExecutionContext &ctx, std::vector<CommandLineAction> actions)
+        {
+            if (actions.empty())
+            {
+                co_return;
+            }
+            std::vector<Task<void>> tasks;
+            for (auto &device : ctx.devices)
+            {
+                tasks.push_back(run_device_actions(ctx, device, actions));
+            }
+            co_await ctx.loop.when_all(std::move(tasks));
+        }
+
+        // Consecutive device actions form a stage that runs concurrently on
+        // all devices; device-independent actions run on their own between stages.
+        Task<void> run_all(ExecutionContext &ctx)
+        {
+            std::vector<CommandLineAction> stage;
+            for (auto action : ctx.options.actions)
+            {
+                if (requires_device_connection(action))
+                {
+                    stage.push_back(action);
+                    continue;
+                }
+                co_await run_stage(ctx, std::exchange(stage, {}));
+                if (ctx.loop.deadline_exceeded())
+                {
+                    ctx.deadline_exceeded = true;
+                    co_return;
+                }
+                if (!execute_local_action(ctx.options, action, deadline_of(ctx.loop)))
+                {
+                    ctx.failed = true;
+                }
+            }
+            co_await run_stage(ctx, std::move(stage));
+        }
+#endif
+
+        // --shell: every command line runs its actions over the same
+        // blocking connection, which is only opened again after a failure.
+        int run_shell_session(const CommandLineOptions &options, DeviceSession &device)
+        {
+            auto execute = [&device](const CommandLineOptions &line)
+            {
+                bool ok = true;
+                for (auto action : line.actions)
+                {
+                    if (action == CommandLineAction::SHELL)
+                    {
+                        portable::println("Already in the shell");
+                    }
+                    else if (!requires_device_connection(action))
+                    {
+                        ok = execute_local_action(line, action, std::nullopt) && ok;
+                    }
+                    else
+                    {
+                        device.failed = false;
+                        ok = run_blocking_action(device, line, action, std::nullopt) && ok;
+                    }
+                }
+                return ok;
+            };
+            return run_shell(options, std::format("{}:{}", device.host, device.port), execute);
+        }
+
+        int run_actions(const CommandLineOptions &options, std::vector<DeviceSession> devices, std::optional<TimePoint> deadline)
+        {
+            if (std::find(options.actions.begin(), options.actions.end(), CommandLineAction::SHELL) != options.actions.end())
+            {
+                return run_shell_session(options, devices.front());
+            }
+
+#ifdef __linux__
+            std::optional<EventLoop> event_loop;
+            try
+            {
+                event_loop.emplace(parse_io_backend(options.io_backend));
+            }
+            catch (const std::exception &e)
+            {
+                portable::println("Error: {}", e.what());
+                return EXIT_FAILURE;
+            }
+            auto &loop = *event_loop;
+            CAPAROC_DEBUG(options.debug, "I/O backend: {}", to_string(loop.backend()));
+            if (deadline)
+            {
+                loop.set_deadline(*deadline);
+            }
+
+            ExecutionContext ctx{options, loop, std::move(devices)};
+            loop.run(run_all(ctx));
+            if (ctx.devices.size() > 1 && ctx.errors.total() > 0)
+            {
+                portable::println("Device errors: {}", ctx.errors.format());
+            }
+            if (options.debug)
+            {
+                for (const auto &device : ctx.devices)
+                {
+                    if (device.rtt)
+                    {
+                        portable::println("RTT {}:{}: smoothed {:.2f} ms, variation {:.2f} ms, timeout {:.2f} ms ({} samples, {} timeouts, {} resent)",
+                                          device.host, device.port, device.rtt->smoothed().count() / 1000.0, device.rtt->variation().count() / 1000.0,
+                                          device.rtt->timeout().count() / 1000.0, device.rtt->samples(), device.rtt->timeouts(),
+                                          device.client ? device.client->retries() : 0);
+                    }
+                }
+            }
+
+            if (ctx.deadline_exceeded || (deadline && Clock::now() >= *deadline && ctx.failed))
+            {
+                portable::println("ERROR: Deadline of {} s exceeded, outstanding actions were cancelled", options.deadline_seconds);
+                return EXIT_FAILURE;
+            }
+            return ctx.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+            // Without the event loop the devices are served one after another.
+            bool failed = false;
+            DeviceErrorCounters errors;
+            for (const auto &action : options.actions)
+            {
+                if (deadline && Clock::now() >= *deadline)
+                {
+                    portable::println("ERROR: Deadline of {} s exceeded, outstanding actions were cancelled", options.deadline_seconds);
+                    return EXIT_FAILURE;
+                }
+                if (!requires_device_connection(action))
+                {
+                    failed = !execute_local_action(options, action, deadline) || failed;
+                    continue;
+                }
+                for (auto &device : devices)
+                {
+                    if (!device.failed && !run_blocking_action(device, options, action, deadline, &errors))
+                    {
+                        failed = true;
+                    }
+                }
+            }
+            if (devices.size() > 1 && errors.total() > 0)
+            {
+                portable::println("Device errors: {}", errors.format());
+            }
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+#endif
+        }
+
+        // Modes that serve one device; the continuous ones also poll a
+        // single unit until they are stopped.
+        struct SingleDeviceMode
+        {
+            CommandLineAction action;
+            const char *flag;
+            bool single_unit;
+        };
+
+        constexpr SingleDeviceMode SINGLE_DEVICE_MODES[] = {
+            {CommandLineAction::PUBLISH_SHM, "--publish-shm", true},
+            {CommandLineAction::PUBLISH_MQTT, "--publish-mqtt", true},
+            {CommandLineAction::LOAD_STATISTICS, "--load-stats", true},
+            {CommandLineAction::TRIP_CAPTURE, "--trip-capture", true},
+            {CommandLineAction::SHELL, "--shell", false},
+        };
+    }
+
+    int execute_actions(const CommandLineOptions &options)
+    {
+        auto start = Clock::now();
+        auto deadline = invocation_deadline(options, start);
+
+        for (const auto &mode : SINGLE_DEVICE_MODES)
+        {
+            if (options.ip_addresses.size() > 1 && std::find(options.actions.begin(), options.actions.end(), mode.action) != options.actions.end())
+            {
+                portable::println("ERROR: {} serves a single device, got {} addresses", mode.flag, options.ip_addresses.size());
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::vector<DeviceSession> devices;
+        try
+        {
+            devices = make_sessions(options);
+        }
+        catch (const std::exception &e)
+        {
+            portable::println("ERROR: {}", e.what());
+            return EXIT_FAILURE;
+        }
+        if (std::any_of(options.actions.begin(), options.actions.end(), requires_device_connection))
+        {
+            attach_device_profiles(options, devices);
+        }
+
+        if (!devices.empty() && devices.front().units.size() > 1)
+        {
+            for (const auto &mode : SINGLE_DEVICE_MODES)
+            {
+                if (mode.single_unit && std::find(options.actions.begin(), options.actions.end(), mode.action) != options.actions.end())
+                {
+                    portable::println("ERROR: {} serves a single unit, got {}", mode.flag, devices.front().units.size());
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        // Debug diagnostics go to the binary log for the whole invocation.
+        std::optional<BinaryLogger> log;
+        try
+        {
+            if (!options.log_file.empty())
+            {
+                log.emplace(options.log_file);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            portable::println("ERROR: {}", e.what());
+            return EXIT_FAILURE;
+        }
+        auto close_log = [&]
+        {
+            if (log)
+            {
+                log->stop();
+                portable::println("Logged {} record(s) to {}{}", log->records_written(), log->path(),
+                                  log->records_dropped() ? std::format(", {} dropped", log->records_dropped()) : std::string());
+            }
+        };
+
+        if (options.capture_file.empty())
+        {
+            auto exit_code = run_actions(options, std::move(devices), deadline);
+            close_log();
+            return exit_code;
+        }
+
+        // Every device session is routed through a loopback proxy that
+        // records the exchanged ADUs; the proxies go away before the trace
+        // is reported, so it holds the close records of all connections.
+        std::optional<TraceWriter> trace;
+        std::vector<std::unique_ptr<CaptureProxy>> proxies;
+        try
+        {
+            trace.emplace(options.capture_file);
+            for (auto &device : devices)
+            {
+                proxies.push_back(std::make_unique<CaptureProxy>(*trace, device.host, device.port, options.timeout_seconds));
+                device.capture_port = proxies.back()->local_port();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            portable::println("ERROR: {}", e.what());
+            return EXIT_FAILURE;
+        }
+
+        auto exit_code = run_actions(options, std::move(devices), deadline);
+        proxies.clear();
+        portable::println("Captured {} trace record(s) to {}", trace->records_written(), trace->path());
+        close_log();
+        return exit_code;
+    }
+
+} // namespace cli
@@ -0,0 +1,285 @@
+#include "caparoc_commander/apply_plan.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace cli {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+std::string_view trim(std::string_view text)
+{
+    auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos)
+    {
+        return {};
+    }
+    auto last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+int parse_number(std::string_view text, int min, int max, std::string_view what, std::size_t line)
+{
+    int value = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size() || value < min || value > max)
+    {
+        throw std::invalid_argument(std::format("line {}: invalid {} '{}' (expected {}-{})", line, what, text, min, max));
+    }
+    return value;
+}
+
+microseconds since(Clock::time_point start)
+{
+    return std::chrono::duration_cast<microseconds>(Clock::now() - start);
+}
+
+} // namespace
+
+std::vector<DevicePlan> parse_apply_plan(std::string_view text)
+{
+    std::vector<DevicePlan> plan;
+    std::size_t line_number = 0;
+    while (!text.empty())
+    {
+        auto newline = text.find('\n');
+        auto line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        ++line_number;
+
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        if (line.front() == '[')
+        {
+            if (line.back() != ']' || trim(line.substr(1, line.size() - 2)).empty())
+            {
+                throw std::invalid_argument(std::format("line {}: expected [HOST] or [HOST:PORT]", line_number));
+            }
+            plan.push_back({std::string(trim(line.substr(1, line.size() - 2))), {}});
+            continue;
+        }
+
+        auto equals = line.find('=');
+        auto dot = line.find('.');
+        if (equals == std::string_view::npos || dot == std::string_view::npos || dot > equals)
+        {
+            throw std::invalid_argument(std::format("line {}: expected MODULE.CHANNEL = AMPERES", line_number));
+        }
+        if (plan.empty())
+        {
+            throw std::invalid_argument(std::format("line {}: setpoint before the first [device] section", line_number));
+        }
+
+        ChannelSetpoint setpoint;
+        setpoint.module = static_cast<uint8_t>(parse_number(trim(line.substr(0, dot)), 1, static_cast<int>(RACK_MAX_MODULES), "module", line_number));
+        setpoint.channel = static_cast<uint8_t>(parse_number(trim(line.substr(dot + 1, equals - dot - 1)), 1, static_cast<int>(RACK_MAX_CHANNELS), "channel", line_number));
+        setpoint.nominal_current_a = static_cast<uint16_t>(parse_number(trim(line.substr(equals + 1)), 0, UINT16_MAX, "nominal current", line_number));
+
+        auto &setpoints = plan.back().setpoints;
+        if (std::any_of(setpoints.begin(), setpoints.end(), [&](const ChannelSetpoint &other)
+                        { return other.module == setpoint.module && other.channel == setpoint.channel; }))
+        {
+            throw std::invalid_argument(std::format("line {}: channel {}.{} listed twice for {}", line_number, setpoint.module, setpoint.channel, plan.back().endpoint));
+        }
+        setpoints.push_back(setpoint);
+    }
+    return plan;
+}
+
+std::vector<DevicePlan> load_apply_plan(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error(std::format("Cannot open plan file '{}'", path));
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return parse_apply_plan(content.str());
+}
+
+DeviceApplyResult apply_device_plan(libmodbus_cpp::ModbusConnection &conn, const DevicePlan &plan, bool dry_run)
+{
+    auto start = Clock::now();
+    DeviceApplyResult result;
+    result.endpoint = plan.endpoint;
+
+    auto finish = [&](ApplyOutcome outcome, std::string message = {})
+    {
+        result.outcome = outcome;
+        result.message = std::move(message);
+        result.total_time = since(start);
+        return result;
+    };
+
+    // Diff against the device; only differing channels are written.
+    for (const auto &setpoint : plan.setpoints)
+    {
+        auto current = caparoc::get_nominal_current(conn, setpoint.module, setpoint.channel);
+        if (!current)
+        {
+            result.read_time = since(start);
+            return finish(ApplyOutcome::READ_FAILED, std::format("cannot read nominal current of {}.{}", setpoint.module, setpoint.channel));
+        }
+        if (*current != setpoint.nominal_current_a)
+        {
+            result.changes.push_back({setpoint, *current});
+        }
+    }
+
+    if (result.changes.empty() || dry_run)
+    {
+        result.read_time = since(start);
+        return finish(result.changes.empty() ? ApplyOutcome::UNCHANGED : ApplyOutcome::DRY_RUN);
+    }
+
+    // Pre-state of the locks that are about to be opened
+    auto global_lock = read_register(conn, registers::GLOBAL_LOCK);
+    if (!global_lock)
+    {
+        result.read_time = since(start);
+        return finish(ApplyOutcome::READ_FAILED, "cannot read global lock");
+    }
+    std::vector<uint16_t> channel_locks;
+    for (const auto &change : result.changes)
+    {
+        auto lock = read_register(conn, registers::CHANNEL_LOCK.at(change.target.module, change.target.channel));
+        if (!lock)
+        {
+            result.read_time = since(start);
+            return finish(ApplyOutcome::READ_FAILED, std::format("cannot read lock of {}.{}", change.target.module, change.target.channel));
+        }
+        channel_locks.push_back(*lock);
+    }
+    result.read_time = since(start);
+    auto write_start = Clock::now();
+
+    auto write_lock = [&](auto lock, uint16_t value)
+    {
+        ++result.writes;
+        return write_register(conn, lock, value);
+    };
+    auto write_nominal = [&](const ChannelSetpoint &channel, uint16_t value)
+    {
+        ++result.writes;
+        return caparoc::set_nominal_current(conn, channel.module, channel.channel, value) &&
+               caparoc::get_nominal_current(conn, channel.module, channel.channel) == value;
+    };
+    auto restore_locks = [&]
+    {
+        bool ok = true;
+        for (std::size_t i = 0; i < result.changes.size(); ++i)
+        {
+            const auto &target = result.changes[i].target;
+            ok = write_lock(registers::CHANNEL_LOCK.at(target.module, target.channel), channel_locks[i]) && ok;
+        }
+        return write_lock(registers::GLOBAL_LOCK, *global_lock) && ok;
+    };
+
+    std::string failure;
+    std::size_t touched = 0;  // channels whose nominal current may have changed
+    if (!write_lock(registers::GLOBAL_LOCK, 0))
+    {
+        failure = "cannot unlock global lock";
+    }
+    for (const auto &change : result.changes)
+    {
+        if (!failure.empty())
+        {
+            break;
+        }
+        const auto &target = change.target;
+        if (!write_lock(registers::CHANNEL_LOCK.at(target.module, target.channel), 0))
+        {
+            failure = std::format("cannot unlock {}.{}", target.module, target.channel);
+            break;
+        }
+        ++touched;
+        if (!write_nominal(target, target.nominal_current_a))
+        {
+            failure = std::format("{}.{} did not take {} A", target.module, target.channel, target.nominal_current_a);
+        }
+    }
+
+    if (failure.empty())
+    {
+        bool locked = restore_locks();
+        result.write_time = since(write_start);
+        return finish(ApplyOutcome::APPLIED, locked ? std::string{} : "values applied, but the locks could not be restored");
+    }
+
+    // Roll back every channel that may have been touched, newest first.
+    bool restored = true;
+    for (std::size_t i = touched; i-- > 0;)
+    {
+        const auto &change = result.changes[i];
+        restored = write_nominal(change.target, change.previous_a) && restored;
+    }
+    restored = restore_locks() && restored;
+    result.write_time = since(write_start);
+    return finish(restored ? ApplyOutcome::ROLLED_BACK : ApplyOutcome::ROLLBACK_FAILED, failure);
+}
+
+std::string_view to_string(ApplyOutcome outcome)
+{
+    switch (outcome)
+    {
+    case ApplyOutcome::UNCHANGED:
+        return "UNCHANGED";
+    case ApplyOutcome::DRY_RUN:
+        return "DRY RUN";
+    case ApplyOutcome::APPLIED:
+        return "APPLIED";
+    case ApplyOutcome::ROLLED_BACK:
+        return "ROLLED BACK";
+    case ApplyOutcome::ROLLBACK_FAILED:
+        return "ROLLBACK FAILED";
+    case ApplyOutcome::READ_FAILED:
+        return "READ FAILED";
+    case ApplyOutcome::CONNECT_FAILED:
+        return "CONNECT FAILED";
+    case ApplyOutcome::SKIPPED:
+        return "SKIPPED";
+    }
+    return "UNKNOWN";
+}
+
+bool is_successful(ApplyOutcome outcome)
+{
+    return outcome == ApplyOutcome::UNCHANGED || outcome == ApplyOutcome::DRY_RUN || outcome == ApplyOutcome::APPLIED;
+}
+
+std::string format_apply_result(const DeviceApplyResult &result)
+{
+    auto ms = [](microseconds duration)
+    { return duration.count() / 1000.0; };
+
+    auto out = std::format("{}: {} ({} change(s), {} write(s); read {:.1f} ms, write {:.1f} ms, total {:.1f} ms)",
+                           result.endpoint, to_string(result.outcome), result.changes.size(), result.writes,
+                           ms(result.read_time), ms(result.write_time), ms(result.total_time));
+    if (!result.message.empty())
+    {
+        out += std::format("\n  {}", result.message);
+    }
+    for (const auto &change : result.changes)
+    {
+        out += std::format("\n  {}.{}: {} A -> {} A", change.target.module, change.target.channel, change.previous_a, change.target.nominal_current_a);
+    }
+    return out;
+}
+
+} // namespace cli
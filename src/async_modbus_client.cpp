@@ -0,0 +1,653 @@
+#include "caparoc_commander/async_modbus_client.hpp"
+#include "caparoc_commander/binary_log.hpp"
+#include "caparoc_commander/modbus_frame.hpp"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace cli {
+
+namespace {
+
+// One sending of a request; a resend is a new attempt with its own id.
+struct Attempt {
+    uint16_t id = 0;
+    uint32_t tx_key = 0;  // stream offset of the request's last byte, as in transmit timestamps
+    uint64_t sent_ns = 0;
+    bool kernel_sent = false;
+};
+
+struct PendingTransaction {
+    EventLoop::Waiter waiter;
+    std::vector<uint8_t> response;
+    PacketTimes times;  // sent_ns and kernel_sent are taken from the answered attempt
+    std::vector<Attempt> attempts;  // every id is in State::pending until the transaction ends
+    uint16_t answered_id = 0;
+
+    Attempt &attempt(uint16_t id)
+    {
+        return *std::find_if(attempts.begin(), attempts.end(), [id](const Attempt &a)
+                             { return a.id == id; });
+    }
+};
+
+uint64_t realtime_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// The software timestamp of a SCM_TIMESTAMPING control message, 0 if there is none
+uint64_t timestamp_of(msghdr &msg)
+{
+    for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+        {
+            scm_timestamping stamps;
+            std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            return static_cast<uint64_t>(stamps.ts[0].tv_sec) * 1'000'000'000u + static_cast<uint64_t>(stamps.ts[0].tv_nsec);
+        }
+    }
+    return 0;
+}
+
+DeviceError error_of(WaitStatus status)
+{
+    switch (status)
+    {
+    case WaitStatus::READY:
+        return {DeviceErrc::CONNECTION_RESET};
+    case WaitStatus::TIMEOUT:
+        return {DeviceErrc::TIMEOUT};
+    case WaitStatus::CANCELLED:
+        return {DeviceErrc::CANCELLED};
+    }
+    return {DeviceErrc::OTHER};
+}
+
+} // namespace
+
+struct AsyncModbusClient::State {
+    explicit State(EventLoop &event_loop) : loop(event_loop) {}
+
+    EventLoop &loop;
+    int fd = -1;
+    bool connected = false;
+    bool flushing = false;
+    uint16_t next_transaction_id = 0;
+    std::vector<uint8_t> tx;
+    std::vector<uint8_t> rx;
+    std::unordered_map<uint16_t, PendingTransaction *> pending;
+    DeviceError last_error{DeviceErrc::NOT_CONNECTED};  // why the connection was lost
+    RttEstimator *rtt = nullptr;
+    uint64_t retries = 0;
+    uint16_t max_block_words = 0;  // 0 = unlimited
+    std::size_t max_in_flight = 0;
+    std::size_t in_flight = 0;
+    std::deque<EventLoop::Waiter *> slot_waiters;  // transactions waiting for an in-flight slot
+    bool timestamping = false;       // requested with set_timestamping()
+    bool kernel_timestamps = false;  // SO_TIMESTAMPING is active on the socket
+    uint32_t tx_bytes = 0;           // bytes queued since SO_TIMESTAMPING was set, wrapping like its key
+    std::chrono::microseconds busy_poll{0};
+
+    // Transmit timestamps arrive on the socket's error queue, keyed by the
+    // stream offset of the last byte of the send() they belong to; every
+    // request that ended at or before that byte left no later.
+    void read_transmit_timestamps()
+    {
+        for (;;)
+        {
+            alignas(cmsghdr) char control[256];
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            {
+                return;
+            }
+            auto stamp = timestamp_of(msg);
+            for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg && stamp; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+                {
+                    continue;
+                }
+                sock_extended_err error;
+                std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                if (error.ee_errno != ENOMSG || error.ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    continue;
+                }
+                for (auto &[id, transaction] : pending)
+                {
+                    auto &attempt = transaction->attempt(id);
+                    if (!attempt.kernel_sent && static_cast<int32_t>(error.ee_data - attempt.tx_key) >= 0)
+                    {
+                        attempt.sent_ns = stamp;
+                        attempt.kernel_sent = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // A released slot passes straight to the oldest waiter, so a newcomer
+    // cannot take it between the wake-up and the waiter resuming.
+    void release_slot()
+    {
+        if (slot_waiters.empty())
+        {
+            --in_flight;
+            return;
+        }
+        auto *waiter = slot_waiters.front();
+        slot_waiters.pop_front();
+        loop.complete(*waiter);
+    }
+
+    // Remove the ids of all attempts of @p transaction from pending.
+    void forget(PendingTransaction &transaction)
+    {
+        for (const auto &attempt : transaction.attempts)
+        {
+            if (auto it = pending.find(attempt.id); it != pending.end() && it->second == &transaction)
+            {
+                pending.erase(it);
+            }
+        }
+    }
+
+    void fail_pending()
+    {
+        while (!pending.empty())
+        {
+            auto *transaction = pending.begin()->second;
+            forget(*transaction);
+            transaction->response.clear();
+            loop.complete(transaction->waiter);
+        }
+    }
+
+    void shutdown()
+    {
+        if (fd >= 0)
+        {
+            loop.cancel_fd(fd);
+            ::close(fd);
+            fd = -1;
+        }
+        connected = false;
+        kernel_timestamps = false;
+        tx.clear();
+        rx.clear();
+        fail_pending();
+    }
+};
+
+AsyncModbusClient::AsyncModbusClient(EventLoop &loop, std::string host, int port)
+    : loop_(loop), host_(std::move(host)), port_(port), state_(std::make_shared<State>(loop))
+{
+}
+
+AsyncModbusClient::~AsyncModbusClient()
+{
+    close();
+}
+
+bool AsyncModbusClient::is_connected() const
+{
+    return state_->connected;
+}
+
+
+void AsyncModbusClient::close()
+{
+    state_->shutdown();
+}
+
+Task<DeviceResult<void>> AsyncModbusClient::connect(TimePoint deadline)
+{
+    auto state = state_;
+    if (state->connected)
+    {
+        co_return DeviceResult<void>{};
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *resolved = nullptr;
+    auto port_text = std::to_string(port_);
+    if (int rc = getaddrinfo(host_.c_str(), port_text.c_str(), &hints, &resolved); rc != 0)
+    {
+        co_return std::unexpected(DeviceError{DeviceErrc::RESOLVE_FAILED, rc == EAI_SYSTEM ? errno : 0});
+    }
+    sockaddr_storage address{};
+    std::memcpy(&address, resolved->ai_addr, resolved->ai_addrlen);
+    socklen_t address_length = resolved->ai_addrlen;
+    freeaddrinfo(resolved);
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        co_return std::unexpected(DeviceError{DeviceErrc::OTHER, errno});
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_BUSY_POLL
+    if (state->busy_poll.count() > 0)
+    {
+        int budget = static_cast<int>(state->busy_poll.count());
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &budget, sizeof(budget));
+    }
+#endif
+    state->fd = fd;
+
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), address_length) != 0)
+    {
+        if (errno != EINPROGRESS)
+        {
+            auto error = device_error_from_errno(errno);
+            state->shutdown();
+            co_return std::unexpected(error);
+        }
+
+        auto status = co_await loop_.writable(fd, deadline);
+        if (status != WaitStatus::READY)
+        {
+            state->shutdown();
+            co_return std::unexpected(error_of(status));
+        }
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0)
+        {
+            state->shutdown();
+            co_return std::unexpected(device_error_from_errno(error));
+        }
+    }
+
+    if (state->timestamping)
+    {
+        // Set once connected: the transmit timestamp key of a TCP socket
+        // counts bytes from this point on.
+        int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+                    SOF_TIMESTAMPING_OPT_TSONLY;
+        state->kernel_timestamps = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+        state->tx_bytes = 0;
+    }
+
+    state->connected = true;
+    loop_.spawn(receive_loop(state));
+    co_return DeviceResult<void>{};
+}
+
+Task<void> AsyncModbusClient::receive_loop(std::shared_ptr<State> state)
+{
+    uint8_t buffer[4096];
+    while (state->connected)
+    {
+        int fd = state->fd;
+        int received = 0;
+        uint64_t kernel_received_ns = 0;
+        if (state->kernel_timestamps)
+        {
+            // The receive timestamps come as control messages, which only
+            // recvmsg() returns.
+            auto status = co_await state->loop.readable(fd, EventLoop::TimePoint::max());
+            if (status != WaitStatus::READY || state->fd != fd)
+            {
+                // Cancelled by close() or by the loop deadline.
+                break;
+            }
+
+            // Also keeps a pending error queue from waking the loop again and again.
+            state->read_transmit_timestamps();
+
+            iovec data{buffer, sizeof(buffer)};
+            alignas(cmsghdr) char control[256];
+            msghdr msg{};
+            msg.msg_iov = &data;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            auto count = ::recvmsg(fd, &msg, 0);
+            received = count < 0 ? -errno : static_cast<int>(count);
+            if (received > 0)
+            {
+                kernel_received_ns = timestamp_of(msg);
+                state->rx.insert(state->rx.end(), buffer, buffer + received);
+            }
+        }
+        else
+        {
+            auto io = co_await state->loop.receive(fd, state->rx, EventLoop::TimePoint::max());
+            if (io.status != WaitStatus::READY || state->fd != fd)
+            {
+                break;
+            }
+            received = io.result;
+        }
+        auto received_ns = kernel_received_ns ? kernel_received_ns : realtime_ns();
+        if (received == -EAGAIN || received == -EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            state->last_error = received == 0 ? DeviceError{DeviceErrc::CONNECTION_RESET} : device_error_from_errno(-received);
+            state->shutdown();
+            break;
+        }
+
+        std::size_t length = 0;
+        while ((length = complete_adu_length(state->rx)) != 0)
+        {
+            auto transaction_id = adu_transaction_id(state->rx);
+            auto it = state->pending.find(transaction_id);
+            if (it != state->pending.end())
+            {
+                // The first response to any attempt completes the transaction.
+                auto *transaction = it->second;
+                transaction->answered_id = transaction_id;
+                state->forget(*transaction);
+                transaction->response.assign(state->rx.begin(), state->rx.begin() + static_cast<std::ptrdiff_t>(length));
+                transaction->times.received_ns = received_ns;
+                transaction->times.kernel_received = kernel_received_ns != 0;
+                state->loop.complete(transaction->waiter);
+            }
+            // Responses to transactions that were given up are dropped.
+            state->rx.erase(state->rx.begin(), state->rx.begin() + static_cast<std::ptrdiff_t>(length));
+        }
+    }
+}
+
+Task<DeviceResult<void>> AsyncModbusClient::flush(TimePoint deadline)
+{
+    auto state = state_;
+    if (state->flushing)
+    {
+        // Another coroutine is already draining the buffer, including our bytes.
+        co_return DeviceResult<void>{};
+    }
+
+    state->flushing = true;
+    DeviceResult<void> result;
+    while (!state->tx.empty() && state->connected && result)
+    {
+        // Requests queued while this batch is on its way go out with the next one.
+        auto batch = std::exchange(state->tx, {});
+        std::size_t offset = 0;
+        while (offset < batch.size() && state->connected)
+        {
+            auto io = co_await loop_.send(state->fd, std::span(batch).subspan(offset), deadline);
+            if (io.status != WaitStatus::READY)
+            {
+                result = std::unexpected(error_of(io.status));
+                break;
+            }
+            if (io.result < 0)
+            {
+                state->last_error = device_error_from_errno(-io.result);
+                state->shutdown();
+                break;
+            }
+            offset += static_cast<std::size_t>(io.result);
+        }
+        if (offset < batch.size() && state->connected)
+        {
+            state->tx.insert(state->tx.begin(), batch.begin() + static_cast<std::ptrdiff_t>(offset), batch.end());
+        }
+    }
+    state->flushing = false;
+    if (result && !state->connected)
+    {
+        result = std::unexpected(state->last_error);
+    }
+    co_return result;
+}
+
+void AsyncModbusClient::set_rtt_estimator(RttEstimator *estimator)
+{
+    state_->rtt = estimator;
+}
+
+uint64_t AsyncModbusClient::retries() const
+{
+    return state_->retries;
+}
+
+void AsyncModbusClient::set_timestamping(bool enabled)
+{
+    state_->timestamping = enabled;
+}
+
+void AsyncModbusClient::set_busy_poll(std::chrono::microseconds budget)
+{
+    state_->busy_poll = budget;
+}
+
+Task<DeviceResult<std::vector<uint8_t>>> AsyncModbusClient::transact(std::vector<uint8_t> request, TimePoint deadline, PacketTimes *times)
+{
+    auto state = state_;
+    if (!state->connected)
+    {
+        co_return std::unexpected(DeviceError{DeviceErrc::NOT_CONNECTED});
+    }
+
+    if (state->max_in_flight > 0 && state->in_flight >= state->max_in_flight)
+    {
+        EventLoop::Waiter slot;
+        state->slot_waiters.push_back(&slot);
+        if (auto status = co_await loop_.wait(slot, deadline); status != WaitStatus::READY)
+        {
+            std::erase(state->slot_waiters, &slot);
+            co_return std::unexpected(error_of(status));
+        }
+        // The slot was handed over by release_slot().
+    }
+    else
+    {
+        ++state->in_flight;
+    }
+    struct SlotGuard {
+        State &state;
+        ~SlotGuard() { state.release_slot(); }
+    } slot_guard{*state};
+
+    if (!state->connected)
+    {
+        co_return std::unexpected(state->last_error);
+    }
+
+    // A resent request goes out on the same connection, behind the first
+    // one, which the device is still working on. Every attempt stays in
+    // pending, so the first response to any of them completes the
+    // transaction and a late answer is not thrown away.
+    PendingTransaction transaction;
+    struct PendingGuard {
+        State &state;
+        PendingTransaction &transaction;
+        ~PendingGuard() { state.forget(transaction); }
+    } pending_guard{*state, transaction};
+
+    for (bool first_attempt = true;; first_attempt = false)
+    {
+        auto transaction_id = state->next_transaction_id++;
+        request[0] = static_cast<uint8_t>(transaction_id >> 8);
+        request[1] = static_cast<uint8_t>(transaction_id & 0xFF);
+
+        state->tx.insert(state->tx.end(), request.begin(), request.end());
+        state->tx_bytes += static_cast<uint32_t>(request.size());
+        transaction.attempts.push_back({transaction_id, state->tx_bytes - 1, realtime_ns()});
+        state->pending[transaction_id] = &transaction;
+
+        if (auto flushed = co_await flush(deadline); !flushed)
+        {
+            CAPAROC_LOG("{}:{} transaction {} not sent: {}", host_, port_, transaction_id, to_string(flushed.error().code));
+            co_return std::unexpected(flushed.error());
+        }
+
+        auto sent = EventLoop::Clock::now();
+        auto attempt_deadline = state->rtt ? std::min(deadline, sent + state->rtt->timeout()) : deadline;
+        auto status = co_await loop_.wait(transaction.waiter, attempt_deadline);
+        if (status == WaitStatus::TIMEOUT && state->rtt)
+        {
+            state->rtt->timed_out();
+            if (attempt_deadline < deadline && state->connected)
+            {
+                // The earlier ids stay pending: their response is as good as one to the resend.
+                ++state->retries;
+                CAPAROC_LOG("{}:{} transaction {} timed out after {} us, resending", host_, port_, transaction_id,
+                            std::chrono::duration_cast<std::chrono::microseconds>(EventLoop::Clock::now() - sent).count());
+                continue;
+            }
+        }
+        if (status != WaitStatus::READY)
+        {
+            CAPAROC_LOG("{}:{} transaction {} failed: {}", host_, port_, transaction_id, to_string(error_of(status).code));
+            co_return std::unexpected(error_of(status));
+        }
+        if (transaction.response.empty())
+        {
+            // Completed without a response: the connection went away.
+            CAPAROC_LOG("{}:{} transaction {} failed: {}", host_, port_, transaction_id, to_string(state->last_error.code));
+            co_return std::unexpected(state->last_error);
+        }
+        CAPAROC_LOG("{}:{} transaction {} unit {} FC {} answered in {} us", host_, port_, transaction_id, request[6], request[7],
+                    std::chrono::duration_cast<std::chrono::microseconds>(EventLoop::Clock::now() - sent).count());
+        if (state->rtt && first_attempt)
+        {
+            // Karn's rule: after a resend, the response may answer any of the attempts.
+            state->rtt->sample(std::chrono::duration_cast<RttEstimator::Duration>(EventLoop::Clock::now() - sent));
+        }
+        if (times)
+        {
+            const auto &answered = transaction.attempt(transaction.answered_id);
+            *times = transaction.times;
+            times->sent_ns = answered.sent_ns;
+            times->kernel_sent = answered.kernel_sent;
+        }
+        co_return std::move(transaction.response);
+    }
+}
+
+void AsyncModbusClient::set_request_shape(uint16_t max_block_words, std::size_t max_in_flight)
+{
+    state_->max_block_words = max_block_words;
+    state_->max_in_flight = max_in_flight;
+}
+
+Task<DeviceResult<std::vector<uint16_t>>> AsyncModbusClient::read_holding_registers(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline)
+{
+    auto block = state_->max_block_words > 0 ? std::min(state_->max_block_words, MAX_READ_REGISTERS) : MAX_READ_REGISTERS;
+    if (count <= block)
+    {
+        co_return co_await read_block(unit_id, address, count, deadline);
+    }
+
+    std::vector<uint16_t> registers;
+    registers.reserve(count);
+    for (uint16_t offset = 0; offset < count; offset = static_cast<uint16_t>(offset + block))
+    {
+        auto part = co_await read_block(unit_id, static_cast<uint16_t>(address + offset), std::min<uint16_t>(block, static_cast<uint16_t>(count - offset)), deadline);
+        if (!part)
+        {
+            co_return std::unexpected(part.error());
+        }
+        registers.insert(registers.end(), part->begin(), part->end());
+    }
+    co_return registers;
+}
+
+Task<DeviceResult<std::vector<uint16_t>>> AsyncModbusClient::read_block(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline)
+{
+    auto response = co_await transact(encode_read_holding_registers(0, unit_id, address, count), deadline);
+    if (!response)
+    {
+        co_return std::unexpected(response.error());
+    }
+    auto registers = decode_read_registers_response(*response);
+    if (!registers || registers->size() != count)
+    {
+        co_return std::unexpected(device_error_from_response(*response));
+    }
+    co_return std::move(*registers);
+}
+
+Task<DeviceResult<void>> AsyncModbusClient::write_single_register(uint8_t unit_id, uint16_t address, uint16_t value, TimePoint deadline)
+{
+    auto response = co_await transact(encode_write_single_register(0, unit_id, address, value), deadline);
+    if (!response)
+    {
+        co_return std::unexpected(response.error());
+    }
+    if (!is_write_acknowledged(*response, FunctionCode::WRITE_SINGLE_REGISTER))
+    {
+        co_return std::unexpected(device_error_from_response(*response));
+    }
+    co_return DeviceResult<void>{};
+}
+
+Task<DeviceResult<void>> AsyncModbusClient::write_multiple_registers(uint8_t unit_id, uint16_t address, std::vector<uint16_t> values, TimePoint deadline)
+{
+    auto response = co_await transact(encode_write_multiple_registers(0, unit_id, address, values), deadline);
+    if (!response)
+    {
+        co_return std::unexpected(response.error());
+    }
+    if (!is_write_acknowledged(*response, FunctionCode::WRITE_MULTIPLE_REGISTERS))
+    {
+        co_return std::unexpected(device_error_from_response(*response));
+    }
+    co_return DeviceResult<void>{};
+}
+
+Task<DeviceResult<CoilBitset>> AsyncModbusClient::read_coils(uint8_t unit_id, uint16_t address, uint16_t count, TimePoint deadline)
+{
+    auto response = co_await transact(encode_read_coils(0, unit_id, address, count), deadline);
+    if (!response)
+    {
+        co_return std::unexpected(response.error());
+    }
+    auto coils = decode_read_coils_response(*response, count);
+    if (!coils)
+    {
+        co_return std::unexpected(device_error_from_response(*response));
+    }
+    co_return std::move(*coils);
+}
+
+Task<DeviceResult<void>> AsyncModbusClient::write_multiple_coils(uint8_t unit_id, uint16_t address, CoilBitset coils, TimePoint deadline)
+{
+    auto response = co_await transact(encode_write_multiple_coils(0, unit_id, address, coils), deadline);
+    if (!response)
+    {
+        co_return std::unexpected(response.error());
+    }
+    if (!is_write_acknowledged(*response, FunctionCode::WRITE_MULTIPLE_COILS))
+    {
+        co_return std::unexpected(device_error_from_response(*response));
+    }
+    co_return DeviceResult<void>{};
+}
+
+} // namespace cli
+
+#endif
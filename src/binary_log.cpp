@@ -0,0 +1,594 @@
+#include "caparoc_commander/binary_log.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t FILE_HEADER_SIZE = 24;
+constexpr auto COLLECT_INTERVAL = std::chrono::milliseconds(10);
+
+enum class EntryKind : uint8_t {
+    SITE = 0,
+    RECORD = 1,
+    DROPPED = 2
+};
+
+template <typename T>
+void put_le(std::vector<uint8_t> &out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t *in)
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+template <typename T>
+T get_host(const uint8_t *in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    return value;
+}
+
+void put_text(std::vector<uint8_t> &out, std::string_view text)
+{
+    auto length = std::min<std::size_t>(text.size(), UINT16_MAX);
+    put_le(out, static_cast<uint16_t>(length));
+    out.insert(out.end(), text.begin(), text.begin() + static_cast<std::ptrdiff_t>(length));
+}
+
+uint64_t steady_now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Sites get ids for the lifetime of the process; buffers belong to the running logger.
+struct Registry {
+    std::mutex mutex;
+    std::vector<const LogSite *> sites;  // id - 1
+    std::vector<std::shared_ptr<detail::LogBuffer>> buffers;
+    bool running = false;
+    uint16_t next_thread = 0;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+// Bumped under the registry mutex whenever a logger starts or stops, so
+// threads notice that their buffer belongs to an earlier logger.
+std::atomic<uint64_t> logger_generation{1};
+
+struct ThreadLog {
+    std::shared_ptr<detail::LogBuffer> buffer;
+    uint64_t generation = 0;
+
+    ~ThreadLog()
+    {
+        if (buffer)
+        {
+            buffer->closed.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadLog thread_log;
+
+std::string format_utc_us(uint64_t timestamp_ns)
+{
+    using namespace std::chrono;
+    sys_time<nanoseconds> time{nanoseconds{timestamp_ns}};
+    auto day = floor<days>(time);
+    year_month_day date{day};
+    hh_mm_ss clock{duration_cast<microseconds>(time - day)};
+    return std::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:06}", static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                       static_cast<unsigned>(date.day()), clock.hours().count(), clock.minutes().count(), clock.seconds().count(),
+                       clock.subseconds().count());
+}
+
+// std::format needs the argument types at compile time; the decoder only
+// knows them from the file, so every replacement field is formatted on
+// its own.
+std::string render(std::string_view format, const std::vector<LogValue> &args)
+{
+    std::string text;
+    std::size_t next_arg = 0;
+    for (std::size_t i = 0; i < format.size(); ++i)
+    {
+        char c = format[i];
+        if ((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c)
+        {
+            text += c;
+            ++i;
+            continue;
+        }
+        if (c != '{')
+        {
+            text += c;
+            continue;
+        }
+        auto end = format.find('}', i);
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        auto field = format.substr(i + 1, end - i - 1);
+        auto colon = field.find(':');
+        auto index_text = field.substr(0, colon);
+        auto index = next_arg++;
+        if (!index_text.empty())
+        {
+            std::from_chars(index_text.data(), index_text.data() + index_text.size(), index);
+        }
+        auto spec = colon == std::string_view::npos ? std::string("{}") : std::format("{{:{}}}", field.substr(colon + 1));
+        if (index < args.size())
+        {
+            try
+            {
+                text += std::visit([&](const auto &value) { return std::vformat(spec, std::make_format_args(value)); }, args[index]);
+            }
+            catch (const std::format_error &)
+            {
+                text += format.substr(i, end - i + 1);
+            }
+        }
+        else
+        {
+            text += "{?}";
+        }
+        i = end;
+    }
+    return text;
+}
+
+} // namespace
+
+namespace detail {
+
+LogBuffer *thread_log_buffer()
+{
+    if (thread_log.generation == logger_generation.load(std::memory_order_acquire))
+    {
+        return thread_log.buffer.get();
+    }
+
+    auto &shared = registry();
+    std::lock_guard lock(shared.mutex);
+    if (thread_log.buffer)
+    {
+        thread_log.buffer->closed.store(true, std::memory_order_release);
+        thread_log.buffer.reset();
+    }
+    thread_log.generation = logger_generation.load(std::memory_order_relaxed);
+    if (shared.running)
+    {
+        thread_log.buffer = std::make_shared<LogBuffer>(++shared.next_thread);
+        shared.buffers.push_back(thread_log.buffer);
+    }
+    return thread_log.buffer.get();
+}
+
+uint32_t register_log_site(LogSite &site, std::span<const LogArgType> types)
+{
+    auto &shared = registry();
+    std::lock_guard lock(shared.mutex);
+    if (auto id = site.id.load(std::memory_order_relaxed))
+    {
+        return id;  // registered by another thread meanwhile
+    }
+    site.types = types;
+    shared.sites.push_back(&site);
+    auto id = static_cast<uint32_t>(shared.sites.size());
+    site.id.store(id, std::memory_order_release);
+    return id;
+}
+
+} // namespace detail
+
+struct BinaryLogger::State {
+    std::ofstream file;
+    std::thread writer;
+    std::atomic<bool> stopping{false};
+    std::vector<const LogSite *> sites;  // copy of the registry's, refreshed for unknown ids
+    std::vector<bool> sites_written;
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> out;
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> dropped{0};
+
+    const LogSite *site(uint32_t id)
+    {
+        if (id > sites.size())
+        {
+            auto &shared = registry();
+            std::lock_guard lock(shared.mutex);
+            sites = shared.sites;
+        }
+        return id >= 1 && id <= sites.size() ? sites[id - 1] : nullptr;
+    }
+
+    void write_site(uint32_t id, const LogSite &site)
+    {
+        if (sites_written.size() <= id)
+        {
+            sites_written.resize(id + 1);
+        }
+        if (sites_written[id])
+        {
+            return;
+        }
+        sites_written[id] = true;
+        out.push_back(static_cast<uint8_t>(EntryKind::SITE));
+        put_le(out, id);
+        put_le(out, site.line);
+        out.push_back(static_cast<uint8_t>(site.types.size()));
+        for (auto type : site.types)
+        {
+            out.push_back(static_cast<uint8_t>(type));
+        }
+        put_text(out, site.file);
+        put_text(out, site.format);
+    }
+
+    // Converts the drained records of one thread from host order to the file layout.
+    void convert(uint16_t thread)
+    {
+        std::size_t offset = 0;
+        while (offset + detail::LogBuffer::RECORD_HEADER_SIZE <= bytes.size())
+        {
+            auto *record = bytes.data() + offset;
+            auto size = get_host<uint16_t>(record);
+            auto id = get_host<uint32_t>(record + 2);
+            auto time_ns = get_host<uint64_t>(record + 6);
+            offset += size;
+            const auto *log_site = site(id);
+            if (!log_site || size < detail::LogBuffer::RECORD_HEADER_SIZE || offset > bytes.size())
+            {
+                break;  // cannot happen with a consistent buffer
+            }
+            write_site(id, *log_site);
+
+            out.push_back(static_cast<uint8_t>(EntryKind::RECORD));
+            put_le(out, thread);
+            put_le(out, id);
+            put_le(out, time_ns);
+            const auto *arg = record + detail::LogBuffer::RECORD_HEADER_SIZE;
+            for (auto type : log_site->types)
+            {
+                switch (type)
+                {
+                case LogArgType::BOOL:
+                case LogArgType::CHAR:
+                    out.push_back(*arg++);
+                    break;
+                case LogArgType::INT:
+                case LogArgType::UINT:
+                case LogArgType::DOUBLE:
+                    put_le(out, get_host<uint64_t>(arg));
+                    arg += 8;
+                    break;
+                case LogArgType::STRING:
+                {
+                    auto length = get_host<uint16_t>(arg);
+                    put_le(out, length);
+                    out.insert(out.end(), arg + 2, arg + 2 + length);
+                    arg += 2 + length;
+                    break;
+                }
+                }
+            }
+            records.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void retire(const detail::LogBuffer &buffer)
+    {
+        if (auto count = buffer.dropped())
+        {
+            out.push_back(static_cast<uint8_t>(EntryKind::DROPPED));
+            put_le(out, buffer.thread());
+            put_le(out, count);
+            dropped.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // One pass over all buffers; buffers of exited threads, or all of them
+    // at the end, are dropped once they are empty.
+    void collect(bool final)
+    {
+        std::vector<std::shared_ptr<detail::LogBuffer>> buffers;
+        {
+            auto &shared = registry();
+            std::lock_guard lock(shared.mutex);
+            buffers = shared.buffers;
+        }
+        std::vector<const detail::LogBuffer *> retired;
+        for (const auto &buffer : buffers)
+        {
+            // Read before draining: everything a closed thread logged is published by then.
+            bool closed = final || buffer->closed.load(std::memory_order_acquire);
+            bytes.clear();
+            buffer->drain(bytes);
+            convert(buffer->thread());
+            if (closed)
+            {
+                retire(*buffer);
+                retired.push_back(buffer.get());
+            }
+        }
+        if (!retired.empty())
+        {
+            auto &shared = registry();
+            std::lock_guard lock(shared.mutex);
+            std::erase_if(shared.buffers, [&](const auto &buffer) { return std::ranges::find(retired, buffer.get()) != retired.end(); });
+        }
+        if (!out.empty())
+        {
+            file.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
+            file.flush();
+            out.clear();
+        }
+    }
+};
+
+BinaryLogger::BinaryLogger(const std::string &path) : path_(path), state_(std::make_unique<State>())
+{
+    auto &shared = registry();
+    std::lock_guard lock(shared.mutex);
+    if (shared.running)
+    {
+        throw std::logic_error("Only one binary log can be written at a time");
+    }
+    state_->file.open(path, std::ios::binary | std::ios::trunc);
+    if (!state_->file)
+    {
+        throw std::runtime_error(std::format("Cannot create log file '{}'", path));
+    }
+
+    std::vector<uint8_t> header;
+    put_le(header, BINARY_LOG_MAGIC);
+    put_le(header, BINARY_LOG_FORMAT_VERSION);
+    put_le(header, uint16_t{0});
+    auto start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    put_le(header, static_cast<uint64_t>(start_time_ns));
+    put_le(header, steady_now_ns());
+    state_->file.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+
+    shared.running = true;
+    shared.next_thread = 0;
+    logger_generation.fetch_add(1, std::memory_order_release);
+    detail::binary_log_active.store(true, std::memory_order_release);
+
+    state_->writer = std::thread(
+        [state = state_.get()]
+        {
+            while (!state->stopping.load(std::memory_order_acquire))
+            {
+                state->collect(false);
+                std::this_thread::sleep_for(COLLECT_INTERVAL);
+            }
+            state->collect(true);
+        });
+}
+
+BinaryLogger::~BinaryLogger()
+{
+    stop();
+}
+
+void BinaryLogger::stop()
+{
+    if (!state_->writer.joinable())
+    {
+        return;
+    }
+    detail::binary_log_active.store(false, std::memory_order_release);
+    {
+        auto &shared = registry();
+        std::lock_guard lock(shared.mutex);
+        shared.running = false;
+        logger_generation.fetch_add(1, std::memory_order_release);
+    }
+    state_->stopping.store(true, std::memory_order_release);
+    state_->writer.join();
+    state_->file.close();
+}
+
+uint64_t BinaryLogger::records_written() const
+{
+    return state_->records.load(std::memory_order_relaxed);
+}
+
+uint64_t BinaryLogger::records_dropped() const
+{
+    return state_->dropped.load(std::memory_order_relaxed);
+}
+
+BinaryLogFile read_binary_log(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error(std::format("Cannot open log file '{}'", path));
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < FILE_HEADER_SIZE || get_le<uint32_t>(data.data()) != BINARY_LOG_MAGIC)
+    {
+        throw std::runtime_error(std::format("'{}' is not a caparoc_commander binary log", path));
+    }
+    if (auto version = get_le<uint16_t>(data.data() + 4); version != BINARY_LOG_FORMAT_VERSION)
+    {
+        throw std::runtime_error(std::format("'{}' has log format version {}, expected {}", path, version, BINARY_LOG_FORMAT_VERSION));
+    }
+
+    BinaryLogFile log;
+    log.start_time_ns = get_le<uint64_t>(data.data() + 8);
+    auto steady_start_ns = get_le<uint64_t>(data.data() + 16);
+
+    std::size_t offset = FILE_HEADER_SIZE;
+    auto available = [&](std::size_t size) { return offset + size <= data.size(); };
+    auto take_text = [&](std::string &text)
+    {
+        if (!available(2))
+        {
+            return false;
+        }
+        auto length = get_le<uint16_t>(data.data() + offset);
+        if (!available(2u + length))
+        {
+            return false;
+        }
+        text.assign(reinterpret_cast<const char *>(data.data() + offset + 2), length);
+        offset += 2u + length;
+        return true;
+    };
+
+    while (available(1))
+    {
+        auto kind = static_cast<EntryKind>(data[offset++]);
+        if (kind == EntryKind::SITE)
+        {
+            if (!available(9))
+            {
+                break;
+            }
+            auto id = get_le<uint32_t>(data.data() + offset);
+            LogSiteInfo site;
+            site.line = get_le<uint32_t>(data.data() + offset + 4);
+            std::size_t argc = data[offset + 8];
+            offset += 9;
+            if (!available(argc))
+            {
+                break;
+            }
+            for (std::size_t i = 0; i < argc; ++i)
+            {
+                site.types.push_back(static_cast<LogArgType>(data[offset + i]));
+            }
+            offset += argc;
+            if (!take_text(site.file) || !take_text(site.format))
+            {
+                break;
+            }
+            log.sites[id] = std::move(site);
+        }
+        else if (kind == EntryKind::RECORD)
+        {
+            if (!available(14))
+            {
+                break;
+            }
+            LogEntry entry;
+            entry.thread = get_le<uint16_t>(data.data() + offset);
+            entry.site = get_le<uint32_t>(data.data() + offset + 2);
+            entry.time_ns = log.start_time_ns + (get_le<uint64_t>(data.data() + offset + 6) - steady_start_ns);
+            offset += 14;
+            auto site = log.sites.find(entry.site);
+            if (site == log.sites.end())
+            {
+                throw std::runtime_error(std::format("'{}' is corrupt: record of undefined log statement {}", path, entry.site));
+            }
+            bool complete = true;
+            for (auto type : site->second.types)
+            {
+                auto size = type == LogArgType::BOOL || type == LogArgType::CHAR ? 1u : type == LogArgType::STRING ? 0u : 8u;
+                if (!available(size))
+                {
+                    complete = false;
+                    break;
+                }
+                switch (type)
+                {
+                case LogArgType::BOOL:
+                    entry.args.emplace_back(data[offset] != 0);
+                    break;
+                case LogArgType::CHAR:
+                    entry.args.emplace_back(static_cast<char>(data[offset]));
+                    break;
+                case LogArgType::INT:
+                    entry.args.emplace_back(static_cast<int64_t>(get_le<uint64_t>(data.data() + offset)));
+                    break;
+                case LogArgType::UINT:
+                    entry.args.emplace_back(get_le<uint64_t>(data.data() + offset));
+                    break;
+                case LogArgType::DOUBLE:
+                {
+                    auto bits = get_le<uint64_t>(data.data() + offset);
+                    double value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    entry.args.emplace_back(value);
+                    break;
+                }
+                case LogArgType::STRING:
+                {
+                    std::string text;
+                    if (!take_text(text))
+                    {
+                        complete = false;
+                        break;
+                    }
+                    entry.args.emplace_back(std::move(text));
+                    break;
+                }
+                default:
+                    throw std::runtime_error(std::format("'{}' is corrupt: unknown argument type {}", path, static_cast<int>(type)));
+                }
+                offset += size;
+                if (!complete)
+                {
+                    break;
+                }
+            }
+            if (!complete)
+            {
+                break;
+            }
+            log.entries.push_back(std::move(entry));
+        }
+        else if (kind == EntryKind::DROPPED)
+        {
+            if (!available(10))
+            {
+                break;
+            }
+            log.dropped[get_le<uint16_t>(data.data() + offset)] += get_le<uint64_t>(data.data() + offset + 2);
+            offset += 10;
+        }
+        else
+        {
+            throw std::runtime_error(std::format("'{}' is corrupt: unknown entry kind {} at offset {}", path, static_cast<int>(kind), offset - 1));
+        }
+    }
+    // Threads are collected one after the other; put their records back in time order.
+    std::ranges::stable_sort(log.entries, {}, &LogEntry::time_ns);
+    return log;
+}
+
+std::string format_log_entry(const BinaryLogFile &log, const LogEntry &entry)
+{
+    auto site = log.sites.find(entry.site);
+    auto message = site == log.sites.end() ? std::format("<log statement {}>", entry.site) : render(site->second.format, entry.args);
+    return std::format("{} T{} {}", format_utc_us(entry.time_ns), entry.thread, message);
+}
+
+} // namespace cli
@@ -0,0 +1,282 @@
+#include "caparoc_commander/capture_proxy.hpp"
+
+#include <stdexcept>
+
+#ifdef __linux__
+
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/portable_print.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <list>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+
+struct ProxiedConnection {
+    int client_fd = -1;
+    int upstream_fd = -1;
+    uint16_t stream = 0;
+    std::vector<uint8_t> requests;   // bytes of a request ADU not yet complete
+    std::vector<uint8_t> responses;  // bytes of a response ADU not yet complete
+};
+
+bool send_all(int fd, const uint8_t *data, std::size_t size)
+{
+    while (size > 0)
+    {
+        auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+// Returns a connected blocking socket, or -1 with errno-style text in @p error.
+int connect_upstream(const std::string &host, int port, int timeout_seconds, std::string &error)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *resolved = nullptr;
+    auto port_text = std::to_string(port);
+    if (int rc = getaddrinfo(host.c_str(), port_text.c_str(), &hints, &resolved); rc != 0)
+    {
+        error = gai_strerror(rc);
+        return -1;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = std::strerror(errno);
+        freeaddrinfo(resolved);
+        return -1;
+    }
+    int rc = ::connect(fd, resolved->ai_addr, resolved->ai_addrlen);
+    freeaddrinfo(resolved);
+    if (rc != 0 && errno != EINPROGRESS)
+    {
+        error = std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    if (rc != 0)
+    {
+        pollfd entry{fd, POLLOUT, 0};
+        int socket_error = 0;
+        socklen_t length = sizeof(socket_error);
+        if (::poll(&entry, 1, timeout_seconds * 1000) <= 0)
+        {
+            error = "Connection timed out";
+            ::close(fd);
+            return -1;
+        }
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &socket_error, &length);
+        if (socket_error != 0)
+        {
+            error = std::strerror(socket_error);
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Forwards what is readable on @p from and records every ADU completed by it.
+// Returns false once either side is gone.
+bool forward(TraceWriter &writer, ProxiedConnection &connection, bool from_client)
+{
+    uint8_t buffer[4096];
+    int from = from_client ? connection.client_fd : connection.upstream_fd;
+    int to = from_client ? connection.upstream_fd : connection.client_fd;
+
+    auto received = ::recv(from, buffer, sizeof(buffer), 0);
+    if (received < 0 && errno == EINTR)
+    {
+        return true;
+    }
+    if (received <= 0 || !send_all(to, buffer, static_cast<std::size_t>(received)))
+    {
+        return false;
+    }
+
+    auto &pending = from_client ? connection.requests : connection.responses;
+    pending.insert(pending.end(), buffer, buffer + received);
+    std::size_t length = 0;
+    while ((length = complete_adu_length(pending)) != 0)
+    {
+        writer.write(connection.stream, from_client ? TraceRecordKind::REQUEST : TraceRecordKind::RESPONSE,
+                     std::span(pending.data(), length));
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(length));
+    }
+    return true;
+}
+
+} // namespace
+
+CaptureProxy::CaptureProxy(TraceWriter &writer, std::string host, int port, int connect_timeout_seconds)
+    : writer_(writer), host_(std::move(host)), port_(port), connect_timeout_seconds_(connect_timeout_seconds)
+{
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+    {
+        throw std::runtime_error(std::format("Capture proxy: socket() failed: {}", std::strerror(errno)));
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0 ||
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length) != 0 ||
+        ::pipe2(stop_fds_, O_CLOEXEC) != 0)
+    {
+        auto error = std::runtime_error(std::format("Capture proxy: cannot listen on loopback: {}", std::strerror(errno)));
+        ::close(listen_fd_);
+        throw error;
+    }
+    local_port_ = ntohs(address.sin_port);
+    thread_ = std::thread([this]
+                          { run(); });
+}
+
+CaptureProxy::~CaptureProxy()
+{
+    [[maybe_unused]] auto written = ::write(stop_fds_[1], "x", 1);
+    thread_.join();
+    ::close(stop_fds_[0]);
+    ::close(stop_fds_[1]);
+    ::close(listen_fd_);
+}
+
+void CaptureProxy::run()
+{
+    std::list<ProxiedConnection> connections;
+    auto endpoint = std::format("{}:{}", host_, port_);
+
+    auto close_connection = [&](std::list<ProxiedConnection>::iterator it)
+    {
+        ::close(it->client_fd);
+        ::close(it->upstream_fd);
+        writer_.close_stream(it->stream);
+        return connections.erase(it);
+    };
+
+    std::vector<pollfd> fds;
+    for (;;)
+    {
+        fds.clear();
+        fds.push_back({stop_fds_[0], POLLIN, 0});
+        fds.push_back({listen_fd_, POLLIN, 0});
+        for (const auto &connection : connections)
+        {
+            fds.push_back({connection.client_fd, POLLIN, 0});
+            fds.push_back({connection.upstream_fd, POLLIN, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents)
+        {
+            break;
+        }
+
+        // Connections accepted below are not in fds yet and are served next round.
+        std::size_t index = 2;
+        for (auto it = connections.begin(); it != connections.end(); index += 2)
+        {
+            bool alive = true;
+            if (fds[index].revents)
+            {
+                alive = forward(writer_, *it, true);
+            }
+            if (alive && fds[index + 1].revents)
+            {
+                alive = forward(writer_, *it, false);
+            }
+            it = alive ? std::next(it) : close_connection(it);
+        }
+
+        if (fds[1].revents)
+        {
+            int client_fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd < 0)
+            {
+                continue;
+            }
+            int one = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            auto stream = writer_.open_stream(endpoint);
+            std::string error;
+            int upstream_fd = connect_upstream(host_, port_, connect_timeout_seconds_, error);
+            if (upstream_fd < 0)
+            {
+                portable::println("Capture: cannot connect to {}: {}", endpoint, error);
+                ::close(client_fd);
+                writer_.close_stream(stream);
+                continue;
+            }
+            connections.push_back({client_fd, upstream_fd, stream, {}, {}});
+        }
+    }
+
+    while (!connections.empty())
+    {
+        close_connection(connections.begin());
+    }
+}
+
+} // namespace cli
+
+#else
+
+namespace cli {
+
+CaptureProxy::CaptureProxy(TraceWriter &writer, std::string host, int port, int connect_timeout_seconds)
+    : writer_(writer), host_(std::move(host)), port_(port), connect_timeout_seconds_(connect_timeout_seconds)
+{
+    throw std::runtime_error("Traffic capture is only supported on Linux");
+}
+
+CaptureProxy::~CaptureProxy() = default;
+
+void CaptureProxy::run()
+{
+}
+
+} // namespace cli
+
+#endif
@@ -1,7 +1,13 @@
 #include "caparoc_commander/cli_parser.hpp"
 #include "CLI/CLI.hpp"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <format>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
 
 namespace cli
 {
@@ -65,243 +71,918 @@ namespace cli
                 return "READ_COIL";
             case CommandLineAction::WRITE_COIL:
                 return "WRITE_COIL";
+            case CommandLineAction::READ_COILS:
+                return "READ_COILS";
+            case CommandLineAction::WRITE_COILS:
+                return "WRITE_COILS";
+            case CommandLineAction::SWITCH_SEQUENCE:
+                return "SWITCH_SEQUENCE";
+            case CommandLineAction::PUBLISH_SHM:
+                return "PUBLISH_SHM";
+            case CommandLineAction::PUBLISH_MQTT:
+                return "PUBLISH_MQTT";
+            case CommandLineAction::LOAD_STATISTICS:
+                return "LOAD_STATISTICS";
+            case CommandLineAction::TRIP_CAPTURE:
+                return "TRIP_CAPTURE";
+            case CommandLineAction::READ_SHM:
+                return "READ_SHM";
+            case CommandLineAction::SHOW_TRIP_EVENT:
+                return "SHOW_TRIP_EVENT";
+            case CommandLineAction::SHOW_LOG:
+                return "SHOW_LOG";
+            case CommandLineAction::REPLAY_TRACE:
+                return "REPLAY_TRACE";
+            case CommandLineAction::APPLY_PLAN:
+                return "APPLY_PLAN";
+            case CommandLineAction::DISCOVER_DEVICES:
+                return "DISCOVER_DEVICES";
+            case CommandLineAction::INVENTORY_REFRESH:
+                return "INVENTORY_REFRESH";
+            case CommandLineAction::INVENTORY_LIST:
+                return "INVENTORY_LIST";
+            case CommandLineAction::INVENTORY_QUERY:
+                return "INVENTORY_QUERY";
+            case CommandLineAction::PROFILE_DEVICE:
+                return "PROFILE_DEVICE";
+            case CommandLineAction::SYNC_SAMPLE:
+                return "SYNC_SAMPLE";
+            case CommandLineAction::CLUSTER_POLL:
+                return "CLUSTER_POLL";
+            case CommandLineAction::HEALTH_WATCH:
+                return "HEALTH_WATCH";
+            case CommandLineAction::SHELL:
+                return "SHELL";
             }
 
             return "UNKNOWN";
         }
-    }
 
-    CommandLineOptions parse_command_line(int argc, char *argv[])
-    {
-        // Default values
-        CommandLineOptions options;
-
-        CLI::App app{"Caparoc Commander"};
-        app.set_help_flag("-h,--help", "Show all available options");
-
-        app.add_option("-i,--ip", options.ip_address, "IP address of the CAPAROC device")
-            ->default_val("192.168.1.2");
-        app.add_option("-p,--port", options.port, "Modbus TCP port")
-            ->default_val(502);
-        app.add_flag_callback("-l,--list", [&options]()
-                              { options.actions.push_back(CommandLineAction::LIST_REGISTERS); }, "List all registers");
-
-        auto register_option = app.add_option("-r,--register", options.register_info_address,
-                                              "Get info about a specific register (e.g. 0x0010)");
-        auto search_option = app.add_option("-s,--search", options.search_filter,
-                                            "Search for registers by name (case-insensitive substring match)");
-        auto read_uint16_option = app.add_option("--read-uint16", options.read_uint16_address,
-                                                 "Read UINT16 register (e.g. 0x0010)");
-        auto read_uint32_option = app.add_option("--read-uint32", options.read_uint32_address,
-                                                 "Read UINT32 register (e.g. 0x0100)");
-        auto read_string32_option = app.add_option("--read-string32", options.read_string32_address,
-                                                   "Read STRING32 register (e.g. 0x1000)");
-        auto product_name_module_option = app.add_option("--product-name-module", options.product_module_numbers,
-                                                         "Get product name for a specific module (1-16)");
-
-        std::vector<std::string> write_uint16_args_raw;
-        std::vector<std::string> write_uint32_args_raw;
-        std::vector<std::string> get_nominal_current_args_raw;
-        std::vector<std::string> set_nominal_current_args_raw;
-        std::vector<std::string> unlock_nominal_current_args_raw;
-        std::vector<std::string> read_coil_args_raw;
-        std::vector<std::string> write_coil_args_raw;
-
-        auto write_uint16_option = app.add_option("--write-uint16", write_uint16_args_raw,
-                                                  "Write UINT16 register (address value)")
-                                       ->expected(2);
-        auto write_uint32_option = app.add_option("--write-uint32", write_uint32_args_raw,
-                                                  "Write UINT32 register (address value)")
-                                       ->expected(2);
-        auto get_nominal_current_option = app.add_option("--get-nominal-current", get_nominal_current_args_raw,
-                                                         "Get nominal current (module_number channel_number)")
-                                               ->expected(2);
-        auto set_nominal_current_option = app.add_option("--set-nominal-current", set_nominal_current_args_raw,
-                                                         "Set nominal current (module_number channel_number value)")
-                                               ->expected(3);
-        auto unlock_nominal_current_option = app.add_option("--unlock-nominal-current", unlock_nominal_current_args_raw,
-                                    "Unlock nominal current parametrization (module_number channel_number)")
-                              ->expected(2);
-        
-        auto read_coil_option = app.add_option("--read-coil", read_coil_args_raw,
-                                               "Read coil status (address)")
-                                    ->expected(1);
-        auto write_coil_option = app.add_option("--write-coil", write_coil_args_raw,
-                                                "Write coil (address state) - state can be on|off|true|false|1|0")
-                                     ->expected(2);
-
-        app.add_flag_callback("--reset-application-params-power-and-cb", [&options]()
-                              { options.actions.push_back(CommandLineAction::RESET_APPLICATION_PARAMS_POWER_AND_CB); }, "Reset application parameters for Power Module and Circuit Breakers");
-        app.add_flag_callback("--global-channel-error-reset-all-cb", [&options]()
-                              { options.actions.push_back(CommandLineAction::GLOBAL_CHANNEL_ERROR_RESET_ALL_CB); }, "Global channel error reset for all Circuit Breakers");
-        app.add_flag_callback("--error-counter-reset-all-cb", [&options]()
-                              { options.actions.push_back(CommandLineAction::ERROR_COUNTER_RESET_ALL_CB); }, "Reset error counters for all Circuit Breakers");
-        app.add_flag_callback("--reset-application-params-quint", [&options]()
-                              { options.actions.push_back(CommandLineAction::RESET_APPLICATION_PARAMS_QUINT); }, "Reset application parameters for QUINT Power Supply");
-        app.add_flag_callback("--product-name-power-module", [&options]()
-                              { options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE); }, "Get product name for Power Module");
-        app.add_flag_callback("--product-name-quint", [&options]()
-                              { options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_QUINT); }, "Get product name for QUINT Power Supply");
-        app.add_flag_callback("--num-connected-modules", [&options]()
-                              { options.actions.push_back(CommandLineAction::GET_NUM_CONNECTED_MODULES); }, "Get number of currently connected modules");
-        app.add_flag_callback("--print-device-info", [&options]()
-                              { options.actions.push_back(CommandLineAction::PRINT_DEVICE_INFO); }, "Print device information (modules, product names, channels)");
-        app.add_flag_callback("--get-system-status", [&options]()
-                              { options.actions.push_back(CommandLineAction::GET_SYSTEM_STATUS); }, "Get system-level status (voltage, current, temperature)");
-        
-        std::vector<std::string> get_channel_status_args_raw;
-        auto get_channel_status_option = app.add_option("--get-channel-status", get_channel_status_args_raw,
-                                                        "Get status for specific channel (module_number channel_number)")
-                                              ->expected(2);
-        
-        std::vector<std::string> get_load_current_args_raw;
-        auto get_load_current_option = app.add_option("--get-load-current", get_load_current_args_raw,
-                                                      "Get actual load current for channel (module_number channel_number)")
-                                             ->expected(2);
-        
-        std::vector<std::string> control_channel_args_raw;
-        auto control_channel_option = app.add_option("--control-channel", control_channel_args_raw,
-                                                     "Control channel on/off (module_number channel_number on|off)")
-                                           ->expected(3);
-        
-        app.add_flag("-d,--debug", options.debug, "Enable debug output")
-            ->default_val(false);
-        app.add_flag("-t,--timeout", options.timeout_seconds, "Connection timeout in seconds")
-            ->default_val(3);
+        constexpr const char *DEFAULT_IP_ADDRESS = "192.168.1.2";
+        constexpr int DEFAULT_PORT = 502;
+        constexpr int DEFAULT_TIMEOUT_SECONDS = 3;
+        constexpr std::size_t DEFAULT_DISCOVER_MAX_SOCKETS = 1024;
 
-        try
+        struct SimpleFlag
         {
-            app.parse(argc, argv);
-        }
-        catch (const CLI::ParseError &e)
-        {
-            app.exit(e);
-            exit(e.get_exit_code());
-        }
+            std::string_view name;
+            CommandLineAction action;
+        };
 
-        if (register_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::REGISTER_INFO);
-        }
-        if (search_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::SEARCH_REGISTERS);
-        }
-        if (read_uint16_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::READ_UINT16);
-        }
-        if (read_uint32_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::READ_UINT32);
-        }
-        if (read_string32_option->count() > 0)
+        // In the order parse_command_line() registers them: CLI11 runs flag
+        // callbacks in definition order, once per flag.
+        constexpr std::array<SimpleFlag, 4> SIMPLE_FLAGS{{
+            {"--product-name-power-module", CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE},
+            {"--num-connected-modules", CommandLineAction::GET_NUM_CONNECTED_MODULES},
+            {"--print-device-info", CommandLineAction::PRINT_DEVICE_INFO},
+            {"--get-system-status", CommandLineAction::GET_SYSTEM_STATUS},
+        }};
+
+        bool is_value(std::string_view token)
         {
-            options.actions.push_back(CommandLineAction::READ_STRING32);
+            return !token.empty() && token.front() != '-';
         }
-        if (write_uint16_option->count() > 0)
+
+        /**
+         * @brief Parse the handful of options used by scripted single-shot calls without CLI11
+         *
+         * Constructing the CLI11 app dominates the start-up time of a short
+         * invocation. This recognizes the most common command lines (one or more
+         * --ip, --port, --debug, register reads, status queries) and produces
+         * exactly what the full parser would. Anything else - help, other
+         * options, "--opt=value", unusual value counts, malformed numbers - yields
+         * std::nullopt so the full parser handles it, including its error messages.
+         */
+        std::optional<CommandLineOptions> parse_simple_command_line(int argc, char *argv[])
         {
-            options.actions.push_back(CommandLineAction::WRITE_UINT16);
-            auto results = write_uint16_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            CommandLineOptions options;
+            options.port = DEFAULT_PORT;
+            options.timeout_seconds = DEFAULT_TIMEOUT_SECONDS;
+            options.discover_max_sockets = DEFAULT_DISCOVER_MAX_SOCKETS;
+
+            std::array<bool, SIMPLE_FLAGS.size()> flags_seen{};
+            bool port_seen = false;
+
+            for (int i = 1; i < argc; ++i)
+            {
+                std::string_view token = argv[i];
+                auto values_left = argc - i - 1;
+                auto value = [&](int offset) -> std::string_view
+                { return argv[i + offset]; };
+                // Vector options in CLI11 keep consuming values, so the token
+                // after the expected ones must start a new option.
+                auto exactly = [&](int count)
+                {
+                    if (values_left < count)
+                    {
+                        return false;
+                    }
+                    for (int k = 1; k <= count; ++k)
+                    {
+                        if (!is_value(value(k)))
+                        {
+                            return false;
+                        }
+                    }
+                    return values_left == count || !is_value(value(count + 1));
+                };
+
+                if (token == "-d" || token == "--debug")
+                {
+                    options.debug = true;
+                    continue;
+                }
+
+                auto flag = std::find_if(SIMPLE_FLAGS.begin(), SIMPLE_FLAGS.end(), [&](const SimpleFlag &f)
+                                         { return f.name == token; });
+                if (flag != SIMPLE_FLAGS.end())
+                {
+                    flags_seen[static_cast<std::size_t>(flag - SIMPLE_FLAGS.begin())] = true;
+                    continue;
+                }
+
+                if (!exactly(token.starts_with("--get-") ? 2 : 1))
+                {
+                    return std::nullopt;
+                }
+
+                if (token == "-i" || token == "--ip")
+                {
+                    options.ip_addresses.emplace_back(value(1));
+                }
+                else if (token == "-p" || token == "--port")
+                {
+                    auto text = value(1);
+                    if (text.size() > 1 && text.front() == '0')
+                    {
+                        // CLI11 reads prefixed forms such as 0x1F6 differently.
+                        return std::nullopt;
+                    }
+                    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), options.port);
+                    if (port_seen || ec != std::errc{} || end != text.data() + text.size())
+                    {
+                        return std::nullopt;
+                    }
+                    port_seen = true;
+                }
+                else if (token == "--read-uint16" && options.read_uint16_address.empty())
+                {
+                    options.read_uint16_address = value(1);
+                }
+                else if (token == "--read-uint32" && options.read_uint32_address.empty())
+                {
+                    options.read_uint32_address = value(1);
+                }
+                else if (token == "--read-string32" && options.read_string32_address.empty())
+                {
+                    options.read_string32_address = value(1);
+                }
+                else if (token == "--get-channel-status")
+                {
+                    options.get_channel_status_args.push_back({std::string(value(1)), std::string(value(2))});
+                    ++i;
+                }
+                else if (token == "--get-load-current")
+                {
+                    options.get_load_current_args.push_back({std::string(value(1)), std::string(value(2))});
+                    ++i;
+                }
+                else
+                {
+                    return std::nullopt;
+                }
+                ++i;
+            }
+
+            for (std::size_t f = 0; f < SIMPLE_FLAGS.size(); ++f)
             {
-                options.write_uint16_args.push_back({results[i], results[i + 1]});
+                if (flags_seen[f])
+                {
+                    options.actions.push_back(SIMPLE_FLAGS[f].action);
+                }
             }
-        }
-        if (write_uint32_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::WRITE_UINT32);
-            auto results = write_uint32_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            if (!options.read_uint16_address.empty())
+            {
+                options.actions.push_back(CommandLineAction::READ_UINT16);
+            }
+            if (!options.read_uint32_address.empty())
+            {
+                options.actions.push_back(CommandLineAction::READ_UINT32);
+            }
+            if (!options.read_string32_address.empty())
+            {
+                options.actions.push_back(CommandLineAction::READ_STRING32);
+            }
+            if (!options.get_channel_status_args.empty())
+            {
+                options.actions.push_back(CommandLineAction::GET_CHANNEL_STATUS);
+            }
+            if (!options.get_load_current_args.empty())
             {
-                options.write_uint32_args.push_back({results[i], results[i + 1]});
+                options.actions.push_back(CommandLineAction::GET_LOAD_CURRENT);
             }
+
+            if (options.actions.empty())
+            {
+                // Leave "nothing to do" handling to the full parser.
+                return std::nullopt;
+            }
+            if (options.ip_addresses.empty())
+            {
+                options.ip_addresses.emplace_back(DEFAULT_IP_ADDRESS);
+            }
+            return options;
         }
-        if (product_name_module_option->count() > 0)
+
+        enum class ParseMode
         {
-            options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_MODULE);
-        }
-        if (get_nominal_current_option->count() > 0)
+            EXIT,
+            THROW
+        };
+
+        /**
+         * @brief The full CLI11 parser
+         *
+         * @param mode EXIT prints errors and help and exits the process, THROW
+         *        reports them as std::invalid_argument (used by the shell)
+         * @param option_names If set, receives the long option names and the
+         *        function returns without parsing
+         */
+        CommandLineOptions parse_full_command_line(int argc, char *argv[], ParseMode mode, std::vector<std::string> *option_names)
         {
-            options.actions.push_back(CommandLineAction::GET_NOMINAL_CURRENT);
-            auto results = get_nominal_current_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            // Default values
+            CommandLineOptions options;
+
+            CLI::App app{"Caparoc Commander"};
+            app.set_help_flag("-h,--help", "Show all available options");
+
+            auto ip_option = app.add_option("-i,--ip", options.ip_addresses,
+                                            "IP address(es) of the CAPAROC device(s), HOST or HOST:PORT, optionally /UNIT,... for units behind a gateway")
+                ->default_val(DEFAULT_IP_ADDRESS);
+            app.add_option("-p,--port", options.port, "Modbus TCP port")
+                ->default_val(DEFAULT_PORT);
+            app.add_option("--unit", options.unit_ids,
+                           "Modbus unit ID(s) addressed over each connection, e.g. several CAPAROC stacks behind one gateway")
+                ->default_val(1);
+            app.add_flag_callback("-l,--list", [&options]()
+                                  { options.actions.push_back(CommandLineAction::LIST_REGISTERS); }, "List all registers");
+
+            auto register_option = app.add_option("-r,--register", options.register_info_address,
+                                                  "Get info about a specific register (e.g. 0x0010)");
+            auto search_option = app.add_option("-s,--search", options.search_filter,
+                                                "Search for registers by name (case-insensitive substring match)");
+            auto read_uint16_option = app.add_option("--read-uint16", options.read_uint16_address,
+                                                     "Read UINT16 register (e.g. 0x0010)");
+            auto read_uint32_option = app.add_option("--read-uint32", options.read_uint32_address,
+                                                     "Read UINT32 register (e.g. 0x0100)");
+            auto read_string32_option = app.add_option("--read-string32", options.read_string32_address,
+                                                       "Read STRING32 register (e.g. 0x1000)");
+            auto product_name_module_option = app.add_option("--product-name-module", options.product_module_numbers,
+                                                             "Get product name for a specific module (1-16)");
+
+            std::vector<std::string> write_uint16_args_raw;
+            std::vector<std::string> write_uint32_args_raw;
+            std::vector<std::string> get_nominal_current_args_raw;
+            std::vector<std::string> set_nominal_current_args_raw;
+            std::vector<std::string> unlock_nominal_current_args_raw;
+            std::vector<std::string> read_coil_args_raw;
+            std::vector<std::string> write_coil_args_raw;
+            std::vector<std::string> read_coils_args_raw;
+            std::vector<std::string> write_coils_args_raw;
+
+            auto write_uint16_option = app.add_option("--write-uint16", write_uint16_args_raw,
+                                                      "Write UINT16 register (address value)")
+                                           ->expected(2);
+            auto write_uint32_option = app.add_option("--write-uint32", write_uint32_args_raw,
+                                                      "Write UINT32 register (address value)")
+                                           ->expected(2);
+            auto get_nominal_current_option = app.add_option("--get-nominal-current", get_nominal_current_args_raw,
+                                                             "Get nominal current (module_number channel_number)")
+                                                   ->expected(2);
+            auto set_nominal_current_option = app.add_option("--set-nominal-current", set_nominal_current_args_raw,
+                                                             "Set nominal current (module_number channel_number value)")
+                                                   ->expected(3);
+            auto unlock_nominal_current_option = app.add_option("--unlock-nominal-current", unlock_nominal_current_args_raw,
+                                        "Unlock nominal current parametrization (module_number channel_number)")
+                                  ->expected(2);
+        
+            auto read_coil_option = app.add_option("--read-coil", read_coil_args_raw,
+                                                   "Read coil status (address)")
+                                        ->expected(1);
+            auto write_coil_option = app.add_option("--write-coil", write_coil_args_raw,
+                                                    "Write coil (address state) - state can be on|off|true|false|1|0")
+                                         ->expected(2);
+            auto read_coils_option = app.add_option("--read-coils", read_coils_args_raw,
+                                                    "Read a range of coils in one request (start count)")
+                                         ->expected(2);
+            auto write_coils_option = app.add_option("--write-coils", write_coils_args_raw,
+                                                     "Write a range of coils in one request (start bitmask, e.g. 0 1011)")
+                                          ->expected(2);
+
+            app.add_flag_callback("--reset-application-params-power-and-cb", [&options]()
+                                  { options.actions.push_back(CommandLineAction::RESET_APPLICATION_PARAMS_POWER_AND_CB); }, "Reset application parameters for Power Module and Circuit Breakers");
+            app.add_flag_callback("--global-channel-error-reset-all-cb", [&options]()
+                                  { options.actions.push_back(CommandLineAction::GLOBAL_CHANNEL_ERROR_RESET_ALL_CB); }, "Global channel error reset for all Circuit Breakers");
+            app.add_flag_callback("--error-counter-reset-all-cb", [&options]()
+                                  { options.actions.push_back(CommandLineAction::ERROR_COUNTER_RESET_ALL_CB); }, "Reset error counters for all Circuit Breakers");
+            app.add_flag_callback("--reset-application-params-quint", [&options]()
+                                  { options.actions.push_back(CommandLineAction::RESET_APPLICATION_PARAMS_QUINT); }, "Reset application parameters for QUINT Power Supply");
+            app.add_flag_callback("--product-name-power-module", [&options]()
+                                  { options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_POWER_MODULE); }, "Get product name for Power Module");
+            app.add_flag_callback("--product-name-quint", [&options]()
+                                  { options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_QUINT); }, "Get product name for QUINT Power Supply");
+            app.add_flag_callback("--num-connected-modules", [&options]()
+                                  { options.actions.push_back(CommandLineAction::GET_NUM_CONNECTED_MODULES); }, "Get number of currently connected modules");
+            app.add_flag_callback("--print-device-info", [&options]()
+                                  { options.actions.push_back(CommandLineAction::PRINT_DEVICE_INFO); }, "Print device information (modules, product names, channels)");
+            app.add_flag_callback("--get-system-status", [&options]()
+                                  { options.actions.push_back(CommandLineAction::GET_SYSTEM_STATUS); }, "Get system-level status (voltage, current, temperature)");
+        
+            std::vector<std::string> get_channel_status_args_raw;
+            auto get_channel_status_option = app.add_option("--get-channel-status", get_channel_status_args_raw,
+                                                            "Get status for specific channel (module_number channel_number)")
+                                                  ->expected(2);
+        
+            std::vector<std::string> get_load_current_args_raw;
+            auto get_load_current_option = app.add_option("--get-load-current", get_load_current_args_raw,
+                                                          "Get actual load current for channel (module_number channel_number)")
+                                                 ->expected(2);
+        
+            std::vector<std::string> control_channel_args_raw;
+            auto control_channel_option = app.add_option("--control-channel", control_channel_args_raw,
+                                                         "Control channel on/off (module_number channel_number on|off)")
+                                               ->expected(3);
+        
+            std::vector<std::string> switch_sequence_args_raw;
+            auto switch_sequence_option = app.add_option("--switch-sequence", switch_sequence_args_raw,
+                                                         "Switch channels in staggered batches and verify (on|off all|MODULE.CHANNEL,...)")
+                                              ->expected(2);
+            app.add_option("--switch-max-simultaneous", options.switch_max_simultaneous,
+                           "Channels switched per batch by --switch-sequence")
+                ->default_val(4);
+            app.add_option("--switch-stagger", options.switch_stagger_ms,
+                           "Milliseconds between batch starts of --switch-sequence")
+                ->default_val(50);
+            app.add_option("--switch-verify-timeout", options.switch_verify_timeout_ms,
+                           "Milliseconds to wait for a switched channel to be confirmed")
+                ->default_val(2000);
+
+            auto publish_shm_option = app.add_option("--publish-shm", options.publish_shm_name,
+                                                     "Poll the device continuously and publish snapshots to shared memory (name, e.g. caparoc)");
+            auto read_shm_option = app.add_option("--read-shm", options.read_shm_name,
+                                                  "Print the latest snapshot from shared memory without contacting the device (name)");
+            app.add_option("--poll-interval", options.poll_interval_ms,
+                           "Milliseconds between polls in continuous modes")
+                ->default_val(1000);
+
+            auto publish_mqtt_option = app.add_option("--publish-mqtt", options.mqtt_broker,
+                                                      "Poll the device continuously and publish snapshots to an MQTT broker (HOST[:PORT])");
+            app.add_option("--mqtt-topic", options.mqtt_topic,
+                           "Topic prefix of --publish-mqtt; the device address is appended")
+                ->default_val("caparoc");
+            app.add_option("--mqtt-client-id", options.mqtt_client_id,
+                           "MQTT client identifier (default: caparoc_commander-DEVICE)");
+            app.add_option("--mqtt-qos", options.mqtt_qos,
+                           "QoS of published snapshots (0 or 1)")
+                ->default_val(0);
+            app.add_option("--mqtt-batch", options.mqtt_batch,
+                           "Polls collected into one message per topic")
+                ->default_val(1);
+            app.add_option("--mqtt-full-every", options.mqtt_full_every,
+                           "Publish all topics every N polls, changed ones in between (0 = only after connecting)")
+                ->default_val(60);
+            app.add_option("--mqtt-deadband", options.mqtt_deadband_ma,
+                           "Load current change in mA below which a channel counts as unchanged")
+                ->default_val(0);
+            app.add_flag("--mqtt-compress", options.mqtt_compress,
+                         "zlib-compress MQTT payloads");
+            app.add_option("--mqtt-queue", options.mqtt_queue_file,
+                           "File that keeps unsent messages while the broker is unreachable");
+            app.add_option("--mqtt-queue-limit", options.mqtt_queue_limit,
+                           "Unsent messages kept before the oldest are dropped")
+                ->default_val(10000);
+
+            auto load_stats_option = app.add_flag("--load-stats",
+                                                  "Poll the device continuously and print per-channel load statistics and energy per window");
+            app.add_option("--stats-window", options.stats_window_s,
+                           "Seconds per --load-stats window, e.g. 28800 for 8 h shifts")
+                ->default_val(3600);
+            app.add_option("--stats-slide", options.stats_slide_s,
+                           "Seconds between sliding --load-stats windows (0 = tumbling windows)")
+                ->default_val(0);
+            app.add_flag("--stats-json", options.stats_json,
+                         "Print each --load-stats window as one line of JSON");
+
+            auto trip_capture_option = app.add_option("--trip-capture", options.trip_capture_dir,
+                                                      "Poll the device continuously and save a window of samples around every trip, warning or voltage fault (directory)");
+            app.add_option("--trip-pre", options.trip_pre,
+                           "Samples per channel kept from before a --trip-capture trigger")
+                ->default_val(200);
+            app.add_option("--trip-post", options.trip_post,
+                           "Burst samples of the module recorded from a --trip-capture trigger on")
+                ->default_val(200);
+            auto trip_show_option = app.add_option("--trip-show", options.trip_show_file,
+                                                   "Print a --trip-capture event file");
+
+            auto capture_option = app.add_option("--capture", options.capture_file,
+                                                 "Record every Modbus request and response exchanged with the -i device(s) to a trace file");
+            auto replay_option = app.add_option("--replay", options.replay_file,
+                                                "Serve a captured trace as a Modbus TCP server (trace file)");
+            app.add_option("--replay-address", options.replay_address,
+                           "IPv4 address the --replay server listens on, e.g. 127.0.0.2 for a second simulated device")
+                ->default_val("127.0.0.1");
+            app.add_option("--replay-port", options.replay_port,
+                           "TCP port of the --replay server")
+                ->default_val(5020);
+            app.add_option("--replay-speed", options.replay_speed,
+                           "Divide recorded response times by this factor during --replay (0 = answer immediately)")
+                ->default_val(1.0);
+
+            auto apply_option = app.add_option("--apply", options.apply_plan_file,
+                                               "Bring the devices of a desired-state plan to their planned nominal currents (plan file)");
+            app.add_option("--apply-workers", options.apply_workers,
+                           "Devices configured concurrently by --apply")
+                ->default_val(8);
+            app.add_flag("--apply-dry-run", options.apply_dry_run,
+                         "Only show the changes --apply would make");
+
+            auto discover_option = app.add_option("--discover", options.discover_cidr,
+                                                  "Scan an IPv4 range for CAPAROC devices (CIDR, e.g. 192.168.1.0/24)");
+            app.add_option("--discover-max-sockets", options.discover_max_sockets,
+                           "Maximum number of concurrently open sockets during discovery")
+                ->default_val(DEFAULT_DISCOVER_MAX_SOCKETS);
+
+            app.add_option("--inventory", options.inventory_file,
+                           "Inventory file of --inventory-refresh, --inventory-list and --inventory-query");
+            auto inventory_refresh_option = app.add_flag("--inventory-refresh",
+                                                         "Update the inventory of the -i devices (default: all recorded ones)");
+            app.add_flag("--inventory-full", options.inventory_full,
+                         "Re-read the modules of every device, not only of those whose module count changed");
+            app.add_option("--inventory-workers", options.inventory_workers,
+                           "Devices refreshed concurrently by --inventory-refresh")
+                ->default_val(8);
+            auto inventory_list_option = app.add_flag("--inventory-list",
+                                                      "Print the recorded devices and modules");
+            auto inventory_query_option = app.add_option("--inventory-query", options.inventory_query,
+                                                         "List the channels of all recorded modules whose product name contains TEXT");
+
+            auto profile_device_option = app.add_flag("--profile-device",
+                                                      "Measure block size, pipelining, connection and rate limits of the -i devices and save their profiles");
+            app.add_option("--profiles", options.profiles_file,
+                           "Device profile file (default: ~/.config/caparoc_commander/profiles.ini)");
+            app.add_flag("--no-profiles", options.no_profiles,
+                         "Ignore the recorded device profiles");
+            app.add_option("--profile-step", options.profile_step_ms,
+                           "Milliseconds per --profile-device load step")
+                ->default_val(1000);
+            app.add_option("--profile-address", options.profile_address,
+                           "First register of the --profile-device reads (hex)")
+                ->default_val("0x2000");
+            app.add_option("--profile-max-connections", options.profile_max_connections,
+                           "Most concurrent connections --profile-device opens to a device")
+                ->default_val(8);
+
+            auto sync_sample_option = app.add_option("--sync-sample", options.sync_address,
+                                                     "Read registers from ADDR (hex) of all -i devices at shared ticks of --poll-interval and print time-aligned rows");
+            app.add_option("--sync-count", options.sync_count,
+                           "Registers per device and tick of --sync-sample")
+                ->default_val(1);
+            app.add_option("--sync-rows", options.sync_rows,
+                           "Stop --sync-sample after N rows (default: until Ctrl+C)")
+                ->default_val(0);
+            app.add_option("--sync-max-skew", options.sync_max_skew_ms,
+                           "Milliseconds of cross-device skew above which a --sync-sample row is flagged")
+                ->default_val(5.0);
+            app.add_flag("--sync-json", options.sync_json,
+                         "Print --sync-sample rows as JSON lines with the send and receive time of every read");
+
+            auto cluster_poll_option = app.add_flag("--cluster-poll",
+                                                    "Poll a share of the -i devices (default: all recorded in --inventory), split with the other --cluster-peer pollers by consistent hashing");
+            app.add_option("--cluster-bind", options.cluster_bind,
+                           "IPv4:PORT for the UDP heartbeats of this poller, also its name in the cluster")
+                ->default_val("127.0.0.1:7400");
+            app.add_option("--cluster-peer", options.cluster_peers,
+                           "IPv4:PORT of another poller; one is enough, the rest are learned from its heartbeats");
+            app.add_option("--cluster-sink", options.cluster_sink,
+                           "File all pollers append their snapshots to, one JSON object per line");
+            app.add_option("--cluster-workers", options.cluster_workers,
+                           "Devices polled concurrently by this poller")
+                ->default_val(8);
+            app.add_option("--cluster-heartbeat", options.cluster_heartbeat_ms,
+                           "Milliseconds between heartbeats; a poller silent for four of them counts as gone")
+                ->default_val(500);
+
+            auto health_watch_option = app.add_flag("--health-watch",
+                                                    "Poll the -i devices (default: all recorded in --inventory) every --poll-interval and rank their worst channels by trips, warnings and time near nominal current");
+            // These open their own connections to each device, past the capture proxies.
+            for (auto *fleet_option : {apply_option, inventory_refresh_option, cluster_poll_option, health_watch_option})
             {
-                options.get_nominal_current_args.push_back({results[i], results[i + 1]});
+                capture_option->excludes(fleet_option);
             }
-        }
-        if (set_nominal_current_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::SET_NOMINAL_CURRENT);
-            auto results = set_nominal_current_option->results();
-            for (std::size_t i = 0; i + 2 < results.size(); i += 3)
+            app.add_option("--health-top", options.health_top,
+                           "Channels and devices listed in each --health-watch ranking")
+                ->default_val(10);
+            app.add_option("--health-report", options.health_report_s,
+                           "Seconds between --health-watch rankings (0 = only when stopped)")
+                ->default_val(60);
+            app.add_option("--health-half-life", options.health_half_life_s,
+                           "Seconds after which a trip or warning counts half in the --health-watch scores")
+                ->default_val(21600);
+            app.add_option("--health-workers", options.health_workers,
+                           "Devices polled concurrently by --health-watch")
+                ->default_val(8);
+
+            app.add_option("--rt-priority", options.rt_priority,
+                           "Run polling loops with SCHED_FIFO at this priority (1-99, needs CAP_SYS_NICE or an rtprio limit)")
+                ->default_val(0);
+            app.add_option("--rt-cpu", options.rt_cpu,
+                           "Pin the polling loop to this CPU")
+                ->default_val(-1);
+            app.add_flag("--rt-lock-memory", options.rt_lock_memory,
+                         "Lock the process in memory and pre-fault it, so polling loops do not page-fault (needs CAP_IPC_LOCK or a memlock limit)");
+            app.add_option("--rt-spin", options.rt_spin_us,
+                           "Microseconds before each poll the loop spins instead of sleeping")
+                ->default_val(0);
+            app.add_option("--rt-busy-poll", options.rt_busy_poll_us,
+                           "Microseconds the --sync-sample sockets busy-poll for responses (SO_BUSY_POLL)")
+                ->default_val(0);
+            app.add_flag("--jitter-report", options.jitter_report,
+                         "Print a histogram of how late the polls of a polling loop started when it ends");
+            app.add_option("--io-backend", options.io_backend,
+                           "How concurrent device I/O talks to the kernel: auto (io_uring where available), io_uring or epoll")
+                ->default_val("auto");
+
+            app.add_flag("-d,--debug", options.debug, "Enable debug output")
+                ->default_val(false);
+            app.add_option("--log-file", options.log_file,
+                           "Record debug diagnostics and per-transaction traces in a binary log instead of printing them");
+            auto log_show_option = app.add_option("--log-show", options.log_show_file,
+                                                  "Print a --log-file binary log");
+            app.add_option("-t,--timeout", options.timeout_seconds, "Connection and response timeout in seconds")
+                ->default_val(DEFAULT_TIMEOUT_SECONDS);
+            app.add_flag("--adaptive-timeout", options.adaptive_timeout,
+                         "Derive the response timeout from the measured round-trip time and resend unanswered requests");
+            app.add_option("--timeout-min", options.timeout_min_ms,
+                           "Lower bound of the adaptive response timeout in ms")
+                ->default_val(50);
+            app.add_option("--timeout-max", options.timeout_max_ms,
+                           "Upper bound of the adaptive response timeout in ms (0 = --timeout)")
+                ->default_val(0);
+            app.add_option("--deadline", options.deadline_seconds,
+                           "Deadline for the whole invocation in seconds; outstanding actions are cancelled when it passes (0 = none)")
+                ->default_val(0.0);
+
+            app.add_flag_callback("--shell", [&options]()
+                                  { options.actions.push_back(CommandLineAction::SHELL); }, "Interactive shell over one persistent device connection");
+
+            if (option_names)
             {
-                options.set_nominal_current_args.push_back({results[i], results[i + 1], results[i + 2]});
+                for (const auto *option : app.get_options())
+                {
+                    for (const auto &name : option->get_lnames())
+                    {
+                        option_names->push_back(name);
+                    }
+                }
+                return options;
             }
-        }
-        if (unlock_nominal_current_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::UNLOCK_NOMINAL_CURRENT);
-            auto results = unlock_nominal_current_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+
+            try
             {
-                options.unlock_nominal_current_args.push_back({results[i], results[i + 1]});
+                app.parse(argc, argv);
             }
-        }
-        if (get_channel_status_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::GET_CHANNEL_STATUS);
-            auto results = get_channel_status_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            catch (const CLI::CallForHelp &e)
             {
-                options.get_channel_status_args.push_back({results[i], results[i + 1]});
+                if (mode == ParseMode::THROW)
+                {
+                    throw std::invalid_argument(app.help());
+                }
+                app.exit(e);
+                exit(e.get_exit_code());
             }
-        }
-        if (get_load_current_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::GET_LOAD_CURRENT);
-            auto results = get_load_current_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            catch (const CLI::ParseError &e)
             {
-                options.get_load_current_args.push_back({results[i], results[i + 1]});
+                if (mode == ParseMode::THROW)
+                {
+                    throw std::invalid_argument(e.what());
+                }
+                app.exit(e);
+                exit(e.get_exit_code());
             }
-        }
-        if (control_channel_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::CONTROL_CHANNEL);
-            auto results = control_channel_option->results();
-            for (std::size_t i = 0; i + 2 < results.size(); i += 3)
+
+            if (register_option->count() > 0)
             {
-                options.control_channel_args.push_back({results[i], results[i + 1], results[i + 2]});
+                options.actions.push_back(CommandLineAction::REGISTER_INFO);
             }
-        }
-        if (read_coil_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::READ_COIL);
-            auto results = read_coil_option->results();
-            for (std::size_t i = 0; i < results.size(); i++)
+            if (search_option->count() > 0)
             {
-                options.read_coil_args.push_back({results[i]});
+                options.actions.push_back(CommandLineAction::SEARCH_REGISTERS);
             }
-        }
-        if (write_coil_option->count() > 0)
-        {
-            options.actions.push_back(CommandLineAction::WRITE_COIL);
-            auto results = write_coil_option->results();
-            for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+            if (read_uint16_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_UINT16);
+            }
+            if (read_uint32_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_UINT32);
+            }
+            if (read_string32_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_STRING32);
+            }
+            if (write_uint16_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::WRITE_UINT16);
+                auto results = write_uint16_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.write_uint16_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (write_uint32_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::WRITE_UINT32);
+                auto results = write_uint32_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.write_uint32_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (product_name_module_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::GET_PRODUCT_NAME_MODULE);
+            }
+            if (get_nominal_current_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::GET_NOMINAL_CURRENT);
+                auto results = get_nominal_current_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.get_nominal_current_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (set_nominal_current_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::SET_NOMINAL_CURRENT);
+                auto results = set_nominal_current_option->results();
+                for (std::size_t i = 0; i + 2 < results.size(); i += 3)
+                {
+                    options.set_nominal_current_args.push_back({results[i], results[i + 1], results[i + 2]});
+                }
+            }
+            if (unlock_nominal_current_option->count() > 0)
             {
-                options.write_coil_args.push_back({results[i], results[i + 1]});
+                options.actions.push_back(CommandLineAction::UNLOCK_NOMINAL_CURRENT);
+                auto results = unlock_nominal_current_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.unlock_nominal_current_args.push_back({results[i], results[i + 1]});
+                }
             }
+            if (get_channel_status_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::GET_CHANNEL_STATUS);
+                auto results = get_channel_status_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.get_channel_status_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (get_load_current_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::GET_LOAD_CURRENT);
+                auto results = get_load_current_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.get_load_current_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (control_channel_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::CONTROL_CHANNEL);
+                auto results = control_channel_option->results();
+                for (std::size_t i = 0; i + 2 < results.size(); i += 3)
+                {
+                    options.control_channel_args.push_back({results[i], results[i + 1], results[i + 2]});
+                }
+            }
+            if (read_coil_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_COIL);
+                auto results = read_coil_option->results();
+                for (std::size_t i = 0; i < results.size(); i++)
+                {
+                    options.read_coil_args.push_back({results[i]});
+                }
+            }
+            if (write_coil_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::WRITE_COIL);
+                auto results = write_coil_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.write_coil_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (read_coils_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_COILS);
+                auto results = read_coils_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.read_coils_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (write_coils_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::WRITE_COILS);
+                auto results = write_coils_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.write_coils_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (switch_sequence_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::SWITCH_SEQUENCE);
+                auto results = switch_sequence_option->results();
+                for (std::size_t i = 0; i + 1 < results.size(); i += 2)
+                {
+                    options.switch_sequence_args.push_back({results[i], results[i + 1]});
+                }
+            }
+            if (publish_shm_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::PUBLISH_SHM);
+            }
+            if (publish_mqtt_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::PUBLISH_MQTT);
+            }
+            if (load_stats_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::LOAD_STATISTICS);
+            }
+            if (trip_capture_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::TRIP_CAPTURE);
+            }
+            if (read_shm_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::READ_SHM);
+            }
+            if (trip_show_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::SHOW_TRIP_EVENT);
+            }
+            if (log_show_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::SHOW_LOG);
+            }
+            if (replay_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::REPLAY_TRACE);
+            }
+            if (apply_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::APPLY_PLAN);
+            }
+            if (discover_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::DISCOVER_DEVICES);
+            }
+            if (inventory_refresh_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::INVENTORY_REFRESH);
+            }
+            if (inventory_list_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::INVENTORY_LIST);
+            }
+            if (inventory_query_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::INVENTORY_QUERY);
+            }
+            if (profile_device_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::PROFILE_DEVICE);
+            }
+            if (sync_sample_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::SYNC_SAMPLE);
+            }
+            if (cluster_poll_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::CLUSTER_POLL);
+            }
+            if (health_watch_option->count() > 0)
+            {
+                options.actions.push_back(CommandLineAction::HEALTH_WATCH);
+            }
+            // The shell takes its actions line by line and has no deadline;
+            // anything given with it on the command line would be ignored.
+            bool shell = std::find(options.actions.begin(), options.actions.end(), CommandLineAction::SHELL) != options.actions.end();
+            if (shell && (options.actions.size() > 1 || options.deadline_seconds > 0))
+            {
+                CLI::ValidationError error("--shell", "cannot be combined with other actions or --deadline");
+                if (mode == ParseMode::THROW)
+                {
+                    throw std::invalid_argument(error.what());
+                }
+                app.exit(error);
+                exit(error.get_exit_code());
+            }
+
+            // Without -i, --inventory-refresh, --cluster-poll and --health-watch cover every recorded device.
+            bool fleet_action = inventory_refresh_option->count() > 0 || cluster_poll_option->count() > 0 || health_watch_option->count() > 0;
+            if (fleet_action && ip_option->count() == 0 &&
+                std::none_of(options.actions.begin(), options.actions.end(), requires_device_connection))
+            {
+                options.ip_addresses.clear();
+            }
+            return options;
+        }
+    }
+
+    CommandLineOptions parse_command_line(int argc, char *argv[])
+    {
+        if (auto simple = parse_simple_command_line(argc, argv))
+        {
+            return std::move(*simple);
+        }
+        return parse_full_command_line(argc, argv, ParseMode::EXIT, nullptr);
+    }
+
+    CommandLineOptions parse_shell_command(const std::vector<std::string> &words)
+    {
+        std::vector<char *> argv{const_cast<char *>("caparoc_commander")};
+        for (const auto &word : words)
+        {
+            argv.push_back(const_cast<char *>(word.c_str()));
+        }
+        auto argc = static_cast<int>(argv.size());
+        if (auto simple = parse_simple_command_line(argc, argv.data()))
+        {
+            return std::move(*simple);
+        }
+        return parse_full_command_line(argc, argv.data(), ParseMode::THROW, nullptr);
+    }
+
+    std::vector<std::string> command_line_option_names()
+    {
+        std::vector<std::string> names;
+        parse_full_command_line(0, nullptr, ParseMode::THROW, &names);
+        return names;
+    }
+
+
+    bool requires_device_connection(CommandLineAction action)
+    {
+        switch (action)
+        {
+        case CommandLineAction::NONE:
+        case CommandLineAction::LIST_REGISTERS:
+        case CommandLineAction::REGISTER_INFO:
+        case CommandLineAction::SEARCH_REGISTERS:
+        case CommandLineAction::DISCOVER_DEVICES:
+        case CommandLineAction::INVENTORY_REFRESH:
+        case CommandLineAction::INVENTORY_LIST:
+        case CommandLineAction::INVENTORY_QUERY:
+        case CommandLineAction::PROFILE_DEVICE:
+        case CommandLineAction::SYNC_SAMPLE:
+        case CommandLineAction::CLUSTER_POLL:
+        case CommandLineAction::HEALTH_WATCH:
+        case CommandLineAction::READ_SHM:
+        case CommandLineAction::SHOW_TRIP_EVENT:
+        case CommandLineAction::SHOW_LOG:
+        case CommandLineAction::REPLAY_TRACE:
+        case CommandLineAction::APPLY_PLAN:
+            return false;
+        default:
+            return true;
         }
-        return options;
     }
 
     std::string dump_command_line_options(const CommandLineOptions &options)
     {
         std::string output;
-        output += std::format("ip_address: {}\n", options.ip_address);
+        output += "ip_addresses:\n";
+        for (const auto &address : options.ip_addresses)
+        {
+            output += std::format("  - {}\n", address);
+        }
         output += std::format("port: {}\n", options.port);
+        output += "unit_ids:";
+        for (auto unit : options.unit_ids)
+        {
+            output += std::format(" {}", unit);
+        }
+        output += '\n';
         output += std::format("timeout_seconds: {}\n", options.timeout_seconds);
+        output += std::format("deadline_seconds: {}\n", options.deadline_seconds);
+        output += std::format("adaptive_timeout: {}\n", options.adaptive_timeout);
+        output += std::format("timeout_min_ms: {}\n", options.timeout_min_ms);
+        output += std::format("timeout_max_ms: {}\n", options.timeout_max_ms);
         output += "actions:\n";
         if (options.actions.empty())
         {
@@ -320,6 +1001,72 @@ namespace cli
         output += std::format("read_uint16_address: {}\n", options.read_uint16_address);
         output += std::format("read_uint32_address: {}\n", options.read_uint32_address);
         output += std::format("read_string32_address: {}\n", options.read_string32_address);
+        output += std::format("publish_shm_name: {}\n", options.publish_shm_name);
+        output += std::format("read_shm_name: {}\n", options.read_shm_name);
+        output += std::format("poll_interval_ms: {}\n", options.poll_interval_ms);
+        output += std::format("mqtt_broker: {}\n", options.mqtt_broker);
+        output += std::format("mqtt_topic: {}\n", options.mqtt_topic);
+        output += std::format("mqtt_client_id: {}\n", options.mqtt_client_id);
+        output += std::format("mqtt_qos: {}\n", options.mqtt_qos);
+        output += std::format("mqtt_batch: {}\n", options.mqtt_batch);
+        output += std::format("mqtt_full_every: {}\n", options.mqtt_full_every);
+        output += std::format("mqtt_deadband_ma: {}\n", options.mqtt_deadband_ma);
+        output += std::format("mqtt_compress: {}\n", options.mqtt_compress);
+        output += std::format("mqtt_queue_file: {}\n", options.mqtt_queue_file);
+        output += std::format("mqtt_queue_limit: {}\n", options.mqtt_queue_limit);
+        output += std::format("stats_window_s: {}\n", options.stats_window_s);
+        output += std::format("stats_slide_s: {}\n", options.stats_slide_s);
+        output += std::format("stats_json: {}\n", options.stats_json);
+        output += std::format("trip_capture_dir: {}\n", options.trip_capture_dir);
+        output += std::format("trip_pre: {}\n", options.trip_pre);
+        output += std::format("trip_post: {}\n", options.trip_post);
+        output += std::format("trip_show_file: {}\n", options.trip_show_file);
+        output += std::format("capture_file: {}\n", options.capture_file);
+        output += std::format("replay_file: {}\n", options.replay_file);
+        output += std::format("replay_address: {}\n", options.replay_address);
+        output += std::format("replay_port: {}\n", options.replay_port);
+        output += std::format("replay_speed: {}\n", options.replay_speed);
+        output += std::format("apply_plan_file: {}\n", options.apply_plan_file);
+        output += std::format("apply_workers: {}\n", options.apply_workers);
+        output += std::format("apply_dry_run: {}\n", options.apply_dry_run);
+        output += std::format("discover_cidr: {}\n", options.discover_cidr);
+        output += std::format("discover_max_sockets: {}\n", options.discover_max_sockets);
+        output += std::format("inventory_file: {}\n", options.inventory_file);
+        output += std::format("inventory_full: {}\n", options.inventory_full);
+        output += std::format("inventory_workers: {}\n", options.inventory_workers);
+        output += std::format("inventory_query: {}\n", options.inventory_query);
+        output += std::format("profiles_file: {}\n", options.profiles_file);
+        output += std::format("no_profiles: {}\n", options.no_profiles);
+        output += std::format("profile_step_ms: {}\n", options.profile_step_ms);
+        output += std::format("profile_address: {}\n", options.profile_address);
+        output += std::format("profile_max_connections: {}\n", options.profile_max_connections);
+        output += std::format("sync_address: {}\n", options.sync_address);
+        output += std::format("sync_count: {}\n", options.sync_count);
+        output += std::format("sync_rows: {}\n", options.sync_rows);
+        output += std::format("sync_max_skew_ms: {}\n", options.sync_max_skew_ms);
+        output += std::format("sync_json: {}\n", options.sync_json);
+        output += std::format("cluster_bind: {}\n", options.cluster_bind);
+        output += "cluster_peers:\n";
+        for (const auto &peer : options.cluster_peers)
+        {
+            output += std::format("  - {}\n", peer);
+        }
+        output += std::format("cluster_sink: {}\n", options.cluster_sink);
+        output += std::format("cluster_workers: {}\n", options.cluster_workers);
+        output += std::format("cluster_heartbeat_ms: {}\n", options.cluster_heartbeat_ms);
+        output += std::format("health_top: {}\n", options.health_top);
+        output += std::format("health_report_s: {}\n", options.health_report_s);
+        output += std::format("health_half_life_s: {}\n", options.health_half_life_s);
+        output += std::format("health_workers: {}\n", options.health_workers);
+        output += std::format("rt_priority: {}\n", options.rt_priority);
+        output += std::format("rt_cpu: {}\n", options.rt_cpu);
+        output += std::format("rt_lock_memory: {}\n", options.rt_lock_memory);
+        output += std::format("rt_spin_us: {}\n", options.rt_spin_us);
+        output += std::format("rt_busy_poll_us: {}\n", options.rt_busy_poll_us);
+        output += std::format("jitter_report: {}\n", options.jitter_report);
+        output += std::format("io_backend: {}\n", options.io_backend);
+        output += std::format("log_file: {}\n", options.log_file);
+        output += std::format("log_show_file: {}\n", options.log_show_file);
 
         output += "write_uint16_args:\n";
         if (options.write_uint16_args.empty())
@@ -399,6 +1146,48 @@ namespace cli
             }
         }
 
+        output += "read_coils_args:\n";
+        if (options.read_coils_args.empty())
+        {
+            output += "  (none)\n";
+        }
+        else
+        {
+            for (const auto &args : options.read_coils_args)
+            {
+                output += std::format("  - start: {}, count: {}\n", args.start, args.count);
+            }
+        }
+
+        output += "switch_sequence_args:\n";
+        if (options.switch_sequence_args.empty())
+        {
+            output += "  (none)\n";
+        }
+        else
+        {
+            for (const auto &args : options.switch_sequence_args)
+            {
+                output += std::format("  - state: {}, channels: {}\n", args.state, args.channels);
+            }
+        }
+        output += std::format("switch_max_simultaneous: {}\n", options.switch_max_simultaneous);
+        output += std::format("switch_stagger_ms: {}\n", options.switch_stagger_ms);
+        output += std::format("switch_verify_timeout_ms: {}\n", options.switch_verify_timeout_ms);
+
+        output += "write_coils_args:\n";
+        if (options.write_coils_args.empty())
+        {
+            output += "  (none)\n";
+        }
+        else
+        {
+            for (const auto &args : options.write_coils_args)
+            {
+                output += std::format("  - start: {}, bitmask: {}\n", args.start, args.bitmask);
+            }
+        }
+
         return output;
     }
 
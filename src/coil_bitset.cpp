@@ -0,0 +1,121 @@
+#include "caparoc_commander/coil_bitset.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t WORD_BITS = 64;
+constexpr std::size_t WORD_BYTES = WORD_BITS / 8;
+
+// The wire order is little endian within a word: the first byte holds coils 0-7.
+uint64_t to_little_endian(uint64_t word)
+{
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        return std::byteswap(word);
+    }
+    return word;
+}
+
+} // namespace
+
+CoilBitset::CoilBitset(std::size_t count)
+    : count_(count), words_((count + WORD_BITS - 1) / WORD_BITS, 0)
+{
+}
+
+CoilBitset CoilBitset::from_packed_bytes(std::span<const uint8_t> bytes, std::size_t count)
+{
+    CoilBitset bits(count);
+    auto byte_count = std::min(bytes.size(), (count + 7) / 8);
+    for (std::size_t w = 0; w < bits.words_.size(); ++w)
+    {
+        auto offset = w * WORD_BYTES;
+        if (offset >= byte_count)
+        {
+            break;
+        }
+        uint64_t word = 0;
+        std::memcpy(&word, bytes.data() + offset, std::min(WORD_BYTES, byte_count - offset));
+        bits.words_[w] = to_little_endian(word);
+    }
+
+    // Devices pad the last byte; padding must not show up in count_on().
+    if (auto tail = count % WORD_BITS; tail != 0)
+    {
+        bits.words_.back() &= (uint64_t{1} << tail) - 1;
+    }
+    return bits;
+}
+
+std::optional<CoilBitset> CoilBitset::parse(std::string_view digits)
+{
+    if (digits.empty())
+    {
+        return std::nullopt;
+    }
+    CoilBitset bits(digits.size());
+    for (std::size_t i = 0; i < digits.size(); ++i)
+    {
+        if (digits[i] != '0' && digits[i] != '1')
+        {
+            return std::nullopt;
+        }
+        bits.set(i, digits[i] == '1');
+    }
+    return bits;
+}
+
+std::vector<uint8_t> CoilBitset::to_packed_bytes() const
+{
+    std::vector<uint8_t> bytes(words_.size() * WORD_BYTES);
+    for (std::size_t w = 0; w < words_.size(); ++w)
+    {
+        auto word = to_little_endian(words_[w]);
+        std::memcpy(bytes.data() + w * WORD_BYTES, &word, WORD_BYTES);
+    }
+    bytes.resize((count_ + 7) / 8);
+    return bytes;
+}
+
+bool CoilBitset::test(std::size_t index) const
+{
+    return (words_[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+void CoilBitset::set(std::size_t index, bool value)
+{
+    auto mask = uint64_t{1} << (index % WORD_BITS);
+    auto &word = words_[index / WORD_BITS];
+    word = value ? (word | mask) : (word & ~mask);
+}
+
+std::size_t CoilBitset::count_on() const
+{
+    std::size_t on = 0;
+    for (auto word : words_)
+    {
+        on += static_cast<std::size_t>(std::popcount(word));
+    }
+    return on;
+}
+
+std::string CoilBitset::to_string() const
+{
+    std::string digits(count_, '0');
+    for (std::size_t w = 0; w < words_.size(); ++w)
+    {
+        // Visit set bits only.
+        for (auto word = words_[w]; word != 0; word &= word - 1)
+        {
+            digits[w * WORD_BITS + static_cast<std::size_t>(std::countr_zero(word))] = '1';
+        }
+    }
+    return digits;
+}
+
+} // namespace cli
@@ -1,25 +1,40 @@
 #include "caparoc_commander/create_modbus_connection.hpp"
 #include "libmodbus_cpp/modbus_connection.hpp"
 
+#include <cerrno>
 #include <format>
 #include <stdexcept>
 
 namespace cli {
 
-libmodbus_cpp::ModbusConnection create_modbus_connection(const std::string& ip_address, int port, int timeout_seconds)
+DeviceResult<libmodbus_cpp::ModbusConnection> connect_modbus_device(const std::string& ip_address, int port, int timeout_seconds)
 {
     libmodbus_cpp::ModbusConnection conn(ip_address, port);
     conn.set_response_timeout(timeout_seconds, 0);
-    
+
+    errno = 0;
     if (!conn.connect())
     {
-        throw std::runtime_error(
-            std::format(
-                "Failed to connect to device: {}\n\nat {}:{}\n",
-                conn.get_last_error(), ip_address, port));
+        // libmodbus leaves the cause in errno.
+        return std::unexpected(device_error_from_errno(errno));
     }
-    
+
     return conn;
 }
 
+libmodbus_cpp::ModbusConnection create_modbus_connection(const std::string& ip_address, int port, int timeout_seconds)
+{
+    auto conn = connect_modbus_device(ip_address, port, timeout_seconds);
+    if (!conn)
+    {
+        throw std::runtime_error(format_connect_error(conn.error(), ip_address, port));
+    }
+    return std::move(*conn);
+}
+
+std::string format_connect_error(const DeviceError& error, const std::string& ip_address, int port)
+{
+    return std::format("Failed to connect to device: {}\n\nat {}:{}\n", describe(error), ip_address, port);
+}
+
 } // namespace cli
@@ -0,0 +1,188 @@
+#include "caparoc_commander/device_error.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+namespace cli {
+
+namespace {
+
+// libmodbus reports its own errors as errno values above MODBUS_ENOBASE:
+// base + 1 to base + 11 are the Modbus exception codes, base + 12 to
+// base + 17 malformed responses (bad CRC, bad data, ..., bad slave).
+constexpr int LIBMODBUS_ERRNO_BASE = 112345678;
+constexpr int LIBMODBUS_LAST_EXCEPTION = 0x0B;
+constexpr int LIBMODBUS_LAST_ERROR = 17;
+
+std::string_view exception_name(uint8_t code)
+{
+    switch (code)
+    {
+    case 0x01:
+        return "illegal function";
+    case 0x02:
+        return "illegal data address";
+    case 0x03:
+        return "illegal data value";
+    case 0x04:
+        return "server device failure";
+    case 0x05:
+        return "acknowledge";
+    case 0x06:
+        return "server device busy";
+    case 0x07:
+        return "negative acknowledge";
+    case 0x08:
+        return "memory parity error";
+    case 0x0A:
+        return "gateway path unavailable";
+    case 0x0B:
+        return "gateway target failed to respond";
+    }
+    return "unknown";
+}
+
+} // namespace
+
+DeviceError device_error_from_errno(int error)
+{
+    if (error > LIBMODBUS_ERRNO_BASE && error <= LIBMODBUS_ERRNO_BASE + LIBMODBUS_LAST_ERROR)
+    {
+        auto code = error - LIBMODBUS_ERRNO_BASE;
+        if (code <= LIBMODBUS_LAST_EXCEPTION)
+        {
+            return {DeviceErrc::MODBUS_EXCEPTION, error, static_cast<uint8_t>(code)};
+        }
+        return {DeviceErrc::INVALID_RESPONSE, error};
+    }
+    switch (error)
+    {
+    case ETIMEDOUT:
+    case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+    case EINPROGRESS:
+        return {DeviceErrc::TIMEOUT, error};
+    case ECONNREFUSED:
+        return {DeviceErrc::CONNECTION_REFUSED, error};
+    case ECONNRESET:
+    case ECONNABORTED:
+    case EPIPE:
+        return {DeviceErrc::CONNECTION_RESET, error};
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+    case ENETDOWN:
+        return {DeviceErrc::UNREACHABLE, error};
+    case ECANCELED:
+        return {DeviceErrc::CANCELLED, error};
+    case ENOTCONN:
+    case EBADF:
+        return {DeviceErrc::NOT_CONNECTED, error};
+    }
+    return {DeviceErrc::OTHER, error};
+}
+
+DeviceError device_error_from_response(std::span<const uint8_t> adu)
+{
+    // MBAP header, then the function code with bit 7 set and the exception code
+    if (adu.size() >= 9 && (adu[7] & 0x80) != 0)
+    {
+        return {DeviceErrc::MODBUS_EXCEPTION, 0, adu[8]};
+    }
+    return {DeviceErrc::INVALID_RESPONSE};
+}
+
+std::string_view to_string(DeviceErrc code)
+{
+    switch (code)
+    {
+    case DeviceErrc::TIMEOUT:
+        return "timeout";
+    case DeviceErrc::CONNECTION_REFUSED:
+        return "connection refused";
+    case DeviceErrc::CONNECTION_RESET:
+        return "connection reset";
+    case DeviceErrc::UNREACHABLE:
+        return "unreachable";
+    case DeviceErrc::RESOLVE_FAILED:
+        return "resolve failed";
+    case DeviceErrc::MODBUS_EXCEPTION:
+        return "Modbus exception";
+    case DeviceErrc::INVALID_RESPONSE:
+        return "invalid response";
+    case DeviceErrc::CANCELLED:
+        return "cancelled";
+    case DeviceErrc::NOT_CONNECTED:
+        return "not connected";
+    case DeviceErrc::OTHER:
+        return "other";
+    }
+    return "unknown";
+}
+
+std::string describe(const DeviceError &error)
+{
+    switch (error.code)
+    {
+    case DeviceErrc::TIMEOUT:
+        return "Response timeout";
+    case DeviceErrc::MODBUS_EXCEPTION:
+        return std::format("Modbus exception 0x{:02X} ({})", error.exception_code, exception_name(error.exception_code));
+    case DeviceErrc::CANCELLED:
+        return "Cancelled (deadline exceeded)";
+    case DeviceErrc::NOT_CONNECTED:
+        return "Not connected";
+    case DeviceErrc::CONNECTION_RESET:
+        if (error.system_error == 0)
+        {
+            return "Connection closed by device";
+        }
+        break;
+    case DeviceErrc::INVALID_RESPONSE:
+        if (error.system_error == 0)
+        {
+            return "Invalid response";
+        }
+        break;
+    case DeviceErrc::RESOLVE_FAILED:
+        return "Cannot resolve host name";
+    default:
+        break;
+    }
+    if (error.system_error > LIBMODBUS_ERRNO_BASE)
+    {
+        return std::format("Invalid response (libmodbus error {})", error.system_error - LIBMODBUS_ERRNO_BASE);
+    }
+    if (error.system_error != 0)
+    {
+        return std::strerror(error.system_error);
+    }
+    return std::string(to_string(error.code));
+}
+
+uint64_t DeviceErrorCounters::total() const
+{
+    uint64_t sum = 0;
+    for (const auto &count : counts_)
+    {
+        sum += count.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::string DeviceErrorCounters::format() const
+{
+    std::string text;
+    for (std::size_t i = 0; i < DEVICE_ERRC_COUNT; ++i)
+    {
+        if (auto count = counts_[i].load(std::memory_order_relaxed); count > 0)
+        {
+            text += std::format("{}{} {}", text.empty() ? "" : ", ", count, to_string(static_cast<DeviceErrc>(i)));
+        }
+    }
+    return text.empty() ? "none" : text;
+}
+
+} // namespace cli
@@ -0,0 +1,551 @@
+#include "caparoc_commander/device_profile.hpp"
+#include "caparoc_commander/load_statistics.hpp"
+
+#ifdef __linux__
+#include "caparoc_commander/async_modbus_client.hpp"
+#include "caparoc_commander/event_loop.hpp"
+#include "caparoc_commander/task.hpp"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace cli {
+
+namespace {
+
+std::string_view trim(std::string_view text)
+{
+    auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos)
+    {
+        return {};
+    }
+    auto last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+template <typename T>
+T parse_value(std::string_view text, std::string_view key, std::size_t line)
+{
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size())
+    {
+        throw std::invalid_argument(std::format("line {}: invalid {} '{}'", line, key, text));
+    }
+    return value;
+}
+
+} // namespace
+
+const DeviceProfile *DeviceProfiles::find(std::string_view endpoint) const
+{
+    auto it = std::lower_bound(devices.begin(), devices.end(), endpoint, [](const DeviceProfile &profile, std::string_view key)
+                               { return profile.endpoint < key; });
+    return it != devices.end() && it->endpoint == endpoint ? &*it : nullptr;
+}
+
+void DeviceProfiles::update(DeviceProfile profile)
+{
+    auto it = std::lower_bound(devices.begin(), devices.end(), profile.endpoint, [](const DeviceProfile &entry, const std::string &key)
+                               { return entry.endpoint < key; });
+    if (it != devices.end() && it->endpoint == profile.endpoint)
+    {
+        *it = std::move(profile);
+        return;
+    }
+    devices.insert(it, std::move(profile));
+}
+
+DeviceProfiles parse_device_profiles(std::string_view text)
+{
+    DeviceProfiles profiles;
+    std::size_t line_number = 0;
+    while (!text.empty())
+    {
+        auto newline = text.find('\n');
+        auto line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        ++line_number;
+
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        if (line.front() == '[')
+        {
+            if (line.back() != ']' || trim(line.substr(1, line.size() - 2)).empty())
+            {
+                throw std::invalid_argument(std::format("line {}: expected [HOST:PORT]", line_number));
+            }
+            profiles.devices.push_back({});
+            profiles.devices.back().endpoint = std::string(trim(line.substr(1, line.size() - 2)));
+            continue;
+        }
+
+        auto equals = line.find('=');
+        if (equals == std::string_view::npos)
+        {
+            throw std::invalid_argument(std::format("line {}: expected KEY = VALUE", line_number));
+        }
+        if (profiles.devices.empty())
+        {
+            throw std::invalid_argument(std::format("line {}: value before the first [device] section", line_number));
+        }
+
+        auto key = trim(line.substr(0, equals));
+        auto value = trim(line.substr(equals + 1));
+        auto &profile = profiles.devices.back();
+        if (key == "block_words")
+        {
+            profile.block_words = parse_value<uint16_t>(value, key, line_number);
+        }
+        else if (key == "max_block_words")
+        {
+            profile.max_block_words = parse_value<uint16_t>(value, key, line_number);
+        }
+        else if (key == "pipeline_depth")
+        {
+            profile.pipeline_depth = parse_value<uint16_t>(value, key, line_number);
+        }
+        else if (key == "connections")
+        {
+            profile.connections = parse_value<uint16_t>(value, key, line_number);
+        }
+        else if (key == "max_rate_hz")
+        {
+            profile.max_rate_hz = parse_value<double>(value, key, line_number);
+        }
+        else if (key == "latency_p50_us")
+        {
+            profile.latency_p50_us = parse_value<uint32_t>(value, key, line_number);
+        }
+        else if (key == "latency_p99_us")
+        {
+            profile.latency_p99_us = parse_value<uint32_t>(value, key, line_number);
+        }
+        else if (key == "profiled_ns")
+        {
+            profile.profiled_ns = parse_value<uint64_t>(value, key, line_number);
+        }
+    }
+
+    std::stable_sort(profiles.devices.begin(), profiles.devices.end(), [](const DeviceProfile &a, const DeviceProfile &b)
+                     { return a.endpoint < b.endpoint; });
+    // A device listed twice keeps its last section.
+    DeviceProfiles unique;
+    for (auto &profile : profiles.devices)
+    {
+        unique.update(std::move(profile));
+    }
+    return unique;
+}
+
+std::string format_device_profiles(const DeviceProfiles &profiles)
+{
+    std::string out = "# caparoc_commander device profiles, written by --profile-device\n";
+    for (const auto &profile : profiles.devices)
+    {
+        out += std::format("\n[{}]\n", profile.endpoint);
+        out += std::format("block_words = {}\n", profile.block_words);
+        out += std::format("max_block_words = {}\n", profile.max_block_words);
+        out += std::format("pipeline_depth = {}\n", profile.pipeline_depth);
+        out += std::format("connections = {}\n", profile.connections);
+        out += std::format("max_rate_hz = {:.1f}\n", profile.max_rate_hz);
+        out += std::format("latency_p50_us = {}\n", profile.latency_p50_us);
+        out += std::format("latency_p99_us = {}\n", profile.latency_p99_us);
+        out += std::format("profiled_ns = {}\n", profile.profiled_ns);
+    }
+    return out;
+}
+
+DeviceProfiles load_device_profiles(const std::string &path)
+{
+    if (!std::filesystem::exists(path))
+    {
+        return {};
+    }
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error(std::format("Cannot open profile file '{}'", path));
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    try
+    {
+        return parse_device_profiles(content.str());
+    }
+    catch (const std::invalid_argument &e)
+    {
+        throw std::invalid_argument(std::format("{}: {}", path, e.what()));
+    }
+}
+
+void save_device_profiles(const DeviceProfiles &profiles, const std::string &path)
+{
+    auto directory = std::filesystem::path(path).parent_path();
+    std::error_code ec;
+    if (!directory.empty())
+    {
+        std::filesystem::create_directories(directory, ec);
+    }
+
+    auto temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << format_device_profiles(profiles);
+        if (!file.flush())
+        {
+            throw std::runtime_error(std::format("Cannot write profile file '{}'", temporary));
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+    if (ec)
+    {
+        throw std::runtime_error(std::format("Cannot replace profile file '{}': {}", path, ec.message()));
+    }
+}
+
+std::string default_device_profiles_path()
+{
+    if (const char *config = std::getenv("XDG_CONFIG_HOME"); config && *config)
+    {
+        return std::format("{}/caparoc_commander/profiles.ini", config);
+    }
+    if (const char *home = std::getenv("HOME"); home && *home)
+    {
+        return std::format("{}/.config/caparoc_commander/profiles.ini", home);
+    }
+    return {};
+}
+
+std::string format_profile_step(const ProfileStep &step)
+{
+    auto line = std::format("{:<11} {:>6}  {:>9.1f} req/s  {:>10.0f} words/s  p50 {:>7.2f} ms  p99 {:>7.2f} ms",
+                            step.stage, step.value, step.throughput_rps, step.words_per_s, step.p50_us / 1000.0, step.p99_us / 1000.0);
+    if (step.errors > 0)
+    {
+        line += std::format("  {} error(s)", step.errors);
+        if (step.error)
+        {
+            line += std::format(": {}", describe(*step.error));
+        }
+    }
+    return line;
+}
+
+std::string format_device_profile(const DeviceProfile &profile)
+{
+    std::string out;
+    out += std::format("Block size:      {} words (device answered up to {})\n", profile.block_words, profile.max_block_words);
+    out += std::format("Pipeline depth:  {}\n", profile.pipeline_depth);
+    out += std::format("Connections:     {}\n", profile.connections);
+    out += std::format("Max rate:        {:.1f} requests/s\n", profile.max_rate_hz);
+    out += std::format("Latency:         p50 {:.2f} ms, p99 {:.2f} ms", profile.latency_p50_us / 1000.0, profile.latency_p99_us / 1000.0);
+    return out;
+}
+
+#ifdef __linux__
+
+namespace {
+
+using Clock = EventLoop::Clock;
+using TimePoint = EventLoop::TimePoint;
+
+constexpr std::array<uint16_t, 8> BLOCK_SIZES{1, 2, 4, 8, 16, 32, 64, 125};
+constexpr std::array<uint16_t, 5> DEPTHS{1, 2, 4, 8, 16};
+constexpr std::array<uint16_t, 4> CONNECTION_COUNTS{1, 2, 4, 8};
+constexpr std::array<double, 6> RATE_FRACTIONS{0.25, 0.5, 0.75, 0.9, 1.0, 1.2};
+
+constexpr double KNEE_THROUGHPUT = 0.9;   // share of the best throughput that counts as saturated
+constexpr double SERVED_SHARE = 0.95;     // share of the offered rate that must be answered
+constexpr double LATENCY_FACTOR = 2.0;    // allowed growth of the unloaded latency ...
+constexpr double LATENCY_SLACK_US = 1000; // ... or at least this much, against timer granularity on fast links
+
+/// Offered load of one step
+struct Load {
+    uint16_t connections = 1;
+    uint16_t depth = 1;  // requests in flight per connection
+    uint16_t block_words = 1;
+    double rate_hz = 0.0;  // 0 = closed loop, as fast as answers arrive
+};
+
+struct StepState {
+    QuantileSketch latencies{0.01, 1.0, 60e6};  // microseconds
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    std::optional<DeviceError> error;
+    TimePoint end;
+
+    void fail(const DeviceError &failure)
+    {
+        ++errors;
+        if (!error)
+        {
+            error = failure;
+        }
+    }
+};
+
+uint64_t now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch())
+                                     .count());
+}
+
+double microseconds_between(TimePoint from, TimePoint to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+// One request stream. In open loop the requests follow a fixed schedule
+// and latency counts from the scheduled time; a worker that falls behind
+// therefore shows the queueing delay instead of silently sending less.
+// The first failure ends the stream.
+Task<void> run_worker(EventLoop &loop, AsyncModbusClient &client, const ProfileSettings &settings, Load load, StepState &state,
+                      TimePoint first_send, Clock::duration interval)
+{
+    auto scheduled = first_send;
+    while (Clock::now() < state.end && scheduled < state.end)
+    {
+        if (interval.count() > 0 && scheduled > Clock::now())
+        {
+            if (co_await loop.sleep_until(scheduled) == WaitStatus::CANCELLED)
+            {
+                state.fail({DeviceErrc::CANCELLED});
+                co_return;
+            }
+        }
+        auto start = interval.count() > 0 ? scheduled : Clock::now();
+        auto words = co_await client.read_holding_registers(settings.unit_id, settings.address, load.block_words, Clock::now() + settings.timeout);
+        if (!words)
+        {
+            state.fail(words.error());
+            co_return;
+        }
+        ++state.requests;
+        state.latencies.add(std::max(1.0, microseconds_between(start, Clock::now())));
+        scheduled = interval.count() > 0 ? scheduled + interval : Clock::now();
+    }
+}
+
+Task<void> run_load(EventLoop &loop, const ProfileSettings &settings, Load load, StepState &state)
+{
+    std::vector<std::unique_ptr<AsyncModbusClient>> clients;
+    for (uint16_t i = 0; i < load.connections; ++i)
+    {
+        clients.push_back(std::make_unique<AsyncModbusClient>(loop, settings.host, settings.port));
+        if (auto connected = co_await clients.back()->connect(Clock::now() + settings.timeout); !connected)
+        {
+            state.fail(connected.error());
+            co_return;
+        }
+    }
+
+    auto streams = static_cast<std::size_t>(load.connections) * load.depth;
+    Clock::duration interval{0};
+    if (load.rate_hz > 0.0)
+    {
+        interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(streams) / load.rate_hz));
+    }
+
+    auto start = Clock::now();
+    state.end = start + settings.step;
+    std::vector<Task<void>> workers;
+    for (std::size_t i = 0; i < streams; ++i)
+    {
+        // Staggered so the open-loop requests are spread over the interval.
+        auto offset = interval * static_cast<Clock::rep>(i) / static_cast<Clock::rep>(streams);
+        workers.push_back(run_worker(loop, *clients[i % clients.size()], settings, load, state, start + offset, interval));
+    }
+    co_await loop.when_all(std::move(workers));
+}
+
+ProfileStep run_step(const ProfileSettings &settings, std::string_view stage, uint32_t value, Load load)
+{
+    EventLoop loop(settings.io_backend);
+    loop.set_deadline(settings.deadline);
+
+    StepState state;
+    auto start = Clock::now();
+    loop.run(run_load(loop, settings, load, state));
+    auto seconds = std::max(std::chrono::duration<double>(std::min(Clock::now(), std::max(state.end, start)) - start).count(), 1e-3);
+
+    ProfileStep step;
+    step.stage = stage;
+    step.value = value;
+    step.requests = state.requests;
+    step.errors = state.errors;
+    step.error = state.error;
+    step.throughput_rps = static_cast<double>(state.requests) / seconds;
+    step.words_per_s = step.throughput_rps * load.block_words;
+    step.p50_us = state.latencies.quantile(0.5);
+    step.p99_us = state.latencies.quantile(0.99);
+    return step;
+}
+
+bool usable(const ProfileStep &step)
+{
+    return step.errors == 0 && step.requests > 0;
+}
+
+// Smallest setting reaching KNEE_THROUGHPUT of the best throughput
+uint16_t throughput_knee(const std::vector<ProfileStep> &steps)
+{
+    double best = 0.0;
+    for (const auto &step : steps)
+    {
+        best = std::max(best, step.throughput_rps);
+    }
+    for (const auto &step : steps)
+    {
+        if (step.throughput_rps >= KNEE_THROUGHPUT * best)
+        {
+            return static_cast<uint16_t>(step.value);
+        }
+    }
+    return 1;
+}
+
+bool within_latency(double latency_us, double unloaded_us)
+{
+    return latency_us <= std::max(LATENCY_FACTOR * unloaded_us, unloaded_us + LATENCY_SLACK_US);
+}
+
+} // namespace
+
+ProfileResult profile_device(const ProfileSettings &settings, const std::function<void(const ProfileStep &)> &on_step)
+{
+    ProfileResult result;
+    auto &profile = result.profile;
+    profile.endpoint = std::format("{}:{}", settings.host, settings.port);
+
+    auto record = [&](std::string_view stage, uint32_t value, Load load)
+    {
+        auto step = run_step(settings, stage, value, load);
+        on_step(step);
+        result.steps.push_back(step);
+        return step;
+    };
+
+    // Block size at one request in flight; the single-word step is the unloaded baseline.
+    double unloaded_p50 = 0.0;
+    double unloaded_p99 = 0.0;
+    for (auto block : BLOCK_SIZES)
+    {
+        auto step = record("block", block, {1, 1, block, 0.0});
+        if (!usable(step))
+        {
+            if (block == BLOCK_SIZES.front())
+            {
+                result.error = step.error.value_or(DeviceError{DeviceErrc::OTHER});
+                return result;
+            }
+            break;
+        }
+        if (block == BLOCK_SIZES.front())
+        {
+            unloaded_p50 = step.p50_us;
+            unloaded_p99 = step.p99_us;
+        }
+        profile.max_block_words = block;
+        if (within_latency(step.p50_us, unloaded_p50))
+        {
+            profile.block_words = block;
+        }
+    }
+    profile.latency_p50_us = static_cast<uint32_t>(unloaded_p50);
+    profile.latency_p99_us = static_cast<uint32_t>(unloaded_p99);
+
+    // Pipelining on one connection
+    std::vector<ProfileStep> depth_steps;
+    for (auto depth : DEPTHS)
+    {
+        auto step = record("depth", depth, {1, depth, 1, 0.0});
+        if (!usable(step))
+        {
+            break;
+        }
+        depth_steps.push_back(step);
+    }
+    if (!depth_steps.empty())
+    {
+        profile.pipeline_depth = throughput_knee(depth_steps);
+    }
+
+    // Concurrent connections, one request each
+    std::vector<ProfileStep> connection_steps;
+    for (auto connections : CONNECTION_COUNTS)
+    {
+        if (connections > settings.max_connections)
+        {
+            break;
+        }
+        auto step = record("connections", connections, {connections, 1, 1, 0.0});
+        if (!usable(step))
+        {
+            break;
+        }
+        connection_steps.push_back(step);
+    }
+    if (!connection_steps.empty())
+    {
+        profile.connections = throughput_knee(connection_steps);
+    }
+
+    // Open-loop rates around the closed-loop throughput at the depth knee
+    double knee_rps = 0.0;
+    for (const auto &step : depth_steps)
+    {
+        if (step.value == profile.pipeline_depth)
+        {
+            knee_rps = step.throughput_rps;
+        }
+    }
+    auto seconds = std::chrono::duration<double>(settings.step).count();
+    for (auto fraction : RATE_FRACTIONS)
+    {
+        auto rate = knee_rps * fraction;
+        if (rate < 1.0)
+        {
+            continue;
+        }
+        auto step = record("rate", static_cast<uint32_t>(rate), {1, profile.pipeline_depth, 1, rate});
+        auto served = static_cast<double>(step.requests) / (rate * seconds);
+        if (!usable(step) || served < SERVED_SHARE || !within_latency(step.p50_us, unloaded_p50))
+        {
+            break;
+        }
+        profile.max_rate_hz = rate;
+    }
+
+    profile.profiled_ns = now_ns();
+    return result;
+}
+
+#else
+
+ProfileResult profile_device(const ProfileSettings &settings, const std::function<void(const ProfileStep &)> &)
+{
+    ProfileResult result;
+    result.profile.endpoint = std::format("{}:{}", settings.host, settings.port);
+    result.error = DeviceError{DeviceErrc::OTHER};
+    return result;
+}
+
+#endif
+
+} // namespace cli
@@ -0,0 +1,421 @@
+#include "caparoc_commander/discovery.hpp"
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <deque>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace cli {
+
+#ifdef __linux__
+
+namespace {
+
+constexpr auto MODULE_COUNT_REGISTER = registers::NUM_CONNECTED_MODULES;
+constexpr auto PRODUCT_NAME_REGISTER = registers::PRODUCT_NAME_POWER_MODULE;
+constexpr uint8_t DISCOVERY_UNIT_ID = 1;
+
+using Clock = std::chrono::steady_clock;
+
+struct AddressRange {
+    uint32_t first = 0;  // host byte order
+    std::size_t count = 0;
+};
+
+AddressRange parse_cidr(const std::string &cidr)
+{
+    auto slash = cidr.find('/');
+    if (slash == std::string::npos)
+    {
+        throw std::invalid_argument(std::format("Invalid CIDR '{}': expected ADDRESS/PREFIX", cidr));
+    }
+
+    in_addr base{};
+    if (inet_pton(AF_INET, cidr.substr(0, slash).c_str(), &base) != 1)
+    {
+        throw std::invalid_argument(std::format("Invalid CIDR '{}': bad IPv4 address", cidr));
+    }
+
+    std::string_view prefix_text = std::string_view(cidr).substr(slash + 1);
+    int prefix = 0;
+    auto [end, ec] = std::from_chars(prefix_text.data(), prefix_text.data() + prefix_text.size(), prefix);
+    if (ec != std::errc{} || end != prefix_text.data() + prefix_text.size())
+    {
+        throw std::invalid_argument(std::format("Invalid CIDR '{}': prefix must be a number", cidr));
+    }
+    if (prefix < 16 || prefix > 32)
+    {
+        throw std::invalid_argument(std::format("Invalid CIDR '{}': prefix must be between 16 and 32", cidr));
+    }
+
+    uint32_t mask = ~uint32_t{0} << (32 - prefix);
+    uint32_t network = ntohl(base.s_addr) & mask;
+    std::size_t size = std::size_t{1} << (32 - prefix);
+
+    // Skip network and broadcast addresses except for /31 and /32 ranges.
+    if (prefix <= 30)
+    {
+        return {network + 1, size - 2};
+    }
+    return {network, size};
+}
+
+enum class ProbeState {
+    PENDING,
+    CONNECTING,
+    AWAIT_MODULE_COUNT,
+    AWAIT_PRODUCT_NAME,
+    DONE
+};
+
+struct Probe {
+    int fd = -1;
+    ProbeState state = ProbeState::PENDING;
+    Clock::time_point started;
+    Clock::time_point deadline;
+    std::vector<uint8_t> rx;
+    uint16_t connected_modules = 0;
+    std::size_t found_index = 0;
+};
+
+class Scanner {
+public:
+    Scanner(AddressRange range, int port, int timeout_seconds, std::size_t max_sockets)
+        : range_(range), port_(port), timeout_(std::chrono::seconds(timeout_seconds)),
+          max_sockets_(std::max<std::size_t>(1, max_sockets)), probes_(range.count)
+    {
+        raise_file_limit();
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0)
+        {
+            throw std::runtime_error(std::format("epoll_create1 failed: errno {}", errno));
+        }
+    }
+
+    ~Scanner()
+    {
+        for (auto &probe : probes_)
+        {
+            if (probe.fd >= 0)
+            {
+                ::close(probe.fd);
+            }
+        }
+        ::close(epoll_fd_);
+    }
+
+    Scanner(const Scanner &) = delete;
+    Scanner &operator=(const Scanner &) = delete;
+
+    std::vector<DiscoveredDevice> run()
+    {
+        std::vector<epoll_event> events(256);
+        while (next_ < range_.count || active_ > 0)
+        {
+            open_pending();
+
+            int n = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), wait_milliseconds());
+            if (n < 0 && errno != EINTR)
+            {
+                throw std::runtime_error(std::format("epoll_wait failed: errno {}", errno));
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                handle_event(events[i].data.u64, events[i].events);
+            }
+
+            expire_probes();
+        }
+
+        std::sort(found_.begin(), found_.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+        std::vector<DiscoveredDevice> devices;
+        devices.reserve(found_.size());
+        for (auto &[address, device] : found_)
+        {
+            devices.push_back(std::move(device));
+        }
+        return devices;
+    }
+
+private:
+    void raise_file_limit()
+    {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            return;
+        }
+        rlim_t wanted = static_cast<rlim_t>(max_sockets_ + 64);
+        if (limit.rlim_cur < wanted)
+        {
+            limit.rlim_cur = std::min(wanted, limit.rlim_max);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    void open_pending()
+    {
+        while (active_ < max_sockets_ && next_ < range_.count)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                if ((errno == EMFILE || errno == ENFILE) && active_ > 0)
+                {
+                    // Out of descriptors: wait for running probes to finish.
+                    return;
+                }
+                throw std::runtime_error(std::format("socket() failed: errno {}", errno));
+            }
+
+            std::size_t index = next_++;
+            auto &probe = probes_[index];
+            probe.fd = fd;
+            probe.started = Clock::now();
+            probe.deadline = probe.started + timeout_;
+            probe.state = ProbeState::CONNECTING;
+            ++active_;
+            in_flight_.push_back(index);
+
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(port_));
+            addr.sin_addr.s_addr = htonl(range_.first + static_cast<uint32_t>(index));
+
+            epoll_event ev{};
+            ev.events = EPOLLOUT;
+            ev.data.u64 = index;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+            {
+                finish(index);
+                continue;
+            }
+
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS)
+            {
+                finish(index);
+            }
+        }
+    }
+
+    int wait_milliseconds()
+    {
+        while (!in_flight_.empty() && probes_[in_flight_.front()].state == ProbeState::DONE)
+        {
+            in_flight_.pop_front();
+        }
+        if (in_flight_.empty())
+        {
+            return 0;
+        }
+        auto remaining = probes_[in_flight_.front()].deadline - Clock::now();
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+        return static_cast<int>(std::clamp<long long>(ms, 0, 1000));
+    }
+
+    void expire_probes()
+    {
+        // Probes are opened in deadline order, so the queue front always expires first.
+        auto now = Clock::now();
+        while (!in_flight_.empty())
+        {
+            auto index = in_flight_.front();
+            auto &probe = probes_[index];
+            if (probe.state != ProbeState::DONE && probe.deadline > now)
+            {
+                break;
+            }
+            in_flight_.pop_front();
+            if (probe.state != ProbeState::DONE)
+            {
+                finish(index);
+            }
+        }
+    }
+
+    void handle_event(std::size_t index, uint32_t events)
+    {
+        auto &probe = probes_[index];
+        switch (probe.state)
+        {
+        case ProbeState::CONNECTING:
+        {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if ((events & (EPOLLERR | EPOLLHUP)) != 0 ||
+                getsockopt(probe.fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0)
+            {
+                finish(index);
+                return;
+            }
+            if (!send_request(index, encode_read_holding_registers(1, DISCOVERY_UNIT_ID, MODULE_COUNT_REGISTER.address, MODULE_COUNT_REGISTER.words)))
+            {
+                return;
+            }
+            probe.state = ProbeState::AWAIT_MODULE_COUNT;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = index;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, probe.fd, &ev);
+            break;
+        }
+
+        case ProbeState::AWAIT_MODULE_COUNT:
+        case ProbeState::AWAIT_PRODUCT_NAME:
+            receive(index);
+            break;
+
+        case ProbeState::PENDING:
+        case ProbeState::DONE:
+            break;
+        }
+    }
+
+    bool send_request(std::size_t index, const std::vector<uint8_t> &adu)
+    {
+        auto sent = ::send(probes_[index].fd, adu.data(), adu.size(), MSG_NOSIGNAL);
+        if (sent != static_cast<ssize_t>(adu.size()))
+        {
+            finish(index);
+            return false;
+        }
+        return true;
+    }
+
+    void receive(std::size_t index)
+    {
+        auto &probe = probes_[index];
+        uint8_t buffer[MAX_ADU_LENGTH];
+        auto received = ::recv(probe.fd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            if (received < 0 && (errno == EAGAIN || errno == EINTR))
+            {
+                return;
+            }
+            finish(index);
+            return;
+        }
+        probe.rx.insert(probe.rx.end(), buffer, buffer + received);
+
+        auto length = complete_adu_length(probe.rx);
+        if (length == 0)
+        {
+            return;
+        }
+        auto registers = decode_read_registers_response(std::span(probe.rx).first(length));
+        probe.rx.clear();
+
+        if (probe.state == ProbeState::AWAIT_MODULE_COUNT)
+        {
+            if (!registers || registers->empty())
+            {
+                // Speaks TCP on the Modbus port but is not a CAPAROC.
+                finish(index);
+                return;
+            }
+            probe.connected_modules = (*registers)[0];
+            record(index, {});
+            if (send_request(index, encode_read_holding_registers(2, DISCOVERY_UNIT_ID, PRODUCT_NAME_REGISTER.address, PRODUCT_NAME_REGISTER.words)))
+            {
+                probe.state = ProbeState::AWAIT_PRODUCT_NAME;
+            }
+            return;
+        }
+
+        if (registers)
+        {
+            found_[probe.found_index].second.power_module_name = decode_string_registers(*registers);
+        }
+        finish(index);
+    }
+
+    void record(std::size_t index, std::string power_module_name)
+    {
+        auto &probe = probes_[index];
+        in_addr addr{htonl(range_.first + static_cast<uint32_t>(index))};
+        char text[INET_ADDRSTRLEN] = {};
+        inet_ntop(AF_INET, &addr, text, sizeof(text));
+
+        DiscoveredDevice device;
+        device.ip_address = text;
+        device.connected_modules = probe.connected_modules;
+        device.power_module_name = std::move(power_module_name);
+        device.response_time = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - probe.started);
+        probe.found_index = found_.size();
+        found_.emplace_back(index, std::move(device));
+    }
+
+    void finish(std::size_t index)
+    {
+        auto &probe = probes_[index];
+        if (probe.fd >= 0)
+        {
+            ::close(probe.fd);
+            probe.fd = -1;
+        }
+        if (probe.state != ProbeState::DONE)
+        {
+            probe.state = ProbeState::DONE;
+            --active_;
+        }
+        probe.rx = {};
+    }
+
+    AddressRange range_;
+    int port_;
+    Clock::duration timeout_;
+    std::size_t max_sockets_;
+    std::vector<Probe> probes_;
+    std::deque<std::size_t> in_flight_;
+    std::vector<std::pair<std::size_t, DiscoveredDevice>> found_;
+    std::size_t next_ = 0;
+    std::size_t active_ = 0;
+    int epoll_fd_ = -1;
+};
+
+} // namespace
+
+DiscoveryResult discover_devices(const std::string &cidr, int port, int timeout_seconds, std::size_t max_sockets)
+{
+    auto range = parse_cidr(cidr);
+    auto start = Clock::now();
+
+    Scanner scanner(range, port, timeout_seconds, max_sockets);
+
+    DiscoveryResult result;
+    result.hosts_scanned = range.count;
+    result.devices = scanner.run();
+    result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    return result;
+}
+
+#else
+
+DiscoveryResult discover_devices(const std::string &, int, int, std::size_t)
+{
+    throw std::runtime_error("Device discovery is only supported on Linux");
+}
+
+#endif
+
+} // namespace cli
@@ -0,0 +1,626 @@
+#include "caparoc_commander/event_loop.hpp"
+
+#include <format>
+#include <stdexcept>
+
+#ifdef __linux__
+#include "caparoc_commander/io_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#endif
+
+namespace cli {
+
+IoBackend parse_io_backend(std::string_view name)
+{
+    if (name == "auto")
+    {
+        return IoBackend::AUTO;
+    }
+    if (name == "io_uring")
+    {
+        return IoBackend::IO_URING;
+    }
+    if (name == "epoll")
+    {
+        return IoBackend::EPOLL;
+    }
+    throw std::invalid_argument(std::format("Unknown I/O backend '{}' (expected auto, io_uring or epoll)", name));
+}
+
+std::string_view to_string(IoBackend backend)
+{
+    switch (backend)
+    {
+    case IoBackend::AUTO:
+        return "auto";
+    case IoBackend::IO_URING:
+        return "io_uring";
+    case IoBackend::EPOLL:
+        return "epoll";
+    }
+    return "unknown";
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 256;
+
+// io_uring user_data: the kind of request in the top byte, an id below.
+enum class OpKind : uint64_t {
+    POLL = 1,     // readiness wait of the Waiter with this id
+    RECEIVE = 2,  // multishot receive of the socket in receive_ops_
+    SEND = 3,     // send of the Operation in operations_
+    CANCEL = 4
+};
+
+constexpr uint64_t op_data(OpKind kind, uint64_t id)
+{
+    return static_cast<uint64_t>(kind) << 56 | id;
+}
+
+struct JoinState {
+    std::size_t remaining = 0;
+    EventLoop::Waiter done;
+    std::exception_ptr error;
+};
+
+Task<void> join_one(EventLoop &loop, Task<void> task, JoinState &state)
+{
+    try
+    {
+        co_await std::move(task);
+    }
+    catch (...)
+    {
+        if (!state.error)
+        {
+            state.error = std::current_exception();
+        }
+    }
+    if (--state.remaining == 0)
+    {
+        loop.complete(state.done);
+    }
+}
+
+} // namespace
+
+bool EventLoop::WaitAwaiter::await_ready() noexcept
+{
+    auto &w = waiter();
+    if (w.signalled)
+    {
+        w.signalled = false;
+        return true;
+    }
+    if (cancellable_ && loop_.deadline_exceeded())
+    {
+        w.status = WaitStatus::CANCELLED;
+        return true;
+    }
+    return false;
+}
+
+void EventLoop::WaitAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    auto &w = waiter();
+    w.handle = handle;
+    loop_.register_wait(w, fd_, for_write_, deadline_, cancellable_);
+}
+
+EventLoop::EventLoop(IoBackend backend)
+{
+    if (backend != IoBackend::EPOLL)
+    {
+        try
+        {
+            ring_ = std::make_unique<IoRing>(RING_ENTRIES);
+            return;
+        }
+        catch (const std::runtime_error &)
+        {
+            if (backend == IoBackend::IO_URING)
+            {
+                throw;
+            }
+        }
+    }
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+        throw std::runtime_error(std::format("epoll_create1 failed: errno {}", errno));
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    // Frames of unfinished tasks are destroyed without resuming them, so
+    // forget their registrations first.
+    waiters_.clear();
+    fds_.clear();
+    ready_.clear();
+    spawned_.clear();
+    receive_ops_.clear();
+    operations_.clear();
+    // Cancels what is still in flight before the receive buffers go away.
+    ring_.reset();
+    if (epoll_fd_ >= 0)
+    {
+        ::close(epoll_fd_);
+    }
+}
+
+void EventLoop::run(Task<void> root)
+{
+    ready_.push_back(root.handle());
+    while (!root.done())
+    {
+        while (!ready_.empty() && !root.done())
+        {
+            auto handle = ready_.front();
+            ready_.pop_front();
+            handle.resume();
+        }
+        sweep_spawned();
+        if (root.done())
+        {
+            break;
+        }
+        if (ready_.empty() && waiters_.empty())
+        {
+            throw std::logic_error("EventLoop stalled: no runnable or waiting coroutine");
+        }
+        poll(ready_.empty());
+        expire_timers();
+    }
+    root.result();
+}
+
+void EventLoop::spawn(Task<void> task)
+{
+    ready_.push_back(task.handle());
+    spawned_.push_back(std::move(task));
+}
+
+Task<void> EventLoop::when_all(std::vector<Task<void>> tasks)
+{
+    if (tasks.empty())
+    {
+        co_return;
+    }
+
+    JoinState state;
+    state.remaining = tasks.size();
+    for (auto &task : tasks)
+    {
+        spawn(join_one(*this, std::move(task), state));
+    }
+
+    // Not cancellable: the children reference this frame and always finish,
+    // because the loop deadline cancels whatever they are waiting on.
+    co_await wait(state.done, TimePoint::max(), false);
+    if (state.error)
+    {
+        std::rethrow_exception(state.error);
+    }
+}
+
+void EventLoop::complete(Waiter &waiter, WaitStatus status)
+{
+    if (waiter.id == 0)
+    {
+        // Not suspended yet: the next wait on this waiter returns immediately.
+        waiter.status = status;
+        waiter.signalled = true;
+        return;
+    }
+
+    waiters_.erase(waiter.id);
+    auto id = std::exchange(waiter.id, 0);
+    waiter.status = status;
+    if (waiter.fd >= 0)
+    {
+        auto it = fds_.find(waiter.fd);
+        if (it != fds_.end())
+        {
+            (waiter.for_write ? it->second.writer : it->second.reader) = nullptr;
+            update_interest(waiter.fd);
+        }
+        if (ring_)
+        {
+            // Woken by a timer or cancel_fd() while the poll is still armed.
+            ring_->prepare(IORING_OP_POLL_REMOVE, -1, op_data(OpKind::CANCEL, 0)).addr = op_data(OpKind::POLL, id);
+        }
+        waiter.fd = -1;
+    }
+    ready_.push_back(waiter.handle);
+}
+
+void EventLoop::cancel_fd(int fd)
+{
+    auto it = fds_.find(fd);
+    if (it == fds_.end())
+    {
+        return;
+    }
+    if (auto *reader = it->second.reader)
+    {
+        complete(*reader, WaitStatus::CANCELLED);
+    }
+    if (auto *writer = it->second.writer)
+    {
+        complete(*writer, WaitStatus::CANCELLED);
+    }
+    if (auto *receiver = std::exchange(it->second.receiver, nullptr))
+    {
+        complete(*receiver, WaitStatus::CANCELLED);
+    }
+    if (it->second.receive_op != 0)
+    {
+        // Its remaining completions only return their buffers.
+        receive_ops_.erase(it->second.receive_op);
+        ring_->prepare(IORING_OP_ASYNC_CANCEL, -1, op_data(OpKind::CANCEL, 0)).addr = op_data(OpKind::RECEIVE, it->second.receive_op);
+    }
+    if (it->second.registered_events != 0)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    fds_.erase(fd);
+}
+
+Task<IoResult> EventLoop::send(int fd, std::span<const uint8_t> data, TimePoint deadline)
+{
+    for (;;)
+    {
+        int result = 0;
+        if (ring_)
+        {
+            // MSG_DONTWAIT: a full socket buffer completes at once with
+            // -EAGAIN instead of leaving the send armed in the kernel, so the
+            // completion never outlives the deadline.
+            Operation operation;
+            auto id = ++next_id_;
+            auto &sqe = ring_->prepare(IORING_OP_SEND, fd, op_data(OpKind::SEND, id));
+            sqe.addr = reinterpret_cast<uint64_t>(data.data());
+            sqe.len = static_cast<uint32_t>(data.size());
+            sqe.msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+            operations_[id] = &operation;
+            co_await wait(operation.waiter, TimePoint::max(), false);
+            result = operation.result;
+        }
+        else
+        {
+            auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            result = sent < 0 ? -errno : static_cast<int>(sent);
+        }
+
+        if (result != -EAGAIN && result != -EWOULDBLOCK && result != -EINTR)
+        {
+            co_return IoResult{WaitStatus::READY, result};
+        }
+        if (auto status = co_await writable(fd, deadline); status != WaitStatus::READY)
+        {
+            co_return IoResult{status, 0};
+        }
+    }
+}
+
+Task<IoResult> EventLoop::receive(int fd, std::vector<uint8_t> &out, TimePoint deadline)
+{
+    if (!ring_)
+    {
+        constexpr std::size_t chunk = 4096;
+        for (;;)
+        {
+            auto old_size = out.size();
+            out.resize(old_size + chunk);
+            auto received = ::recv(fd, out.data() + old_size, chunk, MSG_DONTWAIT);
+            out.resize(old_size + static_cast<std::size_t>(std::max<ssize_t>(received, 0)));
+            if (received >= 0)
+            {
+                co_return IoResult{WaitStatus::READY, static_cast<int>(received)};
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                co_return IoResult{WaitStatus::READY, -errno};
+            }
+            if (auto status = co_await readable(fd, deadline); status != WaitStatus::READY)
+            {
+                co_return IoResult{status, 0};
+            }
+        }
+    }
+
+    for (;;)
+    {
+        // Looked up again after every wait: the map may have rehashed.
+        auto &entry = fds_[fd];
+        if (!entry.received.empty())
+        {
+            auto count = static_cast<int>(entry.received.size());
+            out.insert(out.end(), entry.received.begin(), entry.received.end());
+            entry.received.clear();
+            co_return IoResult{WaitStatus::READY, count};
+        }
+        if (entry.receive_end)
+        {
+            co_return IoResult{WaitStatus::READY, *entry.receive_end};
+        }
+        if (entry.receive_op == 0)
+        {
+            arm_receive(fd, entry);
+        }
+
+        Waiter waiter;
+        entry.receiver = &waiter;
+        auto status = co_await wait(waiter, deadline);
+        if (status != WaitStatus::READY)
+        {
+            if (auto it = fds_.find(fd); it != fds_.end() && it->second.receiver == &waiter)
+            {
+                it->second.receiver = nullptr;
+            }
+            co_return IoResult{status, 0};
+        }
+    }
+}
+
+void EventLoop::arm_receive(int fd, FdEntry &entry)
+{
+    entry.receive_op = ++next_id_;
+    receive_ops_[entry.receive_op] = fd;
+    auto &sqe = ring_->prepare(IORING_OP_RECV, fd, op_data(OpKind::RECEIVE, entry.receive_op));
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = IoRing::BUFFER_GROUP;
+    sqe.ioprio = multishot_receive_ ? IORING_RECV_MULTISHOT : 0;
+}
+
+void EventLoop::handle_completion(uint64_t user_data, int32_t result, uint32_t flags)
+{
+    auto kind = static_cast<OpKind>(user_data >> 56);
+    auto id = user_data & ((uint64_t{1} << 56) - 1);
+    switch (kind)
+    {
+    case OpKind::POLL:
+        if (auto it = waiters_.find(id); it != waiters_.end())
+        {
+            // The poll has fired, so complete() must not remove it.
+            auto *waiter = it->second;
+            if (auto entry = fds_.find(waiter->fd); entry != fds_.end())
+            {
+                (waiter->for_write ? entry->second.writer : entry->second.reader) = nullptr;
+            }
+            waiter->fd = -1;
+            complete(*waiter);
+        }
+        break;
+
+    case OpKind::SEND:
+        if (auto it = operations_.find(id); it != operations_.end())
+        {
+            auto *operation = it->second;
+            operations_.erase(it);
+            operation->result = result;
+            complete(operation->waiter);
+        }
+        break;
+
+    case OpKind::RECEIVE:
+    {
+        auto op = receive_ops_.find(id);
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            auto buffer_id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            if (op != receive_ops_.end() && result > 0)
+            {
+                auto data = ring_->buffer(buffer_id, static_cast<std::size_t>(result));
+                auto &received = fds_[op->second].received;
+                received.insert(received.end(), data.begin(), data.end());
+            }
+            ring_->recycle(buffer_id);
+        }
+        if (op == receive_ops_.end())
+        {
+            // Cancelled by cancel_fd(); the socket may already be closed.
+            break;
+        }
+
+        auto &entry = fds_[op->second];
+        if ((flags & IORING_CQE_F_MORE) == 0)
+        {
+            // Not armed any more; the next receive() arms it again.
+            receive_ops_.erase(op);
+            entry.receive_op = 0;
+            if (result == -EINVAL && multishot_receive_)
+            {
+                // Kernel before 6.0: one receive per submission.
+                multishot_receive_ = false;
+            }
+        }
+        if (result == 0 || (result < 0 && result != -ENOBUFS && result != -EINVAL && result != -ECANCELED))
+        {
+            entry.receive_end = result;
+        }
+        if (auto *receiver = std::exchange(entry.receiver, nullptr))
+        {
+            complete(*receiver);
+        }
+        break;
+    }
+
+    case OpKind::CANCEL:
+        break;
+    }
+}
+
+void EventLoop::register_wait(Waiter &waiter, int fd, bool for_write, TimePoint deadline, bool cancellable)
+{
+    waiter.id = ++next_id_;
+    waiter.fd = fd;
+    waiter.for_write = for_write;
+    waiter.cancellable = cancellable;
+    waiter.status = WaitStatus::READY;
+    waiters_[waiter.id] = &waiter;
+
+    auto effective = cancellable ? std::min(deadline, deadline_) : deadline;
+    if (effective != TimePoint::max())
+    {
+        timers_.push_back({effective, waiter.id});
+        std::push_heap(timers_.begin(), timers_.end(), std::greater<>{});
+    }
+
+    if (fd >= 0)
+    {
+        auto &entry = fds_[fd];
+        (for_write ? entry.writer : entry.reader) = &waiter;
+        update_interest(fd);
+        if (ring_)
+        {
+            auto &sqe = ring_->prepare(IORING_OP_POLL_ADD, fd, op_data(OpKind::POLL, waiter.id));
+            sqe.poll32_events = for_write ? POLLOUT : POLLIN | POLLRDHUP;
+        }
+    }
+}
+
+void EventLoop::update_interest(int fd)
+{
+    if (ring_)
+    {
+        // io_uring polls are one-shot and armed per wait.
+        return;
+    }
+    auto &entry = fds_[fd];
+    uint32_t events = (entry.reader ? EPOLLIN | EPOLLRDHUP : 0u) | (entry.writer ? EPOLLOUT : 0u);
+    if (events == entry.registered_events)
+    {
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    int op = entry.registered_events == 0 ? EPOLL_CTL_ADD : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (epoll_ctl(epoll_fd_, op, fd, &ev) != 0)
+    {
+        throw std::runtime_error(std::format("epoll_ctl failed for fd {}: errno {}", fd, errno));
+    }
+    entry.registered_events = events;
+}
+
+std::optional<EventLoop::Clock::duration> EventLoop::poll_timeout(bool block)
+{
+    if (!block)
+    {
+        return Clock::duration::zero();
+    }
+    // Drop stale timers so the heap top is a live wait.
+    while (!timers_.empty() && !waiters_.contains(timers_.front().id))
+    {
+        std::pop_heap(timers_.begin(), timers_.end(), std::greater<>{});
+        timers_.pop_back();
+    }
+    if (timers_.empty())
+    {
+        return std::nullopt;
+    }
+    return std::clamp<Clock::duration>(timers_.front().deadline - Clock::now(), Clock::duration::zero(), std::chrono::seconds(60));
+}
+
+void EventLoop::poll(bool block)
+{
+    auto timeout = poll_timeout(block);
+    if (ring_)
+    {
+        // Everything the coroutines prepared since the last poll goes in with this call.
+        ring_->submit_and_wait(block ? 1 : 0, timeout);
+        ring_->drain([this](uint64_t user_data, int32_t result, uint32_t flags)
+                     {
+                         handle_completion(user_data, result, flags);
+                     });
+        return;
+    }
+
+    int timeout_ms = timeout ? static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(*timeout).count()) : -1;
+    epoll_event events[64];
+    int n = epoll_wait(epoll_fd_, events, 64, timeout_ms);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        throw std::runtime_error(std::format("epoll_wait failed: errno {}", errno));
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        auto it = fds_.find(events[i].data.fd);
+        if (it == fds_.end())
+        {
+            continue;
+        }
+        // Copy: complete() may modify the entry.
+        auto entry = it->second;
+        uint32_t ev = events[i].events;
+        bool error = (ev & (EPOLLERR | EPOLLHUP)) != 0;
+        if (entry.reader && (error || (ev & (EPOLLIN | EPOLLRDHUP)) != 0))
+        {
+            complete(*entry.reader);
+        }
+        if (entry.writer && (error || (ev & EPOLLOUT) != 0))
+        {
+            complete(*entry.writer);
+        }
+    }
+}
+
+void EventLoop::expire_timers()
+{
+    auto now = Clock::now();
+    while (!timers_.empty() && timers_.front().deadline <= now)
+    {
+        auto id = timers_.front().id;
+        std::pop_heap(timers_.begin(), timers_.end(), std::greater<>{});
+        timers_.pop_back();
+
+        auto it = waiters_.find(id);
+        if (it == waiters_.end())
+        {
+            continue;
+        }
+        auto *waiter = it->second;
+        bool cancelled = waiter->cancellable && now >= deadline_;
+        complete(*waiter, cancelled ? WaitStatus::CANCELLED : WaitStatus::TIMEOUT);
+    }
+}
+
+void EventLoop::sweep_spawned()
+{
+    for (auto it = spawned_.begin(); it != spawned_.end();)
+    {
+        if (it->done())
+        {
+            auto finished = std::move(*it);
+            it = spawned_.erase(it);
+            finished.result();
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+#endif
+
+} // namespace cli
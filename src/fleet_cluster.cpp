@@ -0,0 +1,400 @@
+#include "caparoc_commander/fleet_cluster.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+constexpr std::string_view CLUSTER_MAGIC = "CAPAROC-CLUSTER";
+constexpr std::string_view CLUSTER_VERSION = "1";
+constexpr std::size_t MAX_DATAGRAM = 8192;
+
+std::string json_escape(std::string_view text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::vector<std::string_view> split_words(std::string_view text)
+{
+    std::vector<std::string_view> words;
+    while (!text.empty())
+    {
+        auto start = text.find_first_not_of(" \n");
+        if (start == std::string_view::npos)
+        {
+            break;
+        }
+        text.remove_prefix(start);
+        auto end = std::min(text.find_first_of(" \n"), text.size());
+        words.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return words;
+}
+
+} // namespace
+
+uint64_t ring_hash(std::string_view text)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : text)
+    {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    // FNV-1a alone spreads similar keys ("10.0.0.1:502", "10.0.0.2:502")
+    // poorly over the ring; the splitmix64 finalizer fixes that.
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+HashRing::HashRing(std::size_t virtual_nodes) : virtual_nodes_(std::max<std::size_t>(virtual_nodes, 1))
+{
+}
+
+void HashRing::set_members(std::vector<std::string> members)
+{
+    std::ranges::sort(members);
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+    members_ = std::move(members);
+
+    points_.clear();
+    points_.reserve(members_.size() * virtual_nodes_);
+    for (std::size_t m = 0; m < members_.size(); ++m)
+    {
+        for (std::size_t v = 0; v < virtual_nodes_; ++v)
+        {
+            points_.emplace_back(ring_hash(std::format("{}#{}", members_[m], v)), m);
+        }
+    }
+    std::ranges::sort(points_);
+}
+
+const std::string &HashRing::owner(std::string_view key) const
+{
+    static const std::string none;
+    if (points_.empty())
+    {
+        return none;
+    }
+    auto hash = ring_hash(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), hash, [](const auto &point, uint64_t value) { return point.first < value; });
+    return members_[(it == points_.end() ? points_.front() : *it).second];
+}
+
+std::string format_cluster_record(std::string_view device, std::string_view poller, const RackSnapshot &snapshot)
+{
+    auto json = std::format("{{\"device\":\"{}\",\"poller\":\"{}\",\"system\":{},\"modules\":[", json_escape(device), json_escape(poller),
+                            rack_system_json(snapshot));
+    for (std::size_t module = 0; module < snapshot.module_count && module < RACK_MAX_MODULES; ++module)
+    {
+        json += std::format("{}{}", module == 0 ? "" : ",", rack_module_json(snapshot, module));
+    }
+    return json + "]}";
+}
+
+std::string format_cluster_error(std::string_view device, std::string_view poller, uint64_t timestamp_ns, const DeviceError &error)
+{
+    return std::format("{{\"device\":\"{}\",\"poller\":\"{}\",\"ts\":{},\"error\":\"{}\"}}", json_escape(device), json_escape(poller),
+                       timestamp_ns / 1'000'000, to_string(error.code));
+}
+
+#ifdef __linux__
+
+namespace {
+
+sockaddr_in parse_ipv4_endpoint(const std::string &endpoint)
+{
+    auto colon = endpoint.rfind(':');
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    int port = 0;
+    try
+    {
+        port = colon == std::string::npos ? -1 : std::stoi(endpoint.substr(colon + 1));
+    }
+    catch (const std::exception &)
+    {
+        port = -1;
+    }
+    if (port <= 0 || port > 65535 || ::inet_pton(AF_INET, endpoint.substr(0, colon).c_str(), &address.sin_addr) != 1)
+    {
+        throw std::invalid_argument(std::format("Invalid cluster endpoint '{}', expected IPv4:PORT", endpoint));
+    }
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return address;
+}
+
+} // namespace
+
+ClusterMembership::ClusterMembership(ClusterSettings settings) : settings_(std::move(settings))
+{
+    auto address = parse_ipv4_endpoint(settings_.bind);
+    if (address.sin_addr.s_addr == htonl(INADDR_ANY))
+    {
+        throw std::invalid_argument(std::format("Cluster endpoint '{}' must be an address the other members can reach", settings_.bind));
+    }
+    for (const auto &seed : settings_.seeds)
+    {
+        parse_ipv4_endpoint(seed);
+        if (seed != settings_.bind)
+        {
+            peers_[seed].seed = true;
+        }
+    }
+
+    fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error(std::format("Cannot create cluster socket: {}", std::strerror(errno)));
+    }
+    if (::bind(fd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        auto error = errno;
+        ::close(fd_);
+        throw std::runtime_error(std::format("Cannot bind cluster endpoint {}: {}", settings_.bind, std::strerror(error)));
+    }
+}
+
+ClusterMembership::~ClusterMembership()
+{
+    auto bye = std::format("{} {} BYE {}", CLUSTER_MAGIC, CLUSTER_VERSION, settings_.bind);
+    for (const auto &[endpoint, peer] : peers_)
+    {
+        send_to(endpoint, bye);
+    }
+    ::close(fd_);
+}
+
+void ClusterMembership::send_to(const std::string &endpoint, const std::string &message)
+{
+    auto address = parse_ipv4_endpoint(endpoint);
+    // Best effort: a lost heartbeat is covered by the next one.
+    ::sendto(fd_, message.data(), message.size(), MSG_NOSIGNAL, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+}
+
+bool ClusterMembership::service(std::chrono::milliseconds wait)
+{
+    auto now = Clock::now();
+    if (now >= next_heartbeat_)
+    {
+        auto hello = std::format("{} {} HELLO {}", CLUSTER_MAGIC, CLUSTER_VERSION, settings_.bind);
+        for (const auto &[endpoint, peer] : peers_)
+        {
+            if (peer.present)
+            {
+                hello += ' ';
+                hello += endpoint;
+            }
+        }
+        for (const auto &[endpoint, peer] : peers_)
+        {
+            send_to(endpoint, hello);
+        }
+        next_heartbeat_ = now + settings_.heartbeat;
+    }
+
+    auto until = std::min(now + wait, next_heartbeat_);
+    pollfd entry{fd_, POLLIN, 0};
+    auto timeout_ms = std::chrono::ceil<std::chrono::milliseconds>(until - now).count();
+    ::poll(&entry, 1, static_cast<int>(std::max<int64_t>(timeout_ms, 0)));
+
+    now = Clock::now();
+    bool changed = receive(now);
+    changed |= expire(now);
+    return changed;
+}
+
+bool ClusterMembership::receive(Clock::time_point now)
+{
+    bool changed = false;
+    char buffer[MAX_DATAGRAM];
+    for (;;)
+    {
+        auto received = ::recv(fd_, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            return changed;
+        }
+        auto words = split_words(std::string_view(buffer, static_cast<std::size_t>(received)));
+        if (words.size() < 4 || words[0] != CLUSTER_MAGIC || words[1] != CLUSTER_VERSION || words[3] == settings_.bind)
+        {
+            continue;  // foreign traffic, another protocol version or our own echo
+        }
+        std::string sender(words[3]);
+        try
+        {
+            parse_ipv4_endpoint(sender);
+        }
+        catch (const std::invalid_argument &)
+        {
+            continue;
+        }
+
+        if (words[2] == "BYE")
+        {
+            if (auto it = peers_.find(sender); it != peers_.end())
+            {
+                changed |= it->second.present;
+                if (it->second.seed)
+                {
+                    it->second.present = false;
+                }
+                else
+                {
+                    peers_.erase(it);
+                }
+            }
+            continue;
+        }
+        if (words[2] != "HELLO")
+        {
+            continue;
+        }
+
+        auto &peer = peers_[sender];
+        changed |= !peer.present;
+        peer.present = true;
+        peer.heard = now;
+        peer.mentioned = now;
+        for (std::size_t i = 4; i < words.size(); ++i)
+        {
+            std::string endpoint(words[i]);
+            if (endpoint == settings_.bind)
+            {
+                continue;
+            }
+            try
+            {
+                parse_ipv4_endpoint(endpoint);
+            }
+            catch (const std::invalid_argument &)
+            {
+                continue;
+            }
+            peers_[endpoint].mentioned = now;
+        }
+    }
+}
+
+bool ClusterMembership::expire(Clock::time_point now)
+{
+    bool changed = false;
+    for (auto it = peers_.begin(); it != peers_.end();)
+    {
+        auto &peer = it->second;
+        if (peer.present && now - peer.heard > settings_.expiry)
+        {
+            peer.present = false;
+            changed = true;
+        }
+        // Seeds are contacted for good; gossip about a member nobody hears any more fades out.
+        if (!peer.present && !peer.seed && now - peer.mentioned > settings_.expiry)
+        {
+            it = peers_.erase(it);
+            continue;
+        }
+        ++it;
+    }
+    return changed;
+}
+
+std::vector<std::string> ClusterMembership::members() const
+{
+    std::vector<std::string> members{settings_.bind};
+    for (const auto &[endpoint, peer] : peers_)
+    {
+        if (peer.present)
+        {
+            members.push_back(endpoint);
+        }
+    }
+    std::ranges::sort(members);
+    return members;
+}
+
+AppendSink::AppendSink(const std::string &path)
+{
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error(std::format("Cannot open {}: {}", path, std::strerror(errno)));
+    }
+}
+
+AppendSink::~AppendSink()
+{
+    ::close(fd_);
+}
+
+bool AppendSink::write_line(std::string line)
+{
+    line += '\n';
+    ssize_t written;
+    do
+    {
+        written = ::write(fd_, line.data(), line.size());
+    } while (written < 0 && errno == EINTR);
+    return written == static_cast<ssize_t>(line.size());
+}
+
+#else
+
+ClusterMembership::ClusterMembership(ClusterSettings settings) : settings_(std::move(settings))
+{
+    throw std::runtime_error("Cluster polling is only supported on Linux");
+}
+
+ClusterMembership::~ClusterMembership() = default;
+
+bool ClusterMembership::service(std::chrono::milliseconds)
+{
+    return false;
+}
+
+std::vector<std::string> ClusterMembership::members() const
+{
+    return {settings_.bind};
+}
+
+AppendSink::AppendSink(const std::string &)
+{
+    throw std::runtime_error("Cluster polling is only supported on Linux");
+}
+
+AppendSink::~AppendSink() = default;
+
+bool AppendSink::write_line(std::string)
+{
+    return false;
+}
+
+#endif
+
+} // namespace cli
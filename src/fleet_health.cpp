@@ -0,0 +1,287 @@
+#include "caparoc_commander/fleet_health.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <numbers>
+#include <queue>
+
+namespace cli {
+
+namespace {
+
+constexpr uint16_t FAULT_FLAGS = channel_flag::OVERLOAD | channel_flag::SHORT_CIRCUIT | channel_flag::HARDWARE_ERROR | channel_flag::VOLTAGE_ERROR;
+
+// Score weights, see FleetHealth
+constexpr double TRIP_WEIGHT = 10.0;
+constexpr double WARNING_WEIGHT = 1.0;
+constexpr double NEAR_NOMINAL_WEIGHT = 5.0;
+constexpr double FAULTED_WEIGHT = 20.0;
+constexpr double FAILED_POLL_WEIGHT = 20.0;
+
+constexpr double NS_PER_HOUR = 3600.0 * 1e9;
+
+} // namespace
+
+ScoreHeap::ScoreHeap(std::size_t capacity)
+    : position_(capacity, ABSENT)
+{
+}
+
+void ScoreHeap::place(std::size_t index, Entry entry)
+{
+    heap_[index] = entry;
+    position_[entry.id] = static_cast<uint32_t>(index);
+}
+
+void ScoreHeap::sift_up(std::size_t index)
+{
+    auto entry = heap_[index];
+    while (index > 0)
+    {
+        auto parent = (index - 1) / 2;
+        if (!(heap_[parent].score < entry.score))
+        {
+            break;
+        }
+        place(index, heap_[parent]);
+        index = parent;
+    }
+    place(index, entry);
+}
+
+void ScoreHeap::sift_down(std::size_t index)
+{
+    auto entry = heap_[index];
+    for (;;)
+    {
+        auto child = 2 * index + 1;
+        if (child >= heap_.size())
+        {
+            break;
+        }
+        if (child + 1 < heap_.size() && heap_[child].score < heap_[child + 1].score)
+        {
+            ++child;
+        }
+        if (!(entry.score < heap_[child].score))
+        {
+            break;
+        }
+        place(index, heap_[child]);
+        index = child;
+    }
+    place(index, entry);
+}
+
+void ScoreHeap::update(uint32_t id, double score)
+{
+    auto index = position_[id];
+    if (index == ABSENT)
+    {
+        heap_.push_back({score, id});
+        position_[id] = static_cast<uint32_t>(heap_.size() - 1);
+        sift_up(heap_.size() - 1);
+        return;
+    }
+    auto previous = heap_[index].score;
+    heap_[index].score = score;
+    if (previous < score)
+    {
+        sift_up(index);
+    }
+    else
+    {
+        sift_down(index);
+    }
+}
+
+std::vector<uint32_t> ScoreHeap::top(std::size_t k) const
+{
+    // The k-th highest score is a child of one of the k - 1 higher ones, so
+    // only the children of those taken so far are candidates.
+    auto lower = [this](std::size_t a, std::size_t b)
+    { return heap_[a].score < heap_[b].score; };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(lower)> candidates(lower);
+    std::vector<uint32_t> ids;
+    if (!heap_.empty())
+    {
+        candidates.push(0);
+    }
+    while (ids.size() < k && !candidates.empty())
+    {
+        auto index = candidates.top();
+        candidates.pop();
+        ids.push_back(heap_[index].id);
+        for (auto child : {2 * index + 1, 2 * index + 2})
+        {
+            if (child < heap_.size())
+            {
+                candidates.push(child);
+            }
+        }
+    }
+    return ids;
+}
+
+FleetHealth::FleetHealth(std::size_t device_count, HealthSettings settings)
+    : half_life_ns_(static_cast<double>(std::chrono::nanoseconds(settings.half_life).count()))
+    , max_gap_ns_(static_cast<uint64_t>(std::chrono::nanoseconds(settings.max_gap).count()))
+    , channels_(device_count * SLOTS)
+    , devices_(device_count)
+    , channel_heap_(device_count * SLOTS)
+    , device_heap_(device_count)
+{
+    half_life_ns_ = std::max(half_life_ns_, 1.0);
+}
+
+// Weight left to an event @p elapsed_ns ago
+double FleetHealth::decay(uint64_t elapsed_ns) const
+{
+    return std::exp2(-static_cast<double>(elapsed_ns) / half_life_ns_);
+}
+
+// Events per hour of a steady rate whose decayed count is @p decayed_count
+double FleetHealth::per_hour(double decayed_count) const
+{
+    return decayed_count * std::numbers::ln2 * NS_PER_HOUR / half_life_ns_;
+}
+
+void FleetHealth::add(std::size_t device, const RackSnapshot &snapshot)
+{
+    auto &totals = devices_[device];
+    auto modules = std::min<std::size_t>(snapshot.module_count, RACK_MAX_MODULES);
+    for (std::size_t module = 0; module < modules; ++module)
+    {
+        auto channel_count = std::min<std::size_t>(snapshot.channel_count[module], RACK_MAX_CHANNELS);
+        for (std::size_t channel = 0; channel < channel_count; ++channel)
+        {
+            auto flags = snapshot.channels[module][channel].flags;
+            if (!(flags & channel_flag::VALID))
+            {
+                continue;
+            }
+            auto id = device * SLOTS + module * RACK_MAX_CHANNELS + channel;
+            auto &health = channels_[id];
+
+            double kept = 1.0;
+            if (health.last_ns != 0 && snapshot.timestamp_ns > health.last_ns)
+            {
+                auto elapsed = snapshot.timestamp_ns - health.last_ns;
+                kept = decay(elapsed);
+                if (elapsed <= max_gap_ns_)
+                {
+                    // The state of the previous poll is assumed to have lasted until this one.
+                    bool near = health.last_flags & channel_flag::WARNING_80_PERCENT;
+                    health.observed_ns += elapsed;
+                    health.near_nominal_ns += near ? elapsed : 0;
+                    health.near_nominal = static_cast<float>(health.near_nominal * kept + (near ? 1.0 - kept : 0.0));
+                }
+            }
+
+            // A fault present at the first poll is not counted: it may be
+            // the trip an earlier run already counted.
+            auto new_faults = health.polls > 0 ? flags & FAULT_FLAGS & ~health.last_flags : 0;
+            bool new_warning = health.polls > 0 && (flags & ~health.last_flags & channel_flag::WARNING_80_PERCENT);
+            health.trips += new_faults ? 1 : 0;
+            health.warnings += new_warning ? 1 : 0;
+            health.tripped_flags |= new_faults;
+            health.trip_count = static_cast<float>(health.trip_count * kept + (new_faults ? 1.0 : 0.0));
+            health.warning_count = static_cast<float>(health.warning_count * kept + (new_warning ? 1.0 : 0.0));
+            health.last_ns = std::max(health.last_ns, snapshot.timestamp_ns);
+            health.last_flags = flags;
+            ++health.polls;
+
+            auto score = TRIP_WEIGHT * per_hour(health.trip_count) + WARNING_WEIGHT * per_hour(health.warning_count) +
+                         NEAR_NOMINAL_WEIGHT * health.near_nominal + ((flags & FAULT_FLAGS) ? FAULTED_WEIGHT : 0.0);
+            totals.channel_score += score - health.score;
+            health.score = static_cast<float>(score);
+            channel_heap_.update(static_cast<uint32_t>(id), score);
+        }
+    }
+
+    double kept = totals.last_ns != 0 && snapshot.timestamp_ns > totals.last_ns ? decay(snapshot.timestamp_ns - totals.last_ns) : 1.0;
+    totals.failed = static_cast<float>(totals.polls > 0 ? totals.failed * kept : 0.0);
+    totals.last_ns = std::max(totals.last_ns, snapshot.timestamp_ns);
+    ++totals.polls;
+    update_device(device);
+}
+
+void FleetHealth::add_failure(std::size_t device, uint64_t timestamp_ns)
+{
+    auto &totals = devices_[device];
+    double kept = totals.last_ns != 0 && timestamp_ns > totals.last_ns ? decay(timestamp_ns - totals.last_ns) : 1.0;
+    totals.failed = static_cast<float>(totals.polls > 0 ? totals.failed * kept + (1.0 - kept) : 1.0);
+    totals.last_ns = std::max(totals.last_ns, timestamp_ns);
+    ++totals.polls;
+    ++totals.failures;
+    update_device(device);
+}
+
+void FleetHealth::update_device(std::size_t device)
+{
+    auto &totals = devices_[device];
+    totals.score = totals.channel_score + FAILED_POLL_WEIGHT * totals.failed;
+    device_heap_.update(static_cast<uint32_t>(device), totals.score);
+}
+
+std::vector<ChannelRank> FleetHealth::worst_channels(std::size_t k) const
+{
+    std::vector<ChannelRank> ranks;
+    for (auto id : channel_heap_.top(k))
+    {
+        auto slot = id % SLOTS;
+        ChannelRank rank;
+        rank.device = id / SLOTS;
+        rank.module = static_cast<uint8_t>(slot / RACK_MAX_CHANNELS + 1);
+        rank.channel = static_cast<uint8_t>(slot % RACK_MAX_CHANNELS + 1);
+        rank.health = channels_[id];
+        rank.trips_per_hour = per_hour(rank.health.trip_count);
+        ranks.push_back(rank);
+    }
+    return ranks;
+}
+
+std::vector<DeviceRank> FleetHealth::worst_devices(std::size_t k) const
+{
+    std::vector<DeviceRank> ranks;
+    for (auto id : device_heap_.top(k))
+    {
+        ranks.push_back({id, devices_[id]});
+    }
+    return ranks;
+}
+
+std::string format_health_ranking(const FleetHealth &health, const std::vector<std::string> &endpoints, std::size_t k)
+{
+    auto channels = health.worst_channels(k);
+    auto devices = health.worst_devices(k);
+    std::size_t width = 6;
+    for (const auto &endpoint : endpoints)
+    {
+        width = std::max(width, endpoint.size());
+    }
+
+    auto text = std::format("Worst channels (of {} polled):\n", health.channel_count());
+    text += std::format("  Rank  {:<{}}  Module Ch   Score  Trips/h  Trips  Warnings  Near nominal  Status\n", "Device", width);
+    for (std::size_t i = 0; i < channels.size(); ++i)
+    {
+        const auto &rank = channels[i];
+        const auto &channel = rank.health;
+        text += std::format("  {:>4}  {:<{}}  {:>6} {:>2} {:>7.1f} {:>8.2f} {:>6} {:>9} {:>11.1f} %  {}\n", i + 1, endpoints[rank.device], width,
+                            rank.module, rank.channel, channel.score, rank.trips_per_hour, channel.trips, channel.warnings,
+                            channel.near_nominal * 100.0, describe_channel_flags(channel.last_flags));
+    }
+    text += std::format("Worst devices (of {}):\n", health.device_count());
+    text += std::format("  Rank  {:<{}}   Score  Polls  Failed  Failed recently\n", "Device", width);
+    for (std::size_t i = 0; i < devices.size(); ++i)
+    {
+        const auto &device = devices[i].health;
+        text += std::format("  {:>4}  {:<{}} {:>7.1f} {:>6} {:>7} {:>14.1f} %\n", i + 1, endpoints[devices[i].device], width,
+                            device.score, device.polls, device.failures, device.failed * 100.0);
+    }
+    text.pop_back();
+    return text;
+}
+
+} // namespace cli
@@ -0,0 +1,347 @@
+#include "caparoc_commander/inventory.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+namespace cli {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t device_count;
+    uint32_t module_count;
+    uint64_t saved_ns;
+};
+
+struct DeviceRecord {
+    char endpoint[64];
+    char power_module_name[40];
+    uint64_t checked_ns;
+    uint64_t topology_read_ns;
+    uint32_t first_module;  // index of the device's first module record
+    uint16_t module_count;
+    uint8_t reachable;
+    uint8_t reserved;
+};
+
+struct ModuleRecord {
+    char product_name[40];
+    uint32_t device;  // index of the device record
+    uint8_t position;
+    uint8_t channels;
+    uint16_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader> && sizeof(FileHeader) == 24);
+static_assert(std::is_trivially_copyable_v<DeviceRecord> && sizeof(DeviceRecord) == 128);
+static_assert(std::is_trivially_copyable_v<ModuleRecord> && sizeof(ModuleRecord) == 48);
+
+template <std::size_t N>
+void copy_padded(char (&field)[N], std::string_view text)
+{
+    std::memset(field, 0, N);
+    std::memcpy(field, text.data(), std::min(text.size(), N - 1));
+}
+
+template <std::size_t N>
+std::string from_padded(const char (&field)[N])
+{
+    return std::string(field, std::find(field, field + N, '\0'));
+}
+
+uint64_t now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::string format_age(uint64_t timestamp_ns)
+{
+    if (timestamp_ns == 0)
+    {
+        return "never";
+    }
+    auto now = now_ns();
+    auto seconds = now > timestamp_ns ? (now - timestamp_ns) / 1'000'000'000 : 0;
+    if (seconds < 120)
+    {
+        return std::format("{} s ago", seconds);
+    }
+    if (seconds < 2 * 3600)
+    {
+        return std::format("{} min ago", seconds / 60);
+    }
+    if (seconds < 2 * 86400)
+    {
+        return std::format("{} h ago", seconds / 3600);
+    }
+    return std::format("{} d ago", seconds / 86400);
+}
+
+bool contains_ignoring_case(std::string_view text, std::string_view part)
+{
+    return std::search(text.begin(), text.end(), part.begin(), part.end(), [](char a, char b)
+                       { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); }) != text.end();
+}
+
+} // namespace
+
+const InventoryDevice *Inventory::find(std::string_view endpoint) const
+{
+    auto it = std::lower_bound(devices.begin(), devices.end(), endpoint, [](const InventoryDevice &device, std::string_view key)
+                               { return device.endpoint < key; });
+    return it != devices.end() && it->endpoint == endpoint ? &*it : nullptr;
+}
+
+void Inventory::update(InventoryDevice device)
+{
+    auto it = std::lower_bound(devices.begin(), devices.end(), device.endpoint, [](const InventoryDevice &entry, const std::string &key)
+                               { return entry.endpoint < key; });
+    if (it != devices.end() && it->endpoint == device.endpoint)
+    {
+        *it = std::move(device);
+    }
+    else
+    {
+        devices.insert(it, std::move(device));
+    }
+}
+
+Inventory load_inventory(const std::string &path)
+{
+    Inventory inventory;
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return inventory;
+    }
+    std::vector<char> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    FileHeader header{};
+    if (bytes.size() < sizeof(header))
+    {
+        throw std::runtime_error(std::format("'{}' is not an inventory file", path));
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != INVENTORY_MAGIC)
+    {
+        throw std::runtime_error(std::format("'{}' is not an inventory file", path));
+    }
+    if (header.version != INVENTORY_FORMAT_VERSION)
+    {
+        throw std::runtime_error(std::format("Inventory file '{}' has unsupported version {}", path, header.version));
+    }
+    auto modules_offset = sizeof(header) + std::size_t{header.device_count} * sizeof(DeviceRecord);
+    if (bytes.size() < modules_offset + std::size_t{header.module_count} * sizeof(ModuleRecord))
+    {
+        throw std::runtime_error(std::format("Inventory file '{}' is truncated", path));
+    }
+
+    inventory.devices.reserve(header.device_count);
+    for (uint32_t i = 0; i < header.device_count; ++i)
+    {
+        DeviceRecord record;
+        std::memcpy(&record, bytes.data() + sizeof(header) + i * sizeof(DeviceRecord), sizeof(record));
+        if (std::size_t{record.first_module} + record.module_count > header.module_count)
+        {
+            throw std::runtime_error(std::format("Inventory file '{}' is corrupt (device {})", path, i));
+        }
+
+        InventoryDevice device;
+        device.endpoint = from_padded(record.endpoint);
+        device.power_module_name = from_padded(record.power_module_name);
+        device.checked_ns = record.checked_ns;
+        device.topology_read_ns = record.topology_read_ns;
+        device.reachable = record.reachable != 0;
+        device.modules.reserve(record.module_count);
+        for (uint32_t m = 0; m < record.module_count; ++m)
+        {
+            ModuleRecord module;
+            std::memcpy(&module, bytes.data() + modules_offset + (record.first_module + m) * sizeof(ModuleRecord), sizeof(module));
+            device.modules.push_back({module.position, module.channels, from_padded(module.product_name)});
+        }
+        inventory.update(std::move(device));
+    }
+    return inventory;
+}
+
+void save_inventory(const Inventory &inventory, const std::string &path)
+{
+    FileHeader header{INVENTORY_MAGIC, INVENTORY_FORMAT_VERSION, 0, static_cast<uint32_t>(inventory.devices.size()), 0, now_ns()};
+    std::vector<DeviceRecord> devices;
+    std::vector<ModuleRecord> modules;
+    devices.reserve(inventory.devices.size());
+    for (const auto &device : inventory.devices)
+    {
+        DeviceRecord record{};
+        copy_padded(record.endpoint, device.endpoint);
+        copy_padded(record.power_module_name, device.power_module_name);
+        record.checked_ns = device.checked_ns;
+        record.topology_read_ns = device.topology_read_ns;
+        record.first_module = static_cast<uint32_t>(modules.size());
+        record.module_count = static_cast<uint16_t>(device.modules.size());
+        record.reachable = device.reachable ? 1 : 0;
+        for (const auto &module : device.modules)
+        {
+            ModuleRecord entry{};
+            copy_padded(entry.product_name, module.product_name);
+            entry.device = static_cast<uint32_t>(devices.size());
+            entry.position = module.position;
+            entry.channels = module.channels;
+            modules.push_back(entry);
+        }
+        devices.push_back(record);
+    }
+    header.module_count = static_cast<uint32_t>(modules.size());
+
+    auto temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(devices.data()), static_cast<std::streamsize>(devices.size() * sizeof(DeviceRecord)));
+        file.write(reinterpret_cast<const char *>(modules.data()), static_cast<std::streamsize>(modules.size() * sizeof(ModuleRecord)));
+        if (!file.flush())
+        {
+            throw std::runtime_error(std::format("Cannot write inventory file '{}'", temporary));
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+InventoryRefresh refresh_inventory_device(libmodbus_cpp::ModbusConnection &conn, std::string endpoint, const InventoryDevice *known, bool full)
+{
+    auto start = Clock::now();
+    InventoryRefresh result;
+    if (known)
+    {
+        result.device = *known;
+    }
+    result.device.endpoint = std::move(endpoint);
+    auto finish = [&](RefreshOutcome outcome, std::string message = {}, std::optional<DeviceError> error = std::nullopt)
+    {
+        result.outcome = outcome;
+        result.message = std::move(message);
+        result.error = error;
+        result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+        return result;
+    };
+
+    ++result.reads;
+    errno = 0;
+    auto module_count = read_register(conn, registers::NUM_CONNECTED_MODULES);
+    if (!module_count)
+    {
+        result.device.reachable = false;
+        return finish(RefreshOutcome::UNREACHABLE, "Failed to read the module count", device_error_from_errno(errno));
+    }
+    if (*module_count > RACK_MAX_MODULES)
+    {
+        result.device.reachable = false;
+        return finish(RefreshOutcome::UNREACHABLE, std::format("Device reports {} modules", *module_count));
+    }
+
+    if (known && !full && known->modules.size() == *module_count)
+    {
+        result.device.checked_ns = now_ns();
+        result.device.reachable = true;
+        return finish(RefreshOutcome::UNCHANGED);
+    }
+
+    InventoryDevice device;
+    device.endpoint = result.device.endpoint;
+    ++result.reads;
+    device.power_module_name = read_register(conn, registers::PRODUCT_NAME_POWER_MODULE).value_or("");
+    for (uint8_t position = 1; position <= *module_count; ++position)
+    {
+        ++result.reads;
+        errno = 0;
+        auto name = caparoc::get_product_name_module(conn, position);
+        if (!name)
+        {
+            // Keep what was recorded; a changed module count makes the next
+            // refresh try again.
+            result.device.reachable = false;
+            return finish(RefreshOutcome::UNREACHABLE, std::format("Failed to read the product name of module {}", position), device_error_from_errno(errno));
+        }
+        device.modules.push_back({position, static_cast<uint8_t>(channels_from_product_name(*name)), std::move(*name)});
+    }
+    device.checked_ns = device.topology_read_ns = now_ns();
+
+    bool same = known && known->power_module_name == device.power_module_name && known->modules.size() == device.modules.size() &&
+                std::equal(device.modules.begin(), device.modules.end(), known->modules.begin(), [](const InventoryModule &a, const InventoryModule &b)
+                           { return a.product_name == b.product_name && a.channels == b.channels; });
+    result.device = std::move(device);
+    return finish(!known ? RefreshOutcome::ADDED : same ? RefreshOutcome::UNCHANGED : RefreshOutcome::CHANGED);
+}
+
+std::string_view to_string(RefreshOutcome outcome)
+{
+    switch (outcome)
+    {
+    case RefreshOutcome::UNCHANGED:
+        return "unchanged";
+    case RefreshOutcome::ADDED:
+        return "added";
+    case RefreshOutcome::CHANGED:
+        return "changed";
+    case RefreshOutcome::UNREACHABLE:
+        return "unreachable";
+    }
+    return "unknown";
+}
+
+std::vector<InventoryMatch> find_modules(const Inventory &inventory, std::string_view product_filter)
+{
+    std::vector<InventoryMatch> matches;
+    for (const auto &device : inventory.devices)
+    {
+        for (const auto &module : device.modules)
+        {
+            if (contains_ignoring_case(module.product_name, product_filter))
+            {
+                matches.push_back({&device, &module});
+            }
+        }
+    }
+    return matches;
+}
+
+std::string format_inventory(const Inventory &inventory)
+{
+    std::string text;
+    std::size_t modules = 0;
+    std::size_t channels = 0;
+    for (const auto &device : inventory.devices)
+    {
+        text += std::format("{}  {}  ({} module(s), checked {}, topology read {}){}\n", device.endpoint,
+                            device.power_module_name.empty() ? "(unknown power module)" : device.power_module_name,
+                            device.modules.size(), format_age(device.checked_ns), format_age(device.topology_read_ns),
+                            device.reachable ? "" : "  UNREACHABLE");
+        for (const auto &module : device.modules)
+        {
+            text += std::format("  module {:>2}: {:<32}  {} channel(s)\n", module.position,
+                                module.product_name.empty() ? "(unknown)" : module.product_name, module.channels);
+            ++modules;
+            channels += module.channels;
+        }
+    }
+    text += std::format("{} device(s), {} module(s), {} channel(s)", inventory.devices.size(), modules, channels);
+    return text;
+}
+
+} // namespace cli
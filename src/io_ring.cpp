@@ -0,0 +1,256 @@
+#include "caparoc_commander/io_ring.hpp"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params &params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+void *map(int fd, std::size_t size, off_t offset)
+{
+    void *address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, fd >= 0 ? MAP_SHARED | MAP_POPULATE : MAP_PRIVATE | MAP_ANONYMOUS, fd, offset);
+    if (address == MAP_FAILED)
+    {
+        throw std::runtime_error(std::format("Cannot map io_uring memory: {}", std::strerror(errno)));
+    }
+    return address;
+}
+
+template <typename T>
+T *at(void *ring, uint32_t offset)
+{
+    return reinterpret_cast<T *>(static_cast<uint8_t *>(ring) + offset);
+}
+
+} // namespace
+
+IoRing::IoRing(unsigned entries)
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 8;
+    fd_ = io_uring_setup(entries, params);
+    if (fd_ < 0 && errno == EINVAL)
+    {
+        // SUBMIT_ALL and COOP_TASKRUN are 5.18/5.19 additions.
+        params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 8;
+        fd_ = io_uring_setup(entries, params);
+    }
+    if (fd_ < 0)
+    {
+        throw std::runtime_error(std::format("io_uring is not available: {}", std::strerror(errno)));
+    }
+
+    try
+    {
+        if ((params.features & IORING_FEAT_EXT_ARG) == 0 || (params.features & IORING_FEAT_NODROP) == 0)
+        {
+            throw std::runtime_error("io_uring lacks wait timeouts (needs Linux 5.11)");
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+            cq_ring_ = sq_ring_;
+        }
+        else
+        {
+            sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+            cq_ring_ = map(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(map(fd_, sqes_size_, IORING_OFF_SQES));
+
+        sq_head_ = at<unsigned>(sq_ring_, params.sq_off.head);
+        sq_tail_ = at<unsigned>(sq_ring_, params.sq_off.tail);
+        sq_mask_ = at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+        sq_array_ = at<unsigned>(sq_ring_, params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        sq_local_tail_ = *sq_tail_;
+        cq_head_ = at<unsigned>(cq_ring_, params.cq_off.head);
+        cq_tail_ = at<unsigned>(cq_ring_, params.cq_off.tail);
+        cq_mask_ = at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+        cqes_ = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+        buffers_size_ = BUFFER_COUNT * BUFFER_SIZE;
+        buffers_ = static_cast<uint8_t *>(map(-1, buffers_size_, 0));
+        provide_buffers(0, BUFFER_COUNT, AWAITED);
+        auto provided = await_own().value_or(-ETIME);
+        if (provided < 0)
+        {
+            throw std::runtime_error(std::format("io_uring cannot take receive buffers: {}", std::strerror(-provided)));
+        }
+        buffers_provided_ = true;
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+IoRing::~IoRing()
+{
+    release();
+}
+
+void IoRing::release()
+{
+    if (buffers_provided_)
+    {
+        // Closing the ring tears requests down asynchronously, so a receive
+        // could still fill a buffer after it is unmapped: cancel them all
+        // and wait for the kernel to confirm first.
+        auto &sqe = prepare(IORING_OP_ASYNC_CANCEL, -1, AWAITED);
+        sqe.cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+        try
+        {
+            await_own();
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+        buffers_provided_ = false;
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    if (buffers_)
+    {
+        ::munmap(buffers_, buffers_size_);
+        buffers_ = nullptr;
+    }
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+    {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_)
+    {
+        ::munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+}
+
+// Submit and wait up to a second for the completion of the AWAITED request.
+// Completions of other requests are dropped: only for setup and teardown.
+std::optional<int32_t> IoRing::await_own()
+{
+    std::atomic_ref<unsigned> head_ref(*cq_head_);
+    std::atomic_ref<unsigned> tail_ref(*cq_tail_);
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        submit_and_wait(1, std::chrono::milliseconds(10));
+        auto head = head_ref.load(std::memory_order_relaxed);
+        while (head != tail_ref.load(std::memory_order_acquire))
+        {
+            auto cqe = cqes_[head & *cq_mask_];
+            head_ref.store(++head, std::memory_order_release);
+            if (cqe.user_data == AWAITED)
+            {
+                return cqe.res;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+void IoRing::provide_buffers(uint16_t first, unsigned count, uint64_t user_data)
+{
+    auto &sqe = prepare(IORING_OP_PROVIDE_BUFFERS, static_cast<int>(count), user_data);
+    sqe.addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<std::size_t>(first) * BUFFER_SIZE);
+    sqe.len = static_cast<uint32_t>(BUFFER_SIZE);
+    sqe.off = first;
+    sqe.buf_group = BUFFER_GROUP;
+}
+
+io_uring_sqe &IoRing::prepare(uint8_t opcode, int fd, uint64_t user_data)
+{
+    if (sq_local_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) >= sq_entries_)
+    {
+        submit_and_wait(0, std::chrono::nanoseconds(0));
+        if (sq_local_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) >= sq_entries_)
+        {
+            throw std::runtime_error("io_uring submission queue is full");
+        }
+    }
+    auto index = sq_local_tail_ & *sq_mask_;
+    auto &sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.user_data = user_data;
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+    return sqe;
+}
+
+void IoRing::submit_and_wait(unsigned wait_for, std::optional<std::chrono::nanoseconds> timeout)
+{
+    std::atomic_ref<unsigned>(*sq_tail_).store(sq_local_tail_, std::memory_order_release);
+    auto to_submit = sq_local_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+
+    __kernel_timespec wait_time{};
+    io_uring_getevents_arg arg{};
+    if (timeout)
+    {
+        auto ns = std::max<int64_t>(timeout->count(), 0);
+        wait_time.tv_sec = ns / 1'000'000'000;
+        wait_time.tv_nsec = ns % 1'000'000'000;
+        arg.ts = reinterpret_cast<uint64_t>(&wait_time);
+    }
+    if (io_uring_enter(fd_, to_submit, wait_for, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0)
+    {
+        // ETIME: no completion in time; EBUSY: the completion queue is full
+        // and has to be drained before more can be posted.
+        if (errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        {
+            throw std::runtime_error(std::format("io_uring_enter failed: {}", std::strerror(errno)));
+        }
+    }
+}
+
+std::span<const uint8_t> IoRing::buffer(uint16_t id, std::size_t length) const
+{
+    return {buffers_ + static_cast<std::size_t>(id) * BUFFER_SIZE, std::min(length, BUFFER_SIZE)};
+}
+
+void IoRing::recycle(uint16_t id)
+{
+    provide_buffers(id, 1, RECYCLED);
+}
+
+} // namespace cli
+
+#endif
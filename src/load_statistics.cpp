@@ -0,0 +1,394 @@
+#include "caparoc_commander/load_statistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <stdexcept>
+
+namespace cli {
+
+namespace {
+
+// Sketches track the raw register values: mA for load currents, 1/100 V for
+// the input voltage and A for the total current all fit [1, 65535].
+constexpr double SKETCH_ACCURACY = 0.01;
+constexpr double SKETCH_MIN = 1.0;
+constexpr double SKETCH_MAX = 65535.0;
+
+constexpr double NS_PER_HOUR = 3600.0 * 1e9;
+
+std::string format_utc(uint64_t timestamp_ns)
+{
+    using namespace std::chrono;
+    sys_time<nanoseconds> time{nanoseconds{timestamp_ns}};
+    auto day = floor<days>(time);
+    year_month_day date{day};
+    hh_mm_ss clock{duration_cast<seconds>(time - day)};
+    return std::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}", static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                       static_cast<unsigned>(date.day()), clock.hours().count(), clock.minutes().count(), clock.seconds().count());
+}
+
+std::string summary_json(const LoadSummary &summary)
+{
+    return std::format("\"count\":{},\"min\":{:.3f},\"mean\":{:.3f},\"stddev\":{:.3f},\"p50\":{:.3f},\"p95\":{:.3f},\"p99\":{:.3f},\"max\":{:.3f}",
+                       summary.count, summary.min, summary.mean, summary.stddev, summary.p50, summary.p95, summary.p99, summary.max);
+}
+
+} // namespace
+
+void RunningStats::add(double value)
+{
+    ++count;
+    double delta = value - mean;
+    mean += delta / static_cast<double>(count);
+    m2 += delta * (value - mean);
+    min = std::min(min, value);
+    max = std::max(max, value);
+}
+
+void RunningStats::merge(const RunningStats &other)
+{
+    if (other.count == 0)
+    {
+        return;
+    }
+    if (count == 0)
+    {
+        *this = other;
+        return;
+    }
+    auto total = static_cast<double>(count + other.count);
+    double delta = other.mean - mean;
+    mean += delta * static_cast<double>(other.count) / total;
+    m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / total;
+    count += other.count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+double RunningStats::stddev() const
+{
+    return count > 1 ? std::sqrt(m2 / static_cast<double>(count - 1)) : 0.0;
+}
+
+QuantileSketch::QuantileSketch(double relative_accuracy, double min_value, double max_value)
+    : gamma_((1.0 + relative_accuracy) / (1.0 - relative_accuracy))
+    , log_gamma_(std::log(gamma_))
+    , min_value_(min_value)
+    , first_key_(0)
+{
+    first_key_ = key(min_value);
+    buckets_.assign(static_cast<std::size_t>(key(max_value) - first_key_ + 1), 0);
+}
+
+int QuantileSketch::key(double value) const
+{
+    return static_cast<int>(std::ceil(std::log(value) / log_gamma_));
+}
+
+void QuantileSketch::add(double value)
+{
+    ++count_;
+    if (!(value >= min_value_))
+    {
+        ++zero_count_;
+        return;
+    }
+    auto index = std::clamp(key(value) - first_key_, 0, static_cast<int>(buckets_.size()) - 1);
+    ++buckets_[static_cast<std::size_t>(index)];
+}
+
+void QuantileSketch::merge(const QuantileSketch &other)
+{
+    if (other.buckets_.size() != buckets_.size() || other.first_key_ != first_key_)
+    {
+        throw std::invalid_argument("Cannot merge quantile sketches with different parameters");
+    }
+    count_ += other.count_;
+    zero_count_ += other.zero_count_;
+    std::transform(buckets_.begin(), buckets_.end(), other.buckets_.begin(), buckets_.begin(), std::plus<>{});
+}
+
+void QuantileSketch::clear()
+{
+    count_ = 0;
+    zero_count_ = 0;
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+}
+
+double QuantileSketch::quantile(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0.0;
+    }
+    auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_ - 1));
+    if (rank < zero_count_)
+    {
+        return 0.0;
+    }
+    uint64_t seen = zero_count_;
+    for (std::size_t i = 0; i < buckets_.size(); ++i)
+    {
+        seen += buckets_[i];
+        if (seen > rank)
+        {
+            // Bucket k holds (gamma^(k-1), gamma^k]; this is within the
+            // relative accuracy of both ends.
+            return 2.0 * std::pow(gamma_, first_key_ + static_cast<int>(i)) / (gamma_ + 1.0);
+        }
+    }
+    return 2.0 * std::pow(gamma_, first_key_ + static_cast<int>(buckets_.size()) - 1) / (gamma_ + 1.0);
+}
+
+void LoadAggregator::Series::merge(const Series &other)
+{
+    moments.merge(other.moments);
+    sketch.merge(other.sketch);
+    energy_wh += other.energy_wh;
+}
+
+void LoadAggregator::Series::clear()
+{
+    moments = {};
+    sketch.clear();
+    energy_wh = 0.0;
+}
+
+LoadAggregator::Pane::Pane()
+    : input_voltage_v(SKETCH_ACCURACY, SKETCH_MIN, SKETCH_MAX)
+    , total_current_a(SKETCH_ACCURACY, SKETCH_MIN, SKETCH_MAX)
+    , channels(RACK_MAX_MODULES * RACK_MAX_CHANNELS, Series(SKETCH_ACCURACY, SKETCH_MIN, SKETCH_MAX))
+{
+}
+
+void LoadAggregator::Pane::merge(const Pane &other)
+{
+    polls += other.polls;
+    input_voltage_v.merge(other.input_voltage_v);
+    total_current_a.merge(other.total_current_a);
+    for (std::size_t i = 0; i < channels.size(); ++i)
+    {
+        channels[i].merge(other.channels[i]);
+    }
+}
+
+void LoadAggregator::Pane::clear()
+{
+    polls = 0;
+    input_voltage_v.clear();
+    total_current_a.clear();
+    for (auto &series : channels)
+    {
+        series.clear();
+    }
+}
+
+LoadAggregator::LoadAggregator(std::chrono::seconds window, std::chrono::seconds slide, std::chrono::milliseconds max_gap)
+    : window_ns_(static_cast<uint64_t>(std::chrono::nanoseconds(window).count()))
+    , slide_ns_(static_cast<uint64_t>(std::chrono::nanoseconds(slide).count()))
+    , max_gap_ns_(static_cast<uint64_t>(std::chrono::nanoseconds(max_gap).count()))
+{
+    if (window.count() <= 0 || slide.count() <= 0 || window.count() % slide.count() != 0)
+    {
+        throw std::invalid_argument("The window length must be a positive multiple of the slide");
+    }
+    auto panes = static_cast<std::size_t>(window.count() / slide.count());
+    if (panes > MAX_PANES)
+    {
+        throw std::invalid_argument(std::format("The window may be at most {} times the slide", MAX_PANES));
+    }
+    panes_.resize(panes);
+}
+
+void LoadAggregator::advance_to(uint64_t timestamp_ns, std::vector<LoadWindow> &completed)
+{
+    if (pane_start_ns_ == 0)
+    {
+        pane_start_ns_ = timestamp_ns / slide_ns_ * slide_ns_;
+        return;
+    }
+    // A clock stepped back keeps adding to the current pane.
+    while (timestamp_ns >= pane_start_ns_ + slide_ns_)
+    {
+        auto end = pane_start_ns_ + slide_ns_;
+        auto window = summarize(end > window_ns_ ? end - window_ns_ : 0, end, false);
+        if (window.polls > 0)
+        {
+            completed.push_back(std::move(window));
+        }
+        head_ = (head_ + 1) % panes_.size();
+        panes_[head_].clear();
+        pane_start_ns_ = end;
+
+        // After a long gap, skip the windows that would be empty.
+        if (std::all_of(panes_.begin(), panes_.end(), [](const Pane &pane)
+                        { return pane.polls == 0; }))
+        {
+            pane_start_ns_ = timestamp_ns / slide_ns_ * slide_ns_;
+            break;
+        }
+    }
+}
+
+std::vector<LoadWindow> LoadAggregator::add(const RackSnapshot &snapshot)
+{
+    std::vector<LoadWindow> completed;
+    auto timestamp = snapshot.timestamp_ns;
+    advance_to(timestamp, completed);
+    last_timestamp_ns_ = std::max(last_timestamp_ns_, timestamp);
+
+    // Hours to integrate a sample over, and remember its time
+    auto hours_since = [&](uint64_t &previous)
+    {
+        double hours = 0.0;
+        if (previous != 0 && timestamp > previous && timestamp - previous <= max_gap_ns_)
+        {
+            hours = static_cast<double>(timestamp - previous) / NS_PER_HOUR;
+        }
+        previous = timestamp;
+        return hours;
+    };
+
+    auto &pane = panes_[head_];
+    ++pane.polls;
+    if (snapshot.valid & rack_valid::INPUT_VOLTAGE)
+    {
+        pane.input_voltage_v.moments.add(snapshot.input_voltage_cv);
+        pane.input_voltage_v.sketch.add(snapshot.input_voltage_cv);
+        last_voltage_v_ = snapshot.input_voltage_cv / 100.0;
+    }
+    if (snapshot.valid & rack_valid::TOTAL_CURRENT)
+    {
+        pane.total_current_a.moments.add(snapshot.total_current_a);
+        pane.total_current_a.sketch.add(snapshot.total_current_a);
+        pane.total_current_a.energy_wh += snapshot.total_current_a * last_voltage_v_ * hours_since(last_total_ns_);
+    }
+    auto modules = std::min<std::size_t>(snapshot.module_count, RACK_MAX_MODULES);
+    for (std::size_t module = 0; module < modules; ++module)
+    {
+        auto channels = std::min<std::size_t>(snapshot.channel_count[module], RACK_MAX_CHANNELS);
+        for (std::size_t channel = 0; channel < channels; ++channel)
+        {
+            const auto &values = snapshot.channels[module][channel];
+            if (!(values.flags & channel_flag::VALID))
+            {
+                continue;
+            }
+            auto index = module * RACK_MAX_CHANNELS + channel;
+            auto &series = pane.channels[index];
+            series.moments.add(values.load_current_ma);
+            series.sketch.add(values.load_current_ma);
+            series.energy_wh += values.load_current_ma / 1000.0 * last_voltage_v_ * hours_since(last_channel_ns_[index]);
+        }
+    }
+    return completed;
+}
+
+std::optional<LoadWindow> LoadAggregator::current() const
+{
+    if (pane_start_ns_ == 0)
+    {
+        return std::nullopt;
+    }
+    auto end = pane_start_ns_ + slide_ns_;
+    return summarize(end > window_ns_ ? end - window_ns_ : 0, std::max(last_timestamp_ns_, pane_start_ns_), true);
+}
+
+LoadWindow LoadAggregator::summarize(uint64_t start_ns, uint64_t end_ns, bool partial) const
+{
+    Pane total = panes_[head_];
+    for (std::size_t i = 0; i < panes_.size(); ++i)
+    {
+        if (i != head_)
+        {
+            total.merge(panes_[i]);
+        }
+    }
+
+    auto summary = [](const Series &series, double scale)
+    {
+        LoadSummary result;
+        const auto &moments = series.moments;
+        if (moments.count == 0)
+        {
+            return result;
+        }
+        auto quantile = [&](double q)
+        {
+            return std::clamp(series.sketch.quantile(q), moments.min, moments.max) * scale;
+        };
+        result.count = moments.count;
+        result.min = moments.min * scale;
+        result.mean = moments.mean * scale;
+        result.stddev = moments.stddev() * scale;
+        result.max = moments.max * scale;
+        result.p50 = quantile(0.50);
+        result.p95 = quantile(0.95);
+        result.p99 = quantile(0.99);
+        return result;
+    };
+
+    LoadWindow window;
+    window.start_ns = start_ns;
+    window.end_ns = end_ns;
+    window.partial = partial;
+    window.polls = total.polls;
+    window.input_voltage_v = summary(total.input_voltage_v, 0.01);
+    window.total_current_a = summary(total.total_current_a, 1.0);
+    window.energy_wh = total.total_current_a.energy_wh;
+    for (std::size_t index = 0; index < total.channels.size(); ++index)
+    {
+        const auto &series = total.channels[index];
+        if (series.moments.count == 0)
+        {
+            continue;
+        }
+        window.channels.push_back({static_cast<uint8_t>(index / RACK_MAX_CHANNELS + 1), static_cast<uint8_t>(index % RACK_MAX_CHANNELS + 1),
+                                   summary(series, 0.001), series.energy_wh});
+    }
+    return window;
+}
+
+std::string format_load_window_json(const LoadWindow &window)
+{
+    auto json = std::format("{{\"start\":{},\"end\":{},\"partial\":{},\"polls\":{},\"input_voltage\":{{{}}},\"total_current\":{{{},\"energy_wh\":{:.3f}}},\"channels\":[",
+                            window.start_ns / 1'000'000, window.end_ns / 1'000'000, window.partial, window.polls,
+                            summary_json(window.input_voltage_v), summary_json(window.total_current_a), window.energy_wh);
+    const char *separator = "";
+    for (const auto &channel : window.channels)
+    {
+        json += std::format("{}{{\"module\":{},\"channel\":{},{},\"energy_wh\":{:.3f}}}", separator, channel.module, channel.channel,
+                            summary_json(channel.current_a), channel.energy_wh);
+        separator = ",";
+    }
+    json += "]}";
+    return json;
+}
+
+std::string format_load_window(const LoadWindow &window)
+{
+    auto text = std::format("Window {} - {} UTC{}, {} poll(s)\n", format_utc(window.start_ns), format_utc(window.end_ns),
+                            window.partial ? " (partial)" : "", window.polls);
+    const auto &voltage = window.input_voltage_v;
+    const auto &total = window.total_current_a;
+    if (voltage.count > 0)
+    {
+        text += std::format("  Input voltage:  mean {:.2f} V, min {:.2f} V, max {:.2f} V, p95 {:.2f} V\n", voltage.mean, voltage.min, voltage.max, voltage.p95);
+    }
+    if (total.count > 0)
+    {
+        text += std::format("  Total current:  mean {:.1f} A, max {:.0f} A, p95 {:.0f} A, energy {:.1f} Wh\n", total.mean, total.max, total.p95, window.energy_wh);
+    }
+    text += "  Module Ch    Min A   Mean A  Stddev A    P50 A    P95 A    P99 A    Max A  Energy Wh\n";
+    for (const auto &channel : window.channels)
+    {
+        const auto &current = channel.current_a;
+        text += std::format("  {:>6} {:>2} {:>8.3f} {:>8.3f} {:>9.3f} {:>8.3f} {:>8.3f} {:>8.3f} {:>8.3f} {:>10.2f}\n", channel.module, channel.channel,
+                            current.min, current.mean, current.stddev, current.p50, current.p95, current.p99, current.max, channel.energy_wh);
+    }
+    text.pop_back();
+    return text;
+}
+
+} // namespace cli
@@ -0,0 +1,177 @@
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/register_decode.hpp"
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+namespace cli {
+
+namespace {
+
+void put_uint16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+uint16_t get_uint16(std::span<const uint8_t> data, std::size_t offset)
+{
+    return static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+}
+
+// Writes the MBAP header; the length field is patched once the PDU is complete.
+std::vector<uint8_t> begin_adu(uint16_t transaction_id, uint8_t unit_id, FunctionCode function_code)
+{
+    std::vector<uint8_t> adu;
+    adu.reserve(MAX_ADU_LENGTH);
+    put_uint16(adu, transaction_id);
+    put_uint16(adu, 0);  // protocol identifier
+    put_uint16(adu, 0);  // length, patched by finish_adu()
+    adu.push_back(unit_id);
+    adu.push_back(static_cast<uint8_t>(function_code));
+    return adu;
+}
+
+std::vector<uint8_t> finish_adu(std::vector<uint8_t> adu)
+{
+    auto length = static_cast<uint16_t>(adu.size() - 6);
+    adu[4] = static_cast<uint8_t>(length >> 8);
+    adu[5] = static_cast<uint8_t>(length & 0xFF);
+    return adu;
+}
+
+} // namespace
+
+std::vector<uint8_t> encode_read_holding_registers(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t count)
+{
+    auto adu = begin_adu(transaction_id, unit_id, FunctionCode::READ_HOLDING_REGISTERS);
+    put_uint16(adu, address);
+    put_uint16(adu, count);
+    return finish_adu(std::move(adu));
+}
+
+std::vector<uint8_t> encode_write_single_register(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t value)
+{
+    auto adu = begin_adu(transaction_id, unit_id, FunctionCode::WRITE_SINGLE_REGISTER);
+    put_uint16(adu, address);
+    put_uint16(adu, value);
+    return finish_adu(std::move(adu));
+}
+
+std::vector<uint8_t> encode_write_multiple_registers(uint16_t transaction_id, uint8_t unit_id, uint16_t address, std::span<const uint16_t> values)
+{
+    auto adu = begin_adu(transaction_id, unit_id, FunctionCode::WRITE_MULTIPLE_REGISTERS);
+    put_uint16(adu, address);
+    put_uint16(adu, static_cast<uint16_t>(values.size()));
+    adu.push_back(static_cast<uint8_t>(values.size() * 2));
+    for (auto value : values)
+    {
+        put_uint16(adu, value);
+    }
+    return finish_adu(std::move(adu));
+}
+
+std::vector<uint8_t> encode_read_coils(uint16_t transaction_id, uint8_t unit_id, uint16_t address, uint16_t count)
+{
+    auto adu = begin_adu(transaction_id, unit_id, FunctionCode::READ_COILS);
+    put_uint16(adu, address);
+    put_uint16(adu, count);
+    return finish_adu(std::move(adu));
+}
+
+std::vector<uint8_t> encode_write_multiple_coils(uint16_t transaction_id, uint8_t unit_id, uint16_t address, const CoilBitset &coils)
+{
+    auto adu = begin_adu(transaction_id, unit_id, FunctionCode::WRITE_MULTIPLE_COILS);
+    put_uint16(adu, address);
+    put_uint16(adu, static_cast<uint16_t>(coils.size()));
+    auto packed = coils.to_packed_bytes();
+    adu.push_back(static_cast<uint8_t>(packed.size()));
+    adu.insert(adu.end(), packed.begin(), packed.end());
+    return finish_adu(std::move(adu));
+}
+
+std::size_t complete_adu_length(std::span<const uint8_t> buffer)
+{
+    if (buffer.size() < MBAP_HEADER_LENGTH)
+    {
+        return 0;
+    }
+
+    // The MBAP length field counts the unit id and the PDU.
+    std::size_t total = 6 + get_uint16(buffer, 4);
+    if (total > MAX_ADU_LENGTH || total < MBAP_HEADER_LENGTH + 1)
+    {
+        // Not a Modbus TCP frame. Report it as complete so that the caller
+        // consumes it and fails the decode instead of waiting forever.
+        return std::min(buffer.size(), MAX_ADU_LENGTH);
+    }
+
+    return buffer.size() >= total ? total : 0;
+}
+
+uint16_t adu_transaction_id(std::span<const uint8_t> adu)
+{
+    return adu.size() >= 2 ? get_uint16(adu, 0) : 0;
+}
+
+std::optional<std::vector<uint16_t>> decode_read_registers_response(std::span<const uint8_t> adu)
+{
+    if (adu.size() < MBAP_HEADER_LENGTH + 2 ||
+        adu[MBAP_HEADER_LENGTH] != static_cast<uint8_t>(FunctionCode::READ_HOLDING_REGISTERS))
+    {
+        return std::nullopt;
+    }
+
+    std::size_t byte_count = adu[MBAP_HEADER_LENGTH + 1];
+    std::size_t payload = MBAP_HEADER_LENGTH + 2;
+    if (byte_count % 2 != 0 || adu.size() < payload + byte_count)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<uint16_t> registers(byte_count / 2);
+    decode_be_words(adu.subspan(payload, byte_count), registers);
+    return registers;
+}
+
+std::optional<CoilBitset> decode_read_coils_response(std::span<const uint8_t> adu, uint16_t count)
+{
+    if (adu.size() < MBAP_HEADER_LENGTH + 2 ||
+        adu[MBAP_HEADER_LENGTH] != static_cast<uint8_t>(FunctionCode::READ_COILS))
+    {
+        return std::nullopt;
+    }
+
+    std::size_t byte_count = adu[MBAP_HEADER_LENGTH + 1];
+    std::size_t payload = MBAP_HEADER_LENGTH + 2;
+    if (byte_count < (count + 7u) / 8 || adu.size() < payload + byte_count)
+    {
+        return std::nullopt;
+    }
+    return CoilBitset::from_packed_bytes(adu.subspan(payload, byte_count), count);
+}
+
+bool is_write_acknowledged(std::span<const uint8_t> adu, FunctionCode function_code)
+{
+    // FC 6, 15 and 16 all echo four bytes (address + value or address + count).
+    return adu.size() >= MBAP_HEADER_LENGTH + 5 &&
+           adu[MBAP_HEADER_LENGTH] == static_cast<uint8_t>(function_code);
+}
+
+std::string decode_string_registers(std::span<const uint16_t> registers)
+{
+    std::string result;
+    result.reserve(registers.size() * 2);
+    for (auto reg : registers)
+    {
+        result.push_back(static_cast<char>(reg >> 8));
+        result.push_back(static_cast<char>(reg & 0xFF));
+    }
+
+    auto end = result.find_last_not_of(std::string_view{"\0 ", 2});
+    result.erase(end == std::string::npos ? 0 : end + 1);
+    return result;
+}
+
+} // namespace cli
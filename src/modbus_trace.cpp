@@ -0,0 +1,139 @@
+#include "caparoc_commander/modbus_trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t FILE_HEADER_SIZE = 16;
+constexpr std::size_t RECORD_HEADER_SIZE = 14;
+
+template <typename T>
+void put_le(uint8_t *out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t *in)
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+} // namespace
+
+TraceWriter::TraceWriter(const std::string &path)
+    : path_(path), file_(path, std::ios::binary | std::ios::trunc), start_(std::chrono::steady_clock::now())
+{
+    if (!file_)
+    {
+        throw std::runtime_error(std::format("Cannot create trace file '{}'", path));
+    }
+
+    auto start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::array<uint8_t, FILE_HEADER_SIZE> header{};
+    put_le(header.data(), TRACE_MAGIC);
+    put_le(header.data() + 4, TRACE_FORMAT_VERSION);
+    put_le(header.data() + 8, static_cast<uint64_t>(start_time_ns));
+    file_.write(reinterpret_cast<const char *>(header.data()), header.size());
+}
+
+uint16_t TraceWriter::open_stream(std::string_view endpoint)
+{
+    uint16_t stream;
+    {
+        std::lock_guard lock(mutex_);
+        stream = next_stream_++;
+    }
+    write(stream, TraceRecordKind::OPEN, std::span(reinterpret_cast<const uint8_t *>(endpoint.data()), endpoint.size()));
+    return stream;
+}
+
+void TraceWriter::write(uint16_t stream, TraceRecordKind kind, std::span<const uint8_t> data)
+{
+    auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    std::array<uint8_t, RECORD_HEADER_SIZE> header{};
+    put_le(header.data(), static_cast<uint64_t>(time_ns));
+    put_le(header.data() + 8, stream);
+    header[10] = static_cast<uint8_t>(kind);
+    put_le(header.data() + 12, static_cast<uint16_t>(std::min<std::size_t>(data.size(), UINT16_MAX)));
+
+    std::lock_guard lock(mutex_);
+    file_.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file_.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(std::min<std::size_t>(data.size(), UINT16_MAX)));
+    ++records_;
+}
+
+void TraceWriter::close_stream(uint16_t stream)
+{
+    write(stream, TraceRecordKind::CLOSE, {});
+    std::lock_guard lock(mutex_);
+    file_.flush();
+}
+
+std::size_t TraceWriter::records_written() const
+{
+    std::lock_guard lock(mutex_);
+    return records_;
+}
+
+ModbusTrace read_trace(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error(std::format("Cannot open trace file '{}'", path));
+    }
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (bytes.size() < FILE_HEADER_SIZE || get_le<uint32_t>(bytes.data()) != TRACE_MAGIC)
+    {
+        throw std::runtime_error(std::format("'{}' is not a Modbus trace file", path));
+    }
+    if (auto version = get_le<uint16_t>(bytes.data() + 4); version != TRACE_FORMAT_VERSION)
+    {
+        throw std::runtime_error(std::format("Trace file '{}' has unsupported version {}", path, version));
+    }
+
+    ModbusTrace trace;
+    trace.start_time_ns = get_le<uint64_t>(bytes.data() + 8);
+
+    std::size_t offset = FILE_HEADER_SIZE;
+    while (bytes.size() - offset >= RECORD_HEADER_SIZE)
+    {
+        const uint8_t *header = bytes.data() + offset;
+        auto length = get_le<uint16_t>(header + 12);
+        if (bytes.size() - offset - RECORD_HEADER_SIZE < length)
+        {
+            break;
+        }
+        if (header[10] > static_cast<uint8_t>(TraceRecordKind::CLOSE))
+        {
+            throw std::runtime_error(std::format("Trace file '{}' has an unknown record kind {} at offset {}", path, header[10], offset));
+        }
+
+        TraceRecord record;
+        record.time_ns = get_le<uint64_t>(header);
+        record.stream = get_le<uint16_t>(header + 8);
+        record.kind = static_cast<TraceRecordKind>(header[10]);
+        record.data.assign(header + RECORD_HEADER_SIZE, header + RECORD_HEADER_SIZE + length);
+        trace.records.push_back(std::move(record));
+        offset += RECORD_HEADER_SIZE + length;
+    }
+    return trace;
+}
+
+} // namespace cli
@@ -0,0 +1,508 @@
+#include "caparoc_commander/mqtt_client.hpp"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <poll.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+
+// Fixed header bytes of the packets this client sends or understands
+constexpr uint8_t CONNECT = 0x10;
+constexpr uint8_t CONNACK = 0x20;
+constexpr uint8_t PUBLISH = 0x30;
+constexpr uint8_t PUBACK = 0x40;
+constexpr uint8_t PINGREQ = 0xC0;
+constexpr uint8_t PINGRESP = 0xD0;
+constexpr uint8_t DISCONNECT = 0xE0;
+
+constexpr std::size_t MAX_REMAINING_LENGTH = 268'435'455;
+
+// Output is sent once this much has been buffered, even without flush().
+constexpr std::size_t OUTPUT_FLUSH_BYTES = 64 * 1024;
+
+void put_u16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+void put_string(std::vector<uint8_t> &out, std::string_view text)
+{
+    put_u16(out, static_cast<uint16_t>(text.size()));
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// First byte and "remaining length" (1-4 bytes, 7 bits each, least significant first)
+void put_fixed_header(std::vector<uint8_t> &out, uint8_t first, std::size_t remaining)
+{
+    out.push_back(first);
+    do
+    {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        out.push_back(remaining > 0 ? digit | 0x80 : digit);
+    } while (remaining > 0);
+}
+
+struct PacketExtent {
+    std::size_t header;  // fixed header bytes
+    std::size_t total;   // whole packet
+};
+
+// Extent of the first packet in @p data; std::nullopt if it is still incomplete.
+// A remaining length with more than 4 bytes leaves @p malformed set.
+std::optional<PacketExtent> first_packet(const std::vector<uint8_t> &data, bool &malformed)
+{
+    std::size_t remaining = 0;
+    std::size_t multiplier = 1;
+    for (std::size_t i = 1; i < data.size(); ++i)
+    {
+        if (i > 4)
+        {
+            malformed = true;
+            return std::nullopt;
+        }
+        remaining += (data[i] & 0x7F) * multiplier;
+        multiplier *= 128;
+        if ((data[i] & 0x80) == 0)
+        {
+            if (data.size() < i + 1 + remaining)
+            {
+                return std::nullopt;
+            }
+            return PacketExtent{i + 1, i + 1 + remaining};
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view connack_reason(uint8_t code)
+{
+    switch (code)
+    {
+    case 1:
+        return "unacceptable protocol version";
+    case 2:
+        return "client identifier rejected";
+    case 3:
+        return "server unavailable";
+    case 4:
+        return "bad user name or password";
+    case 5:
+        return "not authorized";
+    default:
+        return "unknown reason";
+    }
+}
+
+} // namespace
+
+MqttClient::MqttClient(std::string host, int port, std::string client_id, uint16_t keepalive_seconds)
+    : host_(std::move(host)), port_(port), client_id_(std::move(client_id)), keepalive_seconds_(keepalive_seconds)
+{
+}
+
+MqttClient::~MqttClient()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+bool MqttClient::fail(std::string error)
+{
+    last_error_ = std::move(error);
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    output_.clear();
+    input_.clear();
+    ping_outstanding_ = false;
+    return false;
+}
+
+bool MqttClient::connect(const MqttMessage &will, int timeout_seconds)
+{
+    if (fd_ >= 0)
+    {
+        return true;
+    }
+    timeout_seconds = std::max(timeout_seconds, 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *resolved = nullptr;
+    auto port_text = std::to_string(port_);
+    if (int rc = getaddrinfo(host_.c_str(), port_text.c_str(), &hints, &resolved); rc != 0)
+    {
+        return fail(std::format("{}: {}", host_, gai_strerror(rc)));
+    }
+
+    fd_ = ::socket(resolved->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        freeaddrinfo(resolved);
+        return fail(std::strerror(errno));
+    }
+    int rc = ::connect(fd_, resolved->ai_addr, resolved->ai_addrlen);
+    freeaddrinfo(resolved);
+    if (rc != 0 && errno != EINPROGRESS)
+    {
+        return fail(std::strerror(errno));
+    }
+    if (rc != 0)
+    {
+        pollfd entry{fd_, POLLOUT, 0};
+        int socket_error = 0;
+        socklen_t length = sizeof(socket_error);
+        if (::poll(&entry, 1, timeout_seconds * 1000) <= 0)
+        {
+            return fail("Connection timed out");
+        }
+        getsockopt(fd_, SOL_SOCKET, SO_ERROR, &socket_error, &length);
+        if (socket_error != 0)
+        {
+            return fail(std::strerror(socket_error));
+        }
+    }
+
+    // Sends block for at most the connect timeout; receives never block.
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_NONBLOCK);
+    timeval send_timeout{timeout_seconds, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // CONNECT: protocol "MQTT" level 4, clean session, will with its QoS and retain flag
+    uint8_t flags = 0x02 | 0x04 | static_cast<uint8_t>((will.qos & 0x03) << 3) | (will.retain ? 0x20 : 0x00);
+    std::size_t remaining = 10 + 2 + client_id_.size() + 2 + will.topic.size() + 2 + will.payload.size();
+    put_fixed_header(output_, CONNECT, remaining);
+    put_string(output_, "MQTT");
+    output_.push_back(4);
+    output_.push_back(flags);
+    put_u16(output_, keepalive_seconds_);
+    put_string(output_, client_id_);
+    put_string(output_, will.topic);
+    put_string(output_, will.payload);
+    if (!send_buffered())
+    {
+        return false;
+    }
+
+    auto give_up = Clock::now() + std::chrono::seconds(timeout_seconds);
+    while (Clock::now() < give_up)
+    {
+        if (!read_packets(std::chrono::milliseconds(100)))
+        {
+            return false;
+        }
+        bool malformed = false;
+        auto extent = first_packet(input_, malformed);
+        if (malformed)
+        {
+            return fail("Malformed packet from broker");
+        }
+        if (!extent)
+        {
+            continue;
+        }
+        if (input_[0] != CONNACK || extent->total != extent->header + 2)
+        {
+            return fail("Broker did not answer CONNECT with CONNACK");
+        }
+        uint8_t code = input_[extent->header + 1];
+        input_.erase(input_.begin(), input_.begin() + static_cast<std::ptrdiff_t>(extent->total));
+        if (code != 0)
+        {
+            return fail(std::format("Broker refused the connection: {}", connack_reason(code)));
+        }
+        last_error_.clear();
+        return true;
+    }
+    return fail("Broker did not answer CONNECT");
+}
+
+bool MqttClient::publish(const MqttMessage &message)
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    uint8_t qos = std::min<uint8_t>(message.qos, 1);
+    if (qos == 1 && inflight_.size() >= MAX_INFLIGHT)
+    {
+        auto give_up = Clock::now() + std::chrono::seconds(std::max<int>(keepalive_seconds_, 5));
+        while (inflight_.size() >= MAX_INFLIGHT)
+        {
+            if (Clock::now() >= give_up)
+            {
+                return fail("Broker stopped acknowledging messages");
+            }
+            if (!service(std::chrono::milliseconds(100)))
+            {
+                return false;
+            }
+        }
+    }
+
+    std::size_t remaining = 2 + message.topic.size() + (qos ? 2 : 0) + message.payload.size();
+    if (remaining > MAX_REMAINING_LENGTH)
+    {
+        last_error_ = std::format("Message for {} exceeds the MQTT size limit", message.topic);
+        return true;  // dropped, the connection is still fine
+    }
+    put_fixed_header(output_, static_cast<uint8_t>(PUBLISH | (qos << 1) | (message.retain ? 0x01 : 0x00)), remaining);
+    put_string(output_, message.topic);
+    if (qos)
+    {
+        if (next_packet_id_ == 0)
+        {
+            next_packet_id_ = 1;
+        }
+        put_u16(output_, next_packet_id_);
+        inflight_.emplace_back(next_packet_id_++, message);
+    }
+    output_.insert(output_.end(), message.payload.begin(), message.payload.end());
+
+    return output_.size() < OUTPUT_FLUSH_BYTES || send_buffered();
+}
+
+bool MqttClient::flush()
+{
+    return fd_ >= 0 && send_buffered();
+}
+
+bool MqttClient::send_buffered()
+{
+    const uint8_t *data = output_.data();
+    std::size_t size = output_.size();
+    while (size > 0)
+    {
+        auto sent = ::send(fd_, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return fail("Timed out sending to the broker");
+        }
+        if (sent <= 0)
+        {
+            return fail(std::strerror(errno));
+        }
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+        bytes_sent_ += static_cast<uint64_t>(sent);
+    }
+    if (!output_.empty())
+    {
+        last_sent_ = Clock::now();
+    }
+    output_.clear();
+    return true;
+}
+
+bool MqttClient::read_packets(std::chrono::milliseconds wait)
+{
+    pollfd entry{fd_, POLLIN, 0};
+    int ready = ::poll(&entry, 1, static_cast<int>(wait.count()));
+    if (ready < 0 && errno != EINTR)
+    {
+        return fail(std::strerror(errno));
+    }
+    if (ready <= 0)
+    {
+        return true;
+    }
+
+    uint8_t buffer[4096];
+    for (;;)
+    {
+        auto received = ::recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (received < 0)
+        {
+            return fail(std::strerror(errno));
+        }
+        if (received == 0)
+        {
+            return fail("Connection closed by the broker");
+        }
+        input_.insert(input_.end(), buffer, buffer + received);
+    }
+}
+
+bool MqttClient::service(std::chrono::milliseconds wait)
+{
+    if (fd_ < 0 || !send_buffered())
+    {
+        return false;
+    }
+
+    auto now = Clock::now();
+    auto keepalive = std::chrono::seconds(keepalive_seconds_);
+    if (keepalive_seconds_ > 0)
+    {
+        if (ping_outstanding_ && now - ping_sent_ > keepalive)
+        {
+            return fail("Broker did not answer PINGREQ");
+        }
+        // Ping well before the broker's 1.5 x keepalive limit.
+        if (!ping_outstanding_ && now - last_sent_ >= keepalive / 2)
+        {
+            output_.push_back(PINGREQ);
+            output_.push_back(0);
+            if (!send_buffered())
+            {
+                return false;
+            }
+            ping_outstanding_ = true;
+            ping_sent_ = now;
+        }
+    }
+
+    if (!read_packets(wait))
+    {
+        return false;
+    }
+
+    bool malformed = false;
+    while (auto extent = first_packet(input_, malformed))
+    {
+        uint8_t type = input_[0] & 0xF0;
+        if (type == PUBACK && extent->total == extent->header + 2)
+        {
+            uint16_t id = static_cast<uint16_t>((input_[extent->header] << 8) | input_[extent->header + 1]);
+            auto acknowledged = std::find_if(inflight_.begin(), inflight_.end(), [id](const auto &entry) { return entry.first == id; });
+            if (acknowledged != inflight_.end())
+            {
+                inflight_.erase(acknowledged);
+            }
+        }
+        else if (type == PINGRESP)
+        {
+            ping_outstanding_ = false;
+        }
+        // Anything else (e.g. a PUBLISH for a subscription of an earlier
+        // session) is of no interest to a publisher.
+        input_.erase(input_.begin(), input_.begin() + static_cast<std::ptrdiff_t>(extent->total));
+    }
+    if (malformed)
+    {
+        return fail("Malformed packet from broker");
+    }
+    return true;
+}
+
+std::vector<MqttMessage> MqttClient::take_unacknowledged()
+{
+    std::vector<MqttMessage> messages;
+    messages.reserve(inflight_.size());
+    for (auto &entry : inflight_)
+    {
+        messages.push_back(std::move(entry.second));
+    }
+    inflight_.clear();
+    return messages;
+}
+
+void MqttClient::disconnect()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    output_.push_back(DISCONNECT);
+    output_.push_back(0);
+    send_buffered();
+    fail("Disconnected");
+}
+
+} // namespace cli
+
+#else
+
+namespace cli {
+
+MqttClient::MqttClient(std::string host, int port, std::string client_id, uint16_t keepalive_seconds)
+    : host_(std::move(host)), port_(port), client_id_(std::move(client_id)), keepalive_seconds_(keepalive_seconds)
+{
+}
+
+MqttClient::~MqttClient() = default;
+
+bool MqttClient::connect(const MqttMessage &, int)
+{
+    return fail("MQTT publishing is only supported on Linux");
+}
+
+bool MqttClient::publish(const MqttMessage &)
+{
+    return false;
+}
+
+bool MqttClient::flush()
+{
+    return false;
+}
+
+bool MqttClient::service(std::chrono::milliseconds)
+{
+    return false;
+}
+
+std::vector<MqttMessage> MqttClient::take_unacknowledged()
+{
+    return {};
+}
+
+void MqttClient::disconnect()
+{
+}
+
+bool MqttClient::send_buffered()
+{
+    return false;
+}
+
+bool MqttClient::read_packets(std::chrono::milliseconds)
+{
+    return false;
+}
+
+bool MqttClient::fail(std::string error)
+{
+    last_error_ = std::move(error);
+    return false;
+}
+
+} // namespace cli
+
+#endif
@@ -0,0 +1,425 @@
+#include "caparoc_commander/mqtt_publisher.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#ifdef CAPAROC_COMMANDER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t QUEUE_FILE_HEADER_SIZE = 8;
+constexpr std::size_t QUEUE_RECORD_HEADER_SIZE = 8;
+constexpr std::chrono::seconds MAX_BACKOFF{30};
+
+// How long the destructor waits for the broker to take the remaining messages
+constexpr std::chrono::seconds SHUTDOWN_GRACE{2};
+
+template <typename T>
+void put_le(uint8_t *out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t *in)
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+// Queue file: 8-byte header (magic: u32, version: u16, reserved: u16), then
+// per message an 8-byte little-endian header (flags: u8 = qos | retain << 1,
+// reserved: u8, topic length: u16, payload length: u32), topic and payload.
+void write_queue_record(std::ofstream &file, const MqttMessage &message)
+{
+    std::array<uint8_t, QUEUE_RECORD_HEADER_SIZE> header{};
+    header[0] = static_cast<uint8_t>((message.qos & 0x01) | (message.retain ? 0x02 : 0x00));
+    put_le(header.data() + 2, static_cast<uint16_t>(message.topic.size()));
+    put_le(header.data() + 4, static_cast<uint32_t>(message.payload.size()));
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(message.topic.data(), static_cast<std::streamsize>(message.topic.size()));
+    file.write(message.payload.data(), static_cast<std::streamsize>(message.payload.size()));
+}
+
+void write_queue_header(std::ofstream &file)
+{
+    std::array<uint8_t, QUEUE_FILE_HEADER_SIZE> header{};
+    put_le(header.data(), MQTT_QUEUE_MAGIC);
+    put_le(header.data() + 4, MQTT_QUEUE_FORMAT_VERSION);
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+}
+
+// Compressed with zlib at the fastest level; payloads that would not shrink
+// are sent as they are. Consumers tell them apart by the first byte: '['
+// for JSON, 0x78 for a zlib stream.
+std::string compress_payload(std::string json)
+{
+#ifdef CAPAROC_COMMANDER_HAVE_ZLIB
+    uLongf size = compressBound(static_cast<uLong>(json.size()));
+    std::string compressed(size, '\0');
+    if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &size, reinterpret_cast<const Bytef *>(json.data()),
+                  static_cast<uLong>(json.size()), Z_BEST_SPEED) == Z_OK &&
+        size < json.size())
+    {
+        compressed.resize(size);
+        return compressed;
+    }
+#endif
+    return json;
+}
+
+} // namespace
+
+bool mqtt_compression_supported()
+{
+#ifdef CAPAROC_COMMANDER_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+MqttPublisher::MqttPublisher(MqttPublisherSettings settings)
+    : settings_(std::move(settings)),
+      client_(settings_.host, settings_.port, settings_.client_id, settings_.keepalive_seconds)
+{
+    if (settings_.compress && !mqtt_compression_supported())
+    {
+        throw std::runtime_error("Payload compression needs a build with zlib");
+    }
+    settings_.batch = std::max(settings_.batch, 1);
+    settings_.queue_limit = std::max<std::size_t>(settings_.queue_limit, 1);
+    settings_.qos = std::min<uint8_t>(settings_.qos, 1);
+    if (!settings_.queue_file.empty())
+    {
+        load_queue_file();
+    }
+}
+
+MqttPublisher::~MqttPublisher()
+{
+    try
+    {
+        flush_samples();
+        if (connected())
+        {
+            auto give_up = Clock::now() + SHUTDOWN_GRACE;
+            while (connected() && (!queue_.empty() || client_.inflight() > 0) && Clock::now() < give_up)
+            {
+                service(std::chrono::milliseconds(50));
+            }
+            if (connected() && client_.publish({state_topic(), "OFFLINE", 1, true}))
+            {
+                client_.service(std::chrono::milliseconds(100));
+            }
+            client_.disconnect();
+        }
+
+        auto unacknowledged = client_.take_unacknowledged();
+        queue_.insert(queue_.begin(), std::make_move_iterator(unacknowledged.begin()), std::make_move_iterator(unacknowledged.end()));
+        if (!settings_.queue_file.empty())
+        {
+            rewrite_queue_file();
+        }
+    }
+    catch (...)
+    {
+        // Nothing sensible left to do with an I/O error while shutting down.
+    }
+}
+
+bool MqttPublisher::system_changed(const RackSnapshot &snapshot) const
+{
+    const auto &last = system_.last;
+    return !system_.reported || snapshot.valid != last.valid || snapshot.module_count != last.module_count ||
+           snapshot.input_voltage_cv != last.input_voltage_cv || snapshot.total_current_a != last.total_current_a ||
+           snapshot.sum_nominal_current_a != last.sum_nominal_current_a || snapshot.temperature_c != last.temperature_c ||
+           snapshot.global_flags != last.global_flags;
+}
+
+bool MqttPublisher::module_changed(const RackSnapshot &snapshot, std::size_t module) const
+{
+    const auto &topic = modules_[module];
+    if (!topic.reported || snapshot.channel_count[module] != topic.last.channel_count[module])
+    {
+        return true;
+    }
+    for (std::size_t channel = 0; channel < snapshot.channel_count[module] && channel < RACK_MAX_CHANNELS; ++channel)
+    {
+        const auto &now = snapshot.channels[module][channel];
+        const auto &before = topic.last.channels[module][channel];
+        if (now.flags != before.flags || std::abs(now.load_current_ma - before.load_current_ma) > settings_.deadband_ma)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MqttPublisher::add_sample(TopicState &topic, const RackSnapshot &snapshot, std::string sample)
+{
+    if (!topic.pending.empty())
+    {
+        topic.pending += ',';
+    }
+    topic.pending += sample;
+    topic.last = snapshot;
+    topic.reported = true;
+    ++stats_.samples;
+}
+
+void MqttPublisher::publish(const RackSnapshot &snapshot)
+{
+    ++stats_.polls;
+    bool full = full_publish_ || (settings_.full_every > 0 && stats_.polls % static_cast<uint64_t>(settings_.full_every) == 0);
+    full_publish_ = false;
+
+    if (full || system_changed(snapshot))
+    {
+        add_sample(system_, snapshot, rack_system_json(snapshot));
+    }
+    auto modules = std::min<std::size_t>(snapshot.module_count, RACK_MAX_MODULES);
+    for (std::size_t module = 0; module < modules; ++module)
+    {
+        if (full || module_changed(snapshot, module))
+        {
+            add_sample(modules_[module], snapshot, rack_module_json(snapshot, module));
+        }
+    }
+
+    if (stats_.polls % static_cast<uint64_t>(settings_.batch) == 0)
+    {
+        flush_samples();
+    }
+}
+
+void MqttPublisher::flush_samples()
+{
+    auto flush = [this](TopicState &topic, std::string name)
+    {
+        if (topic.pending.empty())
+        {
+            return;
+        }
+        std::string json = "[" + topic.pending + "]";
+        topic.pending.clear();
+        stats_.json_bytes += json.size();
+        enqueue({settings_.topic_prefix + name, settings_.compress ? compress_payload(std::move(json)) : std::move(json), settings_.qos, false});
+    };
+
+    flush(system_, "/system");
+    for (std::size_t module = 0; module < RACK_MAX_MODULES; ++module)
+    {
+        flush(modules_[module], std::format("/module/{}", module + 1));
+    }
+}
+
+void MqttPublisher::enqueue(MqttMessage message)
+{
+    stats_.payload_bytes += message.payload.size();
+    queue_.push_back(std::move(message));
+    while (queue_.size() > settings_.queue_limit)
+    {
+        queue_.pop_front();
+        ++stats_.dropped;
+    }
+    if (!connected() && !settings_.queue_file.empty())
+    {
+        append_to_queue_file(queue_.back());
+    }
+}
+
+bool MqttPublisher::connect()
+{
+    if (!client_.connect({state_topic(), "OFFLINE", 1, true}, settings_.connect_timeout_seconds))
+    {
+        return false;
+    }
+    ++stats_.connects;
+    backoff_ = std::chrono::seconds(1);
+    // Subscribers may have missed changes while we were away.
+    full_publish_ = true;
+    return client_.publish({state_topic(), "ONLINE", 1, true});
+}
+
+void MqttPublisher::lost_connection()
+{
+    auto unacknowledged = client_.take_unacknowledged();
+    queue_.insert(queue_.begin(), std::make_move_iterator(unacknowledged.begin()), std::make_move_iterator(unacknowledged.end()));
+    while (queue_.size() > settings_.queue_limit)
+    {
+        queue_.pop_front();
+        ++stats_.dropped;
+    }
+    if (!settings_.queue_file.empty())
+    {
+        rewrite_queue_file();
+    }
+    next_connect_ = Clock::now() + backoff_;
+    backoff_ = std::min(backoff_ * 2, MAX_BACKOFF);
+}
+
+void MqttPublisher::drain()
+{
+    while (!queue_.empty() && client_.inflight() < MqttClient::MAX_INFLIGHT)
+    {
+        if (!client_.publish(queue_.front()))
+        {
+            lost_connection();
+            return;
+        }
+        queue_.pop_front();
+        ++stats_.messages;
+    }
+    // The file is only dropped once nothing in it can be lost any more.
+    if (queue_.empty() && client_.inflight() == 0 && queue_file_records_ > 0)
+    {
+        remove_queue_file();
+    }
+}
+
+void MqttPublisher::service(std::chrono::milliseconds wait)
+{
+    if (!connected())
+    {
+        if (Clock::now() < next_connect_)
+        {
+            std::this_thread::sleep_for(std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(next_connect_ - Clock::now())));
+            return;
+        }
+        if (!connect())
+        {
+            lost_connection();
+            return;
+        }
+    }
+
+    drain();
+    if (connected() && !client_.service(wait))
+    {
+        lost_connection();
+        return;
+    }
+    // Acknowledgements may have made room for more.
+    if (connected())
+    {
+        drain();
+    }
+    if (connected() && !client_.flush())
+    {
+        lost_connection();
+    }
+}
+
+void MqttPublisher::load_queue_file()
+{
+    std::ifstream file(settings_.queue_file, std::ios::binary);
+    if (!file)
+    {
+        return;
+    }
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (bytes.size() < QUEUE_FILE_HEADER_SIZE || get_le<uint32_t>(bytes.data()) != MQTT_QUEUE_MAGIC)
+    {
+        throw std::runtime_error(std::format("'{}' is not an MQTT queue file", settings_.queue_file));
+    }
+    if (auto version = get_le<uint16_t>(bytes.data() + 4); version != MQTT_QUEUE_FORMAT_VERSION)
+    {
+        throw std::runtime_error(std::format("MQTT queue file '{}' has unsupported version {}", settings_.queue_file, version));
+    }
+
+    // A record cut short by a crash ends the queue.
+    std::size_t offset = QUEUE_FILE_HEADER_SIZE;
+    while (bytes.size() - offset >= QUEUE_RECORD_HEADER_SIZE)
+    {
+        const uint8_t *header = bytes.data() + offset;
+        std::size_t topic_length = get_le<uint16_t>(header + 2);
+        std::size_t payload_length = get_le<uint32_t>(header + 4);
+        if (bytes.size() - offset - QUEUE_RECORD_HEADER_SIZE < topic_length + payload_length)
+        {
+            break;
+        }
+        const char *text = reinterpret_cast<const char *>(header + QUEUE_RECORD_HEADER_SIZE);
+        queue_.push_back({std::string(text, topic_length), std::string(text + topic_length, payload_length),
+                          static_cast<uint8_t>(header[0] & 0x01), (header[0] & 0x02) != 0});
+        offset += QUEUE_RECORD_HEADER_SIZE + topic_length + payload_length;
+        ++queue_file_records_;
+    }
+    while (queue_.size() > settings_.queue_limit)
+    {
+        queue_.pop_front();
+        ++stats_.dropped;
+    }
+}
+
+void MqttPublisher::rewrite_queue_file()
+{
+    if (queue_.empty())
+    {
+        remove_queue_file();
+        return;
+    }
+
+    queue_out_.close();
+    auto temporary = settings_.queue_file + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        write_queue_header(file);
+        for (const auto &message : queue_)
+        {
+            write_queue_record(file, message);
+        }
+        if (!file.flush())
+        {
+            throw std::runtime_error(std::format("Cannot write MQTT queue file '{}'", temporary));
+        }
+    }
+    std::filesystem::rename(temporary, settings_.queue_file);
+    queue_file_records_ = queue_.size();
+}
+
+void MqttPublisher::append_to_queue_file(const MqttMessage &message)
+{
+    // Dropped messages are only removed from the file now and then.
+    if (queue_file_records_ == 0 || queue_file_records_ >= 2 * settings_.queue_limit)
+    {
+        rewrite_queue_file();
+        return;
+    }
+    if (!queue_out_.is_open())
+    {
+        queue_out_.open(settings_.queue_file, std::ios::binary | std::ios::app);
+    }
+    write_queue_record(queue_out_, message);
+    if (!queue_out_.flush())
+    {
+        throw std::runtime_error(std::format("Cannot write MQTT queue file '{}'", settings_.queue_file));
+    }
+    ++queue_file_records_;
+}
+
+void MqttPublisher::remove_queue_file()
+{
+    queue_out_.close();
+    std::error_code ignored;
+    std::filesystem::remove(settings_.queue_file, ignored);
+    queue_file_records_ = 0;
+}
+
+} // namespace cli
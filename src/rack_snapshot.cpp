@@ -0,0 +1,284 @@
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <format>
+
+namespace cli {
+
+namespace {
+
+uint16_t to_flags(const caparoc::ChannelStatus &status)
+{
+    uint16_t flags = channel_flag::VALID;
+    flags |= status.warning_80_percent ? channel_flag::WARNING_80_PERCENT : 0;
+    flags |= status.overload ? channel_flag::OVERLOAD : 0;
+    flags |= status.short_circuit ? channel_flag::SHORT_CIRCUIT : 0;
+    flags |= status.hardware_error ? channel_flag::HARDWARE_ERROR : 0;
+    flags |= status.voltage_error ? channel_flag::VOLTAGE_ERROR : 0;
+    flags |= status.module_current_too_high ? channel_flag::MODULE_CURRENT_TOO_HIGH : 0;
+    flags |= status.system_current_too_high ? channel_flag::SYSTEM_CURRENT_TOO_HIGH : 0;
+    return flags;
+}
+
+uint16_t to_flags(const caparoc::GlobalStatus &status)
+{
+    uint16_t flags = 0;
+    flags |= status.undervoltage ? global_flag::UNDERVOLTAGE : 0;
+    flags |= status.overvoltage ? global_flag::OVERVOLTAGE : 0;
+    flags |= status.cumulative_channel_error ? global_flag::CUMULATIVE_CHANNEL_ERROR : 0;
+    flags |= status.cumulative_80_warning ? global_flag::CUMULATIVE_80_WARNING : 0;
+    flags |= status.system_current_too_high ? global_flag::SYSTEM_CURRENT_TOO_HIGH : 0;
+    return flags;
+}
+
+} // namespace
+
+int channels_from_product_name(std::string_view product_name)
+{
+    for (std::size_t i = 0; i + 1 < product_name.size(); ++i)
+    {
+        bool word_start = i == 0 || product_name[i - 1] == ' ';
+        if (word_start && product_name[i] == 'E' && std::isdigit(static_cast<unsigned char>(product_name[i + 1])))
+        {
+            int channels = product_name[i + 1] - '0';
+            if (channels >= 1 && channels <= static_cast<int>(RACK_MAX_CHANNELS))
+            {
+                return channels;
+            }
+        }
+    }
+    return static_cast<int>(RACK_MAX_CHANNELS);
+}
+
+RackSnapshot RackPoller::poll(libmodbus_cpp::ModbusConnection &conn)
+{
+    auto start = std::chrono::steady_clock::now();
+    RackSnapshot snapshot{};
+
+    if (auto count = read_register(conn, registers::NUM_CONNECTED_MODULES))
+    {
+        snapshot.valid |= rack_valid::MODULE_COUNT;
+        snapshot.module_count = std::min<uint16_t>(*count, RACK_MAX_MODULES);
+        if (snapshot.module_count != module_count_)
+        {
+            module_count_ = snapshot.module_count;
+            channel_count_.fill(0);
+            for (int module = 1; module <= module_count_; ++module)
+            {
+                auto name = caparoc::get_product_name_module(conn, static_cast<uint8_t>(module));
+                channel_count_[module - 1] = static_cast<uint8_t>(name ? channels_from_product_name(*name) : RACK_MAX_CHANNELS);
+            }
+        }
+        snapshot.channel_count = channel_count_;
+    }
+
+    if (auto status = caparoc::get_global_status(conn))
+    {
+        snapshot.valid |= rack_valid::GLOBAL_STATUS;
+        snapshot.global_flags = to_flags(*status);
+    }
+    if (auto voltage = caparoc::get_input_voltage(conn))
+    {
+        snapshot.valid |= rack_valid::INPUT_VOLTAGE;
+        snapshot.input_voltage_cv = *voltage;
+    }
+    if (auto current = caparoc::get_total_system_current(conn))
+    {
+        snapshot.valid |= rack_valid::TOTAL_CURRENT;
+        snapshot.total_current_a = *current;
+    }
+    if (auto nominal = caparoc::get_sum_of_nominal_currents(conn))
+    {
+        snapshot.valid |= rack_valid::SUM_NOMINAL_CURRENT;
+        snapshot.sum_nominal_current_a = *nominal;
+    }
+    if (auto temperature = caparoc::get_internal_temperature(conn))
+    {
+        snapshot.valid |= rack_valid::TEMPERATURE;
+        snapshot.temperature_c = *temperature;
+    }
+
+    for (std::size_t m = 0; m < snapshot.module_count; ++m)
+    {
+        for (std::size_t c = 0; c < snapshot.channel_count[m]; ++c)
+        {
+            auto module = static_cast<uint8_t>(m + 1);
+            auto channel = static_cast<uint8_t>(c + 1);
+            auto status = caparoc::get_channel_status(conn, module, channel);
+            auto current = caparoc::get_load_current(conn, module, channel);
+            if (status && current)
+            {
+                snapshot.channels[m][c] = {*current, to_flags(*status)};
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    snapshot.poll_duration_us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    snapshot.timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                      std::chrono::system_clock::now().time_since_epoch())
+                                                      .count());
+    return snapshot;
+}
+
+RackSnapshot RackPoller::poll_module(libmodbus_cpp::ModbusConnection &conn, uint8_t module)
+{
+    auto start = std::chrono::steady_clock::now();
+    RackSnapshot snapshot{};
+    if (module_count_ >= 0)
+    {
+        snapshot.module_count = static_cast<uint16_t>(module_count_);
+        snapshot.channel_count = channel_count_;
+    }
+
+    if (auto voltage = caparoc::get_input_voltage(conn))
+    {
+        snapshot.valid |= rack_valid::INPUT_VOLTAGE;
+        snapshot.input_voltage_cv = *voltage;
+    }
+    if (module >= 1 && module <= snapshot.module_count)
+    {
+        for (std::size_t c = 0; c < snapshot.channel_count[module - 1]; ++c)
+        {
+            auto channel = static_cast<uint8_t>(c + 1);
+            auto status = caparoc::get_channel_status(conn, module, channel);
+            auto current = caparoc::get_load_current(conn, module, channel);
+            if (status && current)
+            {
+                snapshot.channels[module - 1][c] = {*current, to_flags(*status)};
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    snapshot.poll_duration_us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    snapshot.timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                      std::chrono::system_clock::now().time_since_epoch())
+                                                      .count());
+    return snapshot;
+}
+
+std::string describe_channel_flags(uint16_t flags)
+{
+    if (!(flags & channel_flag::VALID))
+    {
+        return "no data";
+    }
+    std::string text;
+    auto add = [&](uint16_t bit, std::string_view name)
+    {
+        if (flags & bit)
+        {
+            text += text.empty() ? "" : ", ";
+            text += name;
+        }
+    };
+    add(channel_flag::WARNING_80_PERCENT, "80% warning");
+    add(channel_flag::OVERLOAD, "overload");
+    add(channel_flag::SHORT_CIRCUIT, "short circuit");
+    add(channel_flag::HARDWARE_ERROR, "hardware error");
+    add(channel_flag::VOLTAGE_ERROR, "voltage error");
+    add(channel_flag::MODULE_CURRENT_TOO_HIGH, "module current too high");
+    add(channel_flag::SYSTEM_CURRENT_TOO_HIGH, "system current too high");
+    return text.empty() ? "ok" : text;
+}
+
+std::string describe_global_flags(uint16_t flags)
+{
+    std::string text;
+    auto add = [&](uint16_t bit, std::string_view name)
+    {
+        if (flags & bit)
+        {
+            text += text.empty() ? "" : ", ";
+            text += name;
+        }
+    };
+    add(global_flag::UNDERVOLTAGE, "undervoltage");
+    add(global_flag::OVERVOLTAGE, "overvoltage");
+    add(global_flag::CUMULATIVE_CHANNEL_ERROR, "channel error");
+    add(global_flag::CUMULATIVE_80_WARNING, "80% warning");
+    add(global_flag::SYSTEM_CURRENT_TOO_HIGH, "system current too high");
+    return text.empty() ? "ok" : text;
+}
+
+std::string format_rack_snapshot(const RackSnapshot &snapshot)
+{
+    auto value_or_dash = [&](uint16_t bit, auto value)
+    { return (snapshot.valid & bit) ? value : std::string("-"); };
+
+    std::string out;
+    out += std::format("Modules: {}\n", value_or_dash(rack_valid::MODULE_COUNT, std::to_string(snapshot.module_count)));
+    out += std::format("Input Voltage: {}\n", value_or_dash(rack_valid::INPUT_VOLTAGE, std::format("{:.2f} V", snapshot.input_voltage_cv / 100.0)));
+    out += std::format("Total System Current: {}\n", value_or_dash(rack_valid::TOTAL_CURRENT, std::format("{} A", snapshot.total_current_a)));
+    out += std::format("Sum of Nominal Currents: {}\n", value_or_dash(rack_valid::SUM_NOMINAL_CURRENT, std::format("{} A", snapshot.sum_nominal_current_a)));
+    out += std::format("Internal Temperature: {}\n", value_or_dash(rack_valid::TEMPERATURE, std::format("{} °C", snapshot.temperature_c)));
+
+    std::string global = (snapshot.valid & rack_valid::GLOBAL_STATUS) ? describe_global_flags(snapshot.global_flags) : std::string("-");
+    out += std::format("Global Status: {}\n", global);
+
+    out += std::format("  {:>6} {:>7} {:>9}  {}", "Module", "Channel", "Load [mA]", "Status");
+    for (std::size_t m = 0; m < snapshot.module_count; ++m)
+    {
+        for (std::size_t c = 0; c < snapshot.channel_count[m]; ++c)
+        {
+            const auto &channel = snapshot.channels[m][c];
+            bool valid = channel.flags & channel_flag::VALID;
+            out += std::format("\n  {:>6} {:>7} {:>9}  {}", m + 1, c + 1,
+                               valid ? std::to_string(channel.load_current_ma) : std::string("-"),
+                               describe_channel_flags(channel.flags));
+        }
+    }
+    return out;
+}
+
+std::string rack_system_json(const RackSnapshot &snapshot)
+{
+    std::string json = std::format("{{\"ts\":{}", snapshot.timestamp_ns / 1'000'000);
+    if (snapshot.valid & rack_valid::MODULE_COUNT)
+    {
+        json += std::format(",\"modules\":{}", snapshot.module_count);
+    }
+    if (snapshot.valid & rack_valid::INPUT_VOLTAGE)
+    {
+        json += std::format(",\"input_voltage\":{}.{:02}", snapshot.input_voltage_cv / 100, snapshot.input_voltage_cv % 100);
+    }
+    if (snapshot.valid & rack_valid::TOTAL_CURRENT)
+    {
+        json += std::format(",\"total_current\":{}", snapshot.total_current_a);
+    }
+    if (snapshot.valid & rack_valid::SUM_NOMINAL_CURRENT)
+    {
+        json += std::format(",\"sum_nominal_current\":{}", snapshot.sum_nominal_current_a);
+    }
+    if (snapshot.valid & rack_valid::TEMPERATURE)
+    {
+        json += std::format(",\"temperature\":{}", snapshot.temperature_c);
+    }
+    if (snapshot.valid & rack_valid::GLOBAL_STATUS)
+    {
+        json += std::format(",\"flags\":{}", snapshot.global_flags);
+    }
+    json += '}';
+    return json;
+}
+
+std::string rack_module_json(const RackSnapshot &snapshot, std::size_t module)
+{
+    std::string currents;
+    std::string flags;
+    for (std::size_t channel = 0; channel < snapshot.channel_count[module] && channel < RACK_MAX_CHANNELS; ++channel)
+    {
+        const auto &values = snapshot.channels[module][channel];
+        const char *separator = channel == 0 ? "" : ",";
+        currents += (values.flags & channel_flag::VALID) ? std::format("{}{}", separator, values.load_current_ma) : std::format("{}null", separator);
+        flags += std::format("{}{}", separator, values.flags);
+    }
+    return std::format("{{\"ts\":{},\"current_ma\":[{}],\"flags\":[{}]}}", snapshot.timestamp_ns / 1'000'000, currents, flags);
+}
+
+} // namespace cli
@@ -0,0 +1,281 @@
+#include "caparoc_commander/realtime.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t PREFAULT_HEAP_BYTES = 8 * 1024 * 1024;
+constexpr std::size_t PREFAULT_STACK_BYTES = 256 * 1024;
+
+// glibc's defaults; mallopt() has no getter, so these are what restore() goes back to.
+constexpr int MALLOC_DEFAULT_TRIM_THRESHOLD = 128 * 1024;
+constexpr int MALLOC_DEFAULT_MMAP_MAX = 65536;
+
+void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+#ifdef __linux__
+
+std::string privilege_error(std::string_view what, int error, std::string_view privilege)
+{
+    if (error == EPERM || error == ENOMEM || error == EAGAIN)
+    {
+        return std::format("Cannot {}: {} (needs {})", what, std::strerror(error), privilege);
+    }
+    return std::format("Cannot {}: {}", what, std::strerror(error));
+}
+
+// Touch the stack once, so its pages are resident (and locked) before the loop needs them.
+[[gnu::noinline]] void prefault_stack()
+{
+    volatile char stack[PREFAULT_STACK_BYTES];
+    for (std::size_t i = 0; i < sizeof(stack); i += 4096)
+    {
+        stack[i] = 0;
+    }
+}
+
+void prefault_heap()
+{
+    // Freed memory stays with malloc instead of going back to the system,
+    // and large blocks come from the (locked) heap instead of fresh mmaps.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    auto *block = static_cast<volatile char *>(std::malloc(PREFAULT_HEAP_BYTES));
+    if (block)
+    {
+        for (std::size_t i = 0; i < PREFAULT_HEAP_BYTES; i += 4096)
+        {
+            block[i] = 0;
+        }
+        std::free(const_cast<char *>(block));
+    }
+}
+
+#endif
+
+} // namespace
+
+void spin_until(std::chrono::steady_clock::time_point deadline)
+{
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        cpu_relax();
+    }
+}
+
+#ifdef __linux__
+
+RealtimeScope::RealtimeScope(const RealtimeSettings &settings) : settings_(settings)
+{
+    try
+    {
+        if (settings_.lock_memory)
+        {
+            if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+            {
+                throw std::runtime_error(privilege_error("lock memory", errno, "CAP_IPC_LOCK or a larger memlock limit"));
+            }
+            memory_locked_ = true;
+            prefault_heap();
+            prefault_stack();
+        }
+
+        if (settings_.cpu >= 0)
+        {
+            cpu_set_t old_set;
+            CPU_ZERO(&old_set);
+            if (::sched_getaffinity(0, sizeof(old_set), &old_set) != 0)
+            {
+                throw std::runtime_error(privilege_error("read the CPU affinity", errno, ""));
+            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(settings_.cpu, &set);
+            if (settings_.cpu >= CPU_SETSIZE || ::sched_setaffinity(0, sizeof(set), &set) != 0)
+            {
+                throw std::runtime_error(std::format("Cannot pin the polling thread to CPU {}: {}", settings_.cpu,
+                                                     settings_.cpu >= CPU_SETSIZE ? "no such CPU" : std::strerror(errno)));
+            }
+            old_affinity_.resize(sizeof(old_set));
+            std::memcpy(old_affinity_.data(), &old_set, sizeof(old_set));
+            affinity_changed_ = true;
+        }
+
+        if (settings_.priority > 0)
+        {
+            sched_param old_param{};
+            if (auto error = ::pthread_getschedparam(::pthread_self(), &old_policy_, &old_param); error != 0)
+            {
+                throw std::runtime_error(privilege_error("read the scheduling policy", error, ""));
+            }
+            old_priority_ = old_param.sched_priority;
+
+            sched_param param{};
+            param.sched_priority = std::clamp(settings_.priority, ::sched_get_priority_min(SCHED_FIFO), ::sched_get_priority_max(SCHED_FIFO));
+            if (auto error = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param); error != 0)
+            {
+                throw std::runtime_error(privilege_error(std::format("switch to SCHED_FIFO priority {}", param.sched_priority), error,
+                                                         "CAP_SYS_NICE or an rtprio limit"));
+            }
+            scheduler_changed_ = true;
+        }
+    }
+    catch (...)
+    {
+        restore();
+        throw;
+    }
+}
+
+RealtimeScope::~RealtimeScope()
+{
+    restore();
+}
+
+void RealtimeScope::restore()
+{
+    if (scheduler_changed_)
+    {
+        sched_param param{};
+        param.sched_priority = old_priority_;
+        ::pthread_setschedparam(::pthread_self(), old_policy_, &param);
+        scheduler_changed_ = false;
+    }
+    if (affinity_changed_)
+    {
+        cpu_set_t set;
+        std::memcpy(&set, old_affinity_.data(), sizeof(set));
+        ::sched_setaffinity(0, sizeof(set), &set);
+        affinity_changed_ = false;
+    }
+    if (memory_locked_)
+    {
+        mallopt(M_TRIM_THRESHOLD, MALLOC_DEFAULT_TRIM_THRESHOLD);
+        mallopt(M_MMAP_MAX, MALLOC_DEFAULT_MMAP_MAX);
+        ::munlockall();
+        memory_locked_ = false;
+    }
+}
+
+#else
+
+RealtimeScope::RealtimeScope(const RealtimeSettings &settings) : settings_(settings)
+{
+    if (settings_.active())
+    {
+        throw std::runtime_error("Real-time scheduling is only supported on Linux");
+    }
+}
+
+RealtimeScope::~RealtimeScope() = default;
+
+void RealtimeScope::restore()
+{
+}
+
+#endif
+
+std::string RealtimeScope::describe() const
+{
+    std::string text;
+    auto add = [&](std::string part)
+    {
+        text += text.empty() ? part : ", " + part;
+    };
+    if (settings_.priority > 0)
+    {
+        add(std::format("SCHED_FIFO {}", settings_.priority));
+    }
+    if (settings_.cpu >= 0)
+    {
+        add(std::format("CPU {}", settings_.cpu));
+    }
+    if (settings_.lock_memory)
+    {
+        add("memory locked");
+    }
+    if (settings_.spin.count() > 0)
+    {
+        add(std::format("{} µs spin", settings_.spin.count()));
+    }
+    return text.empty() ? "normal scheduling" : text;
+}
+
+void JitterHistogram::add(std::chrono::nanoseconds lateness)
+{
+    auto us = std::max(0.0, std::chrono::duration<double, std::micro>(lateness).count());
+    std::size_t bucket = 0;
+    while (bucket < BOUNDS_US.size() && us > BOUNDS_US[bucket])
+    {
+        ++bucket;
+    }
+    ++buckets_[bucket];
+    ++count_;
+    sum_us_ += us;
+    max_us_ = std::max(max_us_, us);
+}
+
+double JitterHistogram::quantile_bound_us(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0.0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_)));
+    uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < BOUNDS_US.size(); ++bucket)
+    {
+        seen += buckets_[bucket];
+        if (seen >= rank)
+        {
+            return BOUNDS_US[bucket];
+        }
+    }
+    return max_us_;
+}
+
+std::string JitterHistogram::format() const
+{
+    auto text = std::format("Poll start lateness over {} poll(s): mean {:.3f} ms, p99 <= {:.3f} ms, max {:.3f} ms", count_,
+                            count_ ? sum_us_ / static_cast<double>(count_) / 1000.0 : 0.0, quantile_bound_us(0.99) / 1000.0, max_us_ / 1000.0);
+    std::size_t last = 0;
+    for (std::size_t bucket = 0; bucket < buckets_.size(); ++bucket)
+    {
+        last = buckets_[bucket] ? bucket : last;
+    }
+    for (std::size_t bucket = 0; count_ > 0 && bucket <= last; ++bucket)
+    {
+        auto share = static_cast<double>(buckets_[bucket]) / static_cast<double>(count_);
+        auto label = bucket < BOUNDS_US.size() ? std::format("<= {:>6.3f} ms", BOUNDS_US[bucket] / 1000.0)
+                                               : std::format(" > {:>6.3f} ms", BOUNDS_US.back() / 1000.0);
+        text += std::format("\n  {}  {:>8}  {:>5.1f} %", label, buckets_[bucket], share * 100.0);
+        if (auto bar = static_cast<std::size_t>(std::lround(share * 40.0)); bar > 0)
+        {
+            text += "  " + std::string(bar, '#');
+        }
+    }
+    return text;
+}
+
+} // namespace cli
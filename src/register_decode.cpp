@@ -0,0 +1,179 @@
+#include "caparoc_commander/register_decode.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CAPAROC_DECODE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define CAPAROC_DECODE_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CAPAROC_DECODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+// Every kernel handles as many elements as its vector width allows and
+// returns how many it processed; the scalar code finishes the tail.
+
+struct DecodeKernels {
+    std::size_t (*be_words)(const uint8_t *bytes, uint16_t *out, std::size_t count);
+};
+
+std::size_t none_be_words(const uint8_t *, uint16_t *, std::size_t) { return 0; }
+
+constexpr DecodeKernels SCALAR_KERNELS{none_be_words};
+
+#ifdef CAPAROC_DECODE_SSE2
+
+std::size_t sse2_be_words(const uint8_t *bytes, uint16_t *out, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 2 * i));
+        words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), words);
+    }
+    return i;
+}
+
+constexpr DecodeKernels SSE2_KERNELS{sse2_be_words};
+
+#endif
+
+#ifdef CAPAROC_DECODE_AVX2
+
+__attribute__((target("avx2"))) std::size_t avx2_be_words(const uint8_t *bytes, uint16_t *out, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        auto words = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + 2 * i));
+        words = _mm256_or_si256(_mm256_slli_epi16(words, 8), _mm256_srli_epi16(words, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), words);
+    }
+    return i;
+}
+
+constexpr DecodeKernels AVX2_KERNELS{avx2_be_words};
+
+#endif
+
+#ifdef CAPAROC_DECODE_NEON
+
+std::size_t neon_be_words(const uint8_t *bytes, uint16_t *out, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_u16(out + i, vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(bytes + 2 * i))));
+    }
+    return i;
+}
+
+constexpr DecodeKernels NEON_KERNELS{neon_be_words};
+
+#endif
+
+const DecodeKernels *kernels_for(DecodeBackend backend)
+{
+    switch (backend)
+    {
+    case DecodeBackend::SCALAR:
+        return &SCALAR_KERNELS;
+#ifdef CAPAROC_DECODE_SSE2
+    case DecodeBackend::SSE2:
+        return &SSE2_KERNELS;
+#endif
+#ifdef CAPAROC_DECODE_AVX2
+    case DecodeBackend::AVX2:
+        return __builtin_cpu_supports("avx2") ? &AVX2_KERNELS : nullptr;
+#endif
+#ifdef CAPAROC_DECODE_NEON
+    case DecodeBackend::NEON:
+        return &NEON_KERNELS;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+struct ActiveBackend {
+    DecodeBackend backend;
+    const DecodeKernels *kernels;
+};
+
+ActiveBackend &active()
+{
+    static ActiveBackend state = []
+    {
+        auto backend = available_decode_backends().back();
+        return ActiveBackend{backend, kernels_for(backend)};
+    }();
+    return state;
+}
+
+} // namespace
+
+std::vector<DecodeBackend> available_decode_backends()
+{
+    std::vector<DecodeBackend> backends;
+    for (auto backend : {DecodeBackend::SCALAR, DecodeBackend::SSE2, DecodeBackend::AVX2, DecodeBackend::NEON})
+    {
+        if (kernels_for(backend))
+        {
+            backends.push_back(backend);
+        }
+    }
+    return backends;
+}
+
+DecodeBackend active_decode_backend()
+{
+    return active().backend;
+}
+
+bool select_decode_backend(DecodeBackend backend)
+{
+    auto kernels = kernels_for(backend);
+    if (!kernels)
+    {
+        return false;
+    }
+    active() = {backend, kernels};
+    return true;
+}
+
+std::string_view to_string(DecodeBackend backend)
+{
+    switch (backend)
+    {
+    case DecodeBackend::SCALAR:
+        return "scalar";
+    case DecodeBackend::SSE2:
+        return "sse2";
+    case DecodeBackend::AVX2:
+        return "avx2";
+    case DecodeBackend::NEON:
+        return "neon";
+    }
+    return "unknown";
+}
+
+void decode_be_words(std::span<const uint8_t> bytes, std::span<uint16_t> out)
+{
+    auto count = std::min(bytes.size() / 2, out.size());
+    for (auto i = active().kernels->be_words(bytes.data(), out.data(), count); i < count; ++i)
+    {
+        out[i] = static_cast<uint16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+    }
+}
+
+} // namespace cli
@@ -0,0 +1,23 @@
+#include "caparoc_commander/register_descriptor.hpp"
+
+#include <charconv>
+
+namespace cli {
+
+uint16_t parse_register_address(std::string_view text)
+{
+    auto digits = text;
+    if (digits.starts_with("0x") || digits.starts_with("0X"))
+    {
+        digits.remove_prefix(2);
+    }
+    unsigned value = 0;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value, 16);
+    if (digits.empty() || ec != std::errc{} || end != digits.data() + digits.size() || value > 0xFFFF)
+    {
+        throw std::invalid_argument(std::format("invalid register address '{}' (expected 0x0000-0xFFFF)", text));
+    }
+    return static_cast<uint16_t>(value);
+}
+
+} // namespace cli
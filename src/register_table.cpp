@@ -0,0 +1,54 @@
+#include "caparoc_commander/register_table.hpp"
+
+#include <algorithm>
+
+namespace cli {
+
+namespace {
+
+#ifdef CAPAROC_COMMANDER_HAVE_REGISTER_TABLE
+// Generated by tools/generate_register_table.cpp:
+// constexpr RegisterEntry REGISTER_TABLE[] = { ... };
+// constexpr std::string_view REGISTER_LIST = "...";
+#include "register_table.inc"
+
+constexpr bool is_sorted_by_address()
+{
+    for (std::size_t i = 1; i < std::size(REGISTER_TABLE); ++i)
+    {
+        if (REGISTER_TABLE[i - 1].address > REGISTER_TABLE[i].address)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(is_sorted_by_address(), "register_table.inc must be sorted by address");
+
+constexpr std::span<const RegisterEntry> TABLE{REGISTER_TABLE};
+#else
+constexpr std::span<const RegisterEntry> TABLE{};
+constexpr std::string_view REGISTER_LIST{};
+#endif
+
+} // namespace
+
+std::span<const RegisterEntry> register_table()
+{
+    return TABLE;
+}
+
+std::string_view register_list()
+{
+    return REGISTER_LIST;
+}
+
+const RegisterEntry *find_register(uint16_t address)
+{
+    auto it = std::lower_bound(TABLE.begin(), TABLE.end(), address, [](const RegisterEntry &entry, uint16_t value)
+                               { return entry.address < value; });
+    return (it != TABLE.end() && it->address == address) ? &*it : nullptr;
+}
+
+} // namespace cli
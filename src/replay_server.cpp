@@ -0,0 +1,386 @@
+#include "caparoc_commander/replay_server.hpp"
+#include "caparoc_commander/modbus_frame.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <queue>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint8_t EXCEPTION_ILLEGAL_DATA_VALUE = 0x03;
+constexpr uint8_t EXCEPTION_SERVER_DEVICE_FAILURE = 0x04;
+
+// Everything after the transaction id, protocol id and length field
+std::vector<uint8_t> request_key(std::span<const uint8_t> adu)
+{
+    return {adu.begin() + 6, adu.end()};
+}
+
+uint16_t word_at(std::span<const uint8_t> adu, std::size_t offset)
+{
+    return static_cast<uint16_t>((adu[offset] << 8) | adu[offset + 1]);
+}
+
+std::vector<uint8_t> exception_response(std::span<const uint8_t> request, uint8_t code)
+{
+    std::vector<uint8_t> adu(request.begin(), request.begin() + 7);
+    adu[4] = 0;
+    adu[5] = 3;
+    adu.push_back(static_cast<uint8_t>(request[7] | 0x80));
+    adu.push_back(code);
+    return adu;
+}
+
+// The registers a request writes, or reads according to its response
+void record_registers(std::span<const uint8_t> request, std::span<const uint8_t> response, std::unordered_map<uint16_t, uint16_t> &registers)
+{
+    auto function = static_cast<FunctionCode>(request[7]);
+    if (function == FunctionCode::WRITE_SINGLE_REGISTER && request.size() >= 12)
+    {
+        registers[word_at(request, 8)] = word_at(request, 10);
+    }
+    else if (function == FunctionCode::WRITE_MULTIPLE_REGISTERS && request.size() >= 13)
+    {
+        auto address = word_at(request, 8);
+        for (std::size_t i = 0; 13 + 2 * i + 1 < request.size() && i < word_at(request, 10); ++i)
+        {
+            registers[static_cast<uint16_t>(address + i)] = word_at(request, 13 + 2 * i);
+        }
+    }
+    else if (function == FunctionCode::READ_HOLDING_REGISTERS && request.size() >= 12 && !response.empty())
+    {
+        if (auto values = decode_read_registers_response(response))
+        {
+            auto address = word_at(request, 8);
+            for (std::size_t i = 0; i < values->size(); ++i)
+            {
+                registers[static_cast<uint16_t>(address + i)] = (*values)[i];
+            }
+        }
+    }
+}
+
+} // namespace
+
+#ifdef __linux__
+
+namespace {
+
+struct ClientConnection {
+    int fd = -1;
+    uint64_t id = 0;
+    std::vector<uint8_t> rx;
+};
+
+struct ScheduledResponse {
+    Clock::time_point due;
+    uint64_t connection_id;
+    std::vector<uint8_t> adu;
+
+    bool operator>(const ScheduledResponse &other) const { return due > other.due; }
+};
+
+} // namespace
+
+#endif
+
+ReplayServer::ReplayServer(const ModbusTrace &trace, int port, const std::string &address)
+    : address_(address)
+{
+    // Pair requests with responses per stream and transaction id.
+    std::unordered_map<uint32_t, std::size_t> pending;
+    std::unordered_map<uint32_t, uint64_t> request_time;
+    std::unordered_map<uint32_t, std::vector<uint8_t>> pending_request;
+    for (const auto &record : trace.records)
+    {
+        if ((record.kind != TraceRecordKind::REQUEST && record.kind != TraceRecordKind::RESPONSE) ||
+            record.data.size() < MBAP_HEADER_LENGTH + 1)
+        {
+            continue;
+        }
+        auto key = (uint32_t{record.stream} << 16) | adu_transaction_id(record.data);
+        if (record.kind == TraceRecordKind::REQUEST)
+        {
+            pending[key] = exchanges_.size();
+            request_time[key] = record.time_ns;
+            pending_request[key] = record.data;
+            by_request_[request_key(record.data)].push_back(exchanges_.size());
+            exchanges_.push_back({});
+        }
+        else if (auto it = pending.find(key); it != pending.end())
+        {
+            auto &exchange = exchanges_[it->second];
+            exchange.response = record.data;
+            exchange.latency = std::chrono::nanoseconds(record.time_ns - request_time[key]);
+            record_registers(pending_request[key], record.data, registers_);
+            pending.erase(it);
+        }
+    }
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    for (const auto &exchange : exchanges_)
+    {
+        if (!exchange.response.empty())
+        {
+            latencies.push_back(exchange.latency);
+        }
+    }
+    if (!latencies.empty())
+    {
+        auto middle = latencies.begin() + static_cast<std::ptrdiff_t>(latencies.size() / 2);
+        std::nth_element(latencies.begin(), middle, latencies.end());
+        typical_latency_ = *middle;
+    }
+
+#ifdef __linux__
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(static_cast<uint16_t>(port));
+    if (::inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1)
+    {
+        throw std::runtime_error(std::format("Replay server: invalid IPv4 address '{}'", address));
+    }
+
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+    {
+        throw std::runtime_error(std::format("Replay server: socket() failed: {}", std::strerror(errno)));
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    socklen_t length = sizeof(local);
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0 ||
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&local), &length) != 0)
+    {
+        auto error = std::runtime_error(std::format("Replay server: cannot listen on {}:{}: {}", address, port, std::strerror(errno)));
+        ::close(listen_fd_);
+        throw error;
+    }
+    port_ = ntohs(local.sin_port);
+#else
+    (void)port;
+    throw std::runtime_error("Trace replay is only supported on Linux");
+#endif
+}
+
+// Answer a register read or write from the register map, std::nullopt for other requests
+std::optional<std::vector<uint8_t>> ReplayServer::register_response(std::span<const uint8_t> request)
+{
+    if (request.size() < 12)
+    {
+        return std::nullopt;
+    }
+    auto function = static_cast<FunctionCode>(request[7]);
+    auto address = word_at(request, 8);
+    auto count = word_at(request, 10);
+    switch (function)
+    {
+    case FunctionCode::READ_HOLDING_REGISTERS:
+    {
+        if (count == 0 || count > MAX_READ_REGISTERS)
+        {
+            return exception_response(request, EXCEPTION_ILLEGAL_DATA_VALUE);
+        }
+        std::vector<uint8_t> adu(request.begin(), request.begin() + 8);
+        adu.push_back(static_cast<uint8_t>(2 * count));
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            auto it = registers_.find(static_cast<uint16_t>(address + i));
+            auto value = it != registers_.end() ? it->second : uint16_t{0};
+            adu.push_back(static_cast<uint8_t>(value >> 8));
+            adu.push_back(static_cast<uint8_t>(value & 0xFF));
+        }
+        auto length = adu.size() - 6;
+        adu[4] = static_cast<uint8_t>(length >> 8);
+        adu[5] = static_cast<uint8_t>(length & 0xFF);
+        return adu;
+    }
+    case FunctionCode::WRITE_SINGLE_REGISTER:
+    case FunctionCode::WRITE_MULTIPLE_REGISTERS:
+    {
+        record_registers(request, {}, registers_);
+        // Both acknowledge with the first five bytes of their PDU.
+        std::vector<uint8_t> adu(request.begin(), request.begin() + 12);
+        adu[4] = 0;
+        adu[5] = 6;
+        return adu;
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+#ifdef __linux__
+
+ReplayServer::~ReplayServer()
+{
+    ::close(listen_fd_);
+}
+
+ReplayStats ReplayServer::run(double speed, const std::function<bool()> &should_stop)
+{
+    ReplayStats stats;
+    std::vector<ClientConnection> connections;
+    std::priority_queue<ScheduledResponse, std::vector<ScheduledResponse>, std::greater<>> scheduled;
+    std::map<std::vector<uint8_t>, std::size_t> next_unused;  // position in by_request_ lists
+    uint64_t next_connection_id = 1;
+
+    auto schedule = [&](const ClientConnection &connection, std::span<const uint8_t> request)
+    {
+        auto key = request_key(request);
+        auto it = by_request_.find(key);
+        if (it == by_request_.end())
+        {
+            if (auto response = register_response(request))
+            {
+                ++stats.from_registers;
+                auto delay = speed > 0 ? std::chrono::duration_cast<Clock::duration>(typical_latency_ / speed) : Clock::duration::zero();
+                scheduled.push({Clock::now() + delay, connection.id, std::move(*response)});
+                return;
+            }
+            ++stats.unmatched;
+            scheduled.push({Clock::now(), connection.id, exception_response(request, EXCEPTION_SERVER_DEVICE_FAILURE)});
+            return;
+        }
+
+        auto &position = next_unused[key];
+        const auto &candidates = it->second;
+        const auto &exchange = exchanges_[candidates[std::min(position, candidates.size() - 1)]];
+        if (position < candidates.size())
+        {
+            ++position;
+            ++stats.matched;
+        }
+        else
+        {
+            ++stats.repeated;
+        }
+        if (exchange.response.empty())
+        {
+            ++stats.unanswered;
+            return;
+        }
+
+        auto delay = speed > 0 ? std::chrono::duration_cast<Clock::duration>(exchange.latency / speed) : Clock::duration::zero();
+        auto response = exchange.response;
+        response[0] = request[0];
+        response[1] = request[1];
+        scheduled.push({Clock::now() + delay, connection.id, std::move(response)});
+    };
+
+    std::vector<pollfd> fds;
+    while (!should_stop())
+    {
+        auto now = Clock::now();
+        while (!scheduled.empty() && scheduled.top().due <= now)
+        {
+            const auto &response = scheduled.top();
+            for (const auto &connection : connections)
+            {
+                if (connection.id == response.connection_id)
+                {
+                    ::send(connection.fd, response.adu.data(), response.adu.size(), MSG_NOSIGNAL);
+                }
+            }
+            scheduled.pop();
+        }
+
+        auto timeout = std::chrono::milliseconds(100);
+        if (!scheduled.empty())
+        {
+            timeout = std::min(timeout, std::chrono::ceil<std::chrono::milliseconds>(scheduled.top().due - now));
+        }
+
+        fds.clear();
+        fds.push_back({listen_fd_, POLLIN, 0});
+        for (const auto &connection : connections)
+        {
+            fds.push_back({connection.fd, POLLIN, 0});
+        }
+        if (::poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) <= 0)
+        {
+            continue;
+        }
+
+        for (std::size_t i = connections.size(); i-- > 0;)
+        {
+            if (!fds[i + 1].revents)
+            {
+                continue;
+            }
+            auto &connection = connections[i];
+            uint8_t buffer[4096];
+            auto received = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (received <= 0)
+            {
+                ::close(connection.fd);
+                connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+                continue;
+            }
+            connection.rx.insert(connection.rx.end(), buffer, buffer + received);
+            std::size_t length = 0;
+            while ((length = complete_adu_length(connection.rx)) != 0)
+            {
+                if (length > MBAP_HEADER_LENGTH)
+                {
+                    schedule(connection, std::span(connection.rx.data(), length));
+                }
+                connection.rx.erase(connection.rx.begin(), connection.rx.begin() + static_cast<std::ptrdiff_t>(length));
+            }
+        }
+
+        if (fds[0].revents)
+        {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                connections.push_back({fd, next_connection_id++, {}});
+                ++stats.connections;
+            }
+        }
+    }
+
+    for (const auto &connection : connections)
+    {
+        ::close(connection.fd);
+    }
+    return stats;
+}
+
+#else
+
+ReplayServer::~ReplayServer() = default;
+
+ReplayStats ReplayServer::run(double, const std::function<bool()> &)
+{
+    return {};
+}
+
+#endif
+
+} // namespace cli
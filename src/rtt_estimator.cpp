@@ -0,0 +1,59 @@
+#include "caparoc_commander/rtt_estimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace cli {
+
+namespace {
+
+constexpr double SRTT_GAIN = 1.0 / 8.0;
+constexpr double RTTVAR_GAIN = 1.0 / 4.0;
+constexpr double VARIATION_FACTOR = 4.0;
+constexpr double GRANULARITY_US = 1000.0;  // lower bound of the variation term
+constexpr RttEstimator::Duration INITIAL_TIMEOUT = std::chrono::seconds(1);
+
+} // namespace
+
+RttEstimator::RttEstimator(Duration min_timeout, Duration max_timeout)
+    : min_(min_timeout), max_(max_timeout), timeout_(max_timeout)
+{
+    if (min_timeout.count() <= 0 || max_timeout < min_timeout)
+    {
+        throw std::invalid_argument("Response timeout bounds must satisfy 0 < min <= max");
+    }
+    timeout_ = std::clamp(INITIAL_TIMEOUT, min_, max_);
+}
+
+void RttEstimator::sample(Duration rtt)
+{
+    auto r = static_cast<double>(std::max<int64_t>(rtt.count(), 0));
+    if (samples_ == 0)
+    {
+        srtt_us_ = r;
+        rttvar_us_ = r / 2.0;
+    }
+    else
+    {
+        // RTTVAR is updated first, with the previous SRTT.
+        rttvar_us_ = (1.0 - RTTVAR_GAIN) * rttvar_us_ + RTTVAR_GAIN * std::abs(srtt_us_ - r);
+        srtt_us_ = (1.0 - SRTT_GAIN) * srtt_us_ + SRTT_GAIN * r;
+    }
+    ++samples_;
+    update_timeout();
+}
+
+void RttEstimator::timed_out()
+{
+    ++timeouts_;
+    timeout_ = std::min(timeout_ * 2, max_);
+}
+
+void RttEstimator::update_timeout()
+{
+    auto us = srtt_us_ + std::max(GRANULARITY_US, VARIATION_FACTOR * rttvar_us_);
+    timeout_ = std::clamp(Duration(static_cast<int64_t>(std::ceil(us))), min_, max_);
+}
+
+} // namespace cli
@@ -0,0 +1,788 @@
+#include "caparoc_commander/shell.hpp"
+#include "caparoc_commander/portable_print.hpp"
+#include "caparoc_commander/register_table.hpp"
+#include "caparoc_commander/stop_signal.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+namespace cli {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t MAX_HISTORY = 1000;
+constexpr double DEFAULT_WATCH_INTERVAL_S = 1.0;
+
+constexpr std::string_view BUILTINS[] = {"exit", "help", "history", "quit", "repeat", "watch"};
+
+constexpr std::string_view SHELL_HELP = R"(Commands use the command-line syntax; the leading "--" may be omitted:
+  read-uint16 0x2004
+  get-load-current 1 2 --get-channel-status 1 2
+Register names can be used instead of addresses (Tab completes them).
+
+Built-in commands:
+  help                     this text; "help options" lists all options
+  history                  previous commands
+  watch [SECONDS] COMMAND  run COMMAND every SECONDS (default 1) until a key is pressed
+  repeat N COMMAND         run COMMAND N times and show the round-trip times
+  exit, quit               leave the shell (also Ctrl-D))";
+
+std::string to_lower(std::string_view text)
+{
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return lower;
+}
+
+bool parse_positive(std::string_view text, double &value)
+{
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc{} && end == text.data() + text.size() && value > 0;
+}
+
+// Splits at whitespace; double quotes group words containing spaces.
+std::vector<std::string> split_words(std::string_view line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool in_word = false;
+    bool quoted = false;
+    for (char c : line)
+    {
+        if (c == '"')
+        {
+            quoted = !quoted;
+            in_word = true;
+        }
+        else if (!quoted && std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (in_word)
+            {
+                words.push_back(std::exchange(word, {}));
+                in_word = false;
+            }
+        }
+        else
+        {
+            word += c;
+            in_word = true;
+        }
+    }
+    if (in_word)
+    {
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+/**
+ * Sorted word list answering prefix queries by binary search. Keys are
+ * lower case, so lookups ignore case.
+ */
+class PrefixIndex {
+public:
+    void add(std::string word)
+    {
+        auto key = to_lower(word);
+        entries_.push_back({std::move(key), std::move(word)});
+    }
+
+    void build()
+    {
+        std::sort(entries_.begin(), entries_.end());
+        entries_.erase(std::unique(entries_.begin(), entries_.end()), entries_.end());
+    }
+
+    std::vector<std::string> complete(std::string_view prefix) const
+    {
+        std::vector<std::string> words;
+        auto key = to_lower(prefix);
+        for (auto it = lower_bound(key); it != entries_.end() && it->key.starts_with(key); ++it)
+        {
+            words.push_back(it->word);
+        }
+        return words;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::string word;
+
+        auto operator<=>(const Entry &) const = default;
+    };
+
+    std::vector<Entry>::const_iterator lower_bound(const std::string &key) const
+    {
+        return std::lower_bound(entries_.begin(), entries_.end(), key, [](const Entry &entry, const std::string &value)
+                                { return entry.key < value; });
+    }
+
+    std::vector<Entry> entries_;
+};
+
+/// Candidates for the word that ends at the cursor
+using Completer = std::function<std::vector<std::string>(const std::vector<std::string> &previous_words, std::string_view word)>;
+
+/**
+ * Line input with history. On a Linux terminal the line is edited in raw
+ * mode (cursor keys, Home/End, Ctrl-A/E/U/W, Tab completion); otherwise
+ * lines are read with std::getline.
+ */
+class LineEditor {
+public:
+    LineEditor()
+    {
+#ifdef __linux__
+        interactive_ = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+#elif defined(_WIN32)
+        interactive_ = _isatty(_fileno(stdin)) != 0;
+#endif
+        if (const char *home = std::getenv("HOME"))
+        {
+            history_path_ = std::format("{}/.caparoc_commander_history", home);
+            std::ifstream file(history_path_);
+            for (std::string line; std::getline(file, line);)
+            {
+                if (!line.empty())
+                {
+                    history_.push_back(line);
+                }
+            }
+            if (history_.size() > MAX_HISTORY)
+            {
+                history_.erase(history_.begin(), history_.end() - MAX_HISTORY);
+            }
+        }
+    }
+
+    bool interactive() const { return interactive_; }
+
+    const std::vector<std::string> &history() const { return history_; }
+
+    void add_history(const std::string &line)
+    {
+        if (line.empty() || (!history_.empty() && history_.back() == line))
+        {
+            return;
+        }
+        history_.push_back(line);
+        if (!history_path_.empty())
+        {
+            std::ofstream(history_path_, std::ios::app) << line << '\n';
+        }
+    }
+
+    /// std::nullopt at end of input
+    std::optional<std::string> read_line(std::string_view prompt, const Completer &completer)
+    {
+#ifdef __linux__
+        if (interactive_)
+        {
+            return edit_line(prompt, completer);
+        }
+#endif
+        (void)completer;
+        if (interactive_)
+        {
+            std::cout << prompt << std::flush;
+        }
+        std::string line;
+        if (!std::getline(std::cin, line))
+        {
+            return std::nullopt;
+        }
+        return line;
+    }
+
+    /// Waits up to @p timeout; true if a key was pressed (or a stop was requested) meanwhile
+    bool wait_for_key(std::chrono::milliseconds timeout)
+    {
+#ifdef __linux__
+        if (interactive_)
+        {
+            RawMode raw;
+            pollfd input{STDIN_FILENO, POLLIN, 0};
+            if (::poll(&input, 1, static_cast<int>(timeout.count())) > 0)
+            {
+                char key = 0;
+                return ::read(STDIN_FILENO, &key, 1) == 1;
+            }
+            return stop_requested();
+        }
+#endif
+        auto end = Clock::now() + timeout;
+        while (Clock::now() < end && !stop_requested())
+        {
+            std::this_thread::sleep_for(std::min<Clock::duration>(end - Clock::now(), std::chrono::milliseconds(50)));
+        }
+        return stop_requested();
+    }
+
+private:
+#ifdef __linux__
+    struct RawMode {
+        termios saved{};
+        bool active = false;
+
+        RawMode()
+        {
+            if (tcgetattr(STDIN_FILENO, &saved) == 0)
+            {
+                auto raw = saved;
+                raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ISIG | IEXTEN);
+                raw.c_iflag &= ~static_cast<tcflag_t>(IXON | ICRNL);
+                raw.c_cc[VMIN] = 1;
+                raw.c_cc[VTIME] = 0;
+                active = tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == 0;
+            }
+        }
+
+        ~RawMode()
+        {
+            if (active)
+            {
+                tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+            }
+        }
+
+        RawMode(const RawMode &) = delete;
+        RawMode &operator=(const RawMode &) = delete;
+    };
+
+    static void emit(std::string_view text)
+    {
+        std::fwrite(text.data(), 1, text.size(), stdout);
+        std::fflush(stdout);
+    }
+
+    static int read_key()
+    {
+        unsigned char c = 0;
+        return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+    }
+
+    std::optional<std::string> edit_line(std::string_view prompt, const Completer &completer)
+    {
+        RawMode raw;
+        std::string line;
+        std::size_t cursor = 0;
+        auto recall = history_.size();  // history_.size() = the line being typed
+        std::string typed;
+
+        auto redraw = [&]
+        {
+            auto text = std::format("\r{}{}\x1b[K", prompt, line);
+            if (cursor < line.size())
+            {
+                text += std::format("\x1b[{}D", line.size() - cursor);
+            }
+            emit(text);
+        };
+        auto show = [&](std::string text)
+        {
+            line = std::move(text);
+            cursor = line.size();
+            redraw();
+        };
+
+        emit(prompt);
+        for (;;)
+        {
+            int key = read_key();
+            switch (key)
+            {
+            case -1:
+            case 4:  // Ctrl-D
+                if (key == 4 && !line.empty())
+                {
+                    if (cursor < line.size())
+                    {
+                        line.erase(cursor, 1);
+                        redraw();
+                    }
+                    break;
+                }
+                emit("\n");
+                return std::nullopt;
+            case '\r':
+            case '\n':
+                emit("\n");
+                return line;
+            case 3:  // Ctrl-C abandons the line
+                emit("^C\n");
+                line.clear();
+                cursor = 0;
+                recall = history_.size();
+                emit(prompt);
+                break;
+            case 127:
+            case 8:
+                if (cursor > 0)
+                {
+                    line.erase(--cursor, 1);
+                    redraw();
+                }
+                break;
+            case 1:  // Ctrl-A
+                cursor = 0;
+                redraw();
+                break;
+            case 5:  // Ctrl-E
+                cursor = line.size();
+                redraw();
+                break;
+            case 21:  // Ctrl-U
+                line.erase(0, cursor);
+                cursor = 0;
+                redraw();
+                break;
+            case 23:  // Ctrl-W deletes the word before the cursor
+            {
+                auto start = cursor;
+                while (start > 0 && line[start - 1] == ' ')
+                {
+                    --start;
+                }
+                while (start > 0 && line[start - 1] != ' ')
+                {
+                    --start;
+                }
+                line.erase(start, cursor - start);
+                cursor = start;
+                redraw();
+                break;
+            }
+            case '\t':
+                complete(line, cursor, completer);
+                redraw();
+                break;
+            case 27:  // escape sequences of the cursor keys
+            {
+                int first = read_key();
+                int second = read_key();
+                if (first != '[' && first != 'O')
+                {
+                    break;
+                }
+                if (second >= '0' && second <= '9')
+                {
+                    if (read_key() == '~' && second == '3' && cursor < line.size())
+                    {
+                        line.erase(cursor, 1);
+                        redraw();
+                    }
+                    break;
+                }
+                if (second == 'A' && recall > 0)
+                {
+                    if (recall == history_.size())
+                    {
+                        typed = line;
+                    }
+                    show(history_[--recall]);
+                }
+                else if (second == 'B' && recall < history_.size())
+                {
+                    ++recall;
+                    show(recall == history_.size() ? typed : history_[recall]);
+                }
+                else if (second == 'C' && cursor < line.size())
+                {
+                    ++cursor;
+                    redraw();
+                }
+                else if (second == 'D' && cursor > 0)
+                {
+                    --cursor;
+                    redraw();
+                }
+                else if (second == 'H')
+                {
+                    cursor = 0;
+                    redraw();
+                }
+                else if (second == 'F')
+                {
+                    cursor = line.size();
+                    redraw();
+                }
+                break;
+            }
+            default:
+                if (key >= 32)
+                {
+                    line.insert(cursor++, 1, static_cast<char>(key));
+                    redraw();
+                }
+                break;
+            }
+        }
+    }
+
+    // Replaces the word before the cursor by the common prefix of its
+    // candidates; lists them if that does not extend the word.
+    static void complete(std::string &line, std::size_t &cursor, const Completer &completer)
+    {
+        auto before = std::string_view(line).substr(0, cursor);
+        auto quotes = std::count(before.begin(), before.end(), '"');
+        auto start = quotes % 2 ? before.rfind('"') : before.find_last_of(' ');
+        start = start == std::string_view::npos ? 0 : start + 1;
+        auto word = before.substr(start);
+
+        auto candidates = completer(split_words(before.substr(0, start)), word);
+        if (candidates.empty())
+        {
+            return;
+        }
+
+        auto common = candidates.front();
+        for (const auto &candidate : candidates)
+        {
+            auto mismatch = std::mismatch(common.begin(), common.end(), candidate.begin(), candidate.end());
+            common.erase(mismatch.first, common.end());
+        }
+
+        if (candidates.size() == 1)
+        {
+            bool spaces = common.find(' ') != std::string::npos;
+            if (spaces && quotes % 2 == 0)
+            {
+                common = '"' + common;
+            }
+            common += spaces ? "\" " : " ";
+        }
+        else if (common.size() <= word.size())
+        {
+            std::string list = "\n";
+            for (const auto &candidate : candidates)
+            {
+                list += candidate + "  ";
+            }
+            emit(list + "\n");
+            return;
+        }
+
+        line.replace(start, cursor - start, common);
+        cursor = start + common.size();
+    }
+#endif
+
+    bool interactive_ = false;
+    std::string history_path_;
+    std::vector<std::string> history_;
+};
+
+class Shell {
+public:
+    Shell(const CommandLineOptions &options, const std::function<bool(const CommandLineOptions &)> &execute)
+        : session_(options), execute_(execute)
+    {
+        for (auto name : BUILTINS)
+        {
+            commands_.add(std::string(name));
+        }
+        for (auto &name : command_line_option_names())
+        {
+            if (name != "help" && name != "shell")
+            {
+                options_.add("--" + name);
+                commands_.add(std::move(name));
+            }
+        }
+
+        auto add_register = [&](std::string_view name, uint16_t address)
+        {
+            registers_.add(std::string(name));
+            register_addresses_.emplace(to_lower(name), address);
+        };
+        if (!register_table().empty())
+        {
+            for (const auto &entry : register_table())
+            {
+                add_register(entry.name, entry.address);
+            }
+        }
+        else
+        {
+            for (const auto &info : caparoc::find_registers(""))
+            {
+                add_register(info.name, info.address);
+            }
+        }
+
+        commands_.build();
+        options_.build();
+        registers_.build();
+    }
+
+    LineEditor &editor() { return editor_; }
+
+    std::vector<std::string> complete(const std::vector<std::string> &previous, std::string_view word) const
+    {
+        if (word.starts_with("-"))
+        {
+            return options_.complete(word);
+        }
+        // The command follows "watch [SECONDS]" or "repeat N".
+        std::size_t command_at = 0;
+        double number = 0;
+        if (!previous.empty() && (previous[0] == "watch" || previous[0] == "repeat"))
+        {
+            command_at = previous.size() > 1 && parse_positive(previous[1], number) ? 2 : 1;
+        }
+        return previous.size() == command_at ? commands_.complete(word) : registers_.complete(word);
+    }
+
+    /// false once the shell should end
+    bool handle(const std::vector<std::string> &words)
+    {
+        const auto &command = words.front();
+        if (command == "exit" || command == "quit")
+        {
+            return false;
+        }
+        if (command == "help")
+        {
+            print_help(words.size() > 1 && words[1] == "options");
+        }
+        else if (command == "history")
+        {
+            for (std::size_t i = 0; i < editor_.history().size(); ++i)
+            {
+                portable::println("{:5}  {}", i + 1, editor_.history()[i]);
+            }
+        }
+        else if (command == "watch")
+        {
+            watch(words);
+        }
+        else if (command == "repeat")
+        {
+            repeat(words);
+        }
+        else if (auto line = parse(words))
+        {
+            run_timed(*line);
+        }
+        else
+        {
+            last_ok_ = false;
+        }
+        clear_stop_request();
+        return true;
+    }
+
+    bool last_ok() const { return last_ok_; }
+
+private:
+    static void print_help(bool options)
+    {
+        if (!options)
+        {
+            portable::println("{}", SHELL_HELP);
+            return;
+        }
+        try
+        {
+            parse_shell_command({"--help"});
+        }
+        catch (const std::invalid_argument &e)
+        {
+            portable::println("{}", e.what());
+        }
+    }
+
+    // The options of one command, with the session's connection settings
+    std::optional<CommandLineOptions> parse(std::vector<std::string> words) const
+    {
+        if (!words.front().starts_with("-"))
+        {
+            words.front().insert(0, "--");
+        }
+        for (auto word = words.begin() + 1; word != words.end(); ++word)
+        {
+            auto address = register_addresses_.find(to_lower(*word));
+            if (!word->starts_with("-") && address != register_addresses_.end())
+            {
+                *word = std::format("0x{:04X}", address->second);
+            }
+        }
+
+        CommandLineOptions line;
+        try
+        {
+            line = parse_shell_command(words);
+        }
+        catch (const std::invalid_argument &e)
+        {
+            portable::println("{}", e.what());
+            return std::nullopt;
+        }
+        if (line.actions.empty())
+        {
+            portable::println("Nothing to do; type help for the available commands");
+            return std::nullopt;
+        }
+
+        line.ip_addresses = session_.ip_addresses;
+        line.port = session_.port;
+        line.timeout_seconds = session_.timeout_seconds;
+        line.debug = line.debug || session_.debug;
+        return line;
+    }
+
+    // Runs one command and prints its duration; that is the device round
+    // trip(s) plus formatting, the connection stays open between commands.
+    double run_timed(const CommandLineOptions &line)
+    {
+        auto start = Clock::now();
+        last_ok_ = execute_(line);
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+        portable::println("[{:.1f} ms{}]", elapsed.count(), last_ok_ ? "" : ", failed");
+        return elapsed.count();
+    }
+
+    void watch(const std::vector<std::string> &words)
+    {
+        double interval = DEFAULT_WATCH_INTERVAL_S;
+        std::size_t first = words.size() > 1 && parse_positive(words[1], interval) ? 2 : 1;
+        if (first >= words.size())
+        {
+            portable::println("Usage: watch [SECONDS] COMMAND");
+            last_ok_ = false;
+            return;
+        }
+        auto line = parse({words.begin() + static_cast<std::ptrdiff_t>(first), words.end()});
+        if (!line)
+        {
+            last_ok_ = false;
+            return;
+        }
+
+        std::string text;
+        for (auto word = words.begin() + static_cast<std::ptrdiff_t>(first); word != words.end(); ++word)
+        {
+            text += (text.empty() ? "" : " ") + *word;
+        }
+        auto period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(interval));
+        do
+        {
+            portable::println("{}Every {} s: {} (press any key to stop)", editor_.interactive() ? "\x1b[H\x1b[2J" : "", interval, text);
+            run_timed(*line);
+        } while (!stop_requested() && !editor_.wait_for_key(period));
+    }
+
+    void repeat(const std::vector<std::string> &words)
+    {
+        std::size_t count = 0;
+        auto [end, ec] = words.size() > 2 ? std::from_chars(words[1].data(), words[1].data() + words[1].size(), count)
+                                          : std::from_chars_result{nullptr, std::errc::invalid_argument};
+        if (ec != std::errc{} || end != words[1].data() + words[1].size() || count == 0)
+        {
+            portable::println("Usage: repeat N COMMAND");
+            last_ok_ = false;
+            return;
+        }
+        auto line = parse({words.begin() + 2, words.end()});
+        if (!line)
+        {
+            last_ok_ = false;
+            return;
+        }
+
+        std::vector<double> times;
+        std::size_t failures = 0;
+        while (times.size() < count && !stop_requested())
+        {
+            times.push_back(run_timed(*line));
+            failures += last_ok_ ? 0 : 1;
+        }
+        if (times.empty())
+        {
+            portable::println("Stopped before the first run");
+            last_ok_ = false;
+            return;
+        }
+        auto [min, max] = std::minmax_element(times.begin(), times.end());
+        double total = 0;
+        for (auto time : times)
+        {
+            total += time;
+        }
+        portable::println("{} run(s), {} failed: min {:.1f} ms, avg {:.1f} ms, max {:.1f} ms",
+                          times.size(), failures, *min, total / static_cast<double>(times.size()), *max);
+        last_ok_ = failures == 0;
+    }
+
+    const CommandLineOptions &session_;
+    const std::function<bool(const CommandLineOptions &)> &execute_;
+    LineEditor editor_;
+    PrefixIndex commands_;   // built-ins and option names without "--"
+    PrefixIndex options_;    // option names with "--"
+    PrefixIndex registers_;  // names from the register map
+    std::unordered_map<std::string, uint16_t> register_addresses_;  // lower-case name -> address
+    bool last_ok_ = true;
+};
+
+} // namespace
+
+int run_shell(const CommandLineOptions &options, const std::string &endpoint,
+              const std::function<bool(const CommandLineOptions &)> &execute)
+{
+    Shell shell(options, execute);
+    auto &editor = shell.editor();
+    auto prompt = std::format("{}> ", endpoint);
+    Completer completer = [&shell](const std::vector<std::string> &previous, std::string_view word)
+    { return shell.complete(previous, word); };
+
+    // SIGINT stops watch/repeat and continuous commands instead of the shell.
+    install_stop_handlers();
+    if (editor.interactive())
+    {
+        portable::println("CAPAROC shell on {}; type help for commands, exit or Ctrl-D to leave", endpoint);
+    }
+
+    while (auto line = editor.read_line(prompt, completer))
+    {
+        auto words = split_words(*line);
+        if (words.empty())
+        {
+            continue;
+        }
+        editor.add_history(*line);
+        if (!shell.handle(words))
+        {
+            break;
+        }
+    }
+    return shell.last_ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace cli
@@ -0,0 +1,240 @@
+#include "caparoc_commander/shm_snapshot.hpp"
+
+#include <stdexcept>
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t SNAPSHOT_WORDS = sizeof(RackSnapshot) / sizeof(uint64_t);
+
+// Everything that is read concurrently with an update is accessed through
+// std::atomic_ref, which keeps the seqlock free of data races.
+struct Segment
+{
+    uint32_t magic;  // written last by the publisher
+    uint16_t layout_version;
+    uint16_t snapshot_size;
+    uint32_t publisher_pid;
+    uint32_t poll_interval_ms;
+    uint64_t sequence;
+    uint64_t words[SNAPSHOT_WORDS];
+};
+
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free);
+static_assert(std::atomic_ref<uint32_t>::is_always_lock_free);
+
+// A reader gives up after this many torn reads in a row. A snapshot update
+// copies a few hundred bytes, so this is only reached if the publisher hangs
+// in the middle of an update.
+constexpr int MAX_READ_ATTEMPTS = 10000;
+
+std::runtime_error shm_error(std::string_view what, const std::string &name)
+{
+    return std::runtime_error(std::format("{} shared memory '{}': {}", what, name, std::strerror(errno)));
+}
+
+} // namespace
+
+std::string normalize_shm_name(std::string_view name)
+{
+    return name.starts_with('/') ? std::string(name) : "/" + std::string(name);
+}
+
+SnapshotPublisher::SnapshotPublisher(std::string name, uint32_t poll_interval_ms)
+    : name_(normalize_shm_name(name))
+{
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        throw shm_error("Cannot create", name_);
+    }
+    if (ftruncate(fd, sizeof(Segment)) != 0)
+    {
+        auto error = shm_error("Cannot size", name_);
+        ::close(fd);
+        throw error;
+    }
+    void *mapping = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw shm_error("Cannot map", name_);
+    }
+
+    // Invalidate a segment left behind by a previous publisher before
+    // changing its header, then restart the sequence.
+    auto *segment = static_cast<Segment *>(mapping);
+    std::atomic_ref<uint32_t>(segment->magic).store(0, std::memory_order_release);
+    segment->layout_version = SNAPSHOT_LAYOUT_VERSION;
+    segment->snapshot_size = sizeof(RackSnapshot);
+    segment->publisher_pid = static_cast<uint32_t>(getpid());
+    segment->poll_interval_ms = poll_interval_ms;
+    std::atomic_ref<uint64_t>(segment->sequence).store(0, std::memory_order_relaxed);
+    std::atomic_ref<uint32_t>(segment->magic).store(SNAPSHOT_MAGIC, std::memory_order_release);
+    segment_ = mapping;
+}
+
+SnapshotPublisher::~SnapshotPublisher()
+{
+    if (segment_)
+    {
+        munmap(segment_, sizeof(Segment));
+        shm_unlink(name_.c_str());
+    }
+}
+
+void SnapshotPublisher::publish(const RackSnapshot &snapshot)
+{
+    auto *segment = static_cast<Segment *>(segment_);
+    uint64_t words[SNAPSHOT_WORDS];
+    std::memcpy(words, &snapshot, sizeof(words));
+
+    std::atomic_ref<uint64_t> sequence(segment->sequence);
+    auto begin = sequence.load(std::memory_order_relaxed) + 1;
+    sequence.store(begin, std::memory_order_relaxed);  // odd: update in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < SNAPSHOT_WORDS; ++i)
+    {
+        std::atomic_ref<uint64_t>(segment->words[i]).store(words[i], std::memory_order_relaxed);
+    }
+    sequence.store(begin + 1, std::memory_order_release);
+}
+
+SnapshotReader::SnapshotReader(std::string name)
+    : name_(normalize_shm_name(name))
+{
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        throw shm_error("Cannot open", name_);
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Segment))
+    {
+        ::close(fd);
+        throw std::runtime_error(std::format("Shared memory '{}' is not a snapshot segment", name_));
+    }
+    void *mapping = mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw shm_error("Cannot map", name_);
+    }
+
+    auto *segment = static_cast<Segment *>(mapping);
+    auto magic = std::atomic_ref<uint32_t>(segment->magic).load(std::memory_order_acquire);
+    if (magic != SNAPSHOT_MAGIC || segment->layout_version != SNAPSHOT_LAYOUT_VERSION ||
+        segment->snapshot_size != sizeof(RackSnapshot))
+    {
+        munmap(mapping, sizeof(Segment));
+        throw std::runtime_error(std::format("Shared memory '{}' has an unknown layout (magic 0x{:08X}, version {})",
+                                             name_, magic, segment->layout_version));
+    }
+    segment_ = mapping;
+}
+
+SnapshotReader::~SnapshotReader()
+{
+    munmap(const_cast<void *>(segment_), sizeof(Segment));
+}
+
+std::optional<SnapshotReading> SnapshotReader::read() const
+{
+    auto start = std::chrono::steady_clock::now();
+    // Loads do not write, so the read-only mapping is fine for atomic_ref.
+    auto *segment = static_cast<Segment *>(const_cast<void *>(segment_));
+    std::atomic_ref<uint64_t> sequence(segment->sequence);
+    uint64_t words[SNAPSHOT_WORDS];
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt)
+    {
+        auto before = sequence.load(std::memory_order_acquire);
+        if (before == 0)
+        {
+            return std::nullopt;
+        }
+        if (before & 1)
+        {
+            continue;
+        }
+        for (std::size_t i = 0; i < SNAPSHOT_WORDS; ++i)
+        {
+            words[i] = std::atomic_ref<uint64_t>(segment->words[i]).load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before)
+        {
+            SnapshotReading reading{};
+            std::memcpy(&reading.snapshot, words, sizeof(words));
+            reading.sequence = before;
+            reading.publisher_pid = segment->publisher_pid;
+            reading.poll_interval_ms = segment->poll_interval_ms;
+            reading.read_duration = std::chrono::steady_clock::now() - start;
+            return reading;
+        }
+    }
+    return std::nullopt;
+}
+
+bool is_publisher_alive(const SnapshotReading &reading)
+{
+    return kill(static_cast<pid_t>(reading.publisher_pid), 0) == 0 || errno == EPERM;
+}
+
+} // namespace cli
+
+#else
+
+namespace cli {
+
+std::string normalize_shm_name(std::string_view name)
+{
+    return name.starts_with('/') ? std::string(name) : "/" + std::string(name);
+}
+
+SnapshotPublisher::SnapshotPublisher(std::string name, uint32_t)
+    : name_(std::move(name))
+{
+    throw std::runtime_error("Shared-memory snapshots are only supported on Linux");
+}
+
+SnapshotPublisher::~SnapshotPublisher() = default;
+
+void SnapshotPublisher::publish(const RackSnapshot &)
+{
+}
+
+SnapshotReader::SnapshotReader(std::string name)
+    : name_(std::move(name))
+{
+    throw std::runtime_error("Shared-memory snapshots are only supported on Linux");
+}
+
+SnapshotReader::~SnapshotReader() = default;
+
+std::optional<SnapshotReading> SnapshotReader::read() const
+{
+    return std::nullopt;
+}
+
+bool is_publisher_alive(const SnapshotReading &)
+{
+    return false;
+}
+
+} // namespace cli
+
+#endif
@@ -0,0 +1,34 @@
+#include "caparoc_commander/stop_signal.hpp"
+
+#include <csignal>
+
+namespace cli {
+
+namespace {
+
+volatile std::sig_atomic_t stop_flag = 0;
+
+extern "C" void handle_stop_signal(int)
+{
+    stop_flag = 1;
+}
+
+} // namespace
+
+void install_stop_handlers()
+{
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
+}
+
+bool stop_requested()
+{
+    return stop_flag != 0;
+}
+
+void clear_stop_request()
+{
+    stop_flag = 0;
+}
+
+} // namespace cli
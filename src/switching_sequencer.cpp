@@ -0,0 +1,334 @@
+#include "caparoc_commander/switching_sequencer.hpp"
+#include "caparoc_commander/rack_snapshot.hpp"
+#include "caparoc_commander/register_descriptor.hpp"
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+namespace cli {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+constexpr int MAX_MODULES = static_cast<int>(RACK_MAX_MODULES);
+constexpr int MAX_CHANNELS_PER_MODULE = static_cast<int>(RACK_MAX_CHANNELS);
+
+int parse_number(std::string_view text, int min, int max, std::string_view what)
+{
+    int value = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size() || value < min || value > max)
+    {
+        throw std::invalid_argument(std::format("invalid {} '{}' (expected {}-{})", what, text, min, max));
+    }
+    return value;
+}
+
+int read_module_count(libmodbus_cpp::ModbusConnection &conn)
+{
+    auto count = read_register(conn, registers::NUM_CONNECTED_MODULES);
+    if (!count)
+    {
+        throw std::runtime_error("cannot read number of connected modules");
+    }
+    return std::min<int>(*count, MAX_MODULES);
+}
+
+int read_channel_count(libmodbus_cpp::ModbusConnection &conn, int module)
+{
+    auto name = caparoc::get_product_name_module(conn, static_cast<uint8_t>(module));
+    return name ? channels_from_product_name(*name) : MAX_CHANNELS_PER_MODULE;
+}
+
+void append_module(libmodbus_cpp::ModbusConnection &conn, int module, std::vector<ChannelRef> &channels)
+{
+    auto count = read_channel_count(conn, module);
+    for (int channel = 1; channel <= count; ++channel)
+    {
+        channels.push_back({static_cast<uint8_t>(module), static_cast<uint8_t>(channel)});
+    }
+}
+
+bool has_channel_fault(const caparoc::ChannelStatus &status)
+{
+    return status.overload || status.short_circuit || status.hardware_error || status.voltage_error;
+}
+
+bool has_supply_overcurrent(const caparoc::ChannelStatus &status)
+{
+    return status.module_current_too_high || status.system_current_too_high;
+}
+
+std::string_view outcome_to_string(SwitchOutcome outcome)
+{
+    switch (outcome)
+    {
+    case SwitchOutcome::CONFIRMED:
+        return "CONFIRMED";
+    case SwitchOutcome::NO_LOAD:
+        return "NO LOAD";
+    case SwitchOutcome::TRIPPED:
+        return "TRIPPED";
+    case SwitchOutcome::NOT_CONFIRMED:
+        return "NOT CONFIRMED";
+    case SwitchOutcome::WRITE_FAILED:
+        return "WRITE FAILED";
+    case SwitchOutcome::SKIPPED:
+        return "SKIPPED";
+    }
+    return "UNKNOWN";
+}
+
+double to_ms(microseconds value)
+{
+    return static_cast<double>(value.count()) / 1000.0;
+}
+
+// Verification state of a written channel.
+struct PendingChannel
+{
+    std::size_t index;
+    Clock::time_point issued;
+    std::optional<Clock::time_point> fault_free_since;
+    bool done = false;
+};
+
+} // namespace
+
+std::vector<ChannelRef> resolve_channel_selection(libmodbus_cpp::ModbusConnection &conn, std::string_view selection)
+{
+    std::vector<ChannelRef> channels;
+    if (selection == "all")
+    {
+        auto modules = read_module_count(conn);
+        for (int module = 1; module <= modules; ++module)
+        {
+            append_module(conn, module, channels);
+        }
+        return channels;
+    }
+
+    while (!selection.empty())
+    {
+        auto comma = selection.find(',');
+        auto item = selection.substr(0, comma);
+        selection = comma == std::string_view::npos ? std::string_view{} : selection.substr(comma + 1);
+
+        auto dot = item.find('.');
+        if (dot == std::string_view::npos)
+        {
+            throw std::invalid_argument(std::format("invalid channel '{}' (expected MODULE.CHANNEL)", item));
+        }
+        auto module = parse_number(item.substr(0, dot), 1, MAX_MODULES, "module");
+        auto channel = item.substr(dot + 1);
+        if (channel == "*")
+        {
+            append_module(conn, module, channels);
+        }
+        else
+        {
+            channels.push_back({static_cast<uint8_t>(module),
+                                static_cast<uint8_t>(parse_number(channel, 1, MAX_CHANNELS_PER_MODULE, "channel"))});
+        }
+    }
+
+    if (channels.empty())
+    {
+        throw std::invalid_argument("empty channel selection");
+    }
+    return channels;
+}
+
+SwitchingReport run_switching_plan(libmodbus_cpp::ModbusConnection &conn, const SwitchingPlan &plan,
+                                   std::optional<Clock::time_point> deadline)
+{
+    SwitchingReport report;
+    report.on = plan.on;
+    for (const auto &ref : plan.channels)
+    {
+        report.channels.push_back({ref});
+    }
+
+    const auto batch_size = std::max<std::size_t>(plan.max_simultaneous, 1);
+    const auto batch_count = (plan.channels.size() + batch_size - 1) / batch_size;
+    const auto start = Clock::now();
+    std::size_t next_batch = 0;
+    std::size_t issued_count = 0;
+    std::vector<PendingChannel> pending;
+
+    auto since_start = [&](Clock::time_point t)
+    { return std::chrono::duration_cast<microseconds>(t - start); };
+    auto batch_time = [&](std::size_t batch)
+    { return start + plan.stagger * static_cast<long>(batch); };
+
+    auto finish = [&](PendingChannel &p, SwitchOutcome outcome, Clock::time_point at)
+    {
+        auto &result = report.channels[p.index];
+        result.outcome = outcome;
+        result.confirm_latency = std::chrono::duration_cast<microseconds>(at - p.issued);
+        p.done = true;
+    };
+
+    while (true)
+    {
+        auto now = Clock::now();
+        if (deadline && now >= *deadline)
+        {
+            break;
+        }
+
+        if (next_batch < batch_count && now >= batch_time(next_batch))
+        {
+            auto first = next_batch * batch_size;
+            auto last = std::min(first + batch_size, plan.channels.size());
+            for (auto i = first; i < last; ++i)
+            {
+                auto &result = report.channels[i];
+                auto issued = Clock::now();
+                bool ok = caparoc::control_channel(conn, result.ref.module, result.ref.channel, plan.on);
+                result.issued_at = since_start(issued);
+                result.write_latency = std::chrono::duration_cast<microseconds>(Clock::now() - issued);
+                if (ok)
+                {
+                    pending.push_back({i, issued, std::nullopt});
+                }
+                else
+                {
+                    result.outcome = SwitchOutcome::WRITE_FAILED;
+                }
+            }
+            issued_count = last;
+            ++next_batch;
+            continue;
+        }
+
+        if (pending.empty() && next_batch >= batch_count)
+        {
+            break;
+        }
+
+        // One round: the status of each unconfirmed channel, then its load
+        // current unless it tripped, each a separate blocking read.
+        for (auto &p : pending)
+        {
+            if (p.done)
+            {
+                continue;
+            }
+            auto &result = report.channels[p.index];
+            auto status = caparoc::get_channel_status(conn, result.ref.module, result.ref.channel);
+            ++report.status_reads;
+            auto read_at = Clock::now();
+            if (!status)
+            {
+                continue;
+            }
+            if (has_supply_overcurrent(*status) && next_batch < batch_count)
+            {
+                report.aborted_on_overcurrent = true;
+                next_batch = batch_count;
+            }
+            if (has_channel_fault(*status))
+            {
+                finish(p, SwitchOutcome::TRIPPED, read_at);
+                continue;
+            }
+
+            result.load_current_ma = caparoc::get_load_current(conn, result.ref.module, result.ref.channel);
+            if (!result.load_current_ma)
+            {
+                continue;
+            }
+            if (plan.on ? *result.load_current_ma > 0 : *result.load_current_ma == 0)
+            {
+                finish(p, SwitchOutcome::CONFIRMED, read_at);
+            }
+            else if (plan.on && !p.fault_free_since)
+            {
+                p.fault_free_since = read_at;
+            }
+        }
+
+        now = Clock::now();
+        for (auto &p : pending)
+        {
+            if (!p.done && now - p.issued >= plan.verify_timeout)
+            {
+                if (p.fault_free_since)
+                {
+                    finish(p, SwitchOutcome::NO_LOAD, *p.fault_free_since);
+                }
+                else
+                {
+                    report.channels[p.index].outcome = SwitchOutcome::NOT_CONFIRMED;
+                    p.done = true;
+                }
+            }
+        }
+        std::erase_if(pending, [](const PendingChannel &p)
+                      { return p.done; });
+
+        auto wake = now + plan.poll_interval;
+        if (next_batch < batch_count)
+        {
+            wake = std::min(wake, batch_time(next_batch));
+        }
+        if (deadline)
+        {
+            wake = std::min(wake, *deadline);
+        }
+        std::this_thread::sleep_until(wake);
+    }
+
+    // Channels never written, because of overcurrent or the deadline.
+    for (auto i = issued_count; i < report.channels.size(); ++i)
+    {
+        report.channels[i].outcome = SwitchOutcome::SKIPPED;
+    }
+    report.elapsed = since_start(Clock::now());
+    return report;
+}
+
+std::string format_switching_report(const SwitchingReport &report)
+{
+    std::string out = std::format("  {:>6} {:>7} {:>11} {:>10} {:>12} {:>9}  {}\n",
+                                  "Module", "Channel", "Issued [ms]", "Write [ms]", "Confirm [ms]", "Load [mA]", "Result");
+
+    std::vector<microseconds> latencies;
+    std::size_t confirmed = 0;
+    for (const auto &result : report.channels)
+    {
+        auto confirm = result.confirm_latency ? std::format("{:.1f}", to_ms(*result.confirm_latency)) : std::string("-");
+        auto load = result.load_current_ma ? std::to_string(*result.load_current_ma) : std::string("-");
+        out += std::format("  {:>6} {:>7} {:>11.1f} {:>10.1f} {:>12} {:>9}  {}\n",
+                           result.ref.module, result.ref.channel, to_ms(result.issued_at), to_ms(result.write_latency),
+                           confirm, load, outcome_to_string(result.outcome));
+        if (result.outcome == SwitchOutcome::CONFIRMED)
+        {
+            ++confirmed;
+            latencies.push_back(*result.confirm_latency);
+        }
+    }
+
+    out += std::format("{} of {} channel(s) confirmed {} in {:.1f} ms, {} status reads",
+                       confirmed, report.channels.size(), report.on ? "ON" : "OFF", to_ms(report.elapsed), report.status_reads);
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        out += std::format("\nSwitch-to-confirm latency [ms]: min {:.1f}, median {:.1f}, max {:.1f}",
+                           to_ms(latencies.front()), to_ms(latencies[latencies.size() / 2]), to_ms(latencies.back()));
+    }
+    if (report.aborted_on_overcurrent)
+    {
+        out += "\nStopped early: module or system current too high";
+    }
+    return out;
+}
+
+} // namespace cli
@@ -0,0 +1,368 @@
+#include "caparoc_commander/sync_sampler.hpp"
+
+#ifdef __linux__
+#include "caparoc_commander/async_modbus_client.hpp"
+#include "caparoc_commander/event_loop.hpp"
+#include "caparoc_commander/load_statistics.hpp"
+#include "caparoc_commander/modbus_frame.hpp"
+#include "caparoc_commander/realtime.hpp"
+#include "caparoc_commander/task.hpp"
+#endif
+
+#include <algorithm>
+#include <format>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace cli {
+
+namespace {
+
+std::string format_utc(uint64_t timestamp_ns)
+{
+    using namespace std::chrono;
+    sys_time<nanoseconds> time{nanoseconds{timestamp_ns}};
+    auto day = floor<days>(time);
+    year_month_day date{day};
+    hh_mm_ss clock{duration_cast<milliseconds>(time - day)};
+    return std::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}", static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                       static_cast<unsigned>(date.day()), clock.hours().count(), clock.minutes().count(), clock.seconds().count(),
+                       clock.subseconds().count());
+}
+
+std::size_t column_width(const SyncSettings &settings, const SyncTarget &target)
+{
+    return std::max<std::size_t>(target.label.size(), settings.count * 6u - 1u);
+}
+
+std::string format_values(const SyncReading &reading)
+{
+    if (reading.error)
+    {
+        return std::string(to_string(reading.error->code));
+    }
+    std::string text;
+    for (auto value : reading.values)
+    {
+        text += text.empty() ? std::format("{}", value) : std::format(" {}", value);
+    }
+    return text;
+}
+
+std::string json_escape(std::string_view text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+std::string format_sync_header(const SyncSettings &settings)
+{
+    auto line = std::format("{:<23}", "Time (UTC)");
+    for (const auto &target : settings.targets)
+    {
+        line += std::format("  {:>{}}", target.label, column_width(settings, target));
+    }
+    return line + std::format("  {:>9}", "Skew [ms]");
+}
+
+std::string format_sync_row(const SyncSettings &settings, const SyncRow &row)
+{
+    auto line = format_utc(row.time_ns);
+    for (std::size_t i = 0; i < row.readings.size() && i < settings.targets.size(); ++i)
+    {
+        line += std::format("  {:>{}}", format_values(row.readings[i]), column_width(settings, settings.targets[i]));
+    }
+    if (!row.skew_us)
+    {
+        return line + std::format("  {:>9}", "-");
+    }
+    return line + std::format("  {:>9.2f}{}", *row.skew_us / 1000.0, row.skewed ? " !" : "");
+}
+
+std::string format_sync_row_json(const SyncSettings &settings, const SyncRow &row)
+{
+    auto json = std::format("{{\"tick\":{},\"time\":{},\"skew_us\":{},\"skewed\":{},\"devices\":[", row.tick, row.time_ns / 1000000,
+                            row.skew_us ? std::to_string(*row.skew_us) : "null", row.skewed);
+    for (std::size_t i = 0; i < row.readings.size() && i < settings.targets.size(); ++i)
+    {
+        const auto &reading = row.readings[i];
+        json += std::format("{}{{\"device\":\"{}\"", i == 0 ? "" : ",", json_escape(settings.targets[i].label));
+        if (reading.error)
+        {
+            json += std::format(",\"error\":\"{}\"}}", to_string(reading.error->code));
+            continue;
+        }
+        json += ",\"values\":[";
+        for (std::size_t v = 0; v < reading.values.size(); ++v)
+        {
+            json += std::format("{}{}", v == 0 ? "" : ",", reading.values[v]);
+        }
+        json += std::format("],\"sent_us\":{},\"received_us\":{},\"kernel\":{}}}", reading.sent_us, reading.received_us, reading.kernel_timestamps);
+    }
+    return json + "]}";
+}
+
+std::string format_sync_summary(const SyncSummary &summary)
+{
+    auto text = std::format("Rows: {} ({} complete), {} tick(s) missed\n", summary.rows, summary.complete_rows, summary.missed_ticks);
+    text += std::format("Skew: p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms, {} row(s) above the limit\n", summary.skew_p50_us / 1000.0,
+                        summary.skew_p99_us / 1000.0, summary.skew_max_us / 1000.0, summary.skewed_rows);
+    text += std::format("Kernel timestamps: {} of {} read(s)", summary.kernel_stamped, summary.readings);
+    return text;
+}
+
+#ifdef __linux__
+
+namespace {
+
+using Clock = EventLoop::Clock;
+using TimePoint = EventLoop::TimePoint;
+
+constexpr auto PRECISE_WAIT = std::chrono::milliseconds(2);  // before a send, waited out with a thread sleep instead of the loop timer
+constexpr auto FIRST_TICK_MARGIN = std::chrono::milliseconds(10);
+constexpr double LEAD_GAIN = 1.0 / 8.0;
+
+struct Device {
+    const SyncTarget &target;
+    std::unique_ptr<AsyncModbusClient> client;
+    double lead_us = 0.0;  // smoothed half round-trip time
+    bool measured = false;
+};
+
+struct Run {
+    QuantileSketch skews{0.01, 1.0, 60e6};  // microseconds
+    SyncSummary summary;
+};
+
+int64_t offset_us(uint64_t timestamp_ns, uint64_t tick_ns)
+{
+    return (static_cast<int64_t>(timestamp_ns) - static_cast<int64_t>(tick_ns)) / 1000;
+}
+
+void update_lead(Device &device, uint64_t sent_ns, uint64_t received_ns)
+{
+    auto half_rtt_us = received_ns > sent_ns ? static_cast<double>(received_ns - sent_ns) / 2000.0 : 0.0;
+    device.lead_us = device.measured ? device.lead_us + LEAD_GAIN * (half_rtt_us - device.lead_us) : half_rtt_us;
+    device.measured = true;
+}
+
+// A device that cannot be reached shows up as NOT_CONNECTED in its reads.
+// Otherwise one probe read seeds the latency estimate, so that the first
+// row is already compensated.
+Task<void> connect_device(const SyncSettings &settings, Device &device, TimePoint deadline)
+{
+    if (!co_await device.client->connect(deadline))
+    {
+        co_return;
+    }
+    PacketTimes times;
+    if (co_await device.client->transact(encode_read_holding_registers(0, device.target.unit_id, settings.address, settings.count), deadline, &times))
+    {
+        update_lead(device, times.sent_ns, times.received_ns);
+    }
+}
+
+// Spawned in send order; the precise sleep holds up the loop, but the
+// devices behind this one are due even later.
+Task<void> read_device(const SyncSettings &settings, Device &device, TimePoint send_at, TimePoint deadline, uint64_t tick_ns, SyncReading &reading)
+{
+    std::this_thread::sleep_until(send_at - settings.spin);
+    if (settings.spin.count() > 0)
+    {
+        spin_until(send_at);
+    }
+    PacketTimes times;
+    auto response = co_await device.client->transact(encode_read_holding_registers(0, device.target.unit_id, settings.address, settings.count), deadline, &times);
+    if (!response)
+    {
+        reading.error = response.error();
+        co_return;
+    }
+    auto values = decode_read_registers_response(*response);
+    if (!values || values->size() != settings.count)
+    {
+        reading.error = device_error_from_response(*response);
+        co_return;
+    }
+    reading.values = std::move(*values);
+    reading.sent_us = offset_us(times.sent_ns, tick_ns);
+    reading.received_us = offset_us(times.received_ns, tick_ns);
+    reading.kernel_timestamps = times.kernel_sent && times.kernel_received;
+    update_lead(device, times.sent_ns, times.received_ns);
+}
+
+void finish_row(const SyncSettings &settings, SyncRow &row, Run &run)
+{
+    std::optional<int64_t> earliest;
+    std::optional<int64_t> latest;
+    std::size_t answered = 0;
+    for (const auto &reading : row.readings)
+    {
+        ++run.summary.readings;
+        if (reading.error)
+        {
+            continue;
+        }
+        ++answered;
+        run.summary.kernel_stamped += reading.kernel_timestamps ? 1 : 0;
+        auto midpoint = (reading.sent_us + reading.received_us) / 2;
+        earliest = std::min(earliest.value_or(midpoint), midpoint);
+        latest = std::max(latest.value_or(midpoint), midpoint);
+    }
+    if (answered >= 2)
+    {
+        row.skew_us = *latest - *earliest;
+        row.skewed = *row.skew_us > settings.max_skew.count();
+        run.skews.add(std::max(1.0, static_cast<double>(*row.skew_us)));
+        run.summary.skew_max_us = std::max(run.summary.skew_max_us, static_cast<double>(*row.skew_us));
+    }
+    ++run.summary.rows;
+    run.summary.complete_rows += answered == row.readings.size() ? 1 : 0;
+    run.summary.skewed_rows += row.skewed ? 1 : 0;
+}
+
+Task<void> run_rows(EventLoop &loop, const SyncSettings &settings, std::vector<Device> &devices, const std::function<void(const SyncRow &)> &on_row,
+                    Run &run)
+{
+    std::vector<Task<void>> connects;
+    for (auto &device : devices)
+    {
+        connects.push_back(connect_device(settings, device, Clock::now() + settings.timeout));
+    }
+    co_await loop.when_all(std::move(connects));
+
+    // Anchor the monotonic grid so that ticks fall on multiples of the
+    // interval in UTC, which lines up rows of separate runs.
+    auto interval_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(settings.interval).count());
+    auto anchor = Clock::now();
+    auto anchor_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    auto margin_ns = static_cast<uint64_t>(std::chrono::nanoseconds(FIRST_TICK_MARGIN).count());
+    auto first_tick_ns = (anchor_ns + margin_ns + interval_ns - 1) / interval_ns * interval_ns;
+
+    auto max_lead_us = std::chrono::duration<double, std::micro>(settings.interval).count() / 4.0;
+    std::vector<TimePoint> send_at(devices.size());
+    std::vector<std::size_t> order(devices.size());
+
+    for (uint64_t tick = 0; settings.rows == 0 || run.summary.rows < settings.rows; ++tick)
+    {
+        if (loop.deadline_exceeded() || (settings.stop_requested && settings.stop_requested()))
+        {
+            break;
+        }
+
+        auto tick_ns = first_tick_ns + tick * interval_ns;
+        auto tick_at = anchor + std::chrono::nanoseconds(tick_ns - anchor_ns);
+        for (std::size_t i = 0; i < devices.size(); ++i)
+        {
+            auto lead = std::chrono::duration<double, std::micro>(std::min(devices[i].lead_us, max_lead_us));
+            send_at[i] = tick_at - std::chrono::duration_cast<Clock::duration>(lead);
+        }
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        std::ranges::sort(order, [&](std::size_t a, std::size_t b) { return send_at[a] < send_at[b]; });
+        auto earliest = send_at[order.front()];
+        if (Clock::now() >= earliest)
+        {
+            ++run.summary.missed_ticks;
+            continue;
+        }
+
+        std::vector<Task<void>> reconnects;
+        for (auto &device : devices)
+        {
+            if (!device.client->is_connected())
+            {
+                reconnects.push_back(connect_device(settings, device, earliest - PRECISE_WAIT));
+            }
+        }
+        if (!reconnects.empty())
+        {
+            co_await loop.when_all(std::move(reconnects));
+        }
+
+        if (co_await loop.sleep_until(earliest - PRECISE_WAIT) == WaitStatus::CANCELLED)
+        {
+            break;
+        }
+        if (Clock::now() >= earliest)
+        {
+            ++run.summary.missed_ticks;
+            continue;
+        }
+
+        // Reads end in time for the earliest possible send of the next tick.
+        auto read_end = tick_at + settings.interval * 3 / 4 - PRECISE_WAIT;
+        SyncRow row;
+        row.tick = tick;
+        row.time_ns = tick_ns;
+        row.readings.resize(devices.size());
+        std::vector<Task<void>> reads;
+        for (auto i : order)
+        {
+            reads.push_back(read_device(settings, devices[i], send_at[i], std::min(send_at[i] + settings.timeout, read_end), tick_ns, row.readings[i]));
+        }
+        co_await loop.when_all(std::move(reads));
+        if (loop.deadline_exceeded())
+        {
+            break;  // reads cut short by the deadline do not make a row
+        }
+
+        finish_row(settings, row, run);
+        on_row(row);
+    }
+}
+
+} // namespace
+
+SyncSummary run_sync_sampling(const SyncSettings &settings, const std::function<void(const SyncRow &)> &on_row)
+{
+    if (settings.targets.empty())
+    {
+        throw std::invalid_argument("Synchronized sampling needs at least one device");
+    }
+    if (settings.interval.count() <= 0 || settings.count == 0)
+    {
+        throw std::invalid_argument("Synchronized sampling needs a positive interval and register count");
+    }
+
+    EventLoop loop(settings.io_backend);
+    loop.set_deadline(settings.deadline);
+
+    std::vector<Device> devices;
+    devices.reserve(settings.targets.size());
+    for (const auto &target : settings.targets)
+    {
+        devices.push_back({target, std::make_unique<AsyncModbusClient>(loop, target.host, target.port)});
+        devices.back().client->set_timestamping(true);
+        devices.back().client->set_busy_poll(settings.busy_poll);
+    }
+
+    Run run;
+    loop.run(run_rows(loop, settings, devices, on_row, run));
+    run.summary.skew_p50_us = run.skews.quantile(0.5);
+    run.summary.skew_p99_us = run.skews.quantile(0.99);
+    return run.summary;
+}
+
+#else
+
+SyncSummary run_sync_sampling(const SyncSettings &, const std::function<void(const SyncRow &)> &)
+{
+    throw std::runtime_error("Synchronized sampling is only supported on Linux");
+}
+
+#endif
+
+} // namespace cli
@@ -0,0 +1,416 @@
+#include "caparoc_commander/trip_capture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace cli {
+
+namespace {
+
+constexpr std::size_t FILE_HEADER_SIZE = 32;
+constexpr std::size_t TRACE_RECORD_SIZE = 12;
+constexpr std::size_t SAMPLE_RECORD_SIZE = 12;
+
+template <typename T>
+void put_le(uint8_t *out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t *in)
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+int32_t offset_us(uint64_t timestamp_ns, uint64_t trigger_ns)
+{
+    auto offset = (static_cast<int64_t>(timestamp_ns) - static_cast<int64_t>(trigger_ns)) / 1000;
+    return static_cast<int32_t>(std::clamp<int64_t>(offset, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()));
+}
+
+std::string format_utc(uint64_t timestamp_ns, bool compact)
+{
+    using namespace std::chrono;
+    sys_time<nanoseconds> time{nanoseconds{timestamp_ns}};
+    auto day = floor<days>(time);
+    year_month_day date{day};
+    hh_mm_ss clock{duration_cast<milliseconds>(time - day)};
+    if (compact)
+    {
+        return std::format("{:04}{:02}{:02}T{:02}{:02}{:02}.{:03}Z", static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                           static_cast<unsigned>(date.day()), clock.hours().count(), clock.minutes().count(), clock.seconds().count(),
+                           clock.subseconds().count());
+    }
+    return std::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}", static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                       static_cast<unsigned>(date.day()), clock.hours().count(), clock.minutes().count(), clock.seconds().count(),
+                       clock.subseconds().count());
+}
+
+std::string describe_event(const TripEvent &event)
+{
+    if (event.module == 0)
+    {
+        return std::format("rack, {}", describe_global_flags(event.cause));
+    }
+    return std::format("module {} channel {}, {}", event.module, event.channel, describe_channel_flags(event.cause | channel_flag::VALID));
+}
+
+} // namespace
+
+void TripRecorder::History::reset(std::size_t capacity)
+{
+    slots_.assign(capacity, TripSample{});
+    next_ = 0;
+    size_ = 0;
+}
+
+void TripRecorder::History::push(const TripSample &sample)
+{
+    if (slots_.empty())
+    {
+        return;
+    }
+    slots_[next_] = sample;
+    next_ = (next_ + 1) % slots_.size();
+    size_ = std::min(size_ + 1, slots_.size());
+}
+
+void TripRecorder::History::copy_to(std::vector<TripSample> &out) const
+{
+    auto first = (next_ + slots_.size() - size_) % std::max<std::size_t>(slots_.size(), 1);
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+        out.push_back(slots_[(first + i) % slots_.size()]);
+    }
+}
+
+TripRecorder::TripRecorder(std::size_t pre_samples, std::size_t post_samples)
+    : pre_samples_(pre_samples), post_samples_(post_samples)
+{
+    if (post_samples == 0)
+    {
+        throw std::invalid_argument("A trip capture needs at least one post-trigger sample");
+    }
+    for (auto &module : channels_)
+    {
+        for (auto &channel : module)
+        {
+            channel.history.reset(pre_samples);
+        }
+    }
+}
+
+void TripRecorder::open_window(const RackSnapshot &snapshot, uint8_t module, uint8_t channel, uint16_t cause)
+{
+    Window window;
+    window.event.trigger_ns = snapshot.timestamp_ns;
+    window.event.module = module;
+    window.event.channel = channel;
+    window.event.cause = cause;
+    window.remaining = post_samples_;
+
+    auto first = module == 0 ? std::size_t{0} : std::size_t{module} - 1;
+    auto last = module == 0 ? std::size_t{snapshot.module_count} : std::size_t{module};
+    for (auto m = first; m < last && m < RACK_MAX_MODULES; ++m)
+    {
+        for (std::size_t c = 0; c < snapshot.channel_count[m] && c < RACK_MAX_CHANNELS; ++c)
+        {
+            TripTrace trace{static_cast<uint8_t>(m + 1), static_cast<uint8_t>(c + 1), {}};
+            trace.samples.reserve(pre_samples_ + post_samples_);
+            channels_[m][c].history.copy_to(trace.samples);
+            window.event.traces.push_back(std::move(trace));
+        }
+    }
+    windows_[module] = std::move(window);
+    ++events_;
+}
+
+void TripRecorder::add(const RackSnapshot &snapshot)
+{
+    auto module_count = std::min<std::size_t>(snapshot.module_count, RACK_MAX_MODULES);
+
+    // Windows open before the samples of this snapshot are recorded, so the
+    // frozen history ends just before the transition.
+    if (snapshot.valid & rack_valid::GLOBAL_STATUS)
+    {
+        auto rising = global_seen_ ? static_cast<uint16_t>(snapshot.global_flags & ~global_flags_ & TRIP_GLOBAL_TRIGGERS) : uint16_t{0};
+        global_flags_ = snapshot.global_flags;
+        global_seen_ = true;
+        if (rising && !windows_[0])
+        {
+            open_window(snapshot, 0, 0, rising);
+        }
+    }
+    for (std::size_t m = 0; m < module_count; ++m)
+    {
+        uint16_t cause = 0;
+        uint8_t first_channel = 0;
+        for (std::size_t c = 0; c < snapshot.channel_count[m] && c < RACK_MAX_CHANNELS; ++c)
+        {
+            auto flags = snapshot.channels[m][c].flags;
+            if (!(flags & channel_flag::VALID))
+            {
+                continue;
+            }
+            auto &state = channels_[m][c];
+            auto rising = state.seen ? static_cast<uint16_t>(flags & ~state.flags & TRIP_CHANNEL_TRIGGERS) : uint16_t{0};
+            state.flags = flags;
+            state.seen = true;
+            if (rising && first_channel == 0)
+            {
+                first_channel = static_cast<uint8_t>(c + 1);
+            }
+            cause |= rising;
+        }
+        if (cause && !windows_[m + 1])
+        {
+            open_window(snapshot, static_cast<uint8_t>(m + 1), first_channel, cause);
+        }
+    }
+
+    auto voltage = (snapshot.valid & rack_valid::INPUT_VOLTAGE) ? snapshot.input_voltage_cv : uint16_t{0};
+    std::array<bool, RACK_MAX_MODULES + 1> sampled{};
+    for (std::size_t m = 0; m < module_count; ++m)
+    {
+        for (std::size_t c = 0; c < snapshot.channel_count[m] && c < RACK_MAX_CHANNELS; ++c)
+        {
+            const auto &channel = snapshot.channels[m][c];
+            if (!(channel.flags & channel_flag::VALID))
+            {
+                continue;
+            }
+            TripSample sample{snapshot.timestamp_ns, channel.load_current_ma, channel.flags, voltage};
+            channels_[m][c].history.push(sample);
+            for (std::size_t w : {std::size_t{0}, m + 1})
+            {
+                if (!windows_[w])
+                {
+                    continue;
+                }
+                auto &traces = windows_[w]->event.traces;
+                auto trace = std::find_if(traces.begin(), traces.end(), [&](const TripTrace &t)
+                                          { return t.module == m + 1 && t.channel == c + 1; });
+                if (trace != traces.end())
+                {
+                    trace->samples.push_back(sample);
+                    sampled[w] = true;
+                }
+            }
+        }
+    }
+
+    for (std::size_t w = 0; w < windows_.size(); ++w)
+    {
+        if (windows_[w] && sampled[w] && --windows_[w]->remaining == 0)
+        {
+            completed_.push_back(std::move(windows_[w]->event));
+            windows_[w].reset();
+        }
+    }
+}
+
+std::vector<uint8_t> TripRecorder::burst_modules() const
+{
+    std::vector<uint8_t> modules;
+    for (std::size_t w = 0; w < windows_.size(); ++w)
+    {
+        if (windows_[w])
+        {
+            modules.push_back(static_cast<uint8_t>(w));
+        }
+    }
+    return modules;
+}
+
+std::vector<TripEvent> TripRecorder::take_completed()
+{
+    std::sort(completed_.begin(), completed_.end(), [](const TripEvent &a, const TripEvent &b)
+              { return a.trigger_ns < b.trigger_ns; });
+    return std::exchange(completed_, {});
+}
+
+void TripRecorder::flush()
+{
+    for (auto &window : windows_)
+    {
+        if (window)
+        {
+            completed_.push_back(std::move(window->event));
+            window.reset();
+        }
+    }
+}
+
+std::string save_trip_event(const TripEvent &event, const std::string &directory)
+{
+    std::size_t sample_count = 0;
+    for (const auto &trace : event.traces)
+    {
+        sample_count += trace.samples.size();
+    }
+    std::vector<uint8_t> bytes(FILE_HEADER_SIZE + event.traces.size() * TRACE_RECORD_SIZE + sample_count * SAMPLE_RECORD_SIZE);
+
+    put_le(bytes.data(), TRIP_EVENT_MAGIC);
+    put_le(bytes.data() + 4, TRIP_EVENT_FORMAT_VERSION);
+    put_le(bytes.data() + 8, event.trigger_ns);
+    put_le(bytes.data() + 16, event.cause);
+    bytes[18] = event.module;
+    bytes[19] = event.channel;
+    put_le(bytes.data() + 20, static_cast<uint16_t>(event.traces.size()));
+    put_le(bytes.data() + 24, static_cast<uint32_t>(sample_count));
+
+    auto *trace_record = bytes.data() + FILE_HEADER_SIZE;
+    auto *sample_record = trace_record + event.traces.size() * TRACE_RECORD_SIZE;
+    uint32_t first_sample = 0;
+    for (const auto &trace : event.traces)
+    {
+        trace_record[0] = trace.module;
+        trace_record[1] = trace.channel;
+        put_le(trace_record + 4, first_sample);
+        put_le(trace_record + 8, static_cast<uint32_t>(trace.samples.size()));
+        trace_record += TRACE_RECORD_SIZE;
+        first_sample += static_cast<uint32_t>(trace.samples.size());
+
+        for (const auto &sample : trace.samples)
+        {
+            put_le(sample_record, static_cast<uint32_t>(offset_us(sample.timestamp_ns, event.trigger_ns)));
+            put_le(sample_record + 4, sample.load_current_ma);
+            put_le(sample_record + 6, sample.flags);
+            put_le(sample_record + 8, sample.input_voltage_cv);
+            sample_record += SAMPLE_RECORD_SIZE;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    auto stem = std::format("trip_{}_{}", format_utc(event.trigger_ns, true),
+                            event.module == 0 ? std::string("rack") : std::format("{}.{}", event.module, event.channel));
+    auto path = std::filesystem::path(directory) / (stem + ".cpte");
+    for (int n = 2; std::filesystem::exists(path, ec); ++n)
+    {
+        path = std::filesystem::path(directory) / std::format("{}-{}.cpte", stem, n);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size())) || !file.flush())
+    {
+        throw std::runtime_error(std::format("Cannot write trip event file '{}'", path.string()));
+    }
+    return path.string();
+}
+
+TripEvent load_trip_event(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error(std::format("Cannot open trip event file '{}'", path));
+    }
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (bytes.size() < FILE_HEADER_SIZE || get_le<uint32_t>(bytes.data()) != TRIP_EVENT_MAGIC)
+    {
+        throw std::runtime_error(std::format("'{}' is not a trip event file", path));
+    }
+    if (auto version = get_le<uint16_t>(bytes.data() + 4); version != TRIP_EVENT_FORMAT_VERSION)
+    {
+        throw std::runtime_error(std::format("Trip event file '{}' has unsupported version {}", path, version));
+    }
+
+    TripEvent event;
+    event.trigger_ns = get_le<uint64_t>(bytes.data() + 8);
+    event.cause = get_le<uint16_t>(bytes.data() + 16);
+    event.module = bytes[18];
+    event.channel = bytes[19];
+    auto trace_count = std::size_t{get_le<uint16_t>(bytes.data() + 20)};
+    auto sample_count = std::size_t{get_le<uint32_t>(bytes.data() + 24)};
+    auto samples_offset = FILE_HEADER_SIZE + trace_count * TRACE_RECORD_SIZE;
+    if (bytes.size() != samples_offset + sample_count * SAMPLE_RECORD_SIZE)
+    {
+        throw std::runtime_error(std::format("Trip event file '{}' is truncated", path));
+    }
+
+    for (std::size_t t = 0; t < trace_count; ++t)
+    {
+        const auto *record = bytes.data() + FILE_HEADER_SIZE + t * TRACE_RECORD_SIZE;
+        TripTrace trace{record[0], record[1], {}};
+        auto first = std::size_t{get_le<uint32_t>(record + 4)};
+        auto count = std::size_t{get_le<uint32_t>(record + 8)};
+        if (first > sample_count || count > sample_count - first)
+        {
+            throw std::runtime_error(std::format("Trip event file '{}' has a trace beyond its samples", path));
+        }
+        trace.samples.reserve(count);
+        for (std::size_t s = first; s < first + count; ++s)
+        {
+            const auto *sample = bytes.data() + samples_offset + s * SAMPLE_RECORD_SIZE;
+            auto offset = static_cast<int32_t>(get_le<uint32_t>(sample));
+            trace.samples.push_back({event.trigger_ns + static_cast<uint64_t>(int64_t{offset} * 1000), get_le<uint16_t>(sample + 4),
+                                     get_le<uint16_t>(sample + 6), get_le<uint16_t>(sample + 8)});
+        }
+        event.traces.push_back(std::move(trace));
+    }
+    return event;
+}
+
+std::string format_trip_event(const TripEvent &event)
+{
+    std::string out = std::format("Trip event at {} UTC: {}", format_utc(event.trigger_ns, false), describe_event(event));
+
+    const TripTrace *detail = event.traces.empty() ? nullptr : &event.traces.front();
+    out += std::format("\n  {:>6} {:>7} {:>7} {:>7} {:>10} {:>10} {:>10}  {}", "Module", "Channel", "Before", "After", "Span [ms]", "Min [mA]",
+                       "Max [mA]", "Last status");
+    for (const auto &trace : event.traces)
+    {
+        if (trace.module == event.module && trace.channel == event.channel)
+        {
+            detail = &trace;
+        }
+        if (trace.samples.empty())
+        {
+            out += std::format("\n  {:>6} {:>7} {:>7} {:>7} {:>10} {:>10} {:>10}  {}", trace.module, trace.channel, 0, 0, "-", "-", "-", "no data");
+            continue;
+        }
+        auto before = std::count_if(trace.samples.begin(), trace.samples.end(), [&](const TripSample &s)
+                                    { return s.timestamp_ns < event.trigger_ns; });
+        auto [min, max] = std::minmax_element(trace.samples.begin(), trace.samples.end(), [](const TripSample &a, const TripSample &b)
+                                              { return a.load_current_ma < b.load_current_ma; });
+        auto span_ms = static_cast<double>(trace.samples.back().timestamp_ns - trace.samples.front().timestamp_ns) / 1e6;
+        out += std::format("\n  {:>6} {:>7} {:>7} {:>7} {:>10.1f} {:>10} {:>10}  {}", trace.module, trace.channel, before,
+                           static_cast<std::ptrdiff_t>(trace.samples.size()) - before, span_ms, min->load_current_ma, max->load_current_ma,
+                           describe_channel_flags(trace.samples.back().flags));
+    }
+
+    if (detail)
+    {
+        out += std::format("\nModule {} channel {}:", detail->module, detail->channel);
+        out += std::format("\n  {:>12} {:>9} {:>9}  {}", "Offset [ms]", "Load [mA]", "Input [V]", "Status");
+        for (const auto &sample : detail->samples)
+        {
+            auto offset_ms = (static_cast<double>(sample.timestamp_ns) - static_cast<double>(event.trigger_ns)) / 1e6;
+            out += std::format("\n  {:>12.3f} {:>9} {:>9}  {}", offset_ms, sample.load_current_ma,
+                               sample.input_voltage_cv ? std::format("{:.2f}", sample.input_voltage_cv / 100.0) : std::string("-"),
+                               describe_channel_flags(sample.flags));
+        }
+    }
+    return out;
+}
+
+} // namespace cli
@@ -0,0 +1,114 @@
+// Build-time helper: dumps the libcaparoc register map into a C++ fragment
+// that src/register_table.cpp compiles into a constexpr array. This keeps the
+// construction of the map out of the startup path of caparoc_commander.
+// The text of list_all_registers() and get_register_info() is dumped as well,
+// so -l and -r print exactly what libcaparoc prints.
+//
+// Usage: generate_register_table OUTPUT_FILE
+
+#include "caparoc/caparoc.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct Entry {
+    uint16_t address;
+    std::string access;
+    std::string name;
+    std::string description;
+    std::string info;
+};
+
+// Octal escapes have a fixed maximum length, so unlike \x they cannot swallow
+// a following character.
+std::string to_literal(std::string_view text)
+{
+    std::string literal = "\"";
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            literal += '\\';
+            literal += static_cast<char>(c);
+        }
+        else if (c < 0x20 || c >= 0x7F)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\%03o", c);
+            literal += escaped;
+        }
+        else
+        {
+            literal += static_cast<char>(c);
+        }
+    }
+    return literal + "\"";
+}
+
+std::string to_access(caparoc::RegisterAccess access)
+{
+    switch (access)
+    {
+    case caparoc::RegisterAccess::READ_ONLY:
+        return "RegisterAccess::READ_ONLY";
+    case caparoc::RegisterAccess::WRITE_ONLY:
+        return "RegisterAccess::WRITE_ONLY";
+    case caparoc::RegisterAccess::READ_WRITE:
+        return "RegisterAccess::READ_WRITE";
+    }
+    return "RegisterAccess::READ_ONLY";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " OUTPUT_FILE\n";
+        return 1;
+    }
+
+    std::vector<Entry> entries;
+    for (const auto &reg : caparoc::find_registers(""))
+    {
+        entries.push_back({reg.address, to_access(reg.access), std::string(reg.name), std::string(reg.description),
+                           caparoc::get_register_info(reg.address)});
+    }
+    if (entries.empty())
+    {
+        std::cerr << "generate_register_table: libcaparoc returned an empty register map\n";
+        return 1;
+    }
+
+    // Registers sharing an address are all kept, in libcaparoc's order.
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                     { return a.address < b.address; });
+
+    std::ofstream out(argv[1], std::ios::trunc);
+    out << "// Generated by generate_register_table from libcaparoc. Do not edit.\n";
+    out << "constexpr RegisterEntry REGISTER_TABLE[] = {\n";
+    for (const auto &entry : entries)
+    {
+        char address[8];
+        std::snprintf(address, sizeof(address), "0x%04X", entry.address);
+        out << "    {" << address << ", " << entry.access << ", " << to_literal(entry.name) << ", " << to_literal(entry.description) << ",\n"
+            << "     " << to_literal(entry.info) << "},\n";
+    }
+    out << "};\n";
+    out << "constexpr std::string_view REGISTER_LIST = " << to_literal(caparoc::list_all_registers()) << ";\n";
+
+    if (!out)
+    {
+        std::cerr << "generate_register_table: cannot write " << argv[1] << "\n";
+        return 1;
+    }
+    return 0;
+}